@@ -73,3 +73,73 @@ APR_DECLARE(void*) apr_atomic_xchgptr(volatile void **mem, void *with)
 {
     return (void*)atomic_xchg((unsigned long *)mem,(unsigned long)with);
 }
+
+APR_DECLARE(apr_uint32_t) apr_atomic_read32_acquire(volatile apr_uint32_t *mem)
+{
+    return atomic_xchgadd((unsigned long *)mem, 0);
+}
+
+APR_DECLARE(void) apr_atomic_set32_release(volatile apr_uint32_t *mem, apr_uint32_t val)
+{
+    atomic_xchg((unsigned long *)mem,(unsigned long)val);
+}
+
+APR_DECLARE(apr_uint32_t) apr_atomic_add32_relaxed(volatile apr_uint32_t *mem, apr_uint32_t val)
+{
+    return atomic_xchgadd((unsigned long *)mem,(unsigned long)val);
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_read64(volatile apr_uint64_t *mem)
+{
+    return atomic64_xchgadd((unsigned long long *)mem, 0);
+}
+
+APR_DECLARE(void) apr_atomic_set64(volatile apr_uint64_t *mem, apr_uint64_t val)
+{
+    atomic64_xchg((unsigned long long *)mem,(unsigned long long)val);
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_add64(volatile apr_uint64_t *mem, apr_uint64_t val)
+{
+    return atomic64_xchgadd((unsigned long long *)mem,(unsigned long long)val);
+}
+
+APR_DECLARE(void) apr_atomic_sub64(volatile apr_uint64_t *mem, apr_uint64_t val)
+{
+    atomic64_sub((unsigned long long *)mem,(unsigned long long)val);
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_inc64(volatile apr_uint64_t *mem)
+{
+    return atomic64_xchgadd((unsigned long long *)mem, 1);
+}
+
+APR_DECLARE(int) apr_atomic_dec64(volatile apr_uint64_t *mem)
+{
+    return atomic64_xchgadd((unsigned long long *)mem, ~0ULL) != 1;
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_cas64(volatile apr_uint64_t *mem, apr_uint64_t with,apr_uint64_t cmp)
+{
+    return atomic64_cmpxchg((unsigned long long *)mem,(unsigned long long)cmp,(unsigned long long)with);
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_xchg64(volatile apr_uint64_t *mem, apr_uint64_t val)
+{
+    return atomic64_xchg((unsigned long long *)mem,(unsigned long long)val);
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_read64_acquire(volatile apr_uint64_t *mem)
+{
+    return apr_atomic_read64(mem);
+}
+
+APR_DECLARE(void) apr_atomic_set64_release(volatile apr_uint64_t *mem, apr_uint64_t val)
+{
+    apr_atomic_set64(mem, val);
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_add64_relaxed(volatile apr_uint64_t *mem, apr_uint64_t val)
+{
+    return apr_atomic_add64(mem, val);
+}
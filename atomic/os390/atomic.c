@@ -135,3 +135,104 @@ APR_DECLARE(void*) apr_atomic_xchgptr(volatile void **mem_ptr, void *new_ptr)
 
     return old_ptr;
 }
+
+apr_uint32_t apr_atomic_read32_acquire(volatile apr_uint32_t *mem)
+{
+    apr_uint32_t old = 0;
+
+    __cs(&old, (cs_t *)mem, 0);
+    return old; /* old is automatically updated from mem on cs failure */
+}
+
+void apr_atomic_set32_release(volatile apr_uint32_t *mem, apr_uint32_t val)
+{
+    apr_atomic_xchg32(mem, val);
+}
+
+apr_uint32_t apr_atomic_add32_relaxed(volatile apr_uint32_t *mem, apr_uint32_t val)
+{
+    return apr_atomic_add32(mem, val);
+}
+
+apr_uint64_t apr_atomic_add64(volatile apr_uint64_t *mem, apr_uint64_t val)
+{
+    apr_uint64_t old, new_val;
+
+    old = *mem;   /* old is automatically updated on csg failure */
+    do {
+        new_val = old + val;
+    } while (__csg(&old, (csg_t *)mem, &new_val));
+    return old;
+}
+
+void apr_atomic_sub64(volatile apr_uint64_t *mem, apr_uint64_t val)
+{
+     apr_uint64_t old, new_val;
+
+     old = *mem;   /* old is automatically updated on csg failure */
+     do {
+         new_val = old - val;
+     } while (__csg(&old, (csg_t *)mem, &new_val));
+}
+
+apr_uint64_t apr_atomic_inc64(volatile apr_uint64_t *mem)
+{
+    return apr_atomic_add64(mem, 1);
+}
+
+int apr_atomic_dec64(volatile apr_uint64_t *mem)
+{
+    apr_uint64_t old, new_val;
+
+    old = *mem;   /* old is automatically updated on csg failure */
+    do {
+        new_val = old - 1;
+    } while (__csg(&old, (csg_t *)mem, &new_val));
+
+    return new_val != 0;
+}
+
+apr_uint64_t apr_atomic_read64(volatile apr_uint64_t *mem)
+{
+    return *mem;
+}
+
+void apr_atomic_set64(volatile apr_uint64_t *mem, apr_uint64_t val)
+{
+    *mem = val;
+}
+
+apr_uint64_t apr_atomic_cas64(volatile apr_uint64_t *mem, apr_uint64_t swap,
+                              apr_uint64_t cmp)
+{
+    apr_uint64_t old = cmp;
+
+    __csg(&old, (csg_t *)mem, &swap);
+    return old; /* old is automatically updated from mem on csg failure */
+}
+
+apr_uint64_t apr_atomic_xchg64(volatile apr_uint64_t *mem, apr_uint64_t val)
+{
+    apr_uint64_t old;
+
+    old = *mem;   /* old is automatically updated on csg failure */
+    do {
+    } while (__csg(&old, (csg_t *)mem, &val));
+
+    return old;
+}
+
+apr_uint64_t apr_atomic_read64_acquire(volatile apr_uint64_t *mem)
+{
+    return apr_atomic_cas64(mem, 0, 0);
+}
+
+void apr_atomic_set64_release(volatile apr_uint64_t *mem, apr_uint64_t val)
+{
+    apr_atomic_xchg64(mem, val);
+}
+
+apr_uint64_t apr_atomic_add64_relaxed(volatile apr_uint64_t *mem, apr_uint64_t val)
+{
+    return apr_atomic_add64(mem, val);
+}
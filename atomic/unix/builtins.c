@@ -18,9 +18,19 @@
 
 #ifdef USE_ATOMICS_BUILTINS
 
+/* The __atomic builtins (GCC >= 4.7, clang) take an explicit memory order,
+ * the older __sync ones are always full barriers */
+#if defined(__ATOMIC_ACQUIRE)
+#define HAVE__ATOMIC_BUILTINS 1
+#endif
+
 APR_DECLARE(apr_status_t) apr_atomic_init(apr_pool_t *p)
 {
+#if defined(USE_ATOMICS_GENERIC64)
+    return apr__atomic_generic64_init(p);
+#else
     return APR_SUCCESS;
+#endif
 }
 
 APR_DECLARE(apr_uint32_t) apr_atomic_read32(volatile apr_uint32_t *mem)
@@ -78,4 +88,125 @@ APR_DECLARE(void*) apr_atomic_xchgptr(volatile void **mem, void *with)
     return (void*) __sync_lock_test_and_set(mem, with);
 }
 
+APR_DECLARE(apr_uint32_t) apr_atomic_read32_acquire(volatile apr_uint32_t *mem)
+{
+#if HAVE__ATOMIC_BUILTINS
+    return __atomic_load_n(mem, __ATOMIC_ACQUIRE);
+#else
+    apr_uint32_t val = *mem;
+
+    __sync_synchronize();
+
+    return val;
+#endif
+}
+
+APR_DECLARE(void) apr_atomic_set32_release(volatile apr_uint32_t *mem, apr_uint32_t val)
+{
+#if HAVE__ATOMIC_BUILTINS
+    __atomic_store_n(mem, val, __ATOMIC_RELEASE);
+#else
+    __sync_synchronize();
+
+    *mem = val;
+#endif
+}
+
+APR_DECLARE(apr_uint32_t) apr_atomic_add32_relaxed(volatile apr_uint32_t *mem, apr_uint32_t val)
+{
+#if HAVE__ATOMIC_BUILTINS
+    return __atomic_fetch_add(mem, val, __ATOMIC_RELAXED);
+#else
+    return __sync_fetch_and_add(mem, val);
+#endif
+}
+
+#if !defined(USE_ATOMICS_GENERIC64)
+
+APR_DECLARE(apr_uint64_t) apr_atomic_read64(volatile apr_uint64_t *mem)
+{
+#if HAVE__ATOMIC_BUILTINS
+    return __atomic_load_n(mem, __ATOMIC_SEQ_CST);
+#else
+    /* a plain read may tear on 32-bit platforms */
+    return __sync_fetch_and_add(mem, 0);
+#endif
+}
+
+APR_DECLARE(void) apr_atomic_set64(volatile apr_uint64_t *mem, apr_uint64_t val)
+{
+#if HAVE__ATOMIC_BUILTINS
+    __atomic_store_n(mem, val, __ATOMIC_SEQ_CST);
+#else
+    apr_uint64_t prev = *mem;
+    apr_uint64_t cur;
+
+    while ((cur = __sync_val_compare_and_swap(mem, prev, val)) != prev) {
+        prev = cur;
+    }
+#endif
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_add64(volatile apr_uint64_t *mem, apr_uint64_t val)
+{
+    return __sync_fetch_and_add(mem, val);
+}
+
+APR_DECLARE(void) apr_atomic_sub64(volatile apr_uint64_t *mem, apr_uint64_t val)
+{
+    __sync_fetch_and_sub(mem, val);
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_inc64(volatile apr_uint64_t *mem)
+{
+    return __sync_fetch_and_add(mem, 1);
+}
+
+APR_DECLARE(int) apr_atomic_dec64(volatile apr_uint64_t *mem)
+{
+    return __sync_sub_and_fetch(mem, 1) != 0;
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_cas64(volatile apr_uint64_t *mem, apr_uint64_t with,
+                                           apr_uint64_t cmp)
+{
+    return __sync_val_compare_and_swap(mem, cmp, with);
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_xchg64(volatile apr_uint64_t *mem, apr_uint64_t val)
+{
+    __sync_synchronize();
+
+    return __sync_lock_test_and_set(mem, val);
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_read64_acquire(volatile apr_uint64_t *mem)
+{
+#if HAVE__ATOMIC_BUILTINS
+    return __atomic_load_n(mem, __ATOMIC_ACQUIRE);
+#else
+    return __sync_fetch_and_add(mem, 0);
+#endif
+}
+
+APR_DECLARE(void) apr_atomic_set64_release(volatile apr_uint64_t *mem, apr_uint64_t val)
+{
+#if HAVE__ATOMIC_BUILTINS
+    __atomic_store_n(mem, val, __ATOMIC_RELEASE);
+#else
+    apr_atomic_set64(mem, val);
+#endif
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_add64_relaxed(volatile apr_uint64_t *mem, apr_uint64_t val)
+{
+#if HAVE__ATOMIC_BUILTINS
+    return __atomic_fetch_add(mem, val, __ATOMIC_RELAXED);
+#else
+    return __sync_fetch_and_add(mem, val);
+#endif
+}
+
+#endif /* !USE_ATOMICS_GENERIC64 */
+
 #endif /* USE_ATOMICS_BUILTINS */
@@ -18,9 +18,17 @@
 
 #ifdef USE_ATOMICS_IA32
 
+/* x86 loads and stores are ordered already, only the compiler could
+ * reorder them */
+#define COMPILER_BARRIER() asm volatile ("" : : : "memory")
+
 APR_DECLARE(apr_status_t) apr_atomic_init(apr_pool_t *p)
 {
+#if defined(USE_ATOMICS_GENERIC64)
+    return apr__atomic_generic64_init(p);
+#else
     return APR_SUCCESS;
+#endif
 }
 
 APR_DECLARE(apr_uint32_t) apr_atomic_read32(volatile apr_uint32_t *mem)
@@ -124,4 +132,116 @@ APR_DECLARE(void*) apr_atomic_xchgptr(volatile void **mem, void *with)
     return prev;
 }
 
+APR_DECLARE(apr_uint32_t) apr_atomic_read32_acquire(volatile apr_uint32_t *mem)
+{
+    apr_uint32_t val = *mem;
+
+    COMPILER_BARRIER();
+
+    return val;
+}
+
+APR_DECLARE(void) apr_atomic_set32_release(volatile apr_uint32_t *mem, apr_uint32_t val)
+{
+    COMPILER_BARRIER();
+
+    *mem = val;
+}
+
+APR_DECLARE(apr_uint32_t) apr_atomic_add32_relaxed(volatile apr_uint32_t *mem, apr_uint32_t val)
+{
+    return apr_atomic_add32(mem, val);
+}
+
+#if !defined(USE_ATOMICS_GENERIC64)
+
+APR_DECLARE(apr_uint64_t) apr_atomic_read64(volatile apr_uint64_t *mem)
+{
+    return *mem;
+}
+
+APR_DECLARE(void) apr_atomic_set64(volatile apr_uint64_t *mem, apr_uint64_t val)
+{
+    *mem = val;
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_add64(volatile apr_uint64_t *mem, apr_uint64_t val)
+{
+    asm volatile ("lock; xaddq %0,%1"
+                  : "=r" (val), "=m" (*mem)
+                  : "0" (val), "m" (*mem)
+                  : "memory", "cc");
+    return val;
+}
+
+APR_DECLARE(void) apr_atomic_sub64(volatile apr_uint64_t *mem, apr_uint64_t val)
+{
+    asm volatile ("lock; subq %1, %0"
+                  : /* no output */
+                  : "m" (*(mem)), "r" (val)
+                  : "memory", "cc");
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_inc64(volatile apr_uint64_t *mem)
+{
+    return apr_atomic_add64(mem, 1);
+}
+
+APR_DECLARE(int) apr_atomic_dec64(volatile apr_uint64_t *mem)
+{
+    unsigned char prev;
+
+    asm volatile ("lock; decq %0; setnz %1"
+                  : "=m" (*mem), "=qm" (prev)
+                  : "m" (*mem)
+                  : "memory");
+
+    return prev;
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_cas64(volatile apr_uint64_t *mem, apr_uint64_t with,
+                                           apr_uint64_t cmp)
+{
+    apr_uint64_t prev;
+
+    asm volatile ("lock; cmpxchgq %1, %2"
+                  : "=a" (prev)
+                  : "r" (with), "m" (*(mem)), "0"(cmp)
+                  : "memory", "cc");
+    return prev;
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_xchg64(volatile apr_uint64_t *mem, apr_uint64_t val)
+{
+    apr_uint64_t prev = val;
+
+    asm volatile ("xchgq %0, %1"
+                  : "=r" (prev), "+m" (*mem)
+                  : "0" (prev));
+    return prev;
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_read64_acquire(volatile apr_uint64_t *mem)
+{
+    apr_uint64_t val = *mem;
+
+    COMPILER_BARRIER();
+
+    return val;
+}
+
+APR_DECLARE(void) apr_atomic_set64_release(volatile apr_uint64_t *mem, apr_uint64_t val)
+{
+    COMPILER_BARRIER();
+
+    *mem = val;
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_add64_relaxed(volatile apr_uint64_t *mem, apr_uint64_t val)
+{
+    return apr_atomic_add64(mem, val);
+}
+
+#endif /* !USE_ATOMICS_GENERIC64 */
+
 #endif /* USE_ATOMICS_IA32 */
@@ -70,7 +70,7 @@ APR_DECLARE(apr_status_t) apr_atomic_init(apr_pool_t *p)
         }
     }
 
-    return APR_SUCCESS;
+    return apr__atomic_generic64_init(p);
 }
 
 static APR_INLINE apr_thread_mutex_t *mutex_hash(volatile apr_uint32_t *mem)
@@ -88,7 +88,7 @@ static APR_INLINE apr_thread_mutex_t *mutex_hash(volatile apr_uint32_t *mem)
 
 APR_DECLARE(apr_status_t) apr_atomic_init(apr_pool_t *p)
 {
-    return APR_SUCCESS;
+    return apr__atomic_generic64_init(p);
 }
 
 #endif /* APR_HAS_THREADS */
@@ -202,4 +202,28 @@ APR_DECLARE(void*) apr_atomic_xchgptr(volatile void **mem, void *with)
     return prev;
 }
 
+/* The mutex orders everything already */
+
+APR_DECLARE(apr_uint32_t) apr_atomic_read32_acquire(volatile apr_uint32_t *mem)
+{
+    apr_uint32_t cur_value;
+    DECLARE_MUTEX_LOCKED(mutex, mem);
+
+    cur_value = *mem;
+
+    MUTEX_UNLOCK(mutex);
+
+    return cur_value;
+}
+
+APR_DECLARE(void) apr_atomic_set32_release(volatile apr_uint32_t *mem, apr_uint32_t val)
+{
+    apr_atomic_set32(mem, val);
+}
+
+APR_DECLARE(apr_uint32_t) apr_atomic_add32_relaxed(volatile apr_uint32_t *mem, apr_uint32_t val)
+{
+    return apr_atomic_add32(mem, val);
+}
+
 #endif /* USE_ATOMICS_GENERIC */
@@ -26,7 +26,7 @@
 
 APR_DECLARE(apr_status_t) apr_atomic_init(apr_pool_t *p)
 {
-    return APR_SUCCESS;
+    return apr__atomic_generic64_init(p);
 }
 
 APR_DECLARE(apr_uint32_t) apr_atomic_read32(volatile apr_uint32_t *mem)
@@ -204,4 +204,27 @@ APR_DECLARE(void*) apr_atomic_xchgptr(volatile void **mem, void *with)
     return prev;
 }
 
+APR_DECLARE(apr_uint32_t) apr_atomic_read32_acquire(volatile apr_uint32_t *mem)
+{
+    apr_uint32_t val = *mem;
+
+    asm volatile ("    sync\n"                /* memory barrier       */
+                  : : : "memory");
+
+    return val;
+}
+
+APR_DECLARE(void) apr_atomic_set32_release(volatile apr_uint32_t *mem, apr_uint32_t val)
+{
+    asm volatile ("    sync\n"                /* memory barrier       */
+                  : : : "memory");
+
+    *mem = val;
+}
+
+APR_DECLARE(apr_uint32_t) apr_atomic_add32_relaxed(volatile apr_uint32_t *mem, apr_uint32_t val)
+{
+    return apr_atomic_add32(mem, val);
+}
+
 #endif /* USE_ATOMICS_PPC */
@@ -76,4 +76,88 @@ APR_DECLARE(void*) apr_atomic_xchgptr(volatile void **mem, void *with)
     return atomic_swap_ptr(mem, with);
 }
 
+APR_DECLARE(apr_uint64_t) apr_atomic_read64(volatile apr_uint64_t *mem)
+{
+    /* a plain read may tear on 32-bit platforms */
+    return atomic_add_64_nv(mem, 0);
+}
+
+APR_DECLARE(void) apr_atomic_set64(volatile apr_uint64_t *mem, apr_uint64_t val)
+{
+    atomic_swap_64(mem, val);
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_add64(volatile apr_uint64_t *mem, apr_uint64_t val)
+{
+    return atomic_add_64_nv(mem, val) - val;
+}
+
+APR_DECLARE(void) apr_atomic_sub64(volatile apr_uint64_t *mem, apr_uint64_t val)
+{
+    atomic_add_64(mem, -val);
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_inc64(volatile apr_uint64_t *mem)
+{
+    return atomic_inc_64_nv(mem) - 1;
+}
+
+APR_DECLARE(int) apr_atomic_dec64(volatile apr_uint64_t *mem)
+{
+    return atomic_dec_64_nv(mem) != 0;
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_cas64(volatile apr_uint64_t *mem, apr_uint64_t with,
+                                           apr_uint64_t cmp)
+{
+    return atomic_cas_64(mem, cmp, with);
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_xchg64(volatile apr_uint64_t *mem, apr_uint64_t val)
+{
+    return atomic_swap_64(mem, val);
+}
+
+APR_DECLARE(apr_uint32_t) apr_atomic_read32_acquire(volatile apr_uint32_t *mem)
+{
+    apr_uint32_t val = *mem;
+
+    membar_enter();
+
+    return val;
+}
+
+APR_DECLARE(void) apr_atomic_set32_release(volatile apr_uint32_t *mem, apr_uint32_t val)
+{
+    membar_exit();
+
+    *mem = val;
+}
+
+APR_DECLARE(apr_uint32_t) apr_atomic_add32_relaxed(volatile apr_uint32_t *mem, apr_uint32_t val)
+{
+    return atomic_add_32_nv(mem, val) - val;
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_read64_acquire(volatile apr_uint64_t *mem)
+{
+    apr_uint64_t val = apr_atomic_read64(mem);
+
+    membar_enter();
+
+    return val;
+}
+
+APR_DECLARE(void) apr_atomic_set64_release(volatile apr_uint64_t *mem, apr_uint64_t val)
+{
+    membar_exit();
+
+    atomic_swap_64(mem, val);
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_add64_relaxed(volatile apr_uint64_t *mem, apr_uint64_t val)
+{
+    return atomic_add_64_nv(mem, val) - val;
+}
+
 #endif /* USE_ATOMICS_SOLARIS */
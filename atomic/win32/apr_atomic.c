@@ -152,3 +152,92 @@ APR_DECLARE(void*) apr_atomic_xchgptr(volatile void **mem, void *with)
     return ((apr_atomic_win32_ptr_ptr_fn)InterlockedExchange)(mem, with);
 #endif
 }
+
+APR_DECLARE(apr_uint32_t) apr_atomic_read32_acquire(volatile apr_uint32_t *mem)
+{
+    apr_uint32_t val = *mem;
+
+    MemoryBarrier();
+
+    return val;
+}
+
+APR_DECLARE(void) apr_atomic_set32_release(volatile apr_uint32_t *mem, apr_uint32_t val)
+{
+    MemoryBarrier();
+
+    *mem = val;
+}
+
+APR_DECLARE(apr_uint32_t) apr_atomic_add32_relaxed(volatile apr_uint32_t *mem, apr_uint32_t val)
+{
+    return apr_atomic_add32(mem, val);
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_read64(volatile apr_uint64_t *mem)
+{
+#if defined(_M_IA64) || defined(_M_AMD64)
+    return *mem;
+#else
+    /* a plain read may tear on 32-bit platforms */
+    return InterlockedCompareExchange64((volatile LONG64 *)mem, 0, 0);
+#endif
+}
+
+APR_DECLARE(void) apr_atomic_set64(volatile apr_uint64_t *mem, apr_uint64_t val)
+{
+    InterlockedExchange64((volatile LONG64 *)mem, val);
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_add64(volatile apr_uint64_t *mem, apr_uint64_t val)
+{
+    return InterlockedExchangeAdd64((volatile LONG64 *)mem, val);
+}
+
+APR_DECLARE(void) apr_atomic_sub64(volatile apr_uint64_t *mem, apr_uint64_t val)
+{
+    InterlockedExchangeAdd64((volatile LONG64 *)mem, -val);
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_inc64(volatile apr_uint64_t *mem)
+{
+    /* we return old value, win32 returns new value :( */
+    return InterlockedIncrement64((volatile LONG64 *)mem) - 1;
+}
+
+APR_DECLARE(int) apr_atomic_dec64(volatile apr_uint64_t *mem)
+{
+    return InterlockedDecrement64((volatile LONG64 *)mem) != 0;
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_cas64(volatile apr_uint64_t *mem, apr_uint64_t with,
+                                           apr_uint64_t cmp)
+{
+    return InterlockedCompareExchange64((volatile LONG64 *)mem, with, cmp);
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_xchg64(volatile apr_uint64_t *mem, apr_uint64_t val)
+{
+    return InterlockedExchange64((volatile LONG64 *)mem, val);
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_read64_acquire(volatile apr_uint64_t *mem)
+{
+    apr_uint64_t val = apr_atomic_read64(mem);
+
+    MemoryBarrier();
+
+    return val;
+}
+
+APR_DECLARE(void) apr_atomic_set64_release(volatile apr_uint64_t *mem, apr_uint64_t val)
+{
+    MemoryBarrier();
+
+    apr_atomic_set64(mem, val);
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_add64_relaxed(volatile apr_uint64_t *mem, apr_uint64_t val)
+{
+    return apr_atomic_add64(mem, val);
+}
@@ -25,6 +25,7 @@
 #include "apr_escape.h"
 #include "apr_file_info.h"
 #include "apr_file_io.h"
+#include "apr_flathash.h"
 #include "apr_fnmatch.h"
 #include "apr_general.h"
 #include "apr_getopt.h"
@@ -45,6 +46,7 @@
 #include "apr_portable.h"
 #include "apr_proc_mutex.h"
 #include "apr_queue.h"
+#include "apr_radix.h"
 #include "apr_random.h"
 #include "apr_reslist.h"
 #include "apr_ring.h"
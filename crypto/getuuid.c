@@ -16,13 +16,22 @@
 
 /*
  * This attempts to generate V1 UUIDs according to the Internet Draft
- * located at http://www.webdav.org/specs/draft-leach-uuids-guids-01.txt
+ * located at http://www.webdav.org/specs/draft-leach-uuids-guids-01.txt,
+ * and the V4 (random) and V7 (time-ordered) UUIDs of RFC 9562.
+ *
+ * The state is shared by the threads without locking: the timestamps are
+ * advanced atomically, so that no two UUIDs of a process get the same one,
+ * and the random bits come from an atomic counter hashed (SipHash) with a
+ * key which is seeded once per process.
  */
 #include "apr.h"
 #include "apr_uuid.h"
 #include "apr_md5.h"
 #include "apr_general.h"
 #include "apr_portable.h"
+#include "apr_atomic.h"
+#include "apr_time.h"
+#include "apr_siphash.h"
 
 
 #if APR_HAVE_UNISTD_H
@@ -48,15 +57,31 @@
 
 #define NODE_LENGTH 6
 
-static int uuid_state_seqnum;
-static unsigned char uuid_state_node[NODE_LENGTH] = { 0 };
+/* The clock sequence (14 bits) and node (48 bits) of the V1 UUIDs, with
+ * UUID_STATE_SET once initialized
+ */
+#define UUID_STATE_SET APR_UINT64_C(0x8000000000000000)
+static volatile apr_uint64_t uuid_state;
+
+/* The last timestamps given to the V1 and V7 UUIDs */
+static volatile apr_uint64_t uuid_v1_last;
+static volatile apr_uint64_t uuid_v7_last;
 
+/* The pseudo-random generator of the V4 and V7 UUIDs */
+#define RAND_UNSEEDED 0
+#define RAND_SEEDING  1
+#define RAND_SEEDED   2
+static volatile apr_uint32_t rand_state = RAND_UNSEEDED;
+static apr_uint64_t rand_key[2];
+static apr_uint32_t rand_pid;
+static volatile apr_uint64_t rand_counter;
 
-static void get_random_info(unsigned char node[NODE_LENGTH])
+
+static void get_random_info(unsigned char *buf, apr_size_t len)
 {
 #if APR_HAS_RANDOM
 
-    (void) apr_generate_random_bytes(node, NODE_LENGTH);
+    (void) apr_generate_random_bytes(buf, len);
 
 #else
 
@@ -76,10 +101,11 @@ static void get_random_info(unsigned char node[NODE_LENGTH])
         struct timeval t;
 #endif
         char hostname[257];
+        /* Which block of the seed bytes */
+        apr_size_t block;
 
     } r;
 
-    apr_md5_init(&c);
 #ifdef NETWARE
     r.pid = NXThreadGetId();
     NXGetTime(NX_SINCE_BOOT, NX_USECONDS, &(r.t));
@@ -88,10 +114,18 @@ static void get_random_info(unsigned char node[NODE_LENGTH])
     gettimeofday(&r.t, (struct timezone *)0);
 #endif
     gethostname(r.hostname, 256);
-    apr_md5_update(&c, (const unsigned char *)&r, sizeof(r));
-    apr_md5_final(seed, &c);
 
-    memcpy(node, seed, NODE_LENGTH);    /* use a subset of the seed bytes */
+    for (r.block = 0; len > 0; r.block++) {
+        apr_size_t n = len < sizeof(seed) ? len : sizeof(seed);
+
+        apr_md5_init(&c);
+        apr_md5_update(&c, (const unsigned char *)&r, sizeof(r));
+        apr_md5_final(seed, &c);
+
+        memcpy(buf, seed, n);           /* use a subset of the seed bytes */
+        buf += n;
+        len -= n;
+    }
 #endif
 }
 
@@ -101,7 +135,7 @@ static void get_random_info(unsigned char node[NODE_LENGTH])
 */
 static void get_pseudo_node_identifier(unsigned char *node)
 {
-    get_random_info(node);
+    get_random_info(node, NODE_LENGTH);
     node[0] |= 0x01;                    /* this designates a random multicast node ID */
 }
 
@@ -137,57 +171,132 @@ static int true_random(void)
     return rand() & 0x0FFFF;
 }
 
-static void init_state(void)
+/* The clock sequence and node, set by the first thread getting there */
+static apr_uint64_t get_state(void)
 {
-    uuid_state_seqnum = true_random();
-    get_pseudo_node_identifier(uuid_state_node);
+    apr_uint64_t state = apr_atomic_read64(&uuid_state), prev;
+    unsigned char node[NODE_LENGTH];
+    int i;
+
+    if (state) {
+        return state;
+    }
+
+    get_pseudo_node_identifier(node);
+    state = UUID_STATE_SET | (apr_uint64_t)(true_random() & 0x3FFF) << 48;
+    for (i = 0; i < NODE_LENGTH; i++) {
+        state |= (apr_uint64_t)node[i] << (8 * (NODE_LENGTH - 1 - i));
+    }
+
+    prev = apr_atomic_cas64(&uuid_state, state, 0);
+    return prev ? prev : state;
 }
 
-static void get_current_time(apr_uint64_t *timestamp)
+/* Reserve n timestamps after the last ones given, from the current time
+ * or later if they were generated too fast (or the clock went back), and
+ * return the first one
+ */
+static apr_uint64_t reserve_time(volatile apr_uint64_t *last,
+                                 apr_uint64_t time_now, apr_uint64_t n)
 {
-    /* ### this needs to be made thread-safe! */
+    apr_uint64_t time_last, timestamp;
+
+    do {
+        time_last = apr_atomic_read64(last);
+        timestamp = (time_now > time_last) ? time_now : time_last + 1;
+    } while (apr_atomic_cas64(last, timestamp + n - 1,
+                              time_last) != time_last);
 
+    return timestamp;
+}
+
+static apr_uint64_t get_current_time(apr_uint64_t n)
+{
     apr_uint64_t time_now;
-    static apr_uint64_t time_last = 0;
-    static apr_uint64_t fudge = 0;
 
     get_system_time(&time_now);
-        
-    /* if clock reading changed since last UUID generated... */
-    if (time_last != time_now) {
-        /* The clock reading has changed since the last UUID was generated.
-           Reset the fudge factor. if we are generating them too fast, then
-           the fudge may need to be reset to something greater than zero. */
-        if (time_last + fudge > time_now)
-            fudge = time_last + fudge - time_now + 1;
-        else
-            fudge = 0;
-        time_last = time_now;
-    }
-    else {
-        /* We generated two really fast. Bump the fudge factor. */
-        ++fudge;
+    return reserve_time(&uuid_v1_last, time_now, n);
+}
+
+/* The V7 timestamps are the Unix time in milliseconds (48 bits) followed
+ * by the fraction of millisecond in 1/4096 (12 bits, the rand_a field)
+ */
+static apr_uint64_t get_current_time_v7(apr_uint64_t n)
+{
+    apr_time_t now = apr_time_now();
+    apr_uint64_t time_now = ((apr_uint64_t)(now / 1000) << 12)
+                            | (apr_uint64_t)(now % 1000) * 4096 / 1000;
+
+    return reserve_time(&uuid_v7_last, time_now, n);
+}
+
+static apr_uint32_t current_pid(void)
+{
+#if APR_HAVE_UNISTD_H
+    return (apr_uint32_t)getpid();
+#else
+    return 0;
+#endif
+}
+
+/* Reserve n 128-bit pseudo-random values, returning the first one's
+ * counter.  The key is seeded on first use, and again in a forked child
+ * not to give the same values as its parent.
+ */
+static apr_uint64_t rand_reserve(apr_uint64_t n)
+{
+    apr_uint32_t pid = current_pid();
+
+    for (;;) {
+        apr_uint32_t state = apr_atomic_read32_acquire(&rand_state);
+
+        if (state == RAND_SEEDED && rand_pid == pid) {
+            break;
+        }
+        if (state != RAND_SEEDING
+            && apr_atomic_cas32(&rand_state, RAND_SEEDING, state) == state) {
+            get_random_info((unsigned char *)rand_key, sizeof(rand_key));
+            rand_pid = pid;
+            apr_atomic_set32_release(&rand_state, RAND_SEEDED);
+            break;
+        }
+        /* else another thread is seeding */
     }
 
-    *timestamp = time_now + fudge;
+    return apr_atomic_add64(&rand_counter, n);
 }
 
-APR_DECLARE(void) apr_uuid_get(apr_uuid_t *uuid)
+/* SipHash-2-4 of the counter (twice), keyed with the random secret: a
+ * pseudo-random function, so no UUID reveals anything of the secret nor
+ * of the other UUIDs.
+ */
+static APR_INLINE void rand_get(apr_uint64_t counter, apr_uint64_t w[2])
 {
-    apr_uint64_t timestamp;
-    unsigned char *d = uuid->data;
+    unsigned char m[9];
+    int i;
 
-#if APR_HAS_OS_UUID
-    if (apr_os_uuid_get(d) == APR_SUCCESS) {
-        return;
+    for (i = 0; i < 8; i++) {
+        m[i] = (unsigned char)(counter >> (8 * i));
     }
-#endif /* !APR_HAS_OS_UUID */
+    m[8] = 0;
+    w[0] = apr__siphash(rand_key[0], rand_key[1], m, sizeof(m), 2, 4);
+    m[8] = 1;
+    w[1] = apr__siphash(rand_key[0], rand_key[1], m, sizeof(m), 2, 4);
+}
 
-    if (!uuid_state_node[0])
-        init_state();
+static APR_INLINE void put_uint64(unsigned char *d, apr_uint64_t w)
+{
+    int i;
 
-    get_current_time(&timestamp);
+    for (i = 7; i >= 0; i--) {
+        d[i] = (unsigned char)w;
+        w >>= 8;
+    }
+}
 
+static void uuid_v1_fill(unsigned char *d, apr_uint64_t timestamp,
+                         apr_uint64_t state)
+{
     /* time_low, uint32 */
     d[3] = (unsigned char)timestamp;
     d[2] = (unsigned char)(timestamp >> 8);
@@ -200,9 +309,107 @@ APR_DECLARE(void) apr_uuid_get(apr_uuid_t *uuid)
     d[7] = (unsigned char)(timestamp >> 48);
     d[6] = (unsigned char)(((timestamp >> 56) & 0x0F) | 0x10);
     /* clock_seq_hi_and_reserved, uint8 */
-    d[8] = (unsigned char)(((uuid_state_seqnum >> 8) & 0x3F) | 0x80);
+    d[8] = (unsigned char)(((state >> 56) & 0x3F) | 0x80);
     /* clock_seq_low, uint8 */
-    d[9] = (unsigned char)uuid_state_seqnum;
+    d[9] = (unsigned char)(state >> 48);
     /* node, byte[6] */
-    memcpy(&d[10], uuid_state_node, NODE_LENGTH);
+    d[10] = (unsigned char)(state >> 40);
+    d[11] = (unsigned char)(state >> 32);
+    d[12] = (unsigned char)(state >> 24);
+    d[13] = (unsigned char)(state >> 16);
+    d[14] = (unsigned char)(state >> 8);
+    d[15] = (unsigned char)state;
+}
+
+static void uuid_v4_fill(unsigned char *d, apr_uint64_t counter)
+{
+    apr_uint64_t w[2];
+
+    rand_get(counter, w);
+    put_uint64(d, w[0]);
+    put_uint64(d + 8, w[1]);
+    /* version, and variant */
+    d[6] = (d[6] & 0x0F) | 0x40;
+    d[8] = (d[8] & 0x3F) | 0x80;
+}
+
+static void uuid_v7_fill(unsigned char *d, apr_uint64_t timestamp,
+                         apr_uint64_t counter)
+{
+    apr_uint64_t w[2];
+
+    rand_get(counter, w);
+    /* unix_ts_ms, uint48 */
+    put_uint64(d, timestamp << 4);
+    /* version, and rand_a */
+    d[6] = (unsigned char)(((timestamp >> 8) & 0x0F) | 0x70);
+    d[7] = (unsigned char)timestamp;
+    /* variant, and rand_b */
+    put_uint64(d + 8, w[0]);
+    d[8] = (d[8] & 0x3F) | 0x80;
+}
+
+APR_DECLARE(void) apr_uuid_get(apr_uuid_t *uuid)
+{
+#if APR_HAS_OS_UUID
+    if (apr_os_uuid_get(uuid->data) == APR_SUCCESS) {
+        return;
+    }
+#endif /* !APR_HAS_OS_UUID */
+
+    uuid_v1_fill(uuid->data, get_current_time(1), get_state());
+}
+
+APR_DECLARE(void) apr_uuid_get_v4(apr_uuid_t *uuid)
+{
+    uuid_v4_fill(uuid->data, rand_reserve(1));
+}
+
+APR_DECLARE(void) apr_uuid_get_v7(apr_uuid_t *uuid)
+{
+    apr_uint64_t counter = rand_reserve(1);
+
+    uuid_v7_fill(uuid->data, get_current_time_v7(1), counter);
+}
+
+APR_DECLARE(apr_status_t) apr_uuid_get_n(apr_uuid_t *uuids, apr_size_t n,
+                                         int version)
+{
+    apr_uint64_t timestamp, counter, state;
+    apr_size_t i;
+
+    /* The timestamps and random values of all the UUIDs are reserved at
+     * once, then they are filled
+     */
+    switch (version) {
+    case 0:
+        for (i = 0; i < n; i++) {
+            apr_uuid_get(&uuids[i]);
+        }
+        break;
+    case 1:
+        state = get_state();
+        timestamp = get_current_time(n);
+        for (i = 0; i < n; i++) {
+            uuid_v1_fill(uuids[i].data, timestamp + i, state);
+        }
+        break;
+    case 4:
+        counter = rand_reserve(n);
+        for (i = 0; i < n; i++) {
+            uuid_v4_fill(uuids[i].data, counter + i);
+        }
+        break;
+    case 7:
+        counter = rand_reserve(n);
+        timestamp = get_current_time_v7(n);
+        for (i = 0; i < n; i++) {
+            uuid_v7_fill(uuids[i].data, timestamp + i, counter + i);
+        }
+        break;
+    default:
+        return APR_EINVAL;
+    }
+
+    return APR_SUCCESS;
 }
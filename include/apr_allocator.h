@@ -66,6 +66,51 @@ struct apr_memnode_t {
 /** Symbolic constants */
 #define APR_ALLOCATOR_MAX_FREE_UNLIMITED 0
 
+/**
+ * @defgroup apr_allocator_create_flags Allocator creation flags
+ * @{
+ */
+/** Carve memnodes from large regions mapped up front */
+#define APR_ALLOCATOR_REGIONS       0x01
+/** Back the regions with huge pages (implies APR_ALLOCATOR_REGIONS) */
+#define APR_ALLOCATOR_HUGEPAGES     0x02
+/** Prefer the NUMA node of the thread mapping the regions
+ * (implies APR_ALLOCATOR_REGIONS) */
+#define APR_ALLOCATOR_NUMA_LOCAL    0x04
+/** @} */
+
+/** The default size of the regions, @see apr_allocator_create_ex() */
+#define APR_ALLOCATOR_REGION_SIZE_DEFAULT (4 * 1024 * 1024)
+
+/** The number of size classes of the allocator's free lists */
+#define APR_ALLOCATOR_SIZE_CLASSES 20
+
+/** Allocator statistics, @see apr_allocator_stats_get() */
+typedef struct apr_allocator_stats_t {
+    /** The memnode size granularity: the free list of size class i
+     * holds memnodes of (i + 1) * boundary bytes, except class 0 which
+     * holds the ones larger than the last class */
+    apr_size_t boundary;
+    /** Bytes of memnodes obtained from the system and not given back */
+    apr_size_t allocated;
+    /** Bytes of memnodes in the free lists */
+    apr_size_t free;
+    /** Bytes of memnodes in the free list of each size class */
+    apr_size_t free_sizes[APR_ALLOCATOR_SIZE_CLASSES];
+    /** Bytes of memnodes in the per-thread caches (approximate) */
+    apr_size_t cached;
+    /** The apr_allocator_max_free_set() threshold, 0 if unlimited */
+    apr_size_t max_free;
+    /** Memnodes given back to the system because of the threshold */
+    apr_size_t max_free_hits;
+    /** Memnodes handed out by the free lists or obtained from the system */
+    apr_size_t node_allocs;
+    /** Memnodes given back to the free lists */
+    apr_size_t node_frees;
+    /** Memnodes obtained from the system */
+    apr_size_t node_mallocs;
+} apr_allocator_stats_t;
+
 /**
  * Create a new allocator
  * @param allocator The allocator we have just created.
@@ -74,11 +119,36 @@ struct apr_memnode_t {
 APR_DECLARE(apr_status_t) apr_allocator_create(apr_allocator_t **allocator)
                           __attribute__((nonnull(1)));
 
+/**
+ * Create a new allocator with the given backing
+ * @param allocator The allocator we have just created.
+ * @param flags A combination of the @ref apr_allocator_create_flags
+ * @param region_size The size of the regions, 0 for
+ *        APR_ALLOCATOR_REGION_SIZE_DEFAULT; it is rounded up to the huge
+ *        page size with APR_ALLOCATOR_HUGEPAGES
+ * @return APR_ENOTIMPL if regions are not supported on this platform
+ * @remark With APR_ALLOCATOR_REGIONS, memnodes are carved from regions
+ *         of region_size bytes (or bigger, for larger memnodes) and are
+ *         always given back to the free lists, regardless of the
+ *         apr_allocator_max_free_set() threshold; the regions are only
+ *         unmapped by apr_allocator_destroy().
+ * @remark APR_ALLOCATOR_HUGEPAGES uses the reserved huge pages if any,
+ *         otherwise it aligns the regions and asks for transparent huge
+ *         pages.  APR_ALLOCATOR_NUMA_LOCAL binds each region to the NUMA
+ *         node of the thread causing it to be mapped.  Both are best
+ *         effort and silently ignored where not supported.
+ */
+APR_DECLARE(apr_status_t) apr_allocator_create_ex(apr_allocator_t **allocator,
+                                                  apr_uint32_t flags,
+                                                  apr_size_t region_size)
+                          __attribute__((nonnull(1)));
+
 /**
  * Destroy an allocator
  * @param allocator The allocator to be destroyed
  * @remark Any memnodes not given back to the allocator prior to destroying
- *         will _not_ be free()d.
+ *         will _not_ be free()d, unless they live in regions,
+ *         @see apr_allocator_create_ex().
  */
 APR_DECLARE(void) apr_allocator_destroy(apr_allocator_t *allocator)
                   __attribute__((nonnull(1)));
@@ -138,6 +208,19 @@ APR_DECLARE(void) apr_allocator_max_free_set(apr_allocator_t *allocator,
                                              apr_size_t size)
                   __attribute__((nonnull(1)));
 
+/**
+ * Get the statistics of the allocator
+ * @param stats The statistics
+ * @param allocator The allocator
+ * @remark The counters are always maintained, regardless of APR_POOL_DEBUG.
+ *         Memnodes served by or given back to the per-thread caches are
+ *         only accounted for when they move from or to the free lists,
+ *         @see apr_allocator_thread_cache_set().
+ */
+APR_DECLARE(void) apr_allocator_stats_get(apr_allocator_stats_t *stats,
+                                          apr_allocator_t *allocator)
+                  __attribute__((nonnull(1,2)));
+
 #include "apr_thread_mutex.h"
 
 #if APR_HAS_THREADS
@@ -158,6 +241,54 @@ APR_DECLARE(apr_thread_mutex_t *) apr_allocator_mutex_get(
                                           apr_allocator_t *allocator)
                                   __attribute__((nonnull(1)));
 
+/** Counters of the calling thread's node cache,
+ * @see apr_allocator_thread_cache_stats_get()
+ */
+typedef struct apr_allocator_thread_cache_stats_t {
+    /** allocations served from the thread's cache */
+    apr_size_t hits;
+    /** allocations which had to take the allocator's mutex */
+    apr_size_t misses;
+    /** batches moved from the allocator's free lists to the cache */
+    apr_size_t refills;
+    /** batches moved from the cache back to the allocator's free lists */
+    apr_size_t flushes;
+} apr_allocator_thread_cache_stats_t;
+
+/**
+ * Enable (or disable) per-thread caches of free memnodes
+ * @param allocator The allocator
+ * @param batch The number of memnodes moved at once between a thread's
+ *        cache and the allocator's free lists, 0 disables the caches
+ * @param pool The pool the caches are bound to; they are disabled and
+ *        their memnodes are given back to the allocator when it is
+ *        cleared or destroyed
+ * @remark Each thread using the allocator caches up to 2 * batch free
+ *         memnodes of each of the small sizes, so that the allocator's
+ *         mutex is only taken once per batch of memnodes, not once per
+ *         memnode.  The cached memnodes do not count against the
+ *         apr_allocator_max_free_set() threshold.
+ * @remark This function must not be called while other threads are
+ *         using the allocator, and the pool must not outlive it.
+ */
+APR_DECLARE(apr_status_t) apr_allocator_thread_cache_set(
+                                          apr_allocator_t *allocator,
+                                          apr_uint32_t batch,
+                                          apr_pool_t *pool)
+                          __attribute__((nonnull(1,3)));
+
+/**
+ * Get the counters of the calling thread's memnode cache
+ * @param stats The counters
+ * @param allocator The allocator
+ * @return APR_EINVAL if the per-thread caches are not enabled
+ * @remark The hit rate of the cache is hits / (hits + misses).
+ */
+APR_DECLARE(apr_status_t) apr_allocator_thread_cache_stats_get(
+                                  apr_allocator_thread_cache_stats_t *stats,
+                                  apr_allocator_t *allocator)
+                          __attribute__((nonnull(1,2)));
+
 #endif /* APR_HAS_THREADS */
 
 /** @} */
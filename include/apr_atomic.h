@@ -131,6 +131,131 @@ APR_DECLARE(void*) apr_atomic_casptr(volatile void **mem, void *with, const void
  */
 APR_DECLARE(void*) apr_atomic_xchgptr(volatile void **mem, void *with);
 
+/*
+ * Atomic operations on 64-bit values
+ * Note: Each of these functions internally implements a memory barrier
+ * on platforms that require it
+ */
+
+/**
+ * atomically read an apr_uint64_t from memory
+ * @param mem the pointer
+ */
+APR_DECLARE(apr_uint64_t) apr_atomic_read64(volatile apr_uint64_t *mem);
+
+/**
+ * atomically set an apr_uint64_t in memory
+ * @param mem pointer to the object
+ * @param val value that the object will assume
+ */
+APR_DECLARE(void) apr_atomic_set64(volatile apr_uint64_t *mem, apr_uint64_t val);
+
+/**
+ * atomically add 'val' to an apr_uint64_t
+ * @param mem pointer to the object
+ * @param val amount to add
+ * @return old value pointed to by mem
+ */
+APR_DECLARE(apr_uint64_t) apr_atomic_add64(volatile apr_uint64_t *mem, apr_uint64_t val);
+
+/**
+ * atomically subtract 'val' from an apr_uint64_t
+ * @param mem pointer to the object
+ * @param val amount to subtract
+ */
+APR_DECLARE(void) apr_atomic_sub64(volatile apr_uint64_t *mem, apr_uint64_t val);
+
+/**
+ * atomically increment an apr_uint64_t by 1
+ * @param mem pointer to the object
+ * @return old value pointed to by mem
+ */
+APR_DECLARE(apr_uint64_t) apr_atomic_inc64(volatile apr_uint64_t *mem);
+
+/**
+ * atomically decrement an apr_uint64_t by 1
+ * @param mem pointer to the atomic value
+ * @return zero if the value becomes zero on decrement, otherwise non-zero
+ */
+APR_DECLARE(int) apr_atomic_dec64(volatile apr_uint64_t *mem);
+
+/**
+ * compare an apr_uint64_t's value with 'cmp'.
+ * If they are the same swap the value with 'with'
+ * @param mem pointer to the value
+ * @param with what to swap it with
+ * @param cmp the value to compare it to
+ * @return the old value of *mem
+ */
+APR_DECLARE(apr_uint64_t) apr_atomic_cas64(volatile apr_uint64_t *mem, apr_uint64_t with,
+                              apr_uint64_t cmp);
+
+/**
+ * exchange an apr_uint64_t's value with 'val'.
+ * @param mem pointer to the value
+ * @param val what to swap it with
+ * @return the old value of *mem
+ */
+APR_DECLARE(apr_uint64_t) apr_atomic_xchg64(volatile apr_uint64_t *mem, apr_uint64_t val);
+
+/*
+ * Atomic operations with an explicit memory ordering
+ * Note: These are for the hot paths where the full barrier of the above
+ * functions is not needed; platforms without a cheaper ordering fall back
+ * to the full barrier
+ */
+
+/**
+ * atomically read an apr_uint32_t from memory, with acquire semantics:
+ * no subsequent memory access can be reordered before the read
+ * @param mem the pointer
+ * @remark Pairs with apr_atomic_set32_release()
+ */
+APR_DECLARE(apr_uint32_t) apr_atomic_read32_acquire(volatile apr_uint32_t *mem);
+
+/**
+ * atomically set an apr_uint32_t in memory, with release semantics:
+ * no preceding memory access can be reordered after the write
+ * @param mem pointer to the object
+ * @param val value that the object will assume
+ * @remark Pairs with apr_atomic_read32_acquire()
+ */
+APR_DECLARE(void) apr_atomic_set32_release(volatile apr_uint32_t *mem, apr_uint32_t val);
+
+/**
+ * atomically add 'val' to an apr_uint32_t, without ordering any other
+ * memory access (e.g. for statistics counters)
+ * @param mem pointer to the object
+ * @param val amount to add
+ * @return old value pointed to by mem
+ */
+APR_DECLARE(apr_uint32_t) apr_atomic_add32_relaxed(volatile apr_uint32_t *mem, apr_uint32_t val);
+
+/**
+ * atomically read an apr_uint64_t from memory, with acquire semantics
+ * @param mem the pointer
+ * @see apr_atomic_read32_acquire()
+ */
+APR_DECLARE(apr_uint64_t) apr_atomic_read64_acquire(volatile apr_uint64_t *mem);
+
+/**
+ * atomically set an apr_uint64_t in memory, with release semantics
+ * @param mem pointer to the object
+ * @param val value that the object will assume
+ * @see apr_atomic_set32_release()
+ */
+APR_DECLARE(void) apr_atomic_set64_release(volatile apr_uint64_t *mem, apr_uint64_t val);
+
+/**
+ * atomically add 'val' to an apr_uint64_t, without ordering any other
+ * memory access
+ * @param mem pointer to the object
+ * @param val amount to add
+ * @return old value pointed to by mem
+ * @see apr_atomic_add32_relaxed()
+ */
+APR_DECLARE(apr_uint64_t) apr_atomic_add64_relaxed(volatile apr_uint64_t *mem, apr_uint64_t val);
+
 /** @} */
 
 #ifdef __cplusplus
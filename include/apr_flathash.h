@@ -0,0 +1,224 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef APR_FLATHASH_H
+#define APR_FLATHASH_H
+
+/**
+ * @file apr_flathash.h
+ * @brief APR Flat Hash Tables
+ */
+
+#include "apr_pools.h"
+#include "apr_hash.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup apr_flathash Flat Hash Tables
+ * @ingroup APR
+ * @{
+ */
+
+/**
+ * Abstract type for flat hash tables.
+ *
+ * Unlike apr_hash_t, a flat hash table stores its entries in a single
+ * open-addressed array probed by groups of slots (using SSE2 where
+ * available), so that neither setting a new key nor looking one up
+ * allocates or chases pointers.  Keys are referenced like with apr_hash_t,
+ * or copied inline in the entries if they have a fixed size.
+ */
+typedef struct apr_flathash_t apr_flathash_t;
+
+/**
+ * Abstract type for scanning flat hash tables.
+ */
+typedef struct apr_flathash_index_t apr_flathash_index_t;
+
+/**
+ * Create a flat hash table.
+ * @param pool The pool to allocate the hash table out of
+ * @return The hash table just created
+ */
+APR_DECLARE(apr_flathash_t *) apr_flathash_make(apr_pool_t *pool);
+
+/**
+ * Create a flat hash table with a custom hash function
+ * @param pool The pool to allocate the hash table out of
+ * @param hash_func A custom hash function.
+ * @return The hash table just created
+ */
+APR_DECLARE(apr_flathash_t *) apr_flathash_make_custom(apr_pool_t *pool,
+                                                   apr_hashfunc_t hash_func);
+
+/**
+ * Create a flat hash table with inline keys and/or an initial size
+ * @param pool The pool to allocate the hash table out of
+ * @param hash_func A custom hash function, or NULL for the default one
+ * @param key_size The size of the keys, to copy them in the entries, or
+ *        zero to only reference them (like apr_flathash_make() does)
+ * @param nelts The number of entries to make room for up front
+ * @return The hash table just created
+ * @remark With a non-zero key_size, all the keys are key_size bytes long
+ *         and the klen arguments of apr_flathash_get() and
+ *         apr_flathash_set() are ignored.  The keys returned by
+ *         apr_flathash_this() then point into the table, and are only
+ *         valid until the table grows.
+ */
+APR_DECLARE(apr_flathash_t *) apr_flathash_make_ex(apr_pool_t *pool,
+                                                   apr_hashfunc_t hash_func,
+                                                   apr_size_t key_size,
+                                                   unsigned int nelts);
+
+/**
+ * Make a copy of a flat hash table
+ * @param pool The pool from which to allocate the new hash table
+ * @param h The hash table to clone
+ * @return The hash table just created
+ * @remark Makes a shallow copy (inline keys are copied, though)
+ */
+APR_DECLARE(apr_flathash_t *) apr_flathash_copy(apr_pool_t *pool,
+                                                const apr_flathash_t *h);
+
+/**
+ * Make room in a flat hash table for a number of entries
+ * @param ht The hash table
+ * @param nelts The number of entries the table should hold without growing
+ * @remark Growing is the only time a flat hash table allocates memory,
+ *         with the previous entries' array left to the pool.  Reserving
+ *         the final size up front avoids both the rehashing and the waste.
+ */
+APR_DECLARE(void) apr_flathash_reserve(apr_flathash_t *ht,
+                                       unsigned int nelts);
+
+/**
+ * Associate a value with a key in a flat hash table.
+ * @param ht The hash table
+ * @param key Pointer to the key
+ * @param klen Length of the key. Can be APR_HASH_KEY_STRING to use the string length.
+ * @param val Value to associate with the key
+ * @remark If the value is NULL the hash entry is deleted.
+ */
+APR_DECLARE(void) apr_flathash_set(apr_flathash_t *ht, const void *key,
+                                   apr_ssize_t klen, const void *val);
+
+/**
+ * Look up the value associated with a key in a flat hash table.
+ * @param ht The hash table
+ * @param key Pointer to the key
+ * @param klen Length of the key. Can be APR_HASH_KEY_STRING to use the string length.
+ * @return Returns NULL if the key is not present.
+ */
+APR_DECLARE(void *) apr_flathash_get(apr_flathash_t *ht, const void *key,
+                                     apr_ssize_t klen);
+
+/**
+ * Start iterating over the entries in a flat hash table.
+ * @param p The pool to allocate the apr_flathash_index_t iterator. If this
+ *          pool is NULL, then an internal, non-thread-safe iterator is used.
+ * @param ht The hash table
+ * @return The iteration state
+ * @remark Deleting the current entry during an iteration is safe, but
+ *         adding entries may make the table grow and the iteration skip
+ *         or repeat entries.
+ */
+APR_DECLARE(apr_flathash_index_t *) apr_flathash_first(apr_pool_t *p,
+                                                       apr_flathash_t *ht);
+
+/**
+ * Continue iterating over the entries in a flat hash table.
+ * @param hi The iteration state
+ * @return a pointer to the updated iteration state.  NULL if there are no more
+ *         entries.
+ */
+APR_DECLARE(apr_flathash_index_t *) apr_flathash_next(apr_flathash_index_t *hi);
+
+/**
+ * Get the current entry's details from the iteration state.
+ * @param hi The iteration state
+ * @param key Return pointer for the pointer to the key.
+ * @param klen Return pointer for the key length.
+ * @param val Return pointer for the associated value.
+ * @remark The return pointers should point to a variable that will be set to the
+ *         corresponding data, or they may be NULL if the data isn't interesting.
+ */
+APR_DECLARE(void) apr_flathash_this(apr_flathash_index_t *hi,
+                                    const void **key, apr_ssize_t *klen,
+                                    void **val);
+
+/**
+ * Get the current entry's key from the iteration state.
+ * @param hi The iteration state
+ * @return The pointer to the key
+ */
+APR_DECLARE(const void *) apr_flathash_this_key(apr_flathash_index_t *hi);
+
+/**
+ * Get the current entry's key length from the iteration state.
+ * @param hi The iteration state
+ * @return The key length
+ */
+APR_DECLARE(apr_ssize_t) apr_flathash_this_key_len(apr_flathash_index_t *hi);
+
+/**
+ * Get the current entry's value from the iteration state.
+ * @param hi The iteration state
+ * @return The pointer to the value
+ */
+APR_DECLARE(void *) apr_flathash_this_val(apr_flathash_index_t *hi);
+
+/**
+ * Get the number of key/value pairs in the flat hash table.
+ * @param ht The hash table
+ * @return The number of key/value pairs in the hash table.
+ */
+APR_DECLARE(unsigned int) apr_flathash_count(apr_flathash_t *ht);
+
+/**
+ * Clear any key/value pairs in the flat hash table.
+ * @param ht The hash table
+ * @remark The table keeps its size.
+ */
+APR_DECLARE(void) apr_flathash_clear(apr_flathash_t *ht);
+
+/**
+ * Iterate over a flat hash table running the provided function once for
+ * every element in the hash table.
+ * @param comp The function to run
+ * @param rec The data to pass as the first argument to the function
+ * @param ht The hash table to iterate over
+ * @return FALSE if one of the comp() iterations returned zero; TRUE if all
+ *            iterations returned non-zero
+ * @see apr_hash_do_callback_fn_t
+ */
+APR_DECLARE(int) apr_flathash_do(apr_hash_do_callback_fn_t *comp,
+                                 void *rec, const apr_flathash_t *ht);
+
+/**
+ * Get a pointer to the pool which the flat hash table was created in
+ */
+APR_POOL_DECLARE_ACCESSOR(flathash);
+
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* !APR_FLATHASH_H */
@@ -26,6 +26,21 @@
  */
 
 #include "apr.h"
+
+/**
+ * Alignment macros
+ */
+
+/* APR_ALIGN() is only to be used to align on a power of 2 boundary */
+#define APR_ALIGN(size, boundary) \
+    (((size) + ((boundary) - 1)) & ~((boundary) - 1))
+
+/** Default alignment */
+#define APR_ALIGN_DEFAULT(size) APR_ALIGN(size, 8)
+
+/* The alignment macros come before apr_pools.h, whose inline
+ * apr_palloc() needs them whichever header is included first.
+ */
 #include "apr_pools.h"
 #include "apr_errno.h"
 
@@ -131,17 +146,6 @@ int strncasecmp(const char *a, const char *b, size_t n);
 
 #endif
 
-/**
- * Alignment macros
- */
-
-/* APR_ALIGN() is only to be used to align on a power of 2 boundary */
-#define APR_ALIGN(size, boundary) \
-    (((size) + ((boundary) - 1)) & ~((boundary) - 1))
-
-/** Default alignment */
-#define APR_ALIGN_DEFAULT(size) APR_ALIGN(size, 8)
-
 
 /**
  * String and memory functions
@@ -70,6 +70,30 @@ typedef unsigned int (*apr_hashfunc_t)(const char *key, apr_ssize_t *klen);
 APR_DECLARE_NONSTD(unsigned int) apr_hashfunc_default(const char *key,
                                                       apr_ssize_t *klen);
 
+/**
+ * SipHash-1-3 hash function, keyed with a random secret of the process.
+ * @remark It hashes 8 bytes per step, and the secret makes it hard to
+ *         craft keys colliding in a hash table, so this is the one to use
+ *         for tables keyed by untrusted input.
+ * @remark To be passed to apr_hash_make_custom().  Like any custom hash
+ *         function, it ignores the seed of the table.
+ * @see apr_hashfunc_t
+ */
+APR_DECLARE_NONSTD(unsigned int) apr_hashfunc_siphash(const char *key,
+                                                      apr_ssize_t *klen);
+
+/**
+ * CRC32C hash function, seeded with a random secret of the process.
+ * @remark Uses the SSE4.2 CRC32 instruction when the CPU has it, which
+ *         makes it the fastest hash function here for long keys.  CRCs
+ *         are linear though, the seed does not prevent crafting colliding
+ *         keys: use apr_hashfunc_siphash() for untrusted input.
+ * @remark To be passed to apr_hash_make_custom().
+ * @see apr_hashfunc_t
+ */
+APR_DECLARE_NONSTD(unsigned int) apr_hashfunc_crc32c(const char *key,
+                                                     apr_ssize_t *klen);
+
 /**
  * Create a hash table.
  * @param pool The pool to allocate the hash table out of
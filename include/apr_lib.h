@@ -27,6 +27,7 @@
 
 #include "apr.h"
 #include "apr_errno.h"
+#include "apr_pools.h"
 
 #if APR_HAVE_CTYPE_H
 #include <ctype.h>
@@ -175,6 +176,47 @@ APR_DECLARE(int) apr_vformatter(int (*flush_func)(apr_vformatter_buff_t *b),
 			        apr_vformatter_buff_t *c, const char *fmt,
 			        va_list ap);
 
+/** @see apr_format_compile */
+typedef struct apr_format_t apr_format_t;
+
+/**
+ * Precompile a format string for apr_format_apply().
+ * @param p The pool from which to allocate the compiled format
+ * @param fmt The format string, in apr_vformatter() syntax
+ * @return The compiled format
+ * @remark The conversions (with their flags, width and precision) and the
+ * runs of literal characters between them are parsed once here, instead of
+ * at each apr_vformatter() call, for the formats used over and over.  The
+ * format string is copied.
+ */
+APR_DECLARE(const apr_format_t *) apr_format_compile(apr_pool_t *p,
+                                                     const char *fmt);
+
+/**
+ * apr_format_apply() is apr_vformatter() for a precompiled format.
+ * @param flush_func The function to call when the buffer is full
+ * @param c The buffer to write to
+ * @param format The format, from apr_format_compile()
+ * @param ap The arguments to use to fill out the format string.
+ * @return The number of bytes written, or -1 if flush_func failed
+ * @see apr_vformatter
+ */
+APR_DECLARE(int) apr_format_apply(int (*flush_func)(apr_vformatter_buff_t *b),
+                                  apr_vformatter_buff_t *c,
+                                  const apr_format_t *format, va_list ap);
+
+/**
+ * apr_snprintf() for a precompiled format.
+ * @param buf The buffer to write to
+ * @param len The size of the buffer
+ * @param format The format, from apr_format_compile()
+ * @param ... The arguments to use to fill out the format string.
+ * @return The number of bytes which would have been written, like
+ *         apr_snprintf()
+ */
+APR_DECLARE_NONSTD(int) apr_format_snprintf(char *buf, apr_size_t len,
+                                            const apr_format_t *format, ...);
+
 /**
  * Display a prompt and read in the password from stdin.
  * @param prompt The prompt to display
@@ -424,8 +424,56 @@ APR_DECLARE(void *) apr_palloc_debug(apr_pool_t *p, apr_size_t size,
 #if APR_POOL_DEBUG
 #define apr_palloc(p, size) \
     apr_palloc_debug(p, size, APR_POOL__FILE_LINE__)
+#elif APR_HAS_POOL_INLINE && APR_HAS_INLINE && !defined(DOXYGEN)
+
+/**
+ * The leading member of apr_pool_t, relied on by apr_palloc_inline()
+ * @internal
+ */
+typedef struct apr_pool_head_t {
+    apr_memnode_t *active;      /**< the memnode allocations are made from */
+} apr_pool_head_t;
+
+/**
+ * Allocate from the active memnode of the pool when the block fits in,
+ * fall back to apr_palloc() otherwise
+ * @internal
+ */
+static APR_INLINE void *apr_palloc_inline(apr_pool_t *p, apr_size_t size)
+{
+    apr_memnode_t *active = ((apr_pool_head_t *)p)->active;
+
+    /* The free space is a multiple of the default alignment, so the
+     * aligned size fits too (and can't overflow).
+     */
+    if (size < (apr_size_t)(active->endp - active->first_avail)) {
+        void *mem = active->first_avail;
+        active->first_avail += APR_ALIGN_DEFAULT(size);
+        return mem;
+    }
+
+    return (apr_palloc)(p, size);
+}
+
+#define apr_palloc(p, size) apr_palloc_inline(p, size)
 #endif
 
+/**
+ * Allocate a block of memory from a pool, aligned on the given boundary
+ * @param p The pool to allocate from
+ * @param size The amount of memory to allocate
+ * @param align The alignment, a power of two
+ * @return The allocated memory, or NULL if align is not a power of two
+ * @remark Only the padding needed to align the block is consumed when it
+ *         fits in the pool's current block of memory.
+ */
+APR_DECLARE(void *) apr_palloc_aligned(apr_pool_t *p, apr_size_t size,
+                                       apr_size_t align)
+#if defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 4))
+                    __attribute__((alloc_size(2)))
+#endif
+                    __attribute__((nonnull(1)));
+
 /**
  * Allocate a block of memory from a pool and set all of the memory to 0
  * @param p The pool to allocate from
@@ -509,6 +557,71 @@ APR_DECLARE(int) apr_pool_is_ancestor(apr_pool_t *a, apr_pool_t *b);
 APR_DECLARE(void) apr_pool_tag(apr_pool_t *pool, const char *tag)
                   __attribute__((nonnull(1)));
 
+/** Pool statistics, @see apr_pool_stats_get() */
+typedef struct apr_pool_stats_t {
+    /** The number of pools accounted for */
+    apr_size_t pools;
+    /** The number of memory blocks held */
+    apr_size_t nodes;
+    /** Bytes of memory held */
+    apr_size_t size;
+    /** Bytes of memory used, including the bookkeeping overhead */
+    apr_size_t used;
+    /** The number of allocations which did not fit the active block */
+    apr_size_t slow_allocs;
+} apr_pool_stats_t;
+
+/**
+ * Get the statistics of a pool
+ * @param stats The statistics
+ * @param pool The pool to inspect
+ * @param recurse Recurse/include the subpools' statistics
+ * @remark When recursing, no pool of the tree may be destroyed concurrently
+ *         by another thread, unless it shares the allocator of @a pool.
+ * @remark With APR_POOL_DEBUG every allocation is a block of its own.
+ */
+APR_DECLARE(void) apr_pool_stats_get(apr_pool_stats_t *stats,
+                                     apr_pool_t *pool, int recurse)
+                  __attribute__((nonnull(1,2)));
+
+
+/** A checkpoint of a pool, @see apr_pool_mark() */
+typedef struct apr_pool_mark_t {
+    void *node;         /**< the block active when marked @internal */
+    apr_size_t offset;  /**< the position in that block @internal */
+} apr_pool_mark_t;
+
+/**
+ * Record the current allocation point of a pool
+ * @param pool The pool
+ * @param mark The mark to fill in
+ * @remark The memory allocated from the pool after the mark can be
+ *         released at once with apr_pool_rollback(), without creating
+ *         a subpool nor going through the allocator.
+ * @remark Marks nest: they must be rolled back in the reverse order they
+ *         were taken.  Each mark must eventually be rolled back unless
+ *         the pool is cleared or destroyed: while a mark is outstanding
+ *         the pool does not reuse the partially used blocks it holds.
+ */
+APR_DECLARE(void) apr_pool_mark(apr_pool_t *pool, apr_pool_mark_t *mark)
+                  __attribute__((nonnull(1,2)));
+
+/**
+ * Release the memory allocated from a pool since a mark
+ * @param pool The pool the mark was taken on
+ * @param mark The mark, as filled in by apr_pool_mark()
+ * @remark The blocks obtained since the mark are kept by the pool for
+ *         its next allocations, they are not given back to the allocator.
+ * @remark Only memory is released: the cleanups, subpools and user data
+ *         registered since the mark are left untouched, so none of them
+ *         may refer to the released memory.
+ * @remark With valgrind the memory is not reclaimed, to keep valgrind's
+ *         view of the pool accurate.
+ */
+APR_DECLARE(void) apr_pool_rollback(apr_pool_t *pool,
+                                    const apr_pool_mark_t *mark)
+                  __attribute__((nonnull(1,2)));
+
 
 /*
  * User data management
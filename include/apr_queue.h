@@ -56,6 +56,29 @@ APR_DECLARE(apr_status_t) apr_queue_create(apr_queue_t **queue,
                                            unsigned int queue_capacity, 
                                            apr_pool_t *a);
 
+/** Create a lock-free queue, @see apr_queue_create_ex() */
+#define APR_QUEUE_LOCKFREE 0x01
+
+/**
+ * create a FIFO queue with options
+ * @param queue The new queue
+ * @param queue_capacity maximum size of the queue
+ * @param flags 0 or APR_QUEUE_LOCKFREE
+ * @param a pool to allocate queue from
+ * @returns APR_EINVAL if a lock-free queue is asked with a capacity
+ *          of 0 or above 2^31
+ * @remark With APR_QUEUE_LOCKFREE, the elements are pushed and popped
+ *         with atomic operations only, the mutex and condition variables
+ *         of the queue being used to block when it is actually full or
+ *         empty.  The capacity is rounded up to the next power of two.
+ *         apr_queue_push() and apr_queue_pop() return APR_EINTR only
+ *         when interrupted by apr_queue_interrupt_all().
+ */
+APR_DECLARE(apr_status_t) apr_queue_create_ex(apr_queue_t **queue,
+                                              unsigned int queue_capacity,
+                                              apr_uint32_t flags,
+                                              apr_pool_t *a);
+
 /**
  * push/add an object to the queue, blocking if the queue is already full
  *
@@ -0,0 +1,226 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef APR_RADIX_H
+#define APR_RADIX_H
+
+/**
+ * @file apr_radix.h
+ * @brief APR Radix Trees
+ */
+
+#include "apr_pools.h"
+#include "apr_network_io.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup apr_radix Radix Trees
+ * @ingroup APR
+ * @{
+ */
+
+/**
+ * When passing a key to the apr_radix functions taking a length in bytes,
+ * this value can be passed to indicate a string-valued key, and have
+ * apr_radix compute the length automatically (NUL terminator excluded).
+ */
+#define APR_RADIX_KEY_STRING     (-1)
+
+/**
+ * Abstract type for radix trees.
+ *
+ * A radix tree maps keys, which are strings of bits, to values, and finds
+ * the value of the longest key which is a prefix of a given one in a time
+ * proportional to the length of that key, whatever the number of keys.
+ * The tree is compressed (each node is where keys diverge), and the keys
+ * are copied in the tree.
+ */
+typedef struct apr_radix_t apr_radix_t;
+
+/**
+ * Create a radix tree.
+ * @param pool The pool to allocate the radix tree out of
+ * @return The radix tree just created
+ */
+APR_DECLARE(apr_radix_t *) apr_radix_make(apr_pool_t *pool);
+
+/**
+ * Associate a value with a key in a radix tree.
+ * @param t The radix tree
+ * @param key Pointer to the key
+ * @param klen Length of the key in bytes. Can be APR_RADIX_KEY_STRING to
+ *        use the string length.
+ * @param val Value to associate with the key
+ * @remark If the value is NULL the key is deleted.
+ * @remark A new key is copied in the pool of the tree, this memory is not
+ *         reused when the key is deleted.
+ */
+APR_DECLARE(void) apr_radix_set(apr_radix_t *t, const void *key,
+                                apr_ssize_t klen, const void *val);
+
+/**
+ * Look up the value associated with a key in a radix tree.
+ * @param t The radix tree
+ * @param key Pointer to the key
+ * @param klen Length of the key in bytes. Can be APR_RADIX_KEY_STRING to
+ *        use the string length.
+ * @return Returns NULL if the key is not present.
+ */
+APR_DECLARE(void *) apr_radix_get(apr_radix_t *t, const void *key,
+                                  apr_ssize_t klen);
+
+/**
+ * Look up the value associated with the longest key of a radix tree
+ * which is a prefix of a given key.
+ * @param t The radix tree
+ * @param key Pointer to the key
+ * @param klen Length of the key in bytes. Can be APR_RADIX_KEY_STRING to
+ *        use the string length.
+ * @param plen If not NULL, set to the length of the matching key in bytes
+ * @return Returns NULL if no key is a prefix of key.
+ * @remark The keys are matched byte per byte, so for instance the key
+ *         "/a" matches "/abc" too, not only "/a/bc".
+ */
+APR_DECLARE(void *) apr_radix_longest_prefix(apr_radix_t *t, const void *key,
+                                             apr_ssize_t klen,
+                                             apr_size_t *plen);
+
+/**
+ * Associate a value with a key of any number of bits in a radix tree.
+ * @param t The radix tree
+ * @param key Pointer to the key, with the bits in network order (from the
+ *        most significant bit of the first byte)
+ * @param bits Length of the key in bits
+ * @param val Value to associate with the key
+ * @remark If the value is NULL the key is deleted.
+ */
+APR_DECLARE(void) apr_radix_set_bits(apr_radix_t *t, const void *key,
+                                     apr_size_t bits, const void *val);
+
+/**
+ * Look up the value associated with a key of any number of bits in a
+ * radix tree.
+ * @param t The radix tree
+ * @param key Pointer to the key
+ * @param bits Length of the key in bits
+ * @return Returns NULL if the key is not present.
+ */
+APR_DECLARE(void *) apr_radix_get_bits(apr_radix_t *t, const void *key,
+                                       apr_size_t bits);
+
+/**
+ * Look up the value associated with the longest key of a radix tree
+ * which is a prefix of a given key of any number of bits.
+ * @param t The radix tree
+ * @param key Pointer to the key
+ * @param bits Length of the key in bits
+ * @param pbits If not NULL, set to the length of the matching key in bits
+ * @return Returns NULL if no key is a prefix of key.
+ */
+APR_DECLARE(void *) apr_radix_longest_prefix_bits(apr_radix_t *t,
+                                                  const void *key,
+                                                  apr_size_t bits,
+                                                  apr_size_t *pbits);
+
+/**
+ * Associate a value with an IP subnet in a radix tree.
+ * @param t The radix tree
+ * @param sa The address of the subnet (IPv4 or IPv6)
+ * @param prefix The length of the subnet's prefix in bits, or -1 for the
+ *        whole address
+ * @param val Value to associate with the subnet
+ * @return APR_EINVAL if the address is not IPv4 or IPv6, or the prefix is
+ *         longer than the address
+ * @remark If the value is NULL the subnet is deleted.  The bits of the
+ *         address after the prefix are ignored.
+ * @remark Like with apr_ipsubnet_test(), an IPv4 subnet matches IPv4
+ *         addresses and IPv4-mapped IPv6 addresses (::ffff:a.b.c.d), but an
+ *         IPv6 subnet only matches IPv6 addresses.
+ */
+APR_DECLARE(apr_status_t) apr_radix_set_addr(apr_radix_t *t,
+                                             const apr_sockaddr_t *sa,
+                                             int prefix, const void *val);
+
+/**
+ * Look up the value associated with the most specific subnet of a radix
+ * tree which contains an IP address.
+ * @param t The radix tree
+ * @param sa The IP address
+ * @param prefix If not NULL, set to the prefix length of the matching
+ *        subnet in bits
+ * @return Returns NULL if no subnet contains the address.
+ * @see apr_radix_set_addr()
+ */
+APR_DECLARE(void *) apr_radix_longest_prefix_addr(apr_radix_t *t,
+                                                  const apr_sockaddr_t *sa,
+                                                  int *prefix);
+
+/**
+ * Get the number of keys in the radix tree.
+ * @param t The radix tree
+ * @return The number of keys in the radix tree.
+ */
+APR_DECLARE(unsigned int) apr_radix_count(apr_radix_t *t);
+
+/**
+ * Clear all the keys in the radix tree.
+ * @param t The radix tree
+ */
+APR_DECLARE(void) apr_radix_clear(apr_radix_t *t);
+
+/**
+ * Declaration prototype for the iterator callback function of apr_radix_do().
+ *
+ * @param rec The data passed as the first argument to apr_radix_do()
+ * @param key The key from this iteration of the radix tree
+ * @param bits The key length in bits
+ * @param value The value from this iteration of the radix tree
+ * @remark Iteration continues while this callback function returns non-zero.
+ * To export the callback function for apr_radix_do() it must be declared
+ * in the _NONSTD convention.
+ */
+typedef int (apr_radix_do_callback_fn_t)(void *rec, const void *key,
+                                         apr_size_t bits, const void *value);
+
+/**
+ * Iterate over a radix tree running the provided function once for every
+ * key in the tree, in the order of the keys (bitwise, a key coming before
+ * the longer ones it's a prefix of).
+ * @param comp The function to run
+ * @param rec The data to pass as the first argument to the function
+ * @param t The radix tree to iterate over
+ * @return FALSE if one of the comp() iterations returned zero; TRUE if all
+ *            iterations returned non-zero
+ * @see apr_radix_do_callback_fn_t
+ */
+APR_DECLARE(int) apr_radix_do(apr_radix_do_callback_fn_t *comp,
+                              void *rec, const apr_radix_t *t);
+
+/**
+ * Get a pointer to the pool which the radix tree was created in
+ */
+APR_POOL_DECLARE_ACCESSOR(radix);
+
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* !APR_RADIX_H */
@@ -84,6 +84,10 @@ APR_DECLARE(void *) apr_skiplist_alloc(apr_skiplist *sl, size_t size);
  * to operations on the skip list or to other calls to apr_skiplist_alloc().
  * Otherwise, memory will be freed using the  C standard library heap
  * functions.
+ * @warning mem must have been returned by apr_skiplist_alloc() for the
+ * same skip list, and not be freed already: a pooled skip list finds the
+ * free list from a header in front of the memory, so unlike with APR 1.x
+ * any other pointer is no longer ignored but corrupts the skip list.
  */
 APR_DECLARE(void) apr_skiplist_free(apr_skiplist *sl, void *mem);
 
@@ -96,6 +100,39 @@ APR_DECLARE(void) apr_skiplist_free(apr_skiplist *sl, void *mem);
  */
 APR_DECLARE(apr_status_t) apr_skiplist_init(apr_skiplist **sl, apr_pool_t *p);
 
+/**
+ * Flag for apr_skiplist_init_ex(): the skip list can be searched and
+ * walked while it is modified by other threads.
+ */
+#define APR_SKIPLIST_CONCURRENT 0x1
+
+/**
+ * Allocate a new skip list, with options
+ * @param sl The pointer in which to return the newly created skip list
+ * @param p The pool from which to allocate the skip list, mandatory with
+ *          APR_SKIPLIST_CONCURRENT
+ * @param flags Zero or APR_SKIPLIST_CONCURRENT
+ * @return APR_EINVAL if APR_SKIPLIST_CONCURRENT is given without a pool
+ * @remark With APR_SKIPLIST_CONCURRENT, apr_skiplist_find(),
+ * apr_skiplist_find_compare(), apr_skiplist_getlist(), apr_skiplist_next()
+ * and apr_skiplist_peek() take no lock and never wait for the threads
+ * inserting or removing elements, which only wait for each other.  The
+ * nodes of the removed elements are recycled once no search or walk is
+ * in progress, so an iterator kept by a thread between two calls may be
+ * moved elsewhere in the list if its element is removed meanwhile, but
+ * it always points to valid memory.  The elements themselves are freed
+ * (myfree) as soon as they are removed, though, outside of the lock so
+ * that myfree can use the skip list.
+ * @remark Even with APR_SKIPLIST_CONCURRENT, apr_skiplist_set_compare(),
+ * apr_skiplist_add_index(), apr_skiplist_remove_all(), apr_skiplist_merge()
+ * and apr_skiplist_destroy() must not be called concurrently with any
+ * other function on the skip list, and apr_skiplist_previous() may see
+ * an element which was just removed.
+ */
+APR_DECLARE(apr_status_t) apr_skiplist_init_ex(apr_skiplist **sl,
+                                               apr_pool_t *p,
+                                               unsigned int flags);
+
 /**
  * Set the comparison functions to be used for searching the skip list.
  * @param sl The skip list
@@ -152,6 +189,46 @@ APR_DECLARE(void *) apr_skiplist_find_compare(apr_skiplist *sl,
  */
 APR_DECLARE(void *) apr_skiplist_find(apr_skiplist *sl, void *data, apr_skiplistnode **iter);
 
+/**
+ * Return the first element in the skip list which is not less than the
+ * given value, using the current comparison function.
+ * @param sl The skip list
+ * @param data The value to search for
+ * @param iter A pointer to the returned skip list node representing the element
+ * found (NULL if none)
+ * @remark Unlike apr_skiplist_find(), this returns the first of the
+ * elements equal to data, if any, and the element which would follow
+ * data otherwise.
+ */
+APR_DECLARE(void *) apr_skiplist_lower_bound(apr_skiplist *sl, void *data,
+                                             apr_skiplistnode **iter);
+
+/**
+ * Return the elements in the skip list which are between two values
+ * (included and excluded respectively), using the current comparison
+ * function.
+ * @param sl The skip list
+ * @param lo The lower bound of the range, or NULL for no lower bound
+ * @param hi The upper bound of the range, or NULL for no upper bound
+ * @param iter A pointer to the returned skip list node representing the
+ * first element in the range
+ * @param end A pointer to the returned skip list node following the last
+ * element in the range (NULL if that's the end of the list)
+ * @return The first element in the range, or NULL if the range is empty
+ * (*iter == *end)
+ * @remark The range is walked with apr_skiplist_next() until *iter is
+ * the end:
+ * @code
+ * for (e = apr_skiplist_range(sl, lo, hi, &iter, &end); iter != end;
+ *      e = apr_skiplist_next(sl, &iter)) {
+ *     ...
+ * }
+ * @endcode
+ */
+APR_DECLARE(void *) apr_skiplist_range(apr_skiplist *sl, void *lo, void *hi,
+                                       apr_skiplistnode **iter,
+                                       apr_skiplistnode **end);
+
 /**
  * Return the next element in the skip list.
  * @param sl The skip list
@@ -208,6 +285,22 @@ APR_DECLARE(apr_skiplistnode *) apr_skiplist_add(apr_skiplist* sl, void *data);
  */
 APR_DECLARE(apr_skiplistnode *) apr_skiplist_insert(apr_skiplist* sl, void *data);
 
+/**
+ * Load sorted elements into an empty skip list.
+ * @param sl The skip list
+ * @param data The elements, sorted according to the current comparison
+ * function (duplicates are kept, in order)
+ * @param n The number of elements
+ * @return APR_EINVAL if the skip list is not empty or the elements are
+ * not sorted, APR_ENOMEM if a node can't be allocated (the elements
+ * loaded so far are kept)
+ * @remark The levels are built from the bottom up while appending the
+ * elements, which takes O(n) rather than the O(n log n) of n calls to
+ * apr_skiplist_add().
+ */
+APR_DECLARE(apr_status_t) apr_skiplist_bulk_load(apr_skiplist *sl,
+                                                 void **data, size_t n);
+
 /**
  * Remove an element from the skip list using the specified comparison function for
  * locating the element.
@@ -70,9 +70,107 @@ APR_DECLARE(const char *) apr_strmatch(const apr_strmatch_pattern *pattern,
  * @param s The pattern string
  * @param case_sensitive Whether the matching should be case-sensitive
  * @return a pointer to the compiled pattern, or NULL if compilation fails
+ * @remark Where the compiler and the CPU support it (SSE2 or AVX2 on x86),
+ *         the pattern is searched for with SIMD instructions instead, for
+ *         the same results.
  */
 APR_DECLARE(const apr_strmatch_pattern *) apr_strmatch_precompile(apr_pool_t *p, const char *s, int case_sensitive);
 
+/**
+ * Precompiled set of search patterns, searched for all at once
+ * @see apr_strmatch_multi_precompile
+ */
+typedef struct apr_strmatch_multi_t apr_strmatch_multi_t;
+
+/**
+ * State of a search of a multi pattern in a stream, carried from one
+ * buffer to the next. Zero it (or use apr_strmatch_multi_state_init())
+ * before the first buffer.
+ */
+typedef struct apr_strmatch_multi_state_t {
+    /** State of the automaton */
+    apr_uint32_t node;
+    /** Offset in the stream of the next buffer */
+    apr_off_t offset;
+} apr_strmatch_multi_state_t;
+
+/**
+ * Callback function for the matches of apr_strmatch_multi_exec().
+ * @param rec The data passed to apr_strmatch_multi_exec()
+ * @param id The index of the pattern matched in the array passed to
+ *        apr_strmatch_multi_precompile()
+ * @param offset The offset in the stream where the match starts, possibly
+ *        in a previous buffer
+ * @return Non-zero to continue the search, zero to stop it
+ */
+typedef int (apr_strmatch_multi_callback_fn_t)(void *rec, int id,
+                                               apr_off_t offset);
+
+/**
+ * Precompile a set of patterns for matching them all in one pass with the
+ * Aho-Corasick algorithm
+ * @param p The pool from which to allocate the multi pattern
+ * @param patterns The pattern strings, which must not be empty
+ * @param npatterns The number of patterns
+ * @param case_sensitive Whether the matching should be case-sensitive
+ * @return a pointer to the compiled multi pattern, or NULL if compilation
+ *         fails (no patterns or an empty one)
+ * @remark The patterns are compiled into a table of the next state for
+ *         each state and each class of bytes (the bytes which are not in
+ *         any pattern being all in the same class), with 16-bit states
+ *         when they fit, so the search takes a lookup per byte whatever
+ *         the number of patterns.
+ */
+APR_DECLARE(const apr_strmatch_multi_t *) apr_strmatch_multi_precompile(
+                                              apr_pool_t *p,
+                                              const char * const *patterns,
+                                              int npatterns,
+                                              int case_sensitive);
+
+/**
+ * Search for the first match of a multi pattern within a string
+ * @param multi The multi pattern
+ * @param s The string in which to search for the patterns
+ * @param slen The length of s (excluding null terminator)
+ * @param id If not NULL, set to the index of the matched pattern
+ * @return A pointer to the first match in s, or NULL if not found
+ * @remark The first match is the one ending first, the longest pattern
+ *         of the ones ending at the same position.
+ */
+APR_DECLARE(const char *) apr_strmatch_multi_first(
+                                              const apr_strmatch_multi_t *multi,
+                                              const char *s, apr_size_t slen,
+                                              int *id);
+
+/**
+ * Initialize the state of a search of a multi pattern in a stream
+ * @param state The state
+ */
+APR_DECLARE(void) apr_strmatch_multi_state_init(
+                                          apr_strmatch_multi_state_t *state);
+
+/**
+ * Search for all the matches of a multi pattern within a buffer of a
+ * stream, including the ones starting in the previous buffers
+ * @param multi The multi pattern
+ * @param state The state of the search, updated for the next buffer
+ * @param s The buffer in which to search for the patterns
+ * @param slen The length of s
+ * @param comp The function to call for each match, in the order of their
+ *        ends (the longest pattern first for the same end)
+ * @param rec The data to pass as the first argument to the function
+ * @return FALSE if one of the comp() calls returned zero; TRUE otherwise
+ * @remark When stopped, the state is after the end of the last match (its
+ *         offset tells how much of the buffer was searched), so the search
+ *         can be resumed with the rest of the buffer, but the other matches
+ *         ending at the same position are skipped.
+ */
+APR_DECLARE(int) apr_strmatch_multi_exec(const apr_strmatch_multi_t *multi,
+                                         apr_strmatch_multi_state_t *state,
+                                         const char *s, apr_size_t slen,
+                                         apr_strmatch_multi_callback_fn_t *comp,
+                                         void *rec);
+
 /** @} */
 #ifdef __cplusplus
 }
@@ -88,6 +88,13 @@ struct apr_table_entry_t {
 
     /** A checksum for the key, for use by the apr_table internals */
     apr_uint32_t key_checksum;
+    /** A hash of the whole key, for use by the apr_table internals
+     *  @remark Added in APR 2.0, which changes the size of the entries on
+     *  32-bit platforms (ABI break).  Like key_checksum, it's computed
+     *  when the entry is added, so the key must not be changed other than
+     *  by the apr_table functions.
+     */
+    apr_uint32_t key_hash;
 };
 
 /**
@@ -121,15 +128,60 @@ APR_DECLARE(int) apr_is_empty_array(const apr_array_header_t *a);
 APR_DECLARE(apr_array_header_t *) apr_array_make(apr_pool_t *p,
                                                  int nelts, int elt_size);
 
+/**
+ * Create an array whose elements are taken from an allocator.
+ * @param p The pool to allocate the array header out of, and whose
+ *          cleanup gives the elements back to the allocator
+ * @param nelts the number of elements in the initial array
+ * @param elt_size The size of each element in the array.
+ * @param allocator The allocator to take the elements from, or NULL for
+ *                  the one of the pool
+ * @return The new array
+ * @remark Unlike the elements of an array made by apr_array_make(), which
+ *         are left to the pool each time the array grows, the previous
+ *         elements are given back to the allocator (for reuse by any pool
+ *         or array using it), so that a big array growing in a long-lived
+ *         pool does not waste as much memory as it needs.
+ * @remark An array made by apr_array_copy_hdr() from such an array is
+ *         only valid until the array grows or its pool is cleared.  So is
+ *         a copy of the header, which grows out of the pool.
+ */
+APR_DECLARE(apr_array_header_t *) apr_array_make_ex(apr_pool_t *p,
+                                                    int nelts, int elt_size,
+                                                    apr_allocator_t *allocator);
+
+/**
+ * Make room in an array for a number of elements.
+ * @param arr The array
+ * @param nelts The total number of elements the array should hold without
+ *              growing
+ * @remark Reserving the final size up front saves the intermediate
+ *         allocations (and copies) of a growing array.
+ */
+APR_DECLARE(void) apr_array_reserve(apr_array_header_t *arr, int nelts);
+
 /**
  * Add a new element to an array (as a first-in, last-out stack).
  * @param arr The array to add an element to.
- * @return Location for the new element in the array.
+ * @return Location for the new element in the array, or NULL if the array
+ *         could not grow (once the abort function of its pool returned).
  * @remark If there are no free spots in the array, then this function will
  *         allocate new space for the new element.
+ * @remark Before APR 2.0 this never returned NULL, the callers of pools
+ *         whose abort function returns must now check it.
  */
 APR_DECLARE(void *) apr_array_push(apr_array_header_t *arr);
 
+/**
+ * Add a number of new elements to an array.
+ * @param arr The array to add the elements to.
+ * @param nelts The number of elements to add.
+ * @return Location for the first new element in the array, the others
+ *         following it, or NULL if the array could not grow.
+ * @remark Unlike with apr_array_push(), the new elements are not zeroed.
+ */
+APR_DECLARE(void *) apr_array_push_n(apr_array_header_t *arr, int nelts);
+
 /** A helper macro for accessing a member of an APR array.
  *
  * @param ary the array
@@ -146,6 +198,7 @@ APR_DECLARE(void *) apr_array_push(apr_array_header_t *arr);
  * @param type the type of the objects stored in the array
  *
  * @return the location where the new object should be placed
+ * @remark The location is not checked, see apr_array_push().
  */
 #define APR_ARRAY_PUSH(ary,type) (*((type *)apr_array_push(ary)))
 
@@ -160,8 +213,8 @@ APR_DECLARE(void *) apr_array_pop(apr_array_header_t *arr);
 /**
  * Remove all elements from an array.
  * @param arr The array to remove all elements from.
- * @remark As the underlying storage is allocated from a pool, no
- * memory is freed by this operation, but is available for reuse.
+ * @remark No memory is freed by this operation, but is available for
+ * reuse.
  */
 APR_DECLARE(void) apr_array_clear(apr_array_header_t *arr);
 
@@ -222,6 +275,71 @@ APR_DECLARE(char *) apr_array_pstrcat(apr_pool_t *p,
 				      const apr_array_header_t *arr,
 				      const char sep);
 
+/**
+ * Declaration prototype for the comparison function of apr_array_sort()
+ * and apr_array_bsearch(), like qsort()'s.
+ * @param a The first element (or the key searched for)
+ * @param b The second element
+ * @return Less than, equal to, or greater than zero if a is respectively
+ *         less than, equal to, or greater than b
+ */
+typedef int (apr_array_compare_fn_t)(const void *a, const void *b);
+
+/**
+ * Sort the elements of an array.
+ * @param arr The array to sort
+ * @param cmp The comparison function
+ * @remark This is an introsort: a quicksort whose worst case is bounded
+ *         by switching to a heapsort, in O(n log n).  It is not stable.
+ */
+APR_DECLARE(void) apr_array_sort(apr_array_header_t *arr,
+                                 apr_array_compare_fn_t *cmp);
+
+#if APR_HAS_THREADS
+struct apr_thread_pool;
+
+/**
+ * Sort the elements of an array with the threads of a thread pool.
+ * @param arr The array to sort
+ * @param cmp The comparison function, called concurrently
+ * @param tp The thread pool
+ * @return APR_SUCCESS, or the error of scheduling the tasks, in which
+ *         case the array holds the same elements in no particular order
+ * @remark The array is cut in as many runs as the thread pool can have
+ *         threads, which are sorted by apr_array_sort() in parallel, then
+ *         merged two by two in parallel.  Small arrays are sorted by the
+ *         calling thread only.  The sort is not stable.
+ * @remark A temporary copy of the elements is allocated from a subpool of
+ *         the array's pool.
+ */
+APR_DECLARE(apr_status_t) apr_array_sort_parallel(apr_array_header_t *arr,
+                                                 apr_array_compare_fn_t *cmp,
+                                                 struct apr_thread_pool *tp);
+#endif
+
+/**
+ * Find the first element of a sorted array which is not less than a key.
+ * @param arr The array, sorted according to cmp
+ * @param key The key to search for
+ * @param cmp The comparison function, called with the key as first argument
+ * @return The index of the element, or arr->nelts if all the elements
+ *         are less than the key
+ */
+APR_DECLARE(int) apr_array_lower_bound(const apr_array_header_t *arr,
+                                       const void *key,
+                                       apr_array_compare_fn_t *cmp);
+
+/**
+ * Find an element equal to a key in a sorted array.
+ * @param arr The array, sorted according to cmp
+ * @param key The key to search for
+ * @param cmp The comparison function, called with the key as first argument
+ * @return The first element equal to the key, or NULL if none
+ */
+APR_DECLARE(void *) apr_array_bsearch(const apr_array_header_t *arr,
+                                      const void *key,
+                                      apr_array_compare_fn_t *cmp);
+
 /**
  * Make a new table.
  * @param p The pool to allocate the pool out of
@@ -304,6 +422,25 @@ APR_DECLARE(void) apr_table_set(apr_table_t *t, const char *key,
 APR_DECLARE(void) apr_table_setn(apr_table_t *t, const char *key,
                                  const char *val);
 
+/**
+ * Add a key/value pair of known lengths to a table.  If another element
+ * already exists with the same key, this will overwrite the old data.
+ * @param t The table to add the data to.
+ * @param key The key to use (case does not matter)
+ * @param klen The length of the key
+ * @param val The value to add
+ * @param vlen The length of the value
+ * @remark Like apr_table_setn(), but saves the table from measuring the
+ *         key: key and val must still be NUL-terminated, at klen and vlen
+ *         respectively.
+ * @warning When adding data, this function does not make a copy of the key or 
+ *          the value, so care should be taken to ensure that the values will 
+ *          not change after they have been added..
+ */
+APR_DECLARE(void) apr_table_setn_len(apr_table_t *t,
+                                     const char *key, apr_size_t klen,
+                                     const char *val, apr_size_t vlen);
+
 /**
  * Remove data from the table.
  * @param t The table to remove data from
@@ -360,6 +497,25 @@ APR_DECLARE(void) apr_table_add(apr_table_t *t, const char *key,
 APR_DECLARE(void) apr_table_addn(apr_table_t *t, const char *key,
                                  const char *val);
 
+/**
+ * Add data of known lengths to a table, regardless of whether there is
+ * another element with the same key.
+ * @param t The table to add to
+ * @param key The key to use
+ * @param klen The length of the key
+ * @param val The value to add.
+ * @param vlen The length of the value
+ * @remark Like apr_table_addn(), but saves the table from measuring the
+ *         key: key and val must still be NUL-terminated, at klen and vlen
+ *         respectively.
+ * @remark When adding data, this function does not make a copy of the key or the
+ *         value, so care should be taken to ensure that the values will not 
+ *         change after they have been added.
+ */
+APR_DECLARE(void) apr_table_addn_len(apr_table_t *t,
+                                     const char *key, apr_size_t klen,
+                                     const char *val, apr_size_t vlen);
+
 /**
  * Merge two tables into one new table.
  * @param p The pool to use for the new table
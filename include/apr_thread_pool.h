@@ -79,6 +79,36 @@ APR_DECLARE(apr_status_t) apr_thread_pool_create(apr_thread_pool_t **me,
                                                  apr_size_t max_threads,
                                                  apr_pool_t *pool);
 
+/** Let the workers steal each other's tasks, @see apr_thread_pool_create_ex() */
+#define APR_THREAD_POOL_WORK_STEALING 0x01
+
+/**
+ * Create a thread pool with options
+ * @param me The pointer in which to return the newly created apr_thread_pool
+ * object, or NULL if thread pool creation fails.
+ * @param init_threads The number of threads to be created initially, this number
+ * will also be used as the initial value for the maximum number of idle threads.
+ * @param max_threads The maximum number of threads that can be created
+ * @param flags 0 or APR_THREAD_POOL_WORK_STEALING
+ * @param pool The pool to use
+ * @return APR_SUCCESS if the thread pool was created successfully. Otherwise,
+ * the error code.
+ * @remark With APR_THREAD_POOL_WORK_STEALING, the tasks pushed by a task
+ * with apr_thread_pool_push() go to a queue of the thread running it, which
+ * takes the most recent one first when done and without locking the thread
+ * pool, while idle threads steal the oldest ones of the highest priority
+ * segment.  The priorities are then only honoured by segments of 64, and
+ * the local tasks of a thread are run before the ones of the thread pool's
+ * queue.  The tasks pushed by other threads and those of
+ * apr_thread_pool_top() and apr_thread_pool_schedule() go to the thread
+ * pool's queue as usual.
+ */
+APR_DECLARE(apr_status_t) apr_thread_pool_create_ex(apr_thread_pool_t **me,
+                                                    apr_size_t init_threads,
+                                                    apr_size_t max_threads,
+                                                    apr_uint32_t flags,
+                                                    apr_pool_t *pool);
+
 /**
  * Destroy the thread pool and stop all the threads
  * @return APR_SUCCESS if all threads are stopped.
@@ -99,6 +129,90 @@ APR_DECLARE(apr_status_t) apr_thread_pool_push(apr_thread_pool_t *me,
                                                void *param,
                                                apr_byte_t priority,
                                                void *owner);
+/** Opaque group of tasks, to wait for their completion */
+typedef struct apr_thread_pool_group apr_thread_pool_group_t;
+
+/**
+ * Create a group of tasks
+ * @param group The pointer in which to return the new group
+ * @param pool The pool to allocate the group from
+ * @return APR_SUCCESS if the group was created successfully. Otherwise,
+ * the error code.
+ * @remark A group can be waited for and reused any number of times, and
+ * with any number of thread pools.  A group of one task is a handle on it.
+ */
+APR_DECLARE(apr_status_t) apr_thread_pool_group_create(
+                                                apr_thread_pool_group_t **group,
+                                                apr_pool_t *pool);
+
+/**
+ * Schedule a task to the bottom of the tasks of same priority, as part of
+ * a group.
+ * @param me The thread pool
+ * @param func The task function
+ * @param param The parameter for the task function
+ * @param priority The priority of the task.
+ * @param owner Owner of this task.
+ * @param group The group of the task, may be NULL
+ * @return APR_SUCCESS if the task had been scheduled successfully
+ */
+APR_DECLARE(apr_status_t) apr_thread_pool_push_group(apr_thread_pool_t *me,
+                                                apr_thread_start_t func,
+                                                void *param,
+                                                apr_byte_t priority,
+                                                void *owner,
+                                                apr_thread_pool_group_t *group);
+
+/**
+ * Schedule tasks to the bottom of the tasks of same priority, at once.
+ * @param me The thread pool
+ * @param func The function of the tasks
+ * @param params The parameters of the tasks, one per task
+ * @param n The number of tasks
+ * @param priority The priority of the tasks.
+ * @param owner Owner of the tasks.
+ * @param group The group of the tasks, may be NULL
+ * @return APR_SUCCESS if the tasks had been scheduled successfully,
+ * APR_EINVAL if the group would have more than APR_UINT32_MAX pending tasks
+ * @remark The thread pool is locked once and its threads woken up at once
+ * for all the tasks.  On failure, some of the first tasks may have been
+ * scheduled nonetheless.
+ */
+APR_DECLARE(apr_status_t) apr_thread_pool_push_batch(apr_thread_pool_t *me,
+                                                apr_thread_start_t func,
+                                                void **params,
+                                                apr_size_t n,
+                                                apr_byte_t priority,
+                                                void *owner,
+                                                apr_thread_pool_group_t *group);
+
+/**
+ * Wait for all the tasks of a group to be done
+ * @param group The group
+ * @return APR_SUCCESS once all the tasks of the group have been run or
+ * cancelled by apr_thread_pool_tasks_cancel()
+ * @remark The tasks discarded by the destruction of their thread pool are
+ * never done.
+ */
+APR_DECLARE(apr_status_t) apr_thread_pool_group_wait(
+                                                apr_thread_pool_group_t *group);
+
+/**
+ * Check whether all the tasks of a group are done, without waiting
+ * @param group The group
+ * @return APR_SUCCESS if done, APR_INCOMPLETE otherwise
+ */
+APR_DECLARE(apr_status_t) apr_thread_pool_group_poll(
+                                                apr_thread_pool_group_t *group);
+
+/**
+ * Get the number of tasks of a group not done yet
+ * @param group The group
+ * @return The number of pending tasks
+ */
+APR_DECLARE(apr_size_t) apr_thread_pool_group_pending(
+                                                apr_thread_pool_group_t *group);
+
 /**
  * Schedule a task to be run after a delay
  * @param me The thread pool
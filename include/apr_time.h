@@ -87,6 +87,50 @@ typedef apr_int32_t apr_short_interval_time_t;
  */
 APR_DECLARE(apr_time_t) apr_time_now(void);
 
+/**
+ * @return the current time of a monotonic clock, in microseconds
+ * @remark Unlike apr_time_now(), this clock does not jump when the system
+ * time is set (by an administrator or NTP), so it is the one to use for
+ * timeouts and intervals.  Its origin is unspecified (e.g. the boot), so
+ * its values are only meaningful relatively to each other.
+ * @remark Where no monotonic clock is available, this is apr_time_now().
+ */
+APR_DECLARE(apr_time_t) apr_time_now_monotonic(void);
+
+/**
+ * @return the current time like apr_time_now(), from a cheaper clock of
+ * the resolution of the system tick (typically 1 to 10 milliseconds)
+ * @remark Where no such clock is available, this is apr_time_now().
+ */
+APR_DECLARE(apr_time_t) apr_time_now_coarse(void);
+
+/**
+ * @return the current time like apr_time_now_monotonic(), from a cheaper
+ * clock of the resolution of the system tick (typically 1 to 10
+ * milliseconds)
+ * @remark Where no such clock is available, this is
+ * apr_time_now_monotonic().
+ */
+APR_DECLARE(apr_time_t) apr_time_now_monotonic_coarse(void);
+
+/**
+ * @return the time of the last apr_time_tick_update(), from
+ * apr_time_now_monotonic_coarse()
+ * @remark This is only a (shared) memory read, for the applications
+ * timestamping a lot, where an event loop or a background thread updates
+ * the tick regularly.  The first call updates the tick if it was never.
+ */
+APR_DECLARE(apr_time_t) apr_time_tick(void);
+
+/**
+ * Update the tick returned by apr_time_tick() to the current time of
+ * apr_time_now_monotonic_coarse().
+ * @return the new tick
+ * @remark This is thread-safe, and the tick never goes back when updated
+ * by multiple threads.
+ */
+APR_DECLARE(apr_time_t) apr_time_tick_update(void);
+
 /** @see apr_time_exp_t */
 typedef struct apr_time_exp_t apr_time_exp_t;
 
@@ -189,6 +233,11 @@ APR_DECLARE(void) apr_sleep(apr_interval_time_t t);
  * including the trailing NUL terminator.
  * @param date_str String to write to.
  * @param t the time to convert 
+ * @remark The format is the one of RFC 1123 (with a four digit year),
+ * as used in HTTP headers.
+ * @remark The dates of the last seconds formatted are cached, so that
+ * formatting the current time again is merely a copy (the cache is shared
+ * by the threads, without locking).
  */
 APR_DECLARE(apr_status_t) apr_rfc822_date(char *date_str, apr_time_t t);
 
@@ -203,9 +252,26 @@ APR_DECLARE(apr_status_t) apr_rfc822_date(char *date_str, apr_time_t t);
  * a \\n at the end of the string.
  * @param date_str String to write to.
  * @param t the time to convert 
+ * @remark The dates of the last seconds formatted are cached, like
+ * with apr_rfc822_date().
  */
 APR_DECLARE(apr_status_t) apr_ctime(char *date_str, apr_time_t t);
 
+/** length of a common log format date */
+#define APR_COMMON_LOG_DATE_LEN (27)
+/**
+ * apr_common_log_date formats dates in local time in the format
+ * of the Common Log Format ("10/Oct/2000:13:55:36 -0700", without
+ * the brackets) in an efficient manner.  It is a fixed length format
+ * and requires APR_COMMON_LOG_DATE_LEN bytes of storage including
+ * the trailing NUL terminator.
+ * @param date_str String to write to.
+ * @param t the time to convert
+ * @remark The dates of the last seconds formatted are cached, like
+ * with apr_rfc822_date().
+ */
+APR_DECLARE(apr_status_t) apr_common_log_date(char *date_str, apr_time_t t);
+
 /**
  * Formats the exploded time according to the format specified
  * @param s string to write to
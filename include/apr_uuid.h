@@ -49,9 +49,47 @@ typedef struct {
 /**
  * Generate and return a (new) UUID
  * @param uuid The resulting UUID
+ * @remark The UUID comes from the system when it provides them, otherwise
+ * it is a version 1 (time-based) UUID with a random node.
+ * @remark This function is thread-safe, like the other generators.
  */ 
 APR_DECLARE(void) apr_uuid_get(apr_uuid_t *uuid);
 
+/**
+ * Generate and return a (new) version 4 (random) UUID
+ * @param uuid The resulting UUID
+ * @remark The random bits are pseudo-random, from a generator seeded once
+ * per process with apr_generate_random_bytes() and advanced atomically.
+ * They are unique within the process and unpredictable from one process
+ * to another, but not meant to be secret: a UUID is not a secure token.
+ */
+APR_DECLARE(void) apr_uuid_get_v4(apr_uuid_t *uuid);
+
+/**
+ * Generate and return a (new) version 7 (time-ordered) UUID
+ * @param uuid The resulting UUID
+ * @remark The UUID holds the time in milliseconds and its sub-millisecond
+ * fraction, so the UUIDs generated by a process sort in the order of
+ * their generation (the fraction being incremented when they are
+ * generated faster than the clock), followed by pseudo-random bits as for
+ * apr_uuid_get_v4().
+ */
+APR_DECLARE(void) apr_uuid_get_v7(apr_uuid_t *uuid);
+
+/**
+ * Generate and return a number of (new) UUIDs
+ * @param uuids The array of n UUIDs to fill
+ * @param n The number of UUIDs
+ * @param version 0 for the UUIDs of apr_uuid_get(), or 1 (time-based, not
+ *        from the system), 4 or 7 for the UUIDs of this version
+ * @return APR_EINVAL if the version is not supported, APR_SUCCESS otherwise
+ * @remark The timestamps and random bits of the UUIDs are reserved all at
+ * once, which is cheaper than generating them one by one when they are
+ * needed in bulk.
+ */
+APR_DECLARE(apr_status_t) apr_uuid_get_n(apr_uuid_t *uuids, apr_size_t n,
+                                         int version);
+
 /**
  * Format a UUID into a string, following the standard format
  * @param buffer The buffer to place the formatted UUID string into. It must
@@ -42,4 +42,17 @@
 #   define USE_ATOMICS_GENERIC
 #endif
 
+/* The 64-bit operations are mutex based (mutex64.c) where the backend
+ * has none of its own */
+#if defined(USE_ATOMICS_GENERIC) \
+    || (defined(USE_ATOMICS_BUILTINS) && !HAVE_ATOMIC_BUILTINS64) \
+    || (defined(USE_ATOMICS_IA32) && !defined(__x86_64__)) \
+    || defined(USE_ATOMICS_PPC) || defined(USE_ATOMICS_S390)
+#   define USE_ATOMICS_GENERIC64
+#endif
+
+#if defined(USE_ATOMICS_GENERIC64)
+apr_status_t apr__atomic_generic64_init(apr_pool_t *p);
+#endif
+
 #endif /* ATOMIC_H */
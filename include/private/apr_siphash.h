@@ -0,0 +1,153 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef APR_SIPHASH_H
+#define APR_SIPHASH_H
+
+/**
+ * @file apr_siphash.h
+ * @brief APR internal SipHash keyed pseudo-random function
+ */
+
+#include "apr.h"
+
+#if APR_HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/**
+ * @defgroup apr_siphash Internal SipHash
+ * @ingroup APR
+ * @{
+ */
+
+/**
+ * Load 8 bytes as a little-endian 64-bit word.
+ * @param p The bytes, not necessarily aligned
+ * @return The word
+ */
+static APR_INLINE apr_uint64_t apr__load64_le(const unsigned char *p)
+{
+    apr_uint64_t v;
+
+    memcpy(&v, p, sizeof(v));
+#if APR_IS_BIGENDIAN
+    v = ((v & APR_UINT64_C(0x00000000ffffffff)) << 32)
+        | ((v >> 32) & APR_UINT64_C(0x00000000ffffffff));
+    v = ((v & APR_UINT64_C(0x0000ffff0000ffff)) << 16)
+        | ((v >> 16) & APR_UINT64_C(0x0000ffff0000ffff));
+    v = ((v & APR_UINT64_C(0x00ff00ff00ff00ff)) << 8)
+        | ((v >> 8) & APR_UINT64_C(0x00ff00ff00ff00ff));
+#endif
+    return v;
+}
+
+#define APR__ROTL64(x, b) (((x) << (b)) | ((x) >> (64 - (b))))
+
+#define APR__SIPROUND(v0, v1, v2, v3)                           \
+    do {                                                        \
+        v0 += v1; v1 = APR__ROTL64(v1, 13); v1 ^= v0;           \
+        v0 = APR__ROTL64(v0, 32);                               \
+        v2 += v3; v3 = APR__ROTL64(v3, 16); v3 ^= v2;           \
+        v0 += v3; v3 = APR__ROTL64(v3, 21); v3 ^= v0;           \
+        v2 += v1; v1 = APR__ROTL64(v1, 17); v1 ^= v2;           \
+        v2 = APR__ROTL64(v2, 32);                               \
+    } while (0)
+
+/**
+ * SipHash-c-d of some bytes.
+ * @param k0 The first half of the 128-bit key
+ * @param k1 The second half of the 128-bit key
+ * @param key The bytes to hash
+ * @param len The number of bytes
+ * @param c The number of compression rounds per 8 bytes
+ * @param d The number of finalization rounds
+ * @return The 64-bit hash
+ * @remark SipHash-2-4 is the pseudo-random function of the reference,
+ *         SipHash-1-3 is enough for hash tables.  Both being constants
+ *         where this is inlined, the rounds are unrolled.
+ */
+static APR_INLINE apr_uint64_t apr__siphash(apr_uint64_t k0, apr_uint64_t k1,
+                                            const unsigned char *key,
+                                            apr_size_t len, int c, int d)
+{
+    const unsigned char *end;
+    apr_uint64_t v0, v1, v2, v3, m, b;
+    int i;
+
+    v0 = k0 ^ APR_UINT64_C(0x736f6d6570736575);
+    v1 = k1 ^ APR_UINT64_C(0x646f72616e646f6d);
+    v2 = k0 ^ APR_UINT64_C(0x6c7967656e657261);
+    v3 = k1 ^ APR_UINT64_C(0x7465646279746573);
+
+    for (end = key + (len & ~(apr_size_t)7); key != end; key += 8) {
+        m = apr__load64_le(key);
+        v3 ^= m;
+        for (i = 0; i < c; i++) {
+            APR__SIPROUND(v0, v1, v2, v3);
+        }
+        v0 ^= m;
+    }
+
+    /* the last 0 to 7 bytes */
+    b = (apr_uint64_t)len << 56;
+    switch (len & 7) {
+    case 7:
+        b |= (apr_uint64_t)key[6] << 48;
+        /* fall through */
+    case 6:
+        b |= (apr_uint64_t)key[5] << 40;
+        /* fall through */
+    case 5:
+        b |= (apr_uint64_t)key[4] << 32;
+        /* fall through */
+    case 4:
+        b |= (apr_uint64_t)key[3] << 24;
+        /* fall through */
+    case 3:
+        b |= (apr_uint64_t)key[2] << 16;
+        /* fall through */
+    case 2:
+        b |= (apr_uint64_t)key[1] << 8;
+        /* fall through */
+    case 1:
+        b |= (apr_uint64_t)key[0];
+    }
+    v3 ^= b;
+    for (i = 0; i < c; i++) {
+        APR__SIPROUND(v0, v1, v2, v3);
+    }
+    v0 ^= b;
+
+    v2 ^= 0xff;
+    for (i = 0; i < d; i++) {
+        APR__SIPROUND(v0, v1, v2, v3);
+    }
+
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* APR_SIPHASH_H */
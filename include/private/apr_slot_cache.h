@@ -0,0 +1,103 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef APR_SLOT_CACHE_H
+#define APR_SLOT_CACHE_H
+
+/**
+ * @file apr_slot_cache.h
+ * @brief APR internal lock-free cache slots
+ */
+
+#include "apr.h"
+#include "apr_atomic.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/**
+ * @defgroup apr_slot_cache Internal lock-free cache slots
+ * @ingroup APR
+ * @{
+ */
+
+/** The maximum number of words of a cache slot */
+#define APR_SLOT_WORDS 10
+
+/**
+ * A cache slot of up to APR_SLOT_WORDS words, shared by the threads
+ * without locking: the sequence number is odd while a thread writes the
+ * words, and readers retry (or miss) when it changed during their read.
+ * Zero-initialized (static) slots are valid and empty.
+ */
+typedef struct apr_slot_t {
+    volatile apr_uint32_t seq;
+    volatile apr_uint32_t w[APR_SLOT_WORDS];
+} apr_slot_t;
+
+/**
+ * Read the n first words of a slot.
+ * @param slot The slot
+ * @param w Where to copy the words
+ * @param n The number of words
+ * @return Non-zero if the words were read consistently, zero if a write
+ *         was in progress (the slot should then be treated as a miss)
+ */
+static APR_INLINE int apr__slot_read(apr_slot_t *slot, apr_uint32_t *w,
+                                     int n)
+{
+    apr_uint32_t seq = apr_atomic_read32_acquire(&slot->seq);
+    int i;
+
+    if (seq == 0 || (seq & 1)) {
+        return 0;
+    }
+    /* Acquire loads, so that the final check can't be done before them */
+    for (i = 0; i < n; i++) {
+        w[i] = apr_atomic_read32_acquire(&slot->w[i]);
+    }
+    return apr_atomic_read32(&slot->seq) == seq;
+}
+
+/**
+ * Write the n first words of a slot, unless another thread is doing so.
+ * @param slot The slot
+ * @param w The words
+ * @param n The number of words
+ */
+static APR_INLINE void apr__slot_write(apr_slot_t *slot,
+                                       const apr_uint32_t *w, int n)
+{
+    apr_uint32_t seq = apr_atomic_read32(&slot->seq);
+    int i;
+
+    if ((seq & 1) || apr_atomic_cas32(&slot->seq, seq + 1, seq) != seq) {
+        return;
+    }
+    for (i = 0; i < n; i++) {
+        apr_atomic_set32(&slot->w[i], w[i]);
+    }
+    apr_atomic_set32_release(&slot->seq, seq + 2);
+}
+
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* APR_SLOT_CACHE_H */
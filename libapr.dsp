@@ -685,6 +685,10 @@ SOURCE=.\strings\apr_strtok.c
 
 SOURCE=.\strmatch\apr_strmatch.c
 # End Source File
+# Begin Source File
+
+SOURCE=.\strmatch\apr_strmatch_multi.c
+# End Source File
 # End Group
 # Begin Group "tables"
 
@@ -700,6 +704,18 @@ SOURCE=.\tables\apr_tables.c
 
 SOURCE=.\tables\apr_skiplist.c
 # End Source File
+# Begin Source File
+
+SOURCE=.\tables\apr_flathash.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\tables\apr_radix.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\tables\apr_sort.c
+# End Source File
 # End Group
 # Begin Group "threadproc"
 
@@ -1129,6 +1145,14 @@ SOURCE=.\include\apr_want.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\include\apr_flathash.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\include\apr_radix.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\include\apu.h
 # End Source File
 # Begin Source File
@@ -21,6 +21,15 @@
 #include "apr_arch_thread_mutex.h"
 #include "apr_arch_thread_cond.h"
 
+/* The timed waits measure their timeout on the monotonic clock when the
+ * condition variables can use it, not to be shortened or lengthened when
+ * the system time is set
+ */
+#if defined(HAVE_PTHREAD_CONDATTR_SETCLOCK) && defined(HAVE_CLOCK_GETTIME) \
+    && defined(CLOCK_MONOTONIC)
+#define USE_COND_MONOTONIC
+#endif
+
 static apr_status_t thread_cond_cleanup(void *data)
 {
     apr_thread_cond_t *cond = (apr_thread_cond_t *)data;
@@ -40,17 +49,35 @@ APR_DECLARE(apr_status_t) apr_thread_cond_create(apr_thread_cond_t **cond,
 {
     apr_thread_cond_t *new_cond;
     apr_status_t rv;
+#ifdef USE_COND_MONOTONIC
+    pthread_condattr_t attr;
+#endif
 
     new_cond = apr_palloc(pool, sizeof(apr_thread_cond_t));
 
     new_cond->pool = pool;
 
+#ifdef USE_COND_MONOTONIC
+    if ((rv = pthread_condattr_init(&attr))) {
+        return rv;
+    }
+    if ((rv = pthread_condattr_setclock(&attr, CLOCK_MONOTONIC))) {
+        pthread_condattr_destroy(&attr);
+        return rv;
+    }
+    rv = pthread_cond_init(&new_cond->cond, &attr);
+    pthread_condattr_destroy(&attr);
+    if (rv) {
+        return rv;
+    }
+#else
     if ((rv = pthread_cond_init(&new_cond->cond, NULL))) {
 #ifdef HAVE_ZOS_PTHREADS
         rv = errno;
 #endif
         return rv;
     }
+#endif
 
     apr_pool_cleanup_register(new_cond->pool,
                               (void *)new_cond, thread_cond_cleanup,
@@ -82,7 +109,11 @@ APR_DECLARE(apr_status_t) apr_thread_cond_timedwait(apr_thread_cond_t *cond,
     apr_time_t then;
     struct timespec abstime;
 
+#ifdef USE_COND_MONOTONIC
+    then = apr_time_now_monotonic() + timeout;
+#else
     then = apr_time_now() + timeout;
+#endif
     abstime.tv_sec = apr_time_sec(then);
     abstime.tv_nsec = apr_time_usec(then) * 1000; /* nanoseconds */
 
@@ -25,6 +25,7 @@
 #include "apr_allocator.h"
 #include "apr_lib.h"
 #include "apr_thread_mutex.h"
+#include "apr_thread_proc.h"
 #include "apr_hash.h"
 #include "apr_time.h"
 #include "apr_support.h"
@@ -44,10 +45,22 @@
 #define APR_ALLOCATOR_USES_MMAP   1
 #endif
 
-#if APR_ALLOCATOR_USES_MMAP
+#if defined(HAVE_MMAP) && defined(HAVE_MAP_ANON) && !APR_ALLOCATOR_GUARD_PAGES
+#define APR_ALLOCATOR_HAS_REGIONS 1
+#else
+#define APR_ALLOCATOR_HAS_REGIONS 0
+#endif
+
+#if APR_ALLOCATOR_USES_MMAP || APR_ALLOCATOR_HAS_REGIONS
 #include <sys/mman.h>
 #endif
 
+#if APR_ALLOCATOR_HAS_REGIONS && defined(HAVE_SYS_SYSCALL_H) \
+    && defined(HAVE_SYS_mbind) && defined(HAVE_SYS_getcpu)
+#include <sys/syscall.h>
+#define APR_ALLOCATOR_HAS_NUMA 1
+#endif
+
 #if HAVE_VALGRIND
 #define REDZONE APR_ALIGN_DEFAULT(8)
 int apr_running_on_valgrind = 0;
@@ -68,7 +81,7 @@ int apr_running_on_valgrind = 0;
  * XXX: to be index 0, so MIN_ALLOC must be at least two pages.
  */
 #define MIN_ALLOC (2 * BOUNDARY_SIZE)
-#define MAX_INDEX   20
+#define MAX_INDEX   APR_ALLOCATOR_SIZE_CLASSES
 
 #if APR_ALLOCATOR_USES_MMAP && defined(_SC_PAGESIZE)
 static unsigned int boundary_index;
@@ -107,6 +120,34 @@ static unsigned int boundary_size;
  * indices, but quantities of BOUNDARY_SIZE big memory blocks.
  */
 
+#if APR_HAS_THREADS
+typedef struct allocator_magazine_t allocator_magazine_t;
+#endif /* APR_HAS_THREADS */
+
+#if APR_ALLOCATOR_HAS_REGIONS
+/*
+ * Regions
+ *
+ * A region is a large mmap()ed area which memnodes are carved from,
+ * @see apr_allocator_create_ex().  Its header is at the start of the
+ * area, and the regions of an allocator are only unmapped when it is
+ * destroyed; memnodes always go back to the free lists.
+ */
+typedef struct allocator_region_t allocator_region_t;
+
+struct allocator_region_t {
+    allocator_region_t *next;
+    apr_size_t          size;
+};
+
+#define SIZEOF_REGION_T     APR_ALIGN_DEFAULT(sizeof(allocator_region_t))
+
+/* Huge page size assumed for alignment, the common PMD size on x86-64
+ * and aarch64.
+ */
+#define REGION_HUGEPAGE_SIZE ((apr_size_t)2 * 1024 * 1024)
+#endif /* APR_ALLOCATOR_HAS_REGIONS */
+
 struct apr_allocator_t {
     /** largest used index into free[], always < MAX_INDEX */
     apr_size_t        max_index;
@@ -123,8 +164,36 @@ struct apr_allocator_t {
     apr_size_t        current_free_index;
 #if APR_HAS_THREADS
     apr_thread_mutex_t *mutex;
+    /** Per-thread node caches, @see apr_allocator_thread_cache_set().
+     * The list of magazines is protected by the mutex.
+     */
+    apr_threadkey_t    *magazine_key;
+    apr_pool_t         *magazine_pool;
+    allocator_magazine_t *magazines;
+    apr_uint32_t        magazine_batch;
 #endif /* APR_HAS_THREADS */
     apr_pool_t         *owner;
+#if APR_ALLOCATOR_HAS_REGIONS
+    /** Creation flags and regions, @see apr_allocator_create_ex().
+     * The regions and the region_avail/region_endp range not carved
+     * yet are protected by the mutex.
+     */
+    apr_uint32_t        flags;
+    apr_size_t          region_size;
+    allocator_region_t *regions;
+    char               *region_avail;
+    char               *region_endp;
+#endif /* APR_ALLOCATOR_HAS_REGIONS */
+    /** Statistics, @see apr_allocator_stats_get().  Protected by the
+     * mutex, like the free lists, except for the nodes malloc()ed which
+     * are counted atomically (without taking the mutex for this only).
+     */
+    apr_size_t          stat_allocated;
+    apr_size_t          stat_node_allocs;
+    apr_size_t          stat_node_frees;
+    apr_size_t          stat_max_free_hits;
+    volatile apr_uint64_t stat_malloc_size;
+    volatile apr_uint64_t stat_node_mallocs;
     /**
      * Lists of free nodes. Slot 0 is used for oversized nodes,
      * and the slots 1..MAX_INDEX-1 contain nodes of sizes
@@ -140,6 +209,30 @@ struct apr_allocator_t {
 
 #define SIZEOF_ALLOCATOR_T  APR_ALIGN_DEFAULT(sizeof(apr_allocator_t))
 
+#if APR_HAS_THREADS
+/*
+ * Magazines
+ *
+ * A magazine is a per-thread cache of free nodes for the small size
+ * classes (slots 1..MAGAZINE_MAX_INDEX-1 of free[]).  Nodes are moved
+ * between a magazine and the allocator's free lists in batches of
+ * magazine_batch nodes, so the allocator mutex is only taken when a
+ * magazine runs empty or overflows.
+ */
+#define MAGAZINE_MAX_INDEX 5
+
+struct allocator_magazine_t {
+    apr_allocator_t       *allocator;
+    allocator_magazine_t  *next;
+    allocator_magazine_t **ref;
+    apr_memnode_t         *free[MAGAZINE_MAX_INDEX];
+    apr_uint32_t           count[MAGAZINE_MAX_INDEX];
+    apr_allocator_thread_cache_stats_t stats;
+};
+
+static apr_status_t magazine_cleanup(void *data);
+#endif /* APR_HAS_THREADS */
+
 
 /*
  * Allocator
@@ -162,11 +255,70 @@ APR_DECLARE(apr_status_t) apr_allocator_create(apr_allocator_t **allocator)
     return APR_SUCCESS;
 }
 
+APR_DECLARE(apr_status_t) apr_allocator_create_ex(apr_allocator_t **allocator,
+                                                  apr_uint32_t flags,
+                                                  apr_size_t region_size)
+{
+    apr_status_t rv;
+
+    if (flags & (APR_ALLOCATOR_HUGEPAGES | APR_ALLOCATOR_NUMA_LOCAL))
+        flags |= APR_ALLOCATOR_REGIONS;
+
+#if !APR_ALLOCATOR_HAS_REGIONS
+    if (flags & APR_ALLOCATOR_REGIONS) {
+        *allocator = NULL;
+        return APR_ENOTIMPL;
+    }
+#endif
+
+    if ((rv = apr_allocator_create(allocator)) != APR_SUCCESS)
+        return rv;
+
+#if APR_ALLOCATOR_HAS_REGIONS
+    if (flags & APR_ALLOCATOR_REGIONS) {
+        if (region_size == 0)
+            region_size = APR_ALLOCATOR_REGION_SIZE_DEFAULT;
+        if (flags & APR_ALLOCATOR_HUGEPAGES)
+            region_size = APR_ALIGN(region_size, REGION_HUGEPAGE_SIZE);
+        else
+            region_size = APR_ALIGN(region_size, BOUNDARY_SIZE);
+
+        (*allocator)->flags = flags;
+        (*allocator)->region_size = region_size;
+    }
+#endif
+
+    return APR_SUCCESS;
+}
+
 APR_DECLARE(void) apr_allocator_destroy(apr_allocator_t *allocator)
 {
     apr_uint32_t index;
     apr_memnode_t *node, **ref;
 
+#if APR_HAS_THREADS
+    /* Give the cached nodes of all threads back to the free lists */
+    if (allocator->magazine_key) {
+        apr_pool_cleanup_run(allocator->magazine_pool, allocator,
+                             magazine_cleanup);
+    }
+#endif /* APR_HAS_THREADS */
+
+#if APR_ALLOCATOR_HAS_REGIONS
+    /* The memnodes all live in the regions, unmap them at once */
+    if (allocator->region_size) {
+        allocator_region_t *region;
+
+        while ((region = allocator->regions) != NULL) {
+            allocator->regions = region->next;
+            munmap(region, region->size);
+        }
+
+        free(allocator);
+        return;
+    }
+#endif /* APR_ALLOCATOR_HAS_REGIONS */
+
     for (index = 0; index < MAX_INDEX; index++) {
         ref = &allocator->free[index];
         while ((node = *ref) != NULL) {
@@ -235,6 +387,236 @@ APR_DECLARE(void) apr_allocator_max_free_set(apr_allocator_t *allocator,
 #endif
 }
 
+#if APR_HAS_THREADS
+static allocator_magazine_t *magazine_get(apr_allocator_t *allocator)
+{
+    allocator_magazine_t *mag;
+    void *data;
+
+    apr_threadkey_private_get(&data, allocator->magazine_key);
+    if ((mag = data) != NULL)
+        return mag;
+
+    /* First use of the allocator by this thread, create its magazine */
+    if ((mag = calloc(1, sizeof(*mag))) == NULL)
+        return NULL;
+
+    mag->allocator = allocator;
+    if (apr_threadkey_private_set(mag, allocator->magazine_key)
+        != APR_SUCCESS) {
+        free(mag);
+        return NULL;
+    }
+
+    if (allocator->mutex)
+        apr_thread_mutex_lock(allocator->mutex);
+
+    if ((mag->next = allocator->magazines) != NULL)
+        mag->next->ref = &mag->next;
+    allocator->magazines = mag;
+    mag->ref = &allocator->magazines;
+
+    if (allocator->mutex)
+        apr_thread_mutex_unlock(allocator->mutex);
+
+    return mag;
+}
+
+static void magazine_refill(allocator_magazine_t *mag, apr_size_t index)
+{
+    apr_allocator_t *allocator = mag->allocator;
+    apr_memnode_t *node;
+    apr_uint32_t n = 0;
+
+    mag->stats.misses++;
+
+    if (index > allocator->max_index)
+        return;
+
+    if (allocator->mutex)
+        apr_thread_mutex_lock(allocator->mutex);
+
+    /* Take up to a batch of nodes of exactly this size */
+    while (n < allocator->magazine_batch
+           && (node = allocator->free[index]) != NULL) {
+        allocator->free[index] = node->next;
+        node->next = mag->free[index];
+        mag->free[index] = node;
+        allocator->current_free_index += index + 1;
+        n++;
+    }
+    allocator->stat_node_allocs += n;
+    if (allocator->current_free_index > allocator->max_free_index)
+        allocator->current_free_index = allocator->max_free_index;
+
+    /* If we emptied the highest available index, find the new one */
+    if (n && index == allocator->max_index) {
+        while (allocator->max_index > 0
+               && allocator->free[allocator->max_index] == NULL)
+            allocator->max_index--;
+    }
+
+    if (allocator->mutex)
+        apr_thread_mutex_unlock(allocator->mutex);
+
+    if (n) {
+        mag->count[index] += n;
+        mag->stats.refills++;
+    }
+}
+#endif /* APR_HAS_THREADS */
+
+#if APR_ALLOCATOR_HAS_REGIONS
+#if APR_ALLOCATOR_HAS_NUMA
+/* Prefer the NUMA node of the calling thread for the given range.
+ * This is best effort, failures are ignored.
+ */
+static void region_bind_local(void *base, apr_size_t size)
+{
+    unsigned long nodemask;
+    unsigned int cpu, node;
+
+    if (syscall(SYS_getcpu, &cpu, &node, NULL) != 0
+        || node >= 8 * sizeof(nodemask))
+        return;
+
+    nodemask = 1UL << node;
+    /* 1 == MPOL_PREFERRED, maxnode is one more than the mask bits */
+    syscall(SYS_mbind, base, size, 1, &nodemask,
+            8 * sizeof(nodemask) + 1, 0);
+}
+#endif /* APR_ALLOCATOR_HAS_NUMA */
+
+/* Map a new region of (at least) the given size and link it to the
+ * allocator, with the mutex held.
+ */
+static allocator_region_t *region_map(apr_allocator_t *allocator,
+                                      apr_size_t size)
+{
+    allocator_region_t *region = MAP_FAILED;
+    char *base;
+
+    if (allocator->flags & APR_ALLOCATOR_HUGEPAGES) {
+        size = APR_ALIGN(size, REGION_HUGEPAGE_SIZE);
+
+#ifdef HAVE_MAP_HUGETLB
+        /* Explicit huge pages, if some are reserved */
+        region = mmap(NULL, size, PROT_READ|PROT_WRITE,
+                      MAP_PRIVATE|MAP_ANON|MAP_HUGETLB, -1, 0);
+#endif
+        if (region == MAP_FAILED) {
+            apr_size_t head, tail;
+
+            /* Otherwise, over-map to align the region on a huge page
+             * boundary and let the kernel back it transparently.
+             */
+            base = mmap(NULL, size + REGION_HUGEPAGE_SIZE,
+                        PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANON, -1, 0);
+            if (base == MAP_FAILED)
+                return NULL;
+
+            region = (allocator_region_t *)APR_ALIGN((apr_uintptr_t)base,
+                                                     REGION_HUGEPAGE_SIZE);
+            head = (char *)region - base;
+            tail = REGION_HUGEPAGE_SIZE - head;
+            if (head)
+                munmap(base, head);
+            if (tail)
+                munmap((char *)region + size, tail);
+
+#if defined(HAVE_MADVISE) && defined(HAVE_MADV_HUGEPAGE)
+            madvise(region, size, MADV_HUGEPAGE);
+#endif
+        }
+    }
+    else {
+        region = mmap(NULL, size, PROT_READ|PROT_WRITE,
+                      MAP_PRIVATE|MAP_ANON, -1, 0);
+        if (region == MAP_FAILED)
+            return NULL;
+    }
+
+#if APR_ALLOCATOR_HAS_NUMA
+    if (allocator->flags & APR_ALLOCATOR_NUMA_LOCAL)
+        region_bind_local(region, size);
+#endif
+
+    region->size = size;
+    region->next = allocator->regions;
+    allocator->regions = region;
+
+    return region;
+}
+
+/* Carve a memnode of the given size (a BOUNDARY_SIZE multiple) from the
+ * current region, mapping a new one if needed.
+ */
+static apr_memnode_t *region_alloc(apr_allocator_t *allocator,
+                                   apr_size_t size)
+{
+    allocator_region_t *region;
+    apr_memnode_t *node = NULL;
+    apr_size_t rest;
+
+#if APR_HAS_THREADS
+    if (allocator->mutex)
+        apr_thread_mutex_lock(allocator->mutex);
+#endif /* APR_HAS_THREADS */
+
+    if (size > allocator->region_size - SIZEOF_REGION_T) {
+        /* Too big for a region, give it one of its own */
+        if ((region = region_map(allocator, size + SIZEOF_REGION_T)) != NULL)
+            node = (apr_memnode_t *)((char *)region + SIZEOF_REGION_T);
+        goto done;
+    }
+
+    rest = allocator->region_endp - allocator->region_avail;
+    if (size > rest) {
+        /* Put what is left of the current region in the free lists */
+        if (rest >= MIN_ALLOC) {
+            apr_memnode_t *left = (apr_memnode_t *)allocator->region_avail;
+            apr_uint32_t index = (rest >> BOUNDARY_INDEX) - 1;
+
+            left->index = index;
+            left->endp = (char *)left + ((apr_size_t)(index + 1)
+                                         << BOUNDARY_INDEX);
+            if (index >= MAX_INDEX)
+                index = 0;
+            if ((left->next = allocator->free[index]) == NULL
+                && index > allocator->max_index)
+                allocator->max_index = index;
+            allocator->free[index] = left;
+            /* Accounted like a node given back by allocator_free(), the
+             * memory is allocated from the system but free
+             */
+            if (allocator->current_free_index >= left->index + 1)
+                allocator->current_free_index -= left->index + 1;
+            else
+                allocator->current_free_index = 0;
+            allocator->stat_allocated += left->endp - (char *)left;
+        }
+
+        if ((region = region_map(allocator, allocator->region_size)) == NULL) {
+            allocator->region_avail = allocator->region_endp = NULL;
+            goto done;
+        }
+        allocator->region_avail = (char *)region + SIZEOF_REGION_T;
+        allocator->region_endp = (char *)region + region->size;
+    }
+
+    node = (apr_memnode_t *)allocator->region_avail;
+    allocator->region_avail += size;
+
+done:
+#if APR_HAS_THREADS
+    if (allocator->mutex)
+        apr_thread_mutex_unlock(allocator->mutex);
+#endif /* APR_HAS_THREADS */
+
+    return node;
+}
+#endif /* APR_ALLOCATOR_HAS_REGIONS */
+
 static APR_INLINE
 apr_memnode_t *allocator_alloc(apr_allocator_t *allocator, apr_size_t in_size)
 {
@@ -261,6 +643,26 @@ apr_memnode_t *allocator_alloc(apr_allocator_t *allocator, apr_size_t in_size)
         return NULL;
     }
 
+#if APR_HAS_THREADS
+    /* Small nodes come from this thread's magazine, if any */
+    if (allocator->magazine_key && index < MAGAZINE_MAX_INDEX) {
+        allocator_magazine_t *mag = magazine_get(allocator);
+
+        if (mag != NULL) {
+            if (mag->free[index] == NULL)
+                magazine_refill(mag, index);
+            else
+                mag->stats.hits++;
+
+            if ((node = mag->free[index]) != NULL) {
+                mag->free[index] = node->next;
+                mag->count[index]--;
+                goto have_node;
+            }
+        }
+    }
+#endif /* APR_HAS_THREADS */
+
     /* First see if there are any nodes in the area we know
      * our node will fit into.
      */
@@ -313,6 +715,7 @@ apr_memnode_t *allocator_alloc(apr_allocator_t *allocator, apr_size_t in_size)
             allocator->current_free_index += node->index + 1;
             if (allocator->current_free_index > allocator->max_free_index)
                 allocator->current_free_index = allocator->max_free_index;
+            allocator->stat_node_allocs++;
 
 #if APR_HAS_THREADS
             if (allocator->mutex)
@@ -350,6 +753,7 @@ apr_memnode_t *allocator_alloc(apr_allocator_t *allocator, apr_size_t in_size)
             allocator->current_free_index += node->index + 1;
             if (allocator->current_free_index > allocator->max_free_index)
                 allocator->current_free_index = allocator->max_free_index;
+            allocator->stat_node_allocs++;
 
 #if APR_HAS_THREADS
             if (allocator->mutex)
@@ -368,6 +772,13 @@ apr_memnode_t *allocator_alloc(apr_allocator_t *allocator, apr_size_t in_size)
     /* If we haven't got a suitable node, malloc a new one
      * and initialize it.
      */
+#if APR_ALLOCATOR_HAS_REGIONS
+    if (allocator->region_size) {
+        if ((node = region_alloc(allocator, size)) == NULL)
+            return NULL;
+    }
+    else
+#endif /* APR_ALLOCATOR_HAS_REGIONS */
 #if APR_ALLOCATOR_GUARD_PAGES
     if ((node = mmap(NULL, size + 2 * GUARDPAGE_SIZE, PROT_NONE,
                      MAP_PRIVATE|MAP_ANON, -1, 0)) == MAP_FAILED)
@@ -389,6 +800,21 @@ apr_memnode_t *allocator_alloc(apr_allocator_t *allocator, apr_size_t in_size)
     node->index = index;
     node->endp = (char *)node + size;
 
+    /* An allocator without a mutex is used by a single thread, maybe
+     * before apr_atomic_init() (the global allocator)
+     */
+#if APR_HAS_THREADS
+    if (allocator->mutex) {
+        apr_atomic_add64(&allocator->stat_malloc_size, size);
+        apr_atomic_inc64(&allocator->stat_node_mallocs);
+    }
+    else
+#endif /* APR_HAS_THREADS */
+    {
+        allocator->stat_malloc_size += size;
+        allocator->stat_node_mallocs++;
+    }
+
 have_node:
     node->next = NULL;
     node->first_avail = (char *)node + APR_MEMNODE_T_SIZE;
@@ -399,7 +825,7 @@ have_node:
 }
 
 static APR_INLINE
-void allocator_free(apr_allocator_t *allocator, apr_memnode_t *node)
+void allocator_free_shared(apr_allocator_t *allocator, apr_memnode_t *node)
 {
     apr_memnode_t *next, *freelist = NULL;
     apr_uint32_t index, max_index;
@@ -424,10 +850,20 @@ void allocator_free(apr_allocator_t *allocator, apr_memnode_t *node)
         APR_VALGRIND_NOACCESS((char *)node + APR_MEMNODE_T_SIZE,
                               (node->index+1) << BOUNDARY_INDEX);
 
+        allocator->stat_node_frees++;
+
         if (max_free_index != APR_ALLOCATOR_MAX_FREE_UNLIMITED
-            && index + 1 > current_free_index) {
+            && index + 1 > current_free_index
+#if APR_ALLOCATOR_HAS_REGIONS
+            /* memnodes can't be given back to the system individually */
+            && !allocator->region_size
+#endif
+            ) {
             node->next = freelist;
             freelist = node;
+            allocator->stat_allocated -= (apr_size_t)(index + 1)
+                                         << BOUNDARY_INDEX;
+            allocator->stat_max_free_hits++;
         }
         else if (index < MAX_INDEX) {
             /* Add the node to the appropriate 'size' bucket.  Adjust
@@ -476,6 +912,252 @@ void allocator_free(apr_allocator_t *allocator, apr_memnode_t *node)
     }
 }
 
+#if APR_HAS_THREADS
+/* Put the nodes of the given list into the magazine, and return the list
+ * of those which have to go to the allocator's free lists: nodes too big
+ * for the magazine, and batches of nodes overflowing it.
+ */
+static apr_memnode_t *magazine_put(allocator_magazine_t *mag,
+                                   apr_memnode_t *node)
+{
+    apr_memnode_t *next, *rest = NULL;
+    apr_uint32_t index, n, batch = mag->allocator->magazine_batch;
+
+    do {
+        next = node->next;
+        index = node->index;
+
+        if (index >= MAGAZINE_MAX_INDEX) {
+            node->next = rest;
+            rest = node;
+            continue;
+        }
+
+        APR_VALGRIND_NOACCESS((char *)node + APR_MEMNODE_T_SIZE,
+                              (node->index+1) << BOUNDARY_INDEX);
+
+        node->next = mag->free[index];
+        mag->free[index] = node;
+        if (++mag->count[index] <= 2 * batch)
+            continue;
+
+        for (n = 0; n < batch; n++) {
+            node = mag->free[index];
+            mag->free[index] = node->next;
+            node->next = rest;
+            rest = node;
+        }
+        mag->count[index] -= batch;
+        mag->stats.flushes++;
+    } while ((node = next) != NULL);
+
+    return rest;
+}
+
+/* Detach all the nodes of the magazine, returning them as a list */
+static apr_memnode_t *magazine_empty(allocator_magazine_t *mag)
+{
+    apr_memnode_t *node, *list = NULL;
+    apr_uint32_t index;
+
+    for (index = 0; index < MAGAZINE_MAX_INDEX; index++) {
+        while ((node = mag->free[index]) != NULL) {
+            mag->free[index] = node->next;
+            node->next = list;
+            list = node;
+        }
+        mag->count[index] = 0;
+    }
+
+    return list;
+}
+
+/* Thread exit, give the cached nodes back to the allocator */
+static void magazine_thread_exit(void *data)
+{
+    allocator_magazine_t *mag = data;
+    apr_allocator_t *allocator = mag->allocator;
+    apr_memnode_t *list;
+
+    if (allocator->mutex)
+        apr_thread_mutex_lock(allocator->mutex);
+
+    if ((*mag->ref = mag->next) != NULL)
+        mag->next->ref = mag->ref;
+
+    if (allocator->mutex)
+        apr_thread_mutex_unlock(allocator->mutex);
+
+    if ((list = magazine_empty(mag)) != NULL)
+        allocator_free_shared(allocator, list);
+
+    free(mag);
+}
+
+static apr_status_t magazine_cleanup(void *data)
+{
+    apr_allocator_t *allocator = data;
+    allocator_magazine_t *mag, *next;
+    apr_memnode_t *list;
+
+    apr_threadkey_private_delete(allocator->magazine_key);
+    allocator->magazine_key = NULL;
+    allocator->magazine_pool = NULL;
+    allocator->magazine_batch = 0;
+
+    if (allocator->mutex)
+        apr_thread_mutex_lock(allocator->mutex);
+
+    mag = allocator->magazines;
+    allocator->magazines = NULL;
+
+    if (allocator->mutex)
+        apr_thread_mutex_unlock(allocator->mutex);
+
+    for (; mag != NULL; mag = next) {
+        next = mag->next;
+        if ((list = magazine_empty(mag)) != NULL)
+            allocator_free_shared(allocator, list);
+        free(mag);
+    }
+
+    return APR_SUCCESS;
+}
+#endif /* APR_HAS_THREADS */
+
+static APR_INLINE
+void allocator_free(apr_allocator_t *allocator, apr_memnode_t *node)
+{
+#if APR_HAS_THREADS
+    if (allocator->magazine_key) {
+        allocator_magazine_t *mag = magazine_get(allocator);
+
+        if (mag != NULL && (node = magazine_put(mag, node)) == NULL)
+            return;
+    }
+#endif /* APR_HAS_THREADS */
+
+    allocator_free_shared(allocator, node);
+}
+
+#if APR_HAS_THREADS
+APR_DECLARE(apr_status_t) apr_allocator_thread_cache_set(
+                                      apr_allocator_t *allocator,
+                                      apr_uint32_t batch,
+                                      apr_pool_t *pool)
+{
+    apr_status_t rv;
+
+    if (allocator->magazine_key) {
+        apr_pool_cleanup_run(allocator->magazine_pool, allocator,
+                             magazine_cleanup);
+    }
+
+    if (batch == 0)
+        return APR_SUCCESS;
+
+    rv = apr_threadkey_private_create(&allocator->magazine_key,
+                                      magazine_thread_exit, pool);
+    if (rv != APR_SUCCESS) {
+        allocator->magazine_key = NULL;
+        return rv;
+    }
+
+    allocator->magazine_pool = pool;
+    allocator->magazine_batch = batch;
+    apr_pool_cleanup_register(pool, allocator, magazine_cleanup,
+                              apr_pool_cleanup_null);
+
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(apr_status_t) apr_allocator_thread_cache_stats_get(
+                                      apr_allocator_thread_cache_stats_t *stats,
+                                      apr_allocator_t *allocator)
+{
+    void *data;
+
+    if (!allocator->magazine_key)
+        return APR_EINVAL;
+
+    apr_threadkey_private_get(&data, allocator->magazine_key);
+    if (data) {
+        *stats = ((allocator_magazine_t *)data)->stats;
+    }
+    else {
+        memset(stats, 0, sizeof(*stats));
+    }
+
+    return APR_SUCCESS;
+}
+#endif /* APR_HAS_THREADS */
+
+APR_DECLARE(void) apr_allocator_stats_get(apr_allocator_stats_t *stats,
+                                          apr_allocator_t *allocator)
+{
+    apr_memnode_t *node;
+    apr_size_t index, size;
+    apr_uint64_t mallocs, malloc_size;
+
+    memset(stats, 0, sizeof(*stats));
+
+#if APR_HAS_THREADS
+    if (allocator->mutex)
+        apr_thread_mutex_lock(allocator->mutex);
+#endif /* APR_HAS_THREADS */
+
+    for (index = 0; index < MAX_INDEX; index++) {
+        for (node = allocator->free[index]; node; node = node->next) {
+            size = (apr_size_t)(node->index + 1) << BOUNDARY_INDEX;
+            stats->free_sizes[index] += size;
+            stats->free += size;
+        }
+    }
+
+#if APR_HAS_THREADS
+    {
+        allocator_magazine_t *mag;
+
+        /* The counts are updated by the owning threads without the lock,
+         * so this is only an approximation.
+         */
+        for (mag = allocator->magazines; mag; mag = mag->next) {
+            for (index = 1; index < MAGAZINE_MAX_INDEX; index++) {
+                stats->cached += (apr_size_t)mag->count[index]
+                                 * ((index + 1) << BOUNDARY_INDEX);
+            }
+        }
+    }
+#endif /* APR_HAS_THREADS */
+
+    stats->boundary = BOUNDARY_SIZE;
+    stats->max_free = (apr_size_t)allocator->max_free_index << BOUNDARY_INDEX;
+    /* The malloc()ed nodes are not in stat_allocated and stat_node_allocs
+     * (which may have wrapped below zero when they were freed)
+     */
+#if APR_HAS_THREADS
+    if (allocator->mutex) {
+        mallocs = apr_atomic_read64(&allocator->stat_node_mallocs);
+        malloc_size = apr_atomic_read64(&allocator->stat_malloc_size);
+    }
+    else
+#endif /* APR_HAS_THREADS */
+    {
+        mallocs = allocator->stat_node_mallocs;
+        malloc_size = allocator->stat_malloc_size;
+    }
+    stats->allocated = allocator->stat_allocated + (apr_size_t)malloc_size;
+    stats->node_allocs = allocator->stat_node_allocs + (apr_size_t)mallocs;
+    stats->node_frees = allocator->stat_node_frees;
+    stats->node_mallocs = (apr_size_t)mallocs;
+    stats->max_free_hits = allocator->stat_max_free_hits;
+
+#if APR_HAS_THREADS
+    if (allocator->mutex)
+        apr_thread_mutex_unlock(allocator->mutex);
+#endif /* APR_HAS_THREADS */
+}
+
 APR_DECLARE(apr_memnode_t *) apr_allocator_alloc(apr_allocator_t *allocator,
                                                  apr_size_t size)
 {
@@ -542,6 +1224,9 @@ struct debug_node_t {
  * to see how it is used.
  */
 struct apr_pool_t {
+#if !APR_POOL_DEBUG
+    apr_memnode_t        *active; /* Must come first, @see apr_pool_head_t */
+#endif /* !APR_POOL_DEBUG */
     apr_pool_t           *parent;
     apr_pool_t           *child;
     apr_pool_t           *sibling;
@@ -555,9 +1240,11 @@ struct apr_pool_t {
     const char           *tag;
 
 #if !APR_POOL_DEBUG
-    apr_memnode_t        *active;
     apr_memnode_t        *self; /* The node containing the pool itself */
     char                 *self_first_avail;
+    apr_size_t            stat_slow_alloc;
+    apr_uint32_t          marks; /* Outstanding apr_pool_mark()s */
+    apr_memnode_t        *spare; /* Nodes emptied by apr_pool_rollback() */
 
 #else /* APR_POOL_DEBUG */
     apr_pool_t           *joined; /* the caller has guaranteed that this pool
@@ -717,6 +1404,11 @@ APR_DECLARE(void) apr_pool_terminate(void)
 /* Returns the amount of free space in the given node. */
 #define node_free_space(node_) ((apr_size_t)(node_->endp - node_->first_avail))
 
+/* Returns the free_index of the given node, @see apr_palloc(). */
+#define node_free_index(node_) \
+    ((APR_ALIGN(node_->endp - node_->first_avail + 1, BOUNDARY_SIZE) \
+      - BOUNDARY_SIZE) >> BOUNDARY_INDEX)
+
 /*
  * Helpers to mark pool as in-use/free. Used for finding thread-unsafe
  * concurrent accesses from different threads.
@@ -783,6 +1475,41 @@ static APR_INLINE void pool_concurrency_set_destroyed(apr_pool_t *pool) { }
  * Memory allocation
  */
 
+/* Takes a node with at least size bytes free from the ones kept by the
+ * pool, or returns NULL.  While marked, the nodes taken from here on are
+ * chained in front of the marked one for apr_pool_rollback(), so only an
+ * empty node can be reused: the rollback keeps them apart on the spare
+ * list, in the order they were taken, so that the same marked cycle finds
+ * them again at the head of the list.
+ */
+static APR_INLINE apr_memnode_t *pool_node_get(apr_pool_t *pool,
+                                               apr_memnode_t *active,
+                                               apr_size_t size)
+{
+    apr_memnode_t *node;
+
+    if (!pool->marks) {
+        node = active->next;
+        if (size <= node_free_space(node)) {
+            list_remove(node);
+            return node;
+        }
+    }
+
+    node = pool->spare;
+    if (node && size <= node_free_space(node)) {
+        pool->spare = node->next;
+        return node;
+    }
+
+    return NULL;
+}
+
+/* apr_palloc() may be the inline fast path, here is the real thing */
+#ifdef apr_palloc
+#undef apr_palloc
+#endif
+
 APR_DECLARE(void *) apr_palloc(apr_pool_t *pool, apr_size_t in_size)
 {
     apr_memnode_t *active, *node;
@@ -811,18 +1538,15 @@ APR_DECLARE(void *) apr_palloc(apr_pool_t *pool, apr_size_t in_size)
         goto have_mem;
     }
 
-    node = active->next;
-    if (size <= node_free_space(node)) {
-        list_remove(node);
-    }
-    else {
-        if ((node = allocator_alloc(pool->allocator, size)) == NULL) {
-            pool_concurrency_set_idle(pool);
-            if (pool->abort_fn)
-                pool->abort_fn(APR_ENOMEM);
+    pool->stat_slow_alloc++;
 
-            return NULL;
-        }
+    if ((node = pool_node_get(pool, active, size)) == NULL
+        && (node = allocator_alloc(pool->allocator, size)) == NULL) {
+        pool_concurrency_set_idle(pool);
+        if (pool->abort_fn)
+            pool->abort_fn(APR_ENOMEM);
+
+        return NULL;
     }
 
     node->free_index = 0;
@@ -834,12 +1558,11 @@ APR_DECLARE(void *) apr_palloc(apr_pool_t *pool, apr_size_t in_size)
 
     pool->active = node;
 
-    free_index = (APR_ALIGN(active->endp - active->first_avail + 1,
-                            BOUNDARY_SIZE) - BOUNDARY_SIZE) >> BOUNDARY_INDEX;
+    free_index = node_free_index(active);
 
     active->free_index = free_index;
     node = active->next;
-    if (free_index >= node->free_index)
+    if (free_index >= node->free_index || pool->marks)
         goto have_mem;
 
     do {
@@ -868,6 +1591,94 @@ have_mem:
 #endif
 }
 
+APR_DECLARE(void *) apr_palloc_aligned(apr_pool_t *pool, apr_size_t size,
+                                       apr_size_t align)
+{
+    apr_memnode_t *active;
+    apr_size_t pad;
+    char *mem;
+
+    if (!align || (align & (align - 1)))
+        return NULL;
+
+    if (align <= APR_ALIGN_DEFAULT(1))
+        return apr_palloc(pool, size);
+
+    /* Allocate enough to align the block wherever it lands... */
+    pad = align - APR_ALIGN_DEFAULT(1);
+    if (size + pad < size) {
+        if (pool->abort_fn)
+            pool->abort_fn(APR_ENOMEM);
+
+        return NULL;
+    }
+    if ((mem = apr_palloc(pool, size + pad)) == NULL)
+        return NULL;
+
+    /* ...and give back what is left past the aligned block, if it is
+     * at the end of the active node (that is, always without valgrind).
+     */
+    pool_concurrency_set_used(pool);
+    active = pool->active;
+    if (active->first_avail == mem + APR_ALIGN_DEFAULT(size + pad)) {
+        active->first_avail = (char *)APR_ALIGN((apr_uintptr_t)mem, align)
+                              + APR_ALIGN_DEFAULT(size);
+    }
+    pool_concurrency_set_idle(pool);
+
+    return (char *)APR_ALIGN((apr_uintptr_t)mem, align);
+}
+
+APR_DECLARE(void) apr_pool_mark(apr_pool_t *pool, apr_pool_mark_t *mark)
+{
+    pool_concurrency_set_used(pool);
+    mark->node = pool->active;
+    mark->offset = pool->active->first_avail - (char *)pool->active;
+    pool->marks++;
+    pool_concurrency_set_idle(pool);
+}
+
+APR_DECLARE(void) apr_pool_rollback(apr_pool_t *pool,
+                                    const apr_pool_mark_t *mark)
+{
+    apr_memnode_t *active = mark->node, *first, *node, *next;
+
+    pool_concurrency_set_used(pool);
+    pool->marks--;
+#if HAVE_VALGRIND
+    if (apr_running_on_valgrind) {
+        pool_concurrency_set_idle(pool);
+        return;
+    }
+#endif
+
+    /* The nodes taken since the mark are chained in front of the marked
+     * one, unlink them all...
+     */
+    first = pool->active;
+    pool->active = active;
+    active->first_avail = (char *)active + mark->offset;
+    active->free_index = 0;
+    if (first == active) {
+        pool_concurrency_set_idle(pool);
+        return;
+    }
+    *first->ref = active;
+    active->ref = first->ref;
+
+    /* ...and keep them empty on the spare list, the first taken at the
+     * head (they are chained from the last taken).
+     */
+    for (node = first; node != active; node = next) {
+        next = node->next;
+        node->first_avail = (char *)node + APR_MEMNODE_T_SIZE;
+        node->next = pool->spare;
+        pool->spare = node;
+    }
+
+    pool_concurrency_set_idle(pool);
+}
+
 /* Provide an implementation of apr_pcalloc for backward compatibility
  * with code built before apr_pcalloc was a macro
  */
@@ -929,6 +1740,11 @@ APR_DECLARE(void) apr_pool_clear(apr_pool_t *pool)
      */
     active = pool->active = pool->self;
     active->first_avail = pool->self_first_avail;
+    pool->marks = 0;
+    if (pool->spare) {
+        allocator_free(pool->allocator, pool->spare);
+        pool->spare = NULL;
+    }
 
     APR_IF_VALGRIND(VALGRIND_MEMPOOL_TRIM(pool, pool, 1));
 
@@ -1007,6 +1823,8 @@ APR_DECLARE(void) apr_pool_destroy(apr_pool_t *pool)
     /* Free all the nodes in the pool (including the node holding the
      * pool struct), by giving them back to the allocator.
      */
+    if (pool->spare)
+        allocator_free(allocator, pool->spare);
     allocator_free(allocator, active);
 
     /* If this pool happens to be the owner of the allocator, free
@@ -1082,6 +1900,9 @@ APR_DECLARE(apr_status_t) apr_pool_create_ex(apr_pool_t **newpool,
     pool->subprocesses = NULL;
     pool->user_data = NULL;
     pool->tag = NULL;
+    pool->stat_slow_alloc = 0;
+    pool->marks = 0;
+    pool->spare = NULL;
 
 #ifdef NETWARE
     pool->owner_proc = (apr_os_proc_t)getnlmhandle();
@@ -1172,6 +1993,9 @@ APR_DECLARE(apr_status_t) apr_pool_create_unmanaged_ex(apr_pool_t **newpool,
     pool->parent = NULL;
     pool->sibling = NULL;
     pool->ref = NULL;
+    pool->stat_slow_alloc = 0;
+    pool->marks = 0;
+    pool->spare = NULL;
 
 #ifdef NETWARE
     pool->owner_proc = (apr_os_proc_t)getnlmhandle();
@@ -1185,6 +2009,60 @@ APR_DECLARE(apr_status_t) apr_pool_create_unmanaged_ex(apr_pool_t **newpool,
     return APR_SUCCESS;
 }
 
+/*
+ * Statistics
+ */
+
+static void pool_stats_add(apr_pool_stats_t *stats, apr_pool_t *pool,
+                           int recurse)
+{
+    apr_memnode_t *node;
+    apr_pool_t *child;
+
+    stats->pools++;
+    stats->slow_allocs += pool->stat_slow_alloc;
+
+    node = pool->active;
+    do {
+        stats->nodes++;
+        stats->size += node->endp - (char *)node;
+        stats->used += node->first_avail - (char *)node;
+        node = node->next;
+    } while (node != pool->active);
+    for (node = pool->spare; node; node = node->next) {
+        stats->nodes++;
+        stats->size += node->endp - (char *)node;
+        stats->used += node->first_avail - (char *)node;
+    }
+
+    if (recurse) {
+        for (child = pool->child; child; child = child->sibling)
+            pool_stats_add(stats, child, recurse);
+    }
+}
+
+APR_DECLARE(void) apr_pool_stats_get(apr_pool_stats_t *stats,
+                                     apr_pool_t *pool, int recurse)
+{
+#if APR_HAS_THREADS
+    apr_thread_mutex_t *mutex = NULL;
+
+    /* Protect the list of children, like apr_pool_create_ex() */
+    if (recurse)
+        mutex = apr_allocator_mutex_get(pool->allocator);
+    if (mutex)
+        apr_thread_mutex_lock(mutex);
+#endif /* APR_HAS_THREADS */
+
+    memset(stats, 0, sizeof(*stats));
+    pool_stats_add(stats, pool, recurse);
+
+#if APR_HAS_THREADS
+    if (mutex)
+        apr_thread_mutex_unlock(mutex);
+#endif /* APR_HAS_THREADS */
+}
+
 /*
  * "Print" functions
  */
@@ -1236,10 +2114,9 @@ static int psprintf_flush(apr_vformatter_buff_t *vbuff)
     if (size < APR_PSPRINTF_MIN_STRINGSIZE)
         size = APR_PSPRINTF_MIN_STRINGSIZE;
 
-    node = active->next;
-    if (!ps->got_a_new_node && size <= node_free_space(node)) {
+    if (!ps->got_a_new_node
+        && (node = pool_node_get(pool, active, size)) != NULL) {
 
-        list_remove(node);
         list_insert(node, active);
 
         node->free_index = 0;
@@ -1251,7 +2128,7 @@ static int psprintf_flush(apr_vformatter_buff_t *vbuff)
 
         active->free_index = free_index;
         node = active->next;
-        if (free_index < node->free_index) {
+        if (free_index < node->free_index && !pool->marks) {
             do {
                 node = node->next;
             }
@@ -1408,7 +2285,7 @@ APR_DECLARE(char *) apr_pvsprintf(apr_pool_t *pool, const char *fmt, va_list ap)
     active->free_index = free_index;
     node = active->next;
 
-    if (free_index >= node->free_index) {
+    if (free_index >= node->free_index || pool->marks) {
         pool_concurrency_set_idle(pool);
         return strp;
     }
@@ -1711,6 +2588,8 @@ APR_DECLARE(void) apr_pool_terminate(void)
  * Memory allocation (debug)
  */
 
+#define POOL_POISON_BYTE 'A'
+
 static void *pool_alloc(apr_pool_t *pool, apr_size_t size)
 {
     debug_node_t *node;
@@ -1766,6 +2645,68 @@ APR_DECLARE(void *) apr_palloc_debug(apr_pool_t *pool, apr_size_t size,
     return mem;
 }
 
+APR_DECLARE(void *) apr_palloc_aligned(apr_pool_t *pool, apr_size_t size,
+                                       apr_size_t align)
+{
+    char *mem;
+
+    if (!align || (align & (align - 1)))
+        return NULL;
+
+    if (align <= APR_ALIGN_DEFAULT(1))
+        return apr_palloc_debug(pool, size, "apr_palloc_aligned");
+
+    /* Each allocation is a malloc() of its own, just over-allocate */
+    if (size + align < size) {
+        if (pool->abort_fn)
+            pool->abort_fn(APR_ENOMEM);
+
+        return NULL;
+    }
+    mem = apr_palloc_debug(pool, size + align - 1, "apr_palloc_aligned");
+    if (mem == NULL)
+        return NULL;
+
+    return (char *)APR_ALIGN((apr_uintptr_t)mem, align);
+}
+
+APR_DECLARE(void) apr_pool_mark(apr_pool_t *pool, apr_pool_mark_t *mark)
+{
+    apr_pool_check_integrity(pool);
+
+    mark->node = pool->nodes;
+    mark->offset = pool->nodes ? pool->nodes->index : 0;
+}
+
+APR_DECLARE(void) apr_pool_rollback(apr_pool_t *pool,
+                                    const apr_pool_mark_t *mark)
+{
+    debug_node_t *node;
+    apr_uint32_t index;
+
+    apr_pool_check_integrity(pool);
+
+    /* Free the blocks allocated since the mark, scribbling over them
+     * first to help highlight use-after-free issues. */
+    while ((node = pool->nodes) != NULL) {
+        index = node == mark->node ? (apr_uint32_t)mark->offset : 0;
+        while (node->index > index) {
+            node->index--;
+            memset(node->beginp[node->index], POOL_POISON_BYTE,
+                   (char *)node->endp[node->index]
+                   - (char *)node->beginp[node->index]);
+            free(node->beginp[node->index]);
+            pool->stat_alloc--;
+        }
+        if (node == mark->node)
+            break;
+
+        pool->nodes = node->next;
+        memset(node, POOL_POISON_BYTE, SIZEOF_DEBUG_NODE_T);
+        free(node);
+    }
+}
+
 APR_DECLARE(void *) apr_pcalloc_debug(apr_pool_t *pool, apr_size_t size,
                                       const char *file_line)
 {
@@ -1788,8 +2729,6 @@ APR_DECLARE(void *) apr_pcalloc_debug(apr_pool_t *pool, apr_size_t size,
  * Pool creation/destruction (debug)
  */
 
-#define POOL_POISON_BYTE 'A'
-
 static void pool_clear_debug(apr_pool_t *pool, const char *file_line)
 {
     debug_node_t *node;
@@ -2274,6 +3213,42 @@ APR_DECLARE(apr_size_t) apr_pool_num_bytes(apr_pool_t *pool, int recurse)
     return size;
 }
 
+static int pool_stats_add(apr_pool_t *pool, void *data)
+{
+    apr_pool_stats_t *stats = (apr_pool_stats_t *)data;
+    debug_node_t *node;
+    apr_uint32_t index;
+    apr_size_t size;
+
+    stats->pools++;
+    stats->slow_allocs += pool->stat_alloc;
+
+    /* Every allocation is a malloc() of its own in debug mode */
+    for (node = pool->nodes; node; node = node->next) {
+        for (index = 0; index < node->index; index++) {
+            size = (char *)node->endp[index] - (char *)node->beginp[index];
+            stats->nodes++;
+            stats->size += size;
+            stats->used += size;
+        }
+    }
+
+    return 0;
+}
+
+APR_DECLARE(void) apr_pool_stats_get(apr_pool_stats_t *stats,
+                                     apr_pool_t *pool, int recurse)
+{
+    memset(stats, 0, sizeof(*stats));
+
+    if (!recurse) {
+        pool_stats_add(pool, stats);
+        return;
+    }
+
+    apr_pool_walk_tree(pool, pool_stats_add, stats);
+}
+
 APR_DECLARE(void) apr_pool_lock(apr_pool_t *pool, int flag)
 {
 }
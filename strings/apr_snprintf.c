@@ -256,6 +256,45 @@ static char *apr_gcvt(double number, int ndigit, char *buf, boolean_e altform)
     cc++;                                           \
 }
 
+/*
+ * Same as INS_CHAR for a string of len chars, copied as much at a time as
+ * the buffer can take (short strings byte per byte, cheaper than memcpy).
+ *
+ * NOTE: Evaluation of the str and len arguments should not have any
+ * side-effects
+ */
+#define INS_STR(str, len, sp, bep, cc)              \
+{                                                   \
+    const char *ins_s = (str);                      \
+    apr_size_t ins_len = (len);                     \
+    cc += (int)ins_len;                             \
+    if (sp) {                                       \
+        while (ins_len) {                           \
+            apr_size_t ins_room;                    \
+            if (sp >= bep) {                        \
+                vbuff->curpos = sp;                 \
+                if (flush_func(vbuff))              \
+                    return -1;                      \
+                sp = vbuff->curpos;                 \
+                bep = vbuff->endpos;                \
+            }                                       \
+            ins_room = bep - sp;                    \
+            if (ins_room > ins_len)                 \
+                ins_room = ins_len;                 \
+            ins_len -= ins_room;                    \
+            if (ins_room > 16) {                    \
+                memcpy(sp, ins_s, ins_room);        \
+                sp += ins_room;                     \
+                ins_s += ins_room;                  \
+            }                                       \
+            else {                                  \
+                while (ins_room--)                  \
+                    *sp++ = *ins_s++;               \
+            }                                       \
+        }                                           \
+    }                                               \
+}
+
 #define NUM(c) (c - '0')
 
 #define STR_TO_DEC(str, num)                        \
@@ -310,6 +349,46 @@ while (width > len)
     has_prefix=YES;
 
 
+/*
+ * The decimal numbers from 00 to 99, for converting two digits at a time
+ */
+static const char dec_pairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+/*
+ * Write the decimal digits of magnitude (at least 1) before p, two per
+ * division, and return the first one.
+ */
+static APR_INLINE char *conv_10_magnitude(register apr_uint32_t magnitude,
+                                          register char *p)
+{
+    while (magnitude >= 100) {
+        register apr_uint32_t new_magnitude = magnitude / 100;
+        const char *pair = &dec_pairs[(magnitude - new_magnitude * 100) * 2];
+
+        *--p = pair[1];
+        *--p = pair[0];
+        magnitude = new_magnitude;
+    }
+    if (magnitude >= 10) {
+        *--p = dec_pairs[magnitude * 2 + 1];
+        *--p = dec_pairs[magnitude * 2];
+    }
+    else {
+        *--p = (char) (magnitude + '0');
+    }
+    return p;
+}
+
 /*
  * Convert num to its decimal format.
  * Return value:
@@ -354,16 +433,7 @@ static char *conv_10(register apr_int32_t num, register int is_unsigned,
         }
     }
 
-    /*
-     * We use a do-while loop so that we write at least 1 digit 
-     */
-    do {
-        register apr_uint32_t new_magnitude = magnitude / 10;
-
-        *--p = (char) (magnitude - new_magnitude * 10 + '0');
-        magnitude = new_magnitude;
-    }
-    while (magnitude);
+    p = conv_10_magnitude(magnitude, p);
 
     *len = buf_end - p;
     return (p);
@@ -407,15 +477,19 @@ static char *conv_10_quad(apr_int64_t num, register int is_unsigned,
     }
 
     /*
-     * We use a do-while loop so that we write at least 1 digit 
+     * Two digits per division, down to 32 bits (more than 2 digits left)
      */
     do {
-        apr_uint64_t new_magnitude = magnitude / 10;
+        apr_uint64_t new_magnitude = magnitude / 100;
+        const char *pair = &dec_pairs[(magnitude - new_magnitude * 100) * 2];
 
-        *--p = (char) (magnitude - new_magnitude * 10 + '0');
+        *--p = pair[1];
+        *--p = pair[0];
         magnitude = new_magnitude;
     }
-    while (magnitude);
+    while (magnitude > APR_UINT32_MAX);
+
+    p = conv_10_magnitude((apr_uint32_t)magnitude, p);
 
     *len = buf_end - p;
     return (p);
@@ -621,6 +695,14 @@ static char *conv_p2(register apr_uint32_t num, register int nbits,
     static const char upper_digits[] = "0123456789ABCDEF";
     register const char *digits = (format == 'X') ? upper_digits : low_digits;
 
+    if (nbits == 4) {
+        /* Hex, the two digits of a byte per step */
+        while (num > 0xff) {
+            *--p = digits[num & 0xf];
+            *--p = digits[(num >> 4) & 0xf];
+            num >>= 8;
+        }
+    }
     do {
         *--p = digits[num & mask];
         num >>= nbits;
@@ -643,6 +725,14 @@ static char *conv_p2_quad(apr_uint64_t num, register int nbits,
     if (num <= APR_UINT32_MAX)
         return(conv_p2((apr_uint32_t)num, nbits, format, buf_end, len));
 
+    if (nbits == 4) {
+        /* Hex, the two digits of a byte per step */
+        while (num > 0xff) {
+            *--p = digits[num & 0xf];
+            *--p = digits[(num >> 4) & 0xf];
+            num >>= 8;
+        }
+    }
     do {
         *--p = digits[num & mask];
         num >>= nbits;
@@ -676,16 +766,221 @@ static char *conv_os_thread_t_hex(apr_os_thread_t *tid, char *buf_end, apr_size_
 }
 #endif
 
+enum var_type_enum {
+        IS_QUAD, IS_LONG, IS_SHORT, IS_INT
+};
+
 /*
- * Do format conversion placing the output in buffer
+ * A conversion specification: flags, width, precision and modifier, up to
+ * the conversion character
  */
-APR_DECLARE(int) apr_vformatter(int (*flush_func)(apr_vformatter_buff_t *),
-    apr_vformatter_buff_t *vbuff, const char *fmt, va_list ap)
+typedef struct format_spec_t {
+    /* For the precompiled formats, the run of literal characters before
+     * the conversion, which is NULL for the end of the format
+     */
+    const char *lit;
+    apr_size_t lit_len;
+    const char *conv;
+
+    apr_size_t min_width;
+    apr_size_t precision;
+    enum var_type_enum var_type;
+    char pad_char;
+    boolean_e adjust_left;
+    boolean_e alternate_form;
+    boolean_e print_sign;
+    boolean_e print_blank;
+    boolean_e adjust_width;
+    boolean_e adjust_precision;
+    /* The width and/or precision are '*', from the arguments */
+    boolean_e width_arg;
+    boolean_e precision_arg;
+} format_spec_t;
+
+struct apr_format_t {
+    const format_spec_t *specs;
+};
+
+/*
+ * Parse the size modifier at fmt, and return a pointer to the conversion
+ * character
+ */
+static APR_INLINE const char *parse_modifier(const char *fmt,
+                                             enum var_type_enum *var_type)
+{
+    /*
+     * Modifier check.  In same cases, APR_OFF_T_FMT can be
+     * "lld" and APR_INT64_T_FMT can be "ld" (that is, off_t is
+     * "larger" than int64). Check that case 1st.
+     * Note that if APR_OFF_T_FMT is "d",
+     * the first if condition is never true. If APR_INT64_T_FMT
+     * is "d' then the second if condition is never true.
+     */
+    if ((sizeof(APR_OFF_T_FMT) > sizeof(APR_INT64_T_FMT)) &&
+        ((sizeof(APR_OFF_T_FMT) == 4 &&
+         fmt[0] == APR_OFF_T_FMT[0] &&
+         fmt[1] == APR_OFF_T_FMT[1]) ||
+        (sizeof(APR_OFF_T_FMT) == 3 &&
+         fmt[0] == APR_OFF_T_FMT[0]) ||
+        (sizeof(APR_OFF_T_FMT) > 4 &&
+         strncmp(fmt, APR_OFF_T_FMT, 
+                 sizeof(APR_OFF_T_FMT) - 2) == 0))) {
+        /* Need to account for trailing 'd' and null in sizeof() */
+        *var_type = IS_QUAD;
+        fmt += (sizeof(APR_OFF_T_FMT) - 2);
+    }
+    else if ((sizeof(APR_INT64_T_FMT) == 4 &&
+         fmt[0] == APR_INT64_T_FMT[0] &&
+         fmt[1] == APR_INT64_T_FMT[1]) ||
+        (sizeof(APR_INT64_T_FMT) == 3 &&
+         fmt[0] == APR_INT64_T_FMT[0]) ||
+        (sizeof(APR_INT64_T_FMT) > 4 &&
+         strncmp(fmt, APR_INT64_T_FMT, 
+                 sizeof(APR_INT64_T_FMT) - 2) == 0)) {
+        /* Need to account for trailing 'd' and null in sizeof() */
+        *var_type = IS_QUAD;
+        fmt += (sizeof(APR_INT64_T_FMT) - 2);
+    }
+    else if (*fmt == 'q') {
+        *var_type = IS_QUAD;
+        fmt++;
+    }
+    else if (*fmt == 'l') {
+        *var_type = IS_LONG;
+        fmt++;
+    }
+    else if (*fmt == 'h') {
+        *var_type = IS_SHORT;
+        fmt++;
+    }
+    else {
+        *var_type = IS_INT;
+    }
+
+    return fmt;
+}
+
+/*
+ * Parse the conversion specification following a '%' at fmt, and return
+ * a pointer to the conversion character
+ */
+static const char *parse_spec(const char *fmt, format_spec_t *spec)
+{
+    /*
+     * Default variable settings
+     */
+    spec->adjust_left = spec->alternate_form = NO;
+    spec->print_sign = spec->print_blank = NO;
+    spec->width_arg = spec->precision_arg = NO;
+    spec->pad_char = ' ';
+    spec->min_width = spec->precision = 0;
+
+    /*
+     * Try to avoid checking for flags, width or precision
+     */
+    if (!apr_islower(*fmt)) {
+        /*
+         * Recognize flags: -, #, BLANK, +
+         */
+        for (;; fmt++) {
+            if (*fmt == '-')
+                spec->adjust_left = YES;
+            else if (*fmt == '+')
+                spec->print_sign = YES;
+            else if (*fmt == '#')
+                spec->alternate_form = YES;
+            else if (*fmt == ' ')
+                spec->print_blank = YES;
+            else if (*fmt == '0')
+                spec->pad_char = '0';
+            else
+                break;
+        }
+
+        /*
+         * Check if a width was specified
+         */
+        if (apr_isdigit(*fmt)) {
+            STR_TO_DEC(fmt, spec->min_width);
+            spec->adjust_width = YES;
+        }
+        else if (*fmt == '*') {
+            fmt++;
+            spec->adjust_width = YES;
+            spec->width_arg = YES;
+        }
+        else
+            spec->adjust_width = NO;
+
+        /*
+         * Check if a precision was specified
+         */
+        if (*fmt == '.') {
+            spec->adjust_precision = YES;
+            fmt++;
+            if (apr_isdigit(*fmt)) {
+                STR_TO_DEC(fmt, spec->precision);
+            }
+            else if (*fmt == '*') {
+                fmt++;
+                spec->precision_arg = YES;
+            }
+        }
+        else
+            spec->adjust_precision = NO;
+    }
+    else
+        spec->adjust_precision = spec->adjust_width = NO;
+
+    return parse_modifier(fmt, &spec->var_type);
+}
+
+/*
+ * Set the variables of vformatter() for the conversion spec, taking the
+ * '*' width and precision from the arguments
+ */
+#define SPEC_TO_VARS(spec)                                  \
+{                                                           \
+    adjust = (spec)->adjust_left ? LEFT : RIGHT;            \
+    alternate_form = (spec)->alternate_form;                \
+    print_sign = (spec)->print_sign;                        \
+    print_blank = (spec)->print_blank;                      \
+    pad_char = (spec)->pad_char;                            \
+    prefix_char = NUL;                                      \
+                                                            \
+    adjust_width = (spec)->adjust_width;                    \
+    min_width = (spec)->min_width;                          \
+    if ((spec)->width_arg) {                                \
+        int v = va_arg(ap, int);                            \
+        if (v < 0) {                                        \
+            adjust = LEFT;                                  \
+            min_width = (apr_size_t)(-v);                   \
+        }                                                   \
+        else                                                \
+            min_width = (apr_size_t)v;                      \
+    }                                                       \
+                                                            \
+    adjust_precision = (spec)->adjust_precision;            \
+    precision = (spec)->precision;                          \
+    if ((spec)->precision_arg) {                            \
+        int v = va_arg(ap, int);                            \
+        precision = (v < 0) ? 0 : (apr_size_t)v;            \
+    }                                                       \
+                                                            \
+    var_type = (spec)->var_type;                            \
+}
+
+/*
+ * Do format conversion placing the output in buffer, from the format
+ * string fmt or the precompiled specs
+ */
+static int vformatter(int (*flush_func)(apr_vformatter_buff_t *),
+                      apr_vformatter_buff_t *vbuff, const char *fmt,
+                      const format_spec_t *specs, va_list ap)
 {
     register char *sp;
     register char *bep;
     register int cc = 0;
-    register apr_size_t i;
 
     register char *s = NULL;
     char *q;
@@ -708,9 +1003,6 @@ APR_DECLARE(int) apr_vformatter(int (*flush_func)(apr_vformatter_buff_t *),
     char num_buf[NUM_BUF_SIZE];
     char char_buf[2];                /* for printing %% and %<unknown> */
 
-    enum var_type_enum {
-            IS_QUAD, IS_LONG, IS_SHORT, IS_INT
-    };
     enum var_type_enum var_type = IS_INT;
 
     /*
@@ -726,135 +1018,51 @@ APR_DECLARE(int) apr_vformatter(int (*flush_func)(apr_vformatter_buff_t *),
     sp = vbuff->curpos;
     bep = vbuff->endpos;
 
-    while (*fmt) {
-        if (*fmt != '%') {
-            INS_CHAR(*fmt, sp, bep, cc);
-        }
-        else {
+    while (specs || *fmt) {
+        if (!specs && *fmt != '%') {
             /*
-             * Default variable settings
+             * Copy the run of literal characters up to the next '%'
              */
-            boolean_e print_something = YES;
-            adjust = RIGHT;
-            alternate_form = print_sign = print_blank = NO;
-            pad_char = ' ';
-            prefix_char = NUL;
-
-            fmt++;
+            const char *run = fmt;
 
-            /*
-             * Try to avoid checking for flags, width or precision
-             */
-            if (!apr_islower(*fmt)) {
-                /*
-                 * Recognize flags: -, #, BLANK, +
-                 */
-                for (;; fmt++) {
-                    if (*fmt == '-')
-                        adjust = LEFT;
-                    else if (*fmt == '+')
-                        print_sign = YES;
-                    else if (*fmt == '#')
-                        alternate_form = YES;
-                    else if (*fmt == ' ')
-                        print_blank = YES;
-                    else if (*fmt == '0')
-                        pad_char = '0';
-                    else
-                        break;
-                }
+            do {
+                fmt++;
+            } while (*fmt && *fmt != '%');
+            INS_STR(run, fmt - run, sp, bep, cc);
+            continue;
+        }
+        else {
+            boolean_e print_something = YES;
 
+            if (specs) {
                 /*
-                 * Check if a width was specified
+                 * Precompiled, the literal run then the conversion
                  */
-                if (apr_isdigit(*fmt)) {
-                    STR_TO_DEC(fmt, min_width);
-                    adjust_width = YES;
-                }
-                else if (*fmt == '*') {
-                    int v = va_arg(ap, int);
-                    fmt++;
-                    adjust_width = YES;
-                    if (v < 0) {
-                        adjust = LEFT;
-                        min_width = (apr_size_t)(-v);
-                    }
-                    else
-                        min_width = (apr_size_t)v;
+                INS_STR(specs->lit, specs->lit_len, sp, bep, cc);
+                if (specs->conv == NULL) {
+                    break;
                 }
-                else
-                    adjust_width = NO;
-
+                fmt = specs->conv;
+                SPEC_TO_VARS(specs);
+                specs++;
+            }
+            else if (apr_islower(fmt[1])) {
                 /*
-                 * Check if a precision was specified
+                 * No flags, width or precision, the usual case: default
+                 * variable settings
                  */
-                if (*fmt == '.') {
-                    adjust_precision = YES;
-                    fmt++;
-                    if (apr_isdigit(*fmt)) {
-                        STR_TO_DEC(fmt, precision);
-                    }
-                    else if (*fmt == '*') {
-                        int v = va_arg(ap, int);
-                        fmt++;
-                        precision = (v < 0) ? 0 : (apr_size_t)v;
-                    }
-                    else
-                        precision = 0;
-                }
-                else
-                    adjust_precision = NO;
-            }
-            else
-                adjust_precision = adjust_width = NO;
-
-            /*
-             * Modifier check.  In same cases, APR_OFF_T_FMT can be
-             * "lld" and APR_INT64_T_FMT can be "ld" (that is, off_t is
-             * "larger" than int64). Check that case 1st.
-             * Note that if APR_OFF_T_FMT is "d",
-             * the first if condition is never true. If APR_INT64_T_FMT
-             * is "d' then the second if condition is never true.
-             */
-            if ((sizeof(APR_OFF_T_FMT) > sizeof(APR_INT64_T_FMT)) &&
-                ((sizeof(APR_OFF_T_FMT) == 4 &&
-                 fmt[0] == APR_OFF_T_FMT[0] &&
-                 fmt[1] == APR_OFF_T_FMT[1]) ||
-                (sizeof(APR_OFF_T_FMT) == 3 &&
-                 fmt[0] == APR_OFF_T_FMT[0]) ||
-                (sizeof(APR_OFF_T_FMT) > 4 &&
-                 strncmp(fmt, APR_OFF_T_FMT, 
-                         sizeof(APR_OFF_T_FMT) - 2) == 0))) {
-                /* Need to account for trailing 'd' and null in sizeof() */
-                var_type = IS_QUAD;
-                fmt += (sizeof(APR_OFF_T_FMT) - 2);
-            }
-            else if ((sizeof(APR_INT64_T_FMT) == 4 &&
-                 fmt[0] == APR_INT64_T_FMT[0] &&
-                 fmt[1] == APR_INT64_T_FMT[1]) ||
-                (sizeof(APR_INT64_T_FMT) == 3 &&
-                 fmt[0] == APR_INT64_T_FMT[0]) ||
-                (sizeof(APR_INT64_T_FMT) > 4 &&
-                 strncmp(fmt, APR_INT64_T_FMT, 
-                         sizeof(APR_INT64_T_FMT) - 2) == 0)) {
-                /* Need to account for trailing 'd' and null in sizeof() */
-                var_type = IS_QUAD;
-                fmt += (sizeof(APR_INT64_T_FMT) - 2);
-            }
-            else if (*fmt == 'q') {
-                var_type = IS_QUAD;
-                fmt++;
-            }
-            else if (*fmt == 'l') {
-                var_type = IS_LONG;
-                fmt++;
-            }
-            else if (*fmt == 'h') {
-                var_type = IS_SHORT;
-                fmt++;
+                adjust = RIGHT;
+                alternate_form = print_sign = print_blank = NO;
+                pad_char = ' ';
+                prefix_char = NUL;
+                adjust_width = adjust_precision = NO;
+                fmt = parse_modifier(fmt + 1, &var_type);
             }
             else {
-                var_type = IS_INT;
+                format_spec_t parsed;
+
+                fmt = parse_spec(fmt + 1, &parsed);
+                SPEC_TO_VARS(&parsed);
             }
 
             /*
@@ -1326,10 +1534,7 @@ APR_DECLARE(int) apr_vformatter(int (*flush_func)(apr_vformatter_buff_t *),
              * Print the string s. 
              */
             if (print_something == YES) {
-                for (i = s_len; i != 0; i--) {
-                      INS_CHAR(*s, sp, bep, cc);
-                    s++;
-                }
+                INS_STR(s, s_len, sp, bep, cc);
             }
 
             if (adjust_width && adjust == LEFT && min_width > s_len)
@@ -1342,6 +1547,64 @@ APR_DECLARE(int) apr_vformatter(int (*flush_func)(apr_vformatter_buff_t *),
     return cc;
 }
 
+APR_DECLARE(int) apr_vformatter(int (*flush_func)(apr_vformatter_buff_t *),
+    apr_vformatter_buff_t *vbuff, const char *fmt, va_list ap)
+{
+    return vformatter(flush_func, vbuff, fmt, NULL, ap);
+}
+
+APR_DECLARE(const apr_format_t *) apr_format_compile(apr_pool_t *p,
+                                                     const char *fmt)
+{
+    apr_format_t *format;
+    format_spec_t *spec;
+    const char *f;
+    apr_size_t n = 1;
+
+    /* At most a conversion per '%', and the end */
+    fmt = apr_pstrdup(p, fmt);
+    for (f = fmt; *f; f++) {
+        if (*f == '%') {
+            n++;
+        }
+    }
+    format = apr_palloc(p, sizeof(*format));
+    format->specs = spec = apr_palloc(p, n * sizeof(*spec));
+
+    for (;; spec++) {
+        spec->lit = fmt;
+        while (*fmt && *fmt != '%') {
+            fmt++;
+        }
+        spec->lit_len = fmt - spec->lit;
+        if (!*fmt) {
+            spec->conv = NULL;
+            break;
+        }
+
+        /*
+         * The conversion is at the end of the spec, then comes the next
+         * literal run (after the second type specifier of %p)
+         */
+        fmt = spec->conv = parse_spec(fmt + 1, spec);
+        if (*fmt == 'p' && fmt[1]) {
+            fmt++;
+        }
+        if (*fmt) {
+            fmt++;
+        }
+    }
+
+    return format;
+}
+
+APR_DECLARE(int) apr_format_apply(int (*flush_func)(apr_vformatter_buff_t *),
+                                  apr_vformatter_buff_t *vbuff,
+                                  const apr_format_t *format, va_list ap)
+{
+    return vformatter(flush_func, vbuff, NULL, format->specs, ap);
+}
+
 
 static int snprintf_flush(apr_vformatter_buff_t *vbuff)
 {
@@ -1384,6 +1647,32 @@ APR_DECLARE_NONSTD(int) apr_snprintf(char *buf, apr_size_t len,
 }
 
 
+APR_DECLARE_NONSTD(int) apr_format_snprintf(char *buf, apr_size_t len,
+                                            const apr_format_t *format, ...)
+{
+    int cc;
+    va_list ap;
+    apr_vformatter_buff_t vbuff;
+
+    if (len == 0) {
+        /* See above note */
+        vbuff.curpos = NULL;
+        vbuff.endpos = NULL;
+    } else {
+        /* save one byte for nul terminator */
+        vbuff.curpos = buf;
+        vbuff.endpos = buf + len - 1;
+    }
+    va_start(ap, format);
+    cc = apr_format_apply(snprintf_flush, &vbuff, format, ap);
+    va_end(ap);
+    if (len != 0) {
+        *vbuff.curpos = '\0';
+    }
+    return (cc == -1) ? (int)len - 1 : cc;
+}
+
+
 APR_DECLARE(int) apr_vsnprintf(char *buf, apr_size_t len, const char *format,
                                va_list ap)
 {
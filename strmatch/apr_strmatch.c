@@ -22,6 +22,16 @@
 
 #define NUM_CHARS  256
 
+typedef struct strmatch_context_t {
+    /* Boyer-Moore-Horspool shifts, indexed by the (lowercased) last byte */
+    apr_size_t shift[NUM_CHARS];
+    /* The bytes matching the first and the last bytes of the pattern, the
+     * same byte twice when case sensitive (see match_candidates())
+     */
+    unsigned char first[2];
+    unsigned char last[2];
+} strmatch_context_t;
+
 /*
  * String searching functions
  */
@@ -36,7 +46,8 @@ static const char *match_boyer_moore_horspool(
                                const char *s, apr_size_t slen)
 {
     const char *s_end = s + slen;
-    apr_size_t *shift = (apr_size_t *)(this_pattern->context);
+    const apr_size_t *shift =
+        ((const strmatch_context_t *)this_pattern->context)->shift;
     const char *s_next = s + this_pattern->length - 1;
     const char *p_start = this_pattern->pattern;
     const char *p_end = p_start + this_pattern->length - 1;
@@ -60,7 +71,8 @@ static const char *match_boyer_moore_horspool_nocase(
                                const char *s, apr_size_t slen)
 {
     const char *s_end = s + slen;
-    apr_size_t *shift = (apr_size_t *)(this_pattern->context);
+    const apr_size_t *shift =
+        ((const strmatch_context_t *)this_pattern->context)->shift;
     const char *s_next = s + this_pattern->length - 1;
     const char *p_start = this_pattern->pattern;
     const char *p_end = p_start + this_pattern->length - 1;
@@ -79,11 +91,174 @@ static const char *match_boyer_moore_horspool_nocase(
     return NULL;
 }
 
+/* The SIMD searches, where the compiler can target SSE2 and AVX2 without
+ * building everything for them, used if the CPU has them: the positions
+ * where both the first and the last bytes of the pattern are found are
+ * looked for in blocks of 16 or 32 at once, and only these candidates are
+ * compared with the whole pattern. Horspool's shifts are rarely much longer
+ * than a block for usual patterns, and comparing one byte per shift costs
+ * more than comparing a block.
+ */
+#if (defined(__x86_64__) || defined(__i386__)) \
+    && (defined(__clang__) \
+        || (defined(__GNUC__) \
+            && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#define HAVE_STRMATCH_SIMD 1
+
+#include <immintrin.h>
+
+static APR_INLINE int match_verify(const apr_strmatch_pattern *this_pattern,
+                                   const char *s, int nocase)
+{
+    const char *p = this_pattern->pattern;
+    apr_size_t len = this_pattern->length, i;
+
+    /* The first and last bytes are known to match already */
+    if (!nocase) {
+        return len <= 2 || memcmp(s + 1, p + 1, len - 2) == 0;
+    }
+    for (i = 1; i + 1 < len; i++) {
+        if (apr_tolower(s[i]) != apr_tolower(p[i])) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+__attribute__((target("sse2")))
+static APR_INLINE const char *match_sse2_core(
+                               const apr_strmatch_pattern *this_pattern,
+                               const char *s, apr_size_t slen, int nocase)
+{
+    const strmatch_context_t *ctx = this_pattern->context;
+    const __m128i first0 = _mm_set1_epi8((char)ctx->first[0]);
+    const __m128i first1 = _mm_set1_epi8((char)ctx->first[1]);
+    const __m128i last0 = _mm_set1_epi8((char)ctx->last[0]);
+    const __m128i last1 = _mm_set1_epi8((char)ctx->last[1]);
+    apr_size_t last = this_pattern->length - 1, i;
+
+    for (i = 0; i + last + 16 <= slen; i += 16) {
+        __m128i f = _mm_loadu_si128((const __m128i *)(s + i));
+        __m128i l = _mm_loadu_si128((const __m128i *)(s + i + last));
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(_mm_and_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(f, first0),
+                             _mm_cmpeq_epi8(f, first1)),
+                _mm_or_si128(_mm_cmpeq_epi8(l, last0),
+                             _mm_cmpeq_epi8(l, last1))));
+
+        while (mask) {
+            const char *c = s + i + __builtin_ctz(mask);
+
+            if (match_verify(this_pattern, c, nocase)) {
+                return c;
+            }
+            mask &= mask - 1;
+        }
+    }
+
+    /* Less than a block left */
+    if (nocase) {
+        return match_boyer_moore_horspool_nocase(this_pattern, s + i,
+                                                 slen - i);
+    }
+    return match_boyer_moore_horspool(this_pattern, s + i, slen - i);
+}
+
+__attribute__((target("sse2")))
+static const char *match_sse2(const apr_strmatch_pattern *this_pattern,
+                              const char *s, apr_size_t slen)
+{
+    return match_sse2_core(this_pattern, s, slen, 0);
+}
+
+__attribute__((target("sse2")))
+static const char *match_sse2_nocase(const apr_strmatch_pattern *this_pattern,
+                                     const char *s, apr_size_t slen)
+{
+    return match_sse2_core(this_pattern, s, slen, 1);
+}
+
+__attribute__((target("avx2")))
+static APR_INLINE const char *match_avx2_core(
+                               const apr_strmatch_pattern *this_pattern,
+                               const char *s, apr_size_t slen, int nocase)
+{
+    const strmatch_context_t *ctx = this_pattern->context;
+    const __m256i first0 = _mm256_set1_epi8((char)ctx->first[0]);
+    const __m256i first1 = _mm256_set1_epi8((char)ctx->first[1]);
+    const __m256i last0 = _mm256_set1_epi8((char)ctx->last[0]);
+    const __m256i last1 = _mm256_set1_epi8((char)ctx->last[1]);
+    apr_size_t last = this_pattern->length - 1, i;
+
+    for (i = 0; i + last + 32 <= slen; i += 32) {
+        __m256i f = _mm256_loadu_si256((const __m256i *)(s + i));
+        __m256i l = _mm256_loadu_si256((const __m256i *)(s + i + last));
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(
+            _mm256_and_si256(
+                _mm256_or_si256(_mm256_cmpeq_epi8(f, first0),
+                                _mm256_cmpeq_epi8(f, first1)),
+                _mm256_or_si256(_mm256_cmpeq_epi8(l, last0),
+                                _mm256_cmpeq_epi8(l, last1))));
+
+        while (mask) {
+            const char *c = s + i + __builtin_ctz(mask);
+
+            if (match_verify(this_pattern, c, nocase)) {
+                return c;
+            }
+            mask &= mask - 1;
+        }
+    }
+
+    /* Less than a block left, maybe a half one */
+    return match_sse2_core(this_pattern, s + i, slen - i, nocase);
+}
+
+__attribute__((target("avx2")))
+static const char *match_avx2(const apr_strmatch_pattern *this_pattern,
+                              const char *s, apr_size_t slen)
+{
+    return match_avx2_core(this_pattern, s, slen, 0);
+}
+
+__attribute__((target("avx2")))
+static const char *match_avx2_nocase(const apr_strmatch_pattern *this_pattern,
+                                     const char *s, apr_size_t slen)
+{
+    return match_avx2_core(this_pattern, s, slen, 1);
+}
+
+/* 0: no SIMD, 1: SSE2, 2: AVX2 */
+static int strmatch_simd_supported = -1;
+
+/* Set the bytes matching c case insensitively (like apr_tolower() does) in
+ * match[2], and return whether there are no more than two of them.
+ */
+static int match_candidates(unsigned char match[2], char c)
+{
+    int i, n = 0;
+
+    for (i = 0; i < NUM_CHARS; i++) {
+        if (apr_tolower(i) == apr_tolower((unsigned char)c)) {
+            if (n == 2) {
+                return 0;
+            }
+            match[n++] = (unsigned char)i;
+        }
+    }
+    if (n == 1) {
+        match[1] = match[0];
+    }
+    return 1;
+}
+#endif /* HAVE_STRMATCH_SIMD */
+
 APR_DECLARE(const apr_strmatch_pattern *) apr_strmatch_precompile(
                                               apr_pool_t *p, const char *s,
                                               int case_sensitive)
 {
     apr_strmatch_pattern *pattern;
+    strmatch_context_t *ctx;
     apr_size_t i;
     apr_size_t *shift;
 
@@ -96,7 +271,8 @@ APR_DECLARE(const apr_strmatch_pattern *) apr_strmatch_precompile(
         return pattern;
     }
 
-    shift = (apr_size_t *)apr_palloc(p, sizeof(apr_size_t) * NUM_CHARS);
+    ctx = apr_palloc(p, sizeof(*ctx));
+    shift = ctx->shift;
     for (i = 0; i < NUM_CHARS; i++) {
         shift[i] = pattern->length;
     }
@@ -112,7 +288,30 @@ APR_DECLARE(const apr_strmatch_pattern *) apr_strmatch_precompile(
             shift[(unsigned char)apr_tolower(s[i])] = pattern->length - i - 1;
         }
     }
-    pattern->context = shift;
+    pattern->context = ctx;
+
+#if HAVE_STRMATCH_SIMD
+    if (strmatch_simd_supported < 0) {
+        __builtin_cpu_init();
+        strmatch_simd_supported = __builtin_cpu_supports("avx2") ? 2
+                                  : __builtin_cpu_supports("sse2") ? 1 : 0;
+    }
+    if (case_sensitive) {
+        ctx->first[0] = ctx->first[1] = (unsigned char)s[0];
+        ctx->last[0] = ctx->last[1] = (unsigned char)s[pattern->length - 1];
+    }
+    else if (!match_candidates(ctx->first, s[0])
+             || !match_candidates(ctx->last, s[pattern->length - 1])) {
+        /* Odd locale, keep to Horspool */
+        return pattern;
+    }
+    if (strmatch_simd_supported == 2) {
+        pattern->compare = case_sensitive ? match_avx2 : match_avx2_nocase;
+    }
+    else if (strmatch_simd_supported == 1) {
+        pattern->compare = case_sensitive ? match_sse2 : match_sse2_nocase;
+    }
+#endif
 
     return pattern;
 }
@@ -0,0 +1,306 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "apr_strmatch.h"
+#include "apr_lib.h"
+#define APR_WANT_STRFUNC
+#include "apr_want.h"
+
+#define NUM_CHARS  256
+
+/*
+ * Aho-Corasick automaton, as a DFA: each state is the longest suffix of
+ * the input which is a prefix of a pattern, and the table gives the next
+ * state for each class of bytes. The bytes are classed so that the rows
+ * are as short as the number of distinct bytes in the patterns (plus one
+ * for all the others), which keeps the table small enough to stay in the
+ * cache with hundreds of patterns.
+ */
+struct apr_strmatch_multi_t {
+    /* Class of each byte, the same for the cases of a letter if
+     * case insensitive
+     */
+    unsigned char cls[NUM_CHARS];
+    apr_uint32_t nclasses;
+    apr_uint32_t nstates;
+    /* Next states, nstates rows of nclasses, either 16 or 32 bit */
+    const apr_uint16_t *table16;
+    const apr_uint32_t *table32;
+    /* Whether some patterns end in a state */
+    const unsigned char *final;
+    /* The longest pattern ending in a state, or -1 */
+    const int *out;
+    /* The next state for the shorter patterns ending there (the longest
+     * suffix state with an out), or 0
+     */
+    const apr_uint32_t *dict;
+    /* The next pattern which is the same string, or -1 */
+    const int *same;
+    /* Pattern lengths */
+    const apr_size_t *lens;
+};
+
+APR_DECLARE(const apr_strmatch_multi_t *) apr_strmatch_multi_precompile(
+                                              apr_pool_t *p,
+                                              const char * const *patterns,
+                                              int npatterns,
+                                              int case_sensitive)
+{
+    apr_strmatch_multi_t *multi;
+    apr_pool_t *tmp;
+    apr_uint32_t *table, *fail, *queue, *dict;
+    apr_uint32_t nclasses, nstates, head, tail, n, c;
+    apr_size_t total = 0, *lens;
+    unsigned char used[NUM_CHARS], *final;
+    int *out, *same;
+    int i;
+
+    if (npatterns <= 0) {
+        return NULL;
+    }
+
+    multi = apr_pcalloc(p, sizeof(*multi));
+    lens = apr_palloc(p, npatterns * sizeof(*lens));
+    same = apr_palloc(p, npatterns * sizeof(*same));
+
+    /* Class the bytes of the patterns, 0 is for the others (unless there
+     * are none)
+     */
+    memset(used, 0, sizeof(used));
+    for (i = 0; i < npatterns; i++) {
+        const unsigned char *s = (const unsigned char *)patterns[i];
+
+        lens[i] = strlen(patterns[i]);
+        if (lens[i] == 0) {
+            return NULL;
+        }
+        total += lens[i];
+        for (; *s; s++) {
+            used[case_sensitive ? *s : (unsigned char)apr_tolower(*s)] = 1;
+        }
+    }
+    for (nclasses = 0, c = 0; c < NUM_CHARS; c++) {
+        nclasses += used[c];
+    }
+    nclasses = (nclasses < NUM_CHARS) ? 1 : 0;
+    for (c = 0; c < NUM_CHARS; c++) {
+        multi->cls[c] = used[c] ? nclasses++ : 0;
+    }
+    if (!case_sensitive) {
+        for (c = 0; c < NUM_CHARS; c++) {
+            multi->cls[c] = multi->cls[(unsigned char)apr_tolower(c)];
+        }
+    }
+    multi->nclasses = nclasses;
+
+    if (apr_pool_create(&tmp, p) != APR_SUCCESS) {
+        return NULL;
+    }
+
+    /* The trie of the patterns, at most a state per byte and the root;
+     * a 0 transition is a missing one (the root is nobody's child)
+     */
+    table = apr_pcalloc(tmp, (total + 1) * nclasses * sizeof(*table));
+    out = apr_palloc(p, (total + 1) * sizeof(*out));
+    out[0] = -1;
+    nstates = 1;
+    for (i = 0; i < npatterns; i++) {
+        const unsigned char *s = (const unsigned char *)patterns[i];
+
+        for (n = 0; *s; s++) {
+            apr_uint32_t *next = &table[n * nclasses + multi->cls[*s]];
+
+            if (!*next) {
+                out[nstates] = -1;
+                *next = nstates++;
+            }
+            n = *next;
+        }
+
+        /* Duplicates are chained in order */
+        same[i] = -1;
+        if (out[n] < 0) {
+            out[n] = i;
+        }
+        else {
+            int *last = &out[n];
+
+            while (*last >= 0) {
+                last = &same[*last];
+            }
+            *last = i;
+        }
+    }
+
+    /* Breadth first, fill the missing transitions of each state with the
+     * ones of its failure state (shallower, so done already)
+     */
+    fail = apr_palloc(tmp, nstates * sizeof(*fail));
+    queue = apr_palloc(tmp, nstates * sizeof(*queue));
+    dict = apr_palloc(p, nstates * sizeof(*dict));
+    final = apr_palloc(p, nstates);
+    fail[0] = dict[0] = 0;
+    final[0] = 0;
+    head = tail = 0;
+    queue[tail++] = 0;
+    while (head < tail) {
+        apr_uint32_t r = queue[head++];
+        apr_uint32_t *row = &table[r * nclasses];
+        const apr_uint32_t *frow = &table[fail[r] * nclasses];
+
+        for (c = 0; c < nclasses; c++) {
+            apr_uint32_t u = row[c];
+
+            if (u) {
+                apr_uint32_t f = r ? frow[c] : 0;
+
+                fail[u] = f;
+                dict[u] = out[f] >= 0 ? f : dict[f];
+                final[u] = out[u] >= 0 || dict[u] != 0;
+                queue[tail++] = u;
+            }
+            else if (r) {
+                row[c] = frow[c];
+            }
+        }
+    }
+
+    if (nstates <= 65536) {
+        apr_uint16_t *table16;
+        apr_size_t j;
+
+        table16 = apr_palloc(p, nstates * nclasses * sizeof(*table16));
+        for (j = 0; j < (apr_size_t)nstates * nclasses; j++) {
+            table16[j] = (apr_uint16_t)table[j];
+        }
+        multi->table16 = table16;
+    }
+    else {
+        apr_uint32_t *table32;
+
+        table32 = apr_palloc(p, nstates * nclasses * sizeof(*table32));
+        memcpy(table32, table, nstates * nclasses * sizeof(*table32));
+        multi->table32 = table32;
+    }
+    apr_pool_destroy(tmp);
+
+    multi->nstates = nstates;
+    multi->final = final;
+    multi->out = out;
+    multi->dict = dict;
+    multi->same = same;
+    multi->lens = lens;
+    return multi;
+}
+
+/* Run the automaton from *node until the end of s or a final state,
+ * returning the number of bytes consumed
+ */
+static APR_INLINE apr_size_t multi_scan(const apr_strmatch_multi_t *multi,
+                                        apr_uint32_t *node,
+                                        const unsigned char *s,
+                                        apr_size_t slen)
+{
+    const unsigned char *cls = multi->cls;
+    const unsigned char *final = multi->final;
+    apr_uint32_t nclasses = multi->nclasses;
+    apr_uint32_t n = *node;
+    apr_size_t i = 0;
+
+    if (multi->table16) {
+        const apr_uint16_t *table = multi->table16;
+
+        while (i < slen) {
+            n = table[n * nclasses + cls[s[i++]]];
+            if (final[n]) {
+                break;
+            }
+        }
+    }
+    else {
+        const apr_uint32_t *table = multi->table32;
+
+        while (i < slen) {
+            n = table[n * nclasses + cls[s[i++]]];
+            if (final[n]) {
+                break;
+            }
+        }
+    }
+    *node = n;
+    return i;
+}
+
+APR_DECLARE(const char *) apr_strmatch_multi_first(
+                                              const apr_strmatch_multi_t *multi,
+                                              const char *s, apr_size_t slen,
+                                              int *id)
+{
+    apr_uint32_t n = 0;
+    apr_size_t i;
+    int match;
+
+    i = multi_scan(multi, &n, (const unsigned char *)s, slen);
+    if (!multi->final[n]) {
+        return NULL;
+    }
+    match = multi->out[n] >= 0 ? multi->out[n] : multi->out[multi->dict[n]];
+    if (id) {
+        *id = match;
+    }
+    return s + i - multi->lens[match];
+}
+
+APR_DECLARE(void) apr_strmatch_multi_state_init(
+                                          apr_strmatch_multi_state_t *state)
+{
+    state->node = 0;
+    state->offset = 0;
+}
+
+APR_DECLARE(int) apr_strmatch_multi_exec(const apr_strmatch_multi_t *multi,
+                                         apr_strmatch_multi_state_t *state,
+                                         const char *s, apr_size_t slen,
+                                         apr_strmatch_multi_callback_fn_t *comp,
+                                         void *rec)
+{
+    const unsigned char *u = (const unsigned char *)s;
+    apr_size_t i = 0;
+
+    while (i < slen) {
+        apr_uint32_t n;
+
+        i += multi_scan(multi, &state->node, u + i, slen - i);
+        if (!multi->final[state->node]) {
+            break;
+        }
+        for (n = state->node; n; n = multi->dict[n]) {
+            int id;
+
+            for (id = multi->out[n]; id >= 0; id = multi->same[id]) {
+                apr_off_t start = state->offset + (apr_off_t)i
+                                  - (apr_off_t)multi->lens[id];
+
+                if (!comp(rec, id, start)) {
+                    state->offset += i;
+                    return FALSE;
+                }
+            }
+        }
+    }
+    state->offset += slen;
+    return TRUE;
+}
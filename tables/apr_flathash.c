@@ -0,0 +1,603 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "apr_private.h"
+
+#include "apr_general.h"
+#include "apr_pools.h"
+#include "apr_time.h"
+
+#include "apr_flathash.h"
+
+#if APR_HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#if APR_HAVE_STRING_H
+#include <string.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) \
+    || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FLATHASH_SSE2 1
+#endif
+
+/*
+ * The internal form of a flat hash table.
+ *
+ * The entries live in an array of slots indexed by the hash of the key,
+ * collisions are resolved by open addressing.  Each slot has a control
+ * byte in a parallel array, which tells whether the slot is empty, was
+ * deleted, or is full, in which case it holds the low 7 bits of the
+ * entry's hash.  Lookups compare the control bytes of a whole group of
+ * slots at once (one SSE2 instruction), and only look at the slots whose
+ * control byte matches, so that most of the probed slots are never
+ * touched.  A group can start at any slot, the first GROUP_WIDTH control
+ * bytes are cloned after the last ones for the groups wrapping around.
+ *
+ * The probing goes group after group, by increasing steps (triangular
+ * numbers of groups, which visit all of them in a power of two table),
+ * and stops at the first group with an empty slot.  There is always one
+ * since the table grows before it is 7/8 full (including the deleted
+ * slots, which are dropped when it grows).
+ */
+
+#define GROUP_WIDTH 16
+
+#define CTRL_EMPTY   ((signed char)-128)
+#define CTRL_DELETED ((signed char)-2)
+#define CTRL_IS_FULL(c) ((c) >= 0)
+
+#define INITIAL_CAPACITY 16 /* tunable == 2^n >= GROUP_WIDTH */
+#define MAX_LOAD(capacity) ((capacity) - (capacity) / 8)
+
+/* Position in the table, and control byte, from the hash */
+#define H1(hash) (((hash) >> 7) | ((hash) << 25))
+#define H2(hash) ((signed char)((hash) & 0x7f))
+
+typedef struct flathash_slot_t {
+    const void   *key;
+    apr_ssize_t   klen;
+    const void   *val;
+    unsigned int  hash;
+} flathash_slot_t;
+
+/* Inline keys follow the slot */
+#define SLOT_HEADER_SIZE APR_ALIGN_DEFAULT(sizeof(flathash_slot_t))
+
+#define SLOT(ht, i) \
+    ((flathash_slot_t *)((ht)->slots + (apr_size_t)(i) * (ht)->slot_size))
+#define SLOT_INDEX(ht, slot) \
+    (((char *)(slot) - (ht)->slots) / (ht)->slot_size)
+#define SLOT_KEY(ht, slot) \
+    ((ht)->key_size ? (const void *)((char *)(slot) + SLOT_HEADER_SIZE) \
+                    : (slot)->key)
+
+/*
+ * Data structure for iterating through a flat hash table.
+ */
+struct apr_flathash_index_t {
+    apr_flathash_t      *ht;
+    flathash_slot_t     *this;
+    apr_size_t           index;
+};
+
+/*
+ * The capacity is always a power of two, we keep the mask to use
+ * bitwise-AND for modular arithmetic.
+ */
+struct apr_flathash_t {
+    apr_pool_t           *pool;
+    char                 *slots;
+    signed char          *ctrl;     /* capacity + GROUP_WIDTH bytes */
+    apr_size_t            mask;
+    apr_size_t            growth_left;
+    apr_size_t            slot_size, key_size;
+    apr_flathash_index_t  iterator; /* For apr_flathash_first(NULL, ...) */
+    unsigned int          count, seed;
+    apr_hashfunc_t        hash_func;
+};
+
+
+/*
+ * Group matching, the bit i of the returned mask is set when the slot
+ * i of the group matches.
+ */
+
+#if FLATHASH_SSE2
+
+static APR_INLINE unsigned int group_match(const signed char *group,
+                                           signed char h2)
+{
+    __m128i ctrl = _mm_loadu_si128((const __m128i *)group);
+
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(h2)));
+}
+
+/* Empty or deleted slots, the only ones with the sign bit set */
+static APR_INLINE unsigned int group_match_free(const signed char *group)
+{
+    return _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)group));
+}
+
+#else
+
+static APR_INLINE unsigned int group_match(const signed char *group,
+                                           signed char h2)
+{
+    unsigned int i, mask = 0;
+
+    for (i = 0; i < GROUP_WIDTH; i++) {
+        mask |= (unsigned int)(group[i] == h2) << i;
+    }
+    return mask;
+}
+
+static APR_INLINE unsigned int group_match_free(const signed char *group)
+{
+    unsigned int i, mask = 0;
+
+    for (i = 0; i < GROUP_WIDTH; i++) {
+        mask |= (unsigned int)(group[i] < 0) << i;
+    }
+    return mask;
+}
+
+#endif /* FLATHASH_SSE2 */
+
+#define group_match_empty(group) group_match(group, CTRL_EMPTY)
+
+#if defined(__GNUC__)
+#define PREFETCH(p) __builtin_prefetch(p)
+#elif FLATHASH_SSE2
+#define PREFETCH(p) _mm_prefetch((const char *)(p), _MM_HINT_T0)
+#else
+#define PREFETCH(p)
+#endif
+
+static APR_INLINE unsigned int lowest_bit(unsigned int mask)
+{
+#if defined(__GNUC__)
+    return __builtin_ctz(mask);
+#else
+    unsigned int n = 0;
+
+    while (!(mask & 1)) {
+        mask >>= 1;
+        n++;
+    }
+    return n;
+#endif
+}
+
+static APR_INLINE unsigned int highest_bit(unsigned int mask)
+{
+#if defined(__GNUC__)
+    return 31 - __builtin_clz(mask);
+#else
+    unsigned int n = 0;
+
+    while (mask >>= 1) {
+        n++;
+    }
+    return n;
+#endif
+}
+
+static APR_INLINE void set_ctrl(apr_flathash_t *ht, apr_size_t i,
+                                signed char c)
+{
+    ht->ctrl[i] = c;
+    /* the clone for i < GROUP_WIDTH, i itself otherwise */
+    ht->ctrl[((i - GROUP_WIDTH) & ht->mask) + GROUP_WIDTH] = c;
+}
+
+
+/*
+ * Hash functions.
+ */
+
+static unsigned int hashfunc_default(const unsigned char *key,
+                                     apr_ssize_t *klen, unsigned int hash)
+{
+    const unsigned char *p;
+    apr_ssize_t i;
+
+    /* The `times 33' hash of apr_hash.c */
+    if (*klen == APR_HASH_KEY_STRING) {
+        for (p = key; *p; p++) {
+            hash = hash * 33 + *p;
+        }
+        *klen = p - key;
+    }
+    else {
+        for (p = key, i = *klen; i; i--, p++) {
+            hash = hash * 33 + *p;
+        }
+    }
+
+    return hash;
+}
+
+static APR_INLINE unsigned int hash_key(apr_flathash_t *ht, const void *key,
+                                        apr_ssize_t *klen)
+{
+    unsigned int hash;
+
+    if (ht->key_size)
+        *klen = ht->key_size;
+
+    if (ht->hash_func)
+        hash = ht->hash_func(key, klen);
+    else
+        hash = hashfunc_default(key, klen, ht->seed);
+
+    /* Both H1 and H2 need well mixed bits (murmur3's finalizer) */
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6b;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35;
+    hash ^= hash >> 16;
+
+    return hash;
+}
+
+
+/*
+ * Hash creation functions.
+ */
+
+static void alloc_arrays(apr_flathash_t *ht, apr_size_t capacity)
+{
+    apr_size_t size = APR_ALIGN_DEFAULT(capacity * ht->slot_size);
+
+    ht->slots = apr_palloc(ht->pool, size + capacity + GROUP_WIDTH);
+    ht->ctrl = (signed char *)ht->slots + size;
+    memset(ht->ctrl, CTRL_EMPTY, capacity + GROUP_WIDTH);
+    ht->mask = capacity - 1;
+    ht->growth_left = MAX_LOAD(capacity);
+}
+
+static apr_size_t capacity_for(unsigned int nelts)
+{
+    apr_size_t capacity = INITIAL_CAPACITY;
+
+    while (MAX_LOAD(capacity) < nelts) {
+        capacity *= 2;
+    }
+    return capacity;
+}
+
+APR_DECLARE(apr_flathash_t *) apr_flathash_make_ex(apr_pool_t *pool,
+                                                   apr_hashfunc_t hash_func,
+                                                   apr_size_t key_size,
+                                                   unsigned int nelts)
+{
+    apr_flathash_t *ht;
+    apr_time_t now = apr_time_now();
+
+    ht = apr_palloc(pool, sizeof(apr_flathash_t));
+    ht->pool = pool;
+    ht->count = 0;
+    ht->seed = (unsigned int)((now >> 32) ^ now ^ (apr_uintptr_t)pool ^
+                              (apr_uintptr_t)ht ^ (apr_uintptr_t)&now) - 1;
+    ht->hash_func = hash_func;
+    ht->key_size = key_size;
+    ht->slot_size = SLOT_HEADER_SIZE + APR_ALIGN_DEFAULT(key_size);
+    alloc_arrays(ht, capacity_for(nelts));
+
+    return ht;
+}
+
+APR_DECLARE(apr_flathash_t *) apr_flathash_make(apr_pool_t *pool)
+{
+    return apr_flathash_make_ex(pool, NULL, 0, 0);
+}
+
+APR_DECLARE(apr_flathash_t *) apr_flathash_make_custom(apr_pool_t *pool,
+                                                   apr_hashfunc_t hash_func)
+{
+    return apr_flathash_make_ex(pool, hash_func, 0, 0);
+}
+
+APR_DECLARE(apr_flathash_t *) apr_flathash_copy(apr_pool_t *pool,
+                                                const apr_flathash_t *orig)
+{
+    apr_flathash_t *ht;
+    apr_size_t capacity = orig->mask + 1;
+
+    ht = apr_palloc(pool, sizeof(apr_flathash_t));
+    *ht = *orig;
+    ht->pool = pool;
+    alloc_arrays(ht, capacity);
+    memcpy(ht->slots, orig->slots, capacity * orig->slot_size);
+    memcpy(ht->ctrl, orig->ctrl, capacity + GROUP_WIDTH);
+    ht->growth_left = orig->growth_left;
+
+    return ht;
+}
+
+
+/*
+ * Probing.
+ */
+
+static flathash_slot_t *find_slot(apr_flathash_t *ht, const void *key,
+                                  apr_ssize_t klen, unsigned int hash)
+{
+    apr_size_t pos = H1(hash) & ht->mask, step = 0;
+    signed char h2 = H2(hash);
+
+    /* Most entries are in their first slot or close to it, load it while
+     * the control bytes are loaded rather than after */
+    PREFETCH(SLOT(ht, pos));
+
+    for (;;) {
+        const signed char *group = ht->ctrl + pos;
+        unsigned int match = group_match(group, h2);
+
+        while (match) {
+            flathash_slot_t *slot = SLOT(ht, (pos + lowest_bit(match))
+                                              & ht->mask);
+
+            if (slot->hash == hash
+                && slot->klen == klen
+                && memcmp(SLOT_KEY(ht, slot), key, klen) == 0)
+                return slot;
+
+            match &= match - 1;
+        }
+        if (group_match_empty(group))
+            return NULL;
+
+        step += GROUP_WIDTH;
+        pos = (pos + step) & ht->mask;
+    }
+}
+
+static apr_size_t find_free(apr_flathash_t *ht, unsigned int hash)
+{
+    apr_size_t pos = H1(hash) & ht->mask, step = 0;
+
+    for (;;) {
+        unsigned int match = group_match_free(ht->ctrl + pos);
+
+        if (match)
+            return (pos + lowest_bit(match)) & ht->mask;
+
+        step += GROUP_WIDTH;
+        pos = (pos + step) & ht->mask;
+    }
+}
+
+/*
+ * Resizing a flat hash table (or dropping its deleted slots)
+ */
+
+static void resize(apr_flathash_t *ht, apr_size_t capacity)
+{
+    signed char *old_ctrl = ht->ctrl;
+    char *old_slots = ht->slots;
+    apr_size_t i, old_capacity = ht->mask + 1;
+
+    alloc_arrays(ht, capacity);
+    for (i = 0; i < old_capacity; i++) {
+        if (CTRL_IS_FULL(old_ctrl[i])) {
+            flathash_slot_t *slot =
+                (flathash_slot_t *)(old_slots + i * ht->slot_size);
+            apr_size_t j = find_free(ht, slot->hash);
+
+            set_ctrl(ht, j, H2(slot->hash));
+            memcpy(SLOT(ht, j), slot, ht->slot_size);
+        }
+    }
+    ht->growth_left -= ht->count;
+}
+
+APR_DECLARE(void) apr_flathash_reserve(apr_flathash_t *ht,
+                                       unsigned int nelts)
+{
+    apr_size_t capacity = capacity_for(nelts);
+
+    if (capacity > ht->mask + 1)
+        resize(ht, capacity);
+}
+
+static void delete_slot(apr_flathash_t *ht, flathash_slot_t *slot)
+{
+    apr_size_t i = SLOT_INDEX(ht, slot);
+    unsigned int empty_before, empty_after;
+
+    /* If no group containing the slot was ever full, no probing went
+     * past it, so it can be emptied rather than marked as deleted.
+     */
+    empty_before = group_match_empty(ht->ctrl + ((i - GROUP_WIDTH)
+                                                 & ht->mask));
+    empty_after = group_match_empty(ht->ctrl + i);
+    if (empty_before && empty_after
+        && (GROUP_WIDTH - 1 - highest_bit(empty_before))
+           + lowest_bit(empty_after) < GROUP_WIDTH) {
+        set_ctrl(ht, i, CTRL_EMPTY);
+        ht->growth_left++;
+    }
+    else {
+        set_ctrl(ht, i, CTRL_DELETED);
+    }
+    ht->count--;
+}
+
+APR_DECLARE(void *) apr_flathash_get(apr_flathash_t *ht,
+                                     const void *key,
+                                     apr_ssize_t klen)
+{
+    flathash_slot_t *slot;
+    unsigned int hash;
+
+    hash = hash_key(ht, key, &klen);
+    slot = find_slot(ht, key, klen, hash);
+    if (slot)
+        return (void *)slot->val;
+    else
+        return NULL;
+}
+
+APR_DECLARE(void) apr_flathash_set(apr_flathash_t *ht,
+                                   const void *key,
+                                   apr_ssize_t klen,
+                                   const void *val)
+{
+    flathash_slot_t *slot;
+    unsigned int hash;
+    apr_size_t i;
+
+    hash = hash_key(ht, key, &klen);
+    slot = find_slot(ht, key, klen, hash);
+    if (slot) {
+        if (val)
+            slot->val = val;
+        else
+            delete_slot(ht, slot);
+        return;
+    }
+    if (!val)
+        return;
+
+    i = find_free(ht, hash);
+    if (ht->ctrl[i] == CTRL_EMPTY && !ht->growth_left) {
+        apr_size_t capacity = ht->mask + 1;
+
+        /* Mostly deleted slots? Drop them and keep the size */
+        if (ht->count > MAX_LOAD(capacity) / 2)
+            capacity *= 2;
+        resize(ht, capacity);
+        i = find_free(ht, hash);
+    }
+    if (ht->ctrl[i] == CTRL_EMPTY)
+        ht->growth_left--;
+
+    set_ctrl(ht, i, H2(hash));
+    slot = SLOT(ht, i);
+    slot->hash = hash;
+    slot->klen = klen;
+    slot->val = val;
+    if (ht->key_size) {
+        slot->key = NULL;
+        memcpy((char *)slot + SLOT_HEADER_SIZE, key, ht->key_size);
+    }
+    else {
+        slot->key = key;
+    }
+    ht->count++;
+}
+
+APR_DECLARE(unsigned int) apr_flathash_count(apr_flathash_t *ht)
+{
+    return ht->count;
+}
+
+APR_DECLARE(void) apr_flathash_clear(apr_flathash_t *ht)
+{
+    memset(ht->ctrl, CTRL_EMPTY, ht->mask + 1 + GROUP_WIDTH);
+    ht->growth_left = MAX_LOAD(ht->mask + 1);
+    ht->count = 0;
+}
+
+
+/*
+ * Hash iteration functions.
+ */
+
+APR_DECLARE(apr_flathash_index_t *) apr_flathash_next(apr_flathash_index_t *hi)
+{
+    apr_flathash_t *ht = hi->ht;
+
+    while (hi->index <= ht->mask) {
+        apr_size_t i = hi->index++;
+
+        if (CTRL_IS_FULL(ht->ctrl[i])) {
+            hi->this = SLOT(ht, i);
+            return hi;
+        }
+    }
+    return NULL;
+}
+
+APR_DECLARE(apr_flathash_index_t *) apr_flathash_first(apr_pool_t *p,
+                                                       apr_flathash_t *ht)
+{
+    apr_flathash_index_t *hi;
+    if (p)
+        hi = apr_palloc(p, sizeof(*hi));
+    else
+        hi = &ht->iterator;
+
+    hi->ht = ht;
+    hi->index = 0;
+    hi->this = NULL;
+    return apr_flathash_next(hi);
+}
+
+APR_DECLARE(void) apr_flathash_this(apr_flathash_index_t *hi,
+                                    const void **key,
+                                    apr_ssize_t *klen,
+                                    void **val)
+{
+    if (key)  *key  = SLOT_KEY(hi->ht, hi->this);
+    if (klen) *klen = hi->this->klen;
+    if (val)  *val  = (void *)hi->this->val;
+}
+
+APR_DECLARE(const void *) apr_flathash_this_key(apr_flathash_index_t *hi)
+{
+    const void *key;
+
+    apr_flathash_this(hi, &key, NULL, NULL);
+    return key;
+}
+
+APR_DECLARE(apr_ssize_t) apr_flathash_this_key_len(apr_flathash_index_t *hi)
+{
+    apr_ssize_t klen;
+
+    apr_flathash_this(hi, NULL, &klen, NULL);
+    return klen;
+}
+
+APR_DECLARE(void *) apr_flathash_this_val(apr_flathash_index_t *hi)
+{
+    void *val;
+
+    apr_flathash_this(hi, NULL, NULL, &val);
+    return val;
+}
+
+APR_DECLARE(int) apr_flathash_do(apr_hash_do_callback_fn_t *comp,
+                                 void *rec, const apr_flathash_t *ht)
+{
+    apr_size_t i;
+
+    for (i = 0; i <= ht->mask; i++) {
+        if (CTRL_IS_FULL(ht->ctrl[i])) {
+            flathash_slot_t *slot = SLOT(ht, i);
+
+            if (!comp(rec, SLOT_KEY(ht, slot), slot->klen, slot->val))
+                return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+APR_POOL_IMPLEMENT_ACCESSOR(flathash)
@@ -19,8 +19,10 @@
 #include "apr_general.h"
 #include "apr_pools.h"
 #include "apr_time.h"
+#include "apr_atomic.h"
 
 #include "apr_hash.h"
+#include "apr_siphash.h"
 
 #if APR_HAVE_STDLIB_H
 #include <stdlib.h>
@@ -273,6 +275,163 @@ APR_DECLARE_NONSTD(unsigned int) apr_hashfunc_default(const char *char_key,
     return hashfunc_default(char_key, klen, 0);
 }
 
+/*
+ * The keyed hash functions, apr_hashfunc_siphash() and apr_hashfunc_crc32c().
+ *
+ * Their secret is random and common to the process, it is set (along with
+ * the table of the software CRC32C) the first time either is called.
+ */
+
+static struct {
+    apr_uint64_t k0, k1;
+    apr_uint32_t crc;
+} hash_secret;
+
+static apr_uint32_t crc32c_table[256];
+
+#define HASH_SECRET_NONE    0
+#define HASH_SECRET_SETTING 1
+#define HASH_SECRET_SET     2
+static volatile apr_uint32_t hash_secret_state = HASH_SECRET_NONE;
+
+static void hash_secret_set(void)
+{
+    apr_uint32_t i, j, crc;
+
+#if APR_HAS_RANDOM
+    if (apr_generate_random_bytes((unsigned char *)&hash_secret,
+                                  sizeof(hash_secret)) != APR_SUCCESS)
+#endif
+    {
+        apr_time_t now = apr_time_now();
+
+        hash_secret.k0 = (apr_uint64_t)now ^ (apr_uintptr_t)&now;
+        hash_secret.k1 = ((apr_uint64_t)now << 32 | (apr_uint64_t)now >> 32)
+                         ^ (apr_uintptr_t)&hash_secret;
+        hash_secret.crc = (apr_uint32_t)(hash_secret.k0 ^ hash_secret.k1);
+    }
+
+    /* reflected CRC32C (Castagnoli) polynomial */
+    for (i = 0; i < 256; i++) {
+        crc = i;
+        for (j = 0; j < 8; j++) {
+            crc = (crc >> 1) ^ (0x82f63b78 & (0 - (crc & 1)));
+        }
+        crc32c_table[i] = crc;
+    }
+}
+
+static APR_INLINE void hash_secret_get(void)
+{
+    if (apr_atomic_read32_acquire(&hash_secret_state) == HASH_SECRET_SET)
+        return;
+
+    if (apr_atomic_cas32(&hash_secret_state, HASH_SECRET_SETTING,
+                         HASH_SECRET_NONE) == HASH_SECRET_NONE) {
+        hash_secret_set();
+        apr_atomic_set32_release(&hash_secret_state, HASH_SECRET_SET);
+    }
+    else {
+        /* someone else is setting it, shortly */
+        while (apr_atomic_read32_acquire(&hash_secret_state)
+               != HASH_SECRET_SET) {
+            apr_sleep(0);
+        }
+    }
+}
+
+APR_DECLARE_NONSTD(unsigned int) apr_hashfunc_siphash(const char *char_key,
+                                                      apr_ssize_t *klen)
+{
+    apr_uint64_t h;
+
+    hash_secret_get();
+
+    if (*klen == APR_HASH_KEY_STRING)
+        *klen = strlen(char_key);
+
+    /* SipHash-1-3: one compression round per 8 bytes, three at the end */
+    h = apr__siphash(hash_secret.k0, hash_secret.k1,
+                     (const unsigned char *)char_key, *klen, 1, 3);
+    return (unsigned int)(h ^ (h >> 32));
+}
+
+/* The SSE4.2 CRC32 instruction, where the compiler can target it without
+ * building everything for SSE4.2, used if the CPU has it
+ */
+#if (defined(__x86_64__) || defined(__i386__)) \
+    && (defined(__clang__) \
+        || (defined(__GNUC__) \
+            && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#define HAVE_CRC32C_SSE42 1
+
+__attribute__((target("sse4.2")))
+static apr_uint32_t crc32c_sse42(apr_uint32_t crc, const unsigned char *p,
+                                 apr_size_t len)
+{
+#if defined(__x86_64__)
+    apr_uint64_t crc64 = crc;
+
+    for (; len >= 8; len -= 8, p += 8) {
+        apr_uint64_t m;
+
+        memcpy(&m, p, sizeof(m));
+        crc64 = __builtin_ia32_crc32di(crc64, m);
+    }
+    crc = (apr_uint32_t)crc64;
+#endif
+    for (; len >= 4; len -= 4, p += 4) {
+        apr_uint32_t m;
+
+        memcpy(&m, p, sizeof(m));
+        crc = __builtin_ia32_crc32si(crc, m);
+    }
+    for (; len; len--, p++) {
+        crc = __builtin_ia32_crc32qi(crc, *p);
+    }
+    return crc;
+}
+
+static int crc32c_sse42_supported = -1;
+#endif /* HAVE_CRC32C_SSE42 */
+
+APR_DECLARE_NONSTD(unsigned int) apr_hashfunc_crc32c(const char *char_key,
+                                                     apr_ssize_t *klen)
+{
+    const unsigned char *key = (const unsigned char *)char_key;
+    apr_uint32_t crc;
+    apr_size_t len;
+
+    hash_secret_get();
+
+    if (*klen == APR_HASH_KEY_STRING)
+        *klen = strlen(char_key);
+    len = *klen;
+
+    crc = ~hash_secret.crc;
+#if HAVE_CRC32C_SSE42
+    if (crc32c_sse42_supported < 0) {
+        __builtin_cpu_init();
+        crc32c_sse42_supported = __builtin_cpu_supports("sse4.2") != 0;
+    }
+    if (crc32c_sse42_supported) {
+        crc = crc32c_sse42(crc, key, len);
+    }
+    else
+#endif
+    for (; len; len--, key++) {
+        crc = crc32c_table[(crc ^ *key) & 0xff] ^ (crc >> 8);
+    }
+
+    /* Close keys have close CRCs, spread them over the (low) bits used
+     * to index the tables */
+    crc ^= crc >> 16;
+    crc *= 0x85ebca6b;
+    crc ^= crc >> 13;
+
+    return crc;
+}
+
 /*
  * This is where we keep the details of the hash function and control
  * the maximum collision rate.
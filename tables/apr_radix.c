@@ -0,0 +1,451 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "apr_private.h"
+
+#include "apr_general.h"
+#include "apr_pools.h"
+#include "apr_strings.h"
+
+#include "apr_radix.h"
+
+#if APR_HAVE_STRING_H
+#include <string.h>
+#endif
+
+/*
+ * The internal form of a radix tree.
+ *
+ * This is a binary trie with path compression: each node holds the bits
+ * of the path from the root to it (a prefix of all the keys below it),
+ * and has a child for each value of the next bit, whose path continues
+ * by any number of bits.  So the nodes are the keys and the points where
+ * keys diverge, a tree of n keys has less than 2n nodes, and walking down
+ * to a key only compares its bits once.
+ *
+ * The path of a node is not a key if the node has no value: deleting a
+ * key only frees its node when that leaves less than two children to it.
+ */
+
+typedef struct radix_node_t radix_node_t;
+
+struct radix_node_t {
+    radix_node_t        *child[2];
+    const unsigned char *key;
+    apr_size_t           bits;
+    const void          *val;
+};
+
+struct apr_radix_t {
+    apr_pool_t   *pool;
+    radix_node_t  root;
+    unsigned int  count;
+    radix_node_t *free;     /* List of recycled nodes (through child[0]) */
+};
+
+#define KEY_BIT(key, i) (((key)[(i) >> 3] >> (7 - ((i) & 7))) & 1)
+
+/* The number of leading bits a and b have in common, knowing that the
+ * first from bits are, and up to max
+ */
+static apr_size_t radix_common_bits(const unsigned char *a,
+                                    const unsigned char *b,
+                                    apr_size_t from, apr_size_t max)
+{
+    apr_size_t i = from;
+
+    while (i < max) {
+        if (!(i & 7) && i + 8 <= max) {
+            unsigned char x = a[i >> 3] ^ b[i >> 3];
+            if (!x) {
+                i += 8;
+                continue;
+            }
+            /* The first differing bit is in this byte */
+            while (!(x & 0x80)) {
+                x <<= 1;
+                i++;
+            }
+            return i;
+        }
+        if (KEY_BIT(a, i) != KEY_BIT(b, i)) {
+            break;
+        }
+        i++;
+    }
+    return i;
+}
+
+static radix_node_t *radix_new_node(apr_radix_t *t, const unsigned char *key,
+                                    apr_size_t bits, const void *val)
+{
+    radix_node_t *n;
+
+    if (t->free) {
+        n = t->free;
+        t->free = n->child[0];
+    }
+    else {
+        n = apr_palloc(t->pool, sizeof(*n));
+    }
+    n->child[0] = n->child[1] = NULL;
+    n->key = key;
+    n->bits = bits;
+    n->val = val;
+    return n;
+}
+
+/* Whether the path of child c of n is a prefix of key */
+#define RADIX_CHILD_MATCHES(n, c, key, bits) \
+    ((c)->bits <= (bits) \
+     && radix_common_bits((c)->key, (key), (n)->bits + 1, (c)->bits) \
+        == (c)->bits)
+
+/* Walk down to the node of key (exact), or the one of the longest key
+ * which is a prefix of it
+ */
+static radix_node_t *radix_find(const apr_radix_t *t,
+                                const unsigned char *key, apr_size_t bits,
+                                int exact)
+{
+    const radix_node_t *n = &t->root, *best = NULL;
+
+    for (;;) {
+        const radix_node_t *c;
+
+        if (n->val) {
+            best = n;
+        }
+        if (n->bits == bits) {
+            break;
+        }
+        c = n->child[KEY_BIT(key, n->bits)];
+        if (!c || !RADIX_CHILD_MATCHES(n, c, key, bits)) {
+            break;
+        }
+        n = c;
+    }
+    if (exact) {
+        return (n->bits == bits && n->val) ? (radix_node_t *)n : NULL;
+    }
+    return (radix_node_t *)best;
+}
+
+static void radix_insert(apr_radix_t *t, const unsigned char *key,
+                         apr_size_t bits, const void *val)
+{
+    radix_node_t *n = &t->root, *c, *m;
+    const unsigned char *copy;
+    apr_size_t common;
+    int b;
+
+    for (;;) {
+        if (n->bits == bits) {
+            if (!n->val) {
+                t->count++;
+            }
+            n->val = val;
+            return;
+        }
+        b = KEY_BIT(key, n->bits);
+        c = n->child[b];
+        if (!c) {
+            copy = apr_pmemdup(t->pool, key, (bits + 7) / 8);
+            n->child[b] = radix_new_node(t, copy, bits, val);
+            t->count++;
+            return;
+        }
+        common = radix_common_bits(c->key, key, n->bits + 1,
+                                   c->bits < bits ? c->bits : bits);
+        if (common == c->bits) {
+            n = c;
+            continue;
+        }
+        break;
+    }
+
+    /* The key diverges from c's path (or ends) before c: split there,
+     * the new node's path being a prefix of the key copy
+     */
+    copy = apr_pmemdup(t->pool, key, (bits + 7) / 8);
+    m = radix_new_node(t, copy, common, NULL);
+    m->child[KEY_BIT(c->key, common)] = c;
+    n->child[b] = m;
+    if (common == bits) {
+        m->val = val;
+    }
+    else {
+        m->child[KEY_BIT(key, common)] = radix_new_node(t, copy, bits, val);
+    }
+    t->count++;
+}
+
+static void radix_free_node(apr_radix_t *t, radix_node_t *n)
+{
+    n->child[0] = t->free;
+    t->free = n;
+}
+
+static void radix_delete(apr_radix_t *t, const unsigned char *key,
+                         apr_size_t bits)
+{
+    radix_node_t *n = &t->root, *parent = NULL, *grandparent = NULL, *c;
+
+    while (n->bits < bits) {
+        c = n->child[KEY_BIT(key, n->bits)];
+        if (!c || !RADIX_CHILD_MATCHES(n, c, key, bits)) {
+            return;
+        }
+        grandparent = parent;
+        parent = n;
+        n = c;
+    }
+    if (n->bits != bits || !n->val) {
+        return;
+    }
+    n->val = NULL;
+    t->count--;
+    if (!parent) {
+        /* The root stays */
+        return;
+    }
+
+    if (n->child[0] && n->child[1]) {
+        /* Still a branching point */
+        return;
+    }
+    c = n->child[0] ? n->child[0] : n->child[1];
+    parent->child[parent->child[1] == n] = c;
+    radix_free_node(t, n);
+
+    /* A valueless parent left with a single child is not needed either */
+    if (!c && grandparent && !parent->val) {
+        c = parent->child[0] ? parent->child[0] : parent->child[1];
+        grandparent->child[grandparent->child[1] == parent] = c;
+        radix_free_node(t, parent);
+    }
+}
+
+APR_DECLARE(apr_radix_t *) apr_radix_make(apr_pool_t *pool)
+{
+    apr_radix_t *t = apr_pcalloc(pool, sizeof(*t));
+
+    t->pool = pool;
+    t->root.key = (const unsigned char *)"";
+    return t;
+}
+
+APR_DECLARE(void) apr_radix_set_bits(apr_radix_t *t, const void *key,
+                                     apr_size_t bits, const void *val)
+{
+    if (val) {
+        radix_insert(t, key, bits, val);
+    }
+    else {
+        radix_delete(t, key, bits);
+    }
+}
+
+APR_DECLARE(void *) apr_radix_get_bits(apr_radix_t *t, const void *key,
+                                       apr_size_t bits)
+{
+    radix_node_t *n = radix_find(t, key, bits, 1);
+
+    return n ? (void *)n->val : NULL;
+}
+
+APR_DECLARE(void *) apr_radix_longest_prefix_bits(apr_radix_t *t,
+                                                  const void *key,
+                                                  apr_size_t bits,
+                                                  apr_size_t *pbits)
+{
+    radix_node_t *n = radix_find(t, key, bits, 0);
+
+    if (!n) {
+        return NULL;
+    }
+    if (pbits) {
+        *pbits = n->bits;
+    }
+    return (void *)n->val;
+}
+
+APR_DECLARE(void) apr_radix_set(apr_radix_t *t, const void *key,
+                                apr_ssize_t klen, const void *val)
+{
+    if (klen == APR_RADIX_KEY_STRING) {
+        klen = strlen(key);
+    }
+    apr_radix_set_bits(t, key, (apr_size_t)klen * 8, val);
+}
+
+APR_DECLARE(void *) apr_radix_get(apr_radix_t *t, const void *key,
+                                  apr_ssize_t klen)
+{
+    if (klen == APR_RADIX_KEY_STRING) {
+        klen = strlen(key);
+    }
+    return apr_radix_get_bits(t, key, (apr_size_t)klen * 8);
+}
+
+APR_DECLARE(void *) apr_radix_longest_prefix(apr_radix_t *t, const void *key,
+                                             apr_ssize_t klen,
+                                             apr_size_t *plen)
+{
+    apr_size_t bits;
+    void *val;
+
+    if (klen == APR_RADIX_KEY_STRING) {
+        klen = strlen(key);
+    }
+    /* Only the keys of whole bytes count (all of them, unless some were
+     * set with apr_radix_set_bits())
+     */
+    val = apr_radix_longest_prefix_bits(t, key, (apr_size_t)klen * 8, &bits);
+    while (val && (bits & 7)) {
+        val = apr_radix_longest_prefix_bits(t, key, bits & ~(apr_size_t)7,
+                                            &bits);
+    }
+    if (val && plen) {
+        *plen = bits / 8;
+    }
+    return val;
+}
+
+/*
+ * The IP addresses are keyed by their family (one byte: 4 or 6) followed
+ * by their bits, IPv4-mapped IPv6 addresses being looked up as IPv4.
+ */
+
+#define ADDR_KEY_MAX (1 + 16)
+
+static apr_status_t radix_addr_key(const apr_sockaddr_t *sa,
+                                   unsigned char *key, apr_size_t *bits)
+{
+    const unsigned char *addr = sa->ipaddr_ptr;
+
+    if (sa->family == APR_INET) {
+        key[0] = 4;
+        memcpy(key + 1, addr, 4);
+        *bits = 8 + 32;
+        return APR_SUCCESS;
+    }
+#if APR_HAVE_IPV6
+    if (sa->family == APR_INET6) {
+        static const unsigned char v4mapped[12] = {
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff
+        };
+        if (!memcmp(addr, v4mapped, sizeof(v4mapped))) {
+            key[0] = 4;
+            memcpy(key + 1, addr + 12, 4);
+            *bits = 8 + 32;
+        }
+        else {
+            key[0] = 6;
+            memcpy(key + 1, addr, 16);
+            *bits = 8 + 128;
+        }
+        return APR_SUCCESS;
+    }
+#endif
+    return APR_EINVAL;
+}
+
+APR_DECLARE(apr_status_t) apr_radix_set_addr(apr_radix_t *t,
+                                             const apr_sockaddr_t *sa,
+                                             int prefix, const void *val)
+{
+    unsigned char key[ADDR_KEY_MAX];
+    apr_size_t bits;
+
+    if (radix_addr_key(sa, key, &bits) != APR_SUCCESS) {
+        return APR_EINVAL;
+    }
+    if (prefix >= 0) {
+        if ((apr_size_t)prefix > bits - 8) {
+            return APR_EINVAL;
+        }
+        bits = 8 + prefix;
+    }
+    apr_radix_set_bits(t, key, bits, val);
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(void *) apr_radix_longest_prefix_addr(apr_radix_t *t,
+                                                  const apr_sockaddr_t *sa,
+                                                  int *prefix)
+{
+    unsigned char key[ADDR_KEY_MAX];
+    apr_size_t bits;
+    void *val;
+
+    if (radix_addr_key(sa, key, &bits) != APR_SUCCESS) {
+        return NULL;
+    }
+    val = apr_radix_longest_prefix_bits(t, key, bits, &bits);
+    /* The family byte must match as a whole */
+    if (val && bits < 8) {
+        val = NULL;
+    }
+    if (val && prefix) {
+        *prefix = (int)(bits - 8);
+    }
+    return val;
+}
+
+APR_DECLARE(unsigned int) apr_radix_count(apr_radix_t *t)
+{
+    return t->count;
+}
+
+static void radix_free_nodes(apr_radix_t *t, radix_node_t *n)
+{
+    if (n) {
+        radix_free_nodes(t, n->child[0]);
+        radix_free_nodes(t, n->child[1]);
+        radix_free_node(t, n);
+    }
+}
+
+APR_DECLARE(void) apr_radix_clear(apr_radix_t *t)
+{
+    radix_free_nodes(t, t->root.child[0]);
+    radix_free_nodes(t, t->root.child[1]);
+    t->root.child[0] = t->root.child[1] = NULL;
+    t->root.val = NULL;
+    t->count = 0;
+}
+
+static int radix_do(apr_radix_do_callback_fn_t *comp, void *rec,
+                    const radix_node_t *n)
+{
+    if (!n) {
+        return 1;
+    }
+    if (n->val && !comp(rec, n->key, n->bits, n->val)) {
+        return 0;
+    }
+    return radix_do(comp, rec, n->child[0])
+           && radix_do(comp, rec, n->child[1]);
+}
+
+APR_DECLARE(int) apr_radix_do(apr_radix_do_callback_fn_t *comp,
+                              void *rec, const apr_radix_t *t)
+{
+    return radix_do(comp, rec, &t->root);
+}
+
+APR_POOL_IMPLEMENT_ACCESSOR(radix)
@@ -24,6 +24,54 @@
  */
 
 #include "apr_skiplist.h"
+#include "apr_general.h"
+#include "apr_atomic.h"
+#if APR_HAS_THREADS
+#include "apr_thread_mutex.h"
+#endif
+
+/* The height of the skip list is limited, so that the search paths fit
+ * on the stack: with one element out of two going up a level, this is
+ * enough for 2^32 elements
+ */
+#define SKIPLIST_MAX_HEIGHT 32
+
+/* The state of an APR_SKIPLIST_CONCURRENT skip list, shared with its
+ * indexes:
+ *   - the writers (insertion and removal) are serialized by the lock,
+ *     and make each change visible to the readers with a single atomic
+ *     pointer update: a new node is complete before it's linked, bottom
+ *     level first, and a removed one is unlinked top level first;
+ *   - the readers (find, next, peek) take no lock, they are counted so
+ *     that the nodes removed meanwhile (retired) are only reused once
+ *     no reader can be walking through them anymore: by the writer which
+ *     retires them, or by the last reader leaving.
+ */
+typedef struct {
+#if APR_HAS_THREADS
+    apr_thread_mutex_t *lock;
+#endif
+    volatile apr_uint32_t readers;
+    /* The number of retired nodes, for the readers to check locklessly */
+    volatile apr_uint32_t nretired;
+    apr_array_header_t *retired;
+} skiplist_sync_t;
+
+#if APR_HAS_THREADS
+#define SKIPLIST_LOCK(sl) \
+    ((sl)->sync ? apr_thread_mutex_lock((sl)->sync->lock) : APR_SUCCESS)
+#define SKIPLIST_UNLOCK(sl) \
+    ((sl)->sync ? apr_thread_mutex_unlock((sl)->sync->lock) : APR_SUCCESS)
+#else
+#define SKIPLIST_LOCK(sl) APR_SUCCESS
+#define SKIPLIST_UNLOCK(sl) APR_SUCCESS
+#endif
+#define SKIPLIST_READ_BEGIN(sl) \
+    do { if ((sl)->sync) apr_atomic_inc32(&(sl)->sync->readers); } while (0)
+#define SKIPLIST_READ_END(sl) \
+    do { if ((sl)->sync) skiplist_read_end((sl)->sync); } while (0)
+
+static void skiplist_read_end(skiplist_sync_t *sync);
 
 struct apr_skiplist {
     apr_skiplist_compare compare;
@@ -31,158 +79,246 @@ struct apr_skiplist {
     int height;
     int preheight;
     size_t size;
-    apr_skiplistnode *top;
-    apr_skiplistnode *bottom;
-    /* These two are needed for appending */
-    apr_skiplistnode *topend;
-    apr_skiplistnode *bottomend;
+    /* The head node, with SKIPLIST_MAX_HEIGHT levels (NULL if none yet) */
+    apr_skiplistnode *head;
     apr_skiplist *index;
     apr_array_header_t *memlist;
-    apr_skiplistnode **stack;
-    size_t stack_pos,
-           stack_len;
+    /* The state of the random generator for the height of the nodes */
+    apr_uint32_t rand_state;
+    /* NULL unless APR_SKIPLIST_CONCURRENT */
+    skiplist_sync_t *sync;
     apr_pool_t *pool;
 };
 
+/* Each element has a single node, holding its forward pointers at every
+ * level it is in (its height), so that walking down a level does not
+ * take a pointer chase.  The bottom level is also linked backward.
+ */
 struct apr_skiplistnode {
     void *data;
-    apr_skiplistnode *next;
     apr_skiplistnode *prev;
-    apr_skiplistnode *down;
-    apr_skiplistnode *up;
     apr_skiplistnode *previndex;
     apr_skiplistnode *nextindex;
     apr_skiplist *sl;
+    int height;
+    apr_skiplistnode *volatile next[1];
 };
 
-static int get_b_rand(void)
+#define SKIPLIST_NODE_SIZE(height) \
+    (APR_OFFSETOF(apr_skiplistnode, next) + \
+     (height) * sizeof(apr_skiplistnode *))
+
+/* Replace the link from m at level by n, the change being atomic for the
+ * concurrent readers (and a full memory barrier)
+ */
+static APR_INLINE void skiplist_link(apr_skiplist *sl, apr_skiplistnode *m,
+                                     int level, apr_skiplistnode *n)
+{
+    if (sl->sync) {
+        /* Can't fail, the writers are serialized */
+        apr_atomic_casptr((volatile void **)&m->next[level], n,
+                          m->next[level]);
+    }
+    else {
+        m->next[level] = n;
+    }
+}
+
+/* Any non-zero seed works, using the same one for every skip list makes
+ * their structure reproducible
+ */
+#define SKIPLIST_RAND_SEED 0x9e3779b9
+
+/* The random height of a new node, at most max: each level is taken with
+ * a probability of 1/2.  The generator (xorshift32) is per skip list, so
+ * different skip lists can be used concurrently.
+ */
+static int skiplist_rand_height(apr_skiplist *sl, int max)
 {
-    static int ph = 32;         /* More bits than we will ever use */
-    static apr_uint32_t randseq;
-    if (ph > 31) {              /* Num bits in return of rand() */
-        ph = 0;
-        randseq = (apr_uint32_t) rand();
+    apr_uint32_t x = sl->rand_state;
+    int height = 1;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    sl->rand_state = x;
+
+    while (height < max && (x & 1)) {
+        x >>= 1;
+        height++;
     }
-    ph++;
-    return ((randseq & (1 << (ph - 1))) >> (ph - 1));
+    return height;
 }
 
+/* The pooled memory is recycled through a free list per size, each chunk
+ * being prefixed by the index of its size in sl->memlist.  The nodes have
+ * their own free lists, apart from apr_skiplist_alloc()'s, so that the
+ * memory of a node stays a node of the skip list for the iterators the
+ * concurrent readers may still hold on it.
+ */
 typedef struct {
     size_t size;
-    apr_array_header_t *list;
+    int node;
+    apr_array_header_t *list;   /* of (void *) */
 } memlist_t;
 
 typedef struct {
-    void *ptr;
-    char inuse;
+    apr_size_t memlist;
 } chunk_t;
 
-APR_DECLARE(void *) apr_skiplist_alloc(apr_skiplist *sl, size_t size)
+#define CHUNK_HEADER_SIZE APR_ALIGN_DEFAULT(sizeof(chunk_t))
+
+static void *skiplist_alloc(apr_skiplist *sl, size_t size, int node)
 {
     if (sl->pool) {
-        void *ptr;
-        int found_size = 0;
+        chunk_t *chunk;
         int i;
-        chunk_t *newchunk;
         memlist_t *memlist = (memlist_t *)sl->memlist->elts;
         for (i = 0; i < sl->memlist->nelts; i++) {
-            if (memlist->size == size) {
-                int j;
-                chunk_t *chunk = (chunk_t *)memlist->list->elts;
-                found_size = 1;
-                for (j = 0; j < memlist->list->nelts; j++) {
-                    if (!chunk->inuse) {
-                        chunk->inuse = 1;
-                        return chunk->ptr;
-                    }
-                    chunk++;
+            if (memlist[i].size == size && memlist[i].node == node) {
+                if (memlist[i].list->nelts) {
+                    return *(void **)apr_array_pop(memlist[i].list);
                 }
                 break; /* no free of this size; punt */
             }
-            memlist++;
         }
         /* no free chunks */
-        ptr = apr_palloc(sl->pool, size);
-        if (!ptr) {
-            return ptr;
+        chunk = apr_palloc(sl->pool, CHUNK_HEADER_SIZE + size);
+        if (!chunk) {
+            return NULL;
         }
         /*
          * is this a new sized chunk? If so, we need to create a new
-         * array of them. Otherwise, re-use what we already have.
+         * list of them. Otherwise, re-use what we already have.
          */
-        if (!found_size) {
+        if (i == sl->memlist->nelts) {
             memlist = apr_array_push(sl->memlist);
             memlist->size = size;
-            memlist->list = apr_array_make(sl->pool, 20, sizeof(chunk_t));
+            memlist->node = node;
+            memlist->list = apr_array_make(sl->pool, 20, sizeof(void *));
         }
-        newchunk = apr_array_push(memlist->list);
-        newchunk->ptr = ptr;
-        newchunk->inuse = 1;
-        return ptr;
+        chunk->memlist = i;
+        return (char *)chunk + CHUNK_HEADER_SIZE;
     }
     else {
         return malloc(size);
     }
 }
 
-APR_DECLARE(void) apr_skiplist_free(apr_skiplist *sl, void *mem)
+static void skiplist_free(apr_skiplist *sl, void *mem)
 {
     if (!sl->pool) {
         free(mem);
     }
     else {
-        int i;
+        chunk_t *chunk = (chunk_t *)((char *)mem - CHUNK_HEADER_SIZE);
         memlist_t *memlist = (memlist_t *)sl->memlist->elts;
-        for (i = 0; i < sl->memlist->nelts; i++) {
-            int j;
-            chunk_t *chunk = (chunk_t *)memlist->list->elts;
-            for (j = 0; j < memlist->list->nelts; j++) {
-                if (chunk->ptr == mem) {
-                    chunk->inuse = 0;
-                    return;
-                }
-                chunk++;
-            }
-            memlist++;
-        }
+        *(void **)apr_array_push(memlist[chunk->memlist].list) = mem;
     }
 }
 
-static apr_status_t skiplist_stack_push(apr_skiplist *sl, apr_skiplistnode *m)
+APR_DECLARE(void *) apr_skiplist_alloc(apr_skiplist *sl, size_t size)
 {
-    if (sl->stack_pos >= sl->stack_len) {
-        apr_skiplistnode **ptr;
-        size_t len = sl->stack_pos * 2;
-        if (len < 32) {
-            len = 32;
-        }
-        if (sl->pool) {
-            ptr = apr_palloc(sl->pool, len * sizeof(*ptr));
-            if (ptr) {
-                memcpy(ptr, sl->stack, sl->stack_pos * sizeof(*ptr));
-            }
-        }
-        else {
-            ptr = realloc(sl->stack, len * sizeof(*ptr));
-        }
-        if (!ptr) {
-            return APR_ENOMEM;
+    void *ptr;
+    if (SKIPLIST_LOCK(sl) != APR_SUCCESS) {
+        return NULL;
+    }
+    ptr = skiplist_alloc(sl, size, 0);
+    SKIPLIST_UNLOCK(sl);
+    return ptr;
+}
+
+APR_DECLARE(void) apr_skiplist_free(apr_skiplist *sl, void *mem)
+{
+    if (SKIPLIST_LOCK(sl) == APR_SUCCESS) {
+        skiplist_free(sl, mem);
+        SKIPLIST_UNLOCK(sl);
+    }
+}
+
+/* Free the retired nodes if no reader is left.  Called with the lock
+ * held, so all of them were unlinked before the readers were counted.
+ */
+static void skiplist_drain(skiplist_sync_t *sync)
+{
+    apr_skiplistnode **retired = (apr_skiplistnode **)sync->retired->elts;
+    int i;
+
+    if (apr_atomic_read32(&sync->readers) != 0) {
+        return;
+    }
+    /* The nodes of the indexes belong to their own skip list */
+    for (i = 0; i < sync->retired->nelts; i++) {
+        skiplist_free(retired[i]->sl, retired[i]);
+    }
+    sync->retired->nelts = 0;
+    apr_atomic_set32(&sync->nretired, 0);
+}
+
+/* Free a node unlinked from sl, or if sl is concurrent retire it until
+ * no reader is left (the unlinking was a memory barrier, so the readers
+ * coming after can't reach it anymore).  Called with the lock held.
+ */
+static void skiplist_retire(apr_skiplist *sl, apr_skiplistnode *m)
+{
+    skiplist_sync_t *sync = sl->sync;
+
+    if (!sync) {
+        skiplist_free(sl, m);
+        return;
+    }
+    *(apr_skiplistnode **)apr_array_push(sync->retired) = m;
+    apr_atomic_set32(&sync->nretired, sync->retired->nelts);
+    skiplist_drain(sync);
+}
+
+/* Leave a read section, the last reader out freeing the nodes retired
+ * meanwhile unless a writer holds the lock (it will do it then).
+ */
+static void skiplist_read_end(skiplist_sync_t *sync)
+{
+    if (apr_atomic_dec32(&sync->readers) == 0
+        && apr_atomic_read32(&sync->nretired) != 0) {
+#if APR_HAS_THREADS
+        if (apr_thread_mutex_trylock(sync->lock) == APR_SUCCESS) {
+            skiplist_drain(sync);
+            apr_thread_mutex_unlock(sync->lock);
         }
-        sl->stack = ptr;
-        sl->stack_len = len;
+#else
+        skiplist_drain(sync);
+#endif
     }
-    sl->stack[sl->stack_pos++] = m;
-    return APR_SUCCESS;
 }
 
-static APR_INLINE apr_skiplistnode *skiplist_stack_pop(apr_skiplist *sl)
+static apr_skiplistnode *skiplist_new_node(apr_skiplist *sl, void *data,
+                                           int height)
 {
-    return (sl->stack_pos > 0) ? sl->stack[--sl->stack_pos] : NULL;
+    apr_skiplistnode *m;
+
+    m = (apr_skiplistnode *)skiplist_alloc(sl, SKIPLIST_NODE_SIZE(height), 1);
+    if (!m) {
+        return NULL;
+    }
+    m->data = data;
+    m->prev = m->previndex = m->nextindex = NULL;
+    m->sl = sl;
+    m->height = height;
+    return m;
 }
 
-static APR_INLINE void skiplist_stack_clear(apr_skiplist *sl)
+static apr_status_t skiplist_make_head(apr_skiplist *sl)
 {
-    sl->stack_pos = 0;
+    int level;
+
+    sl->head = skiplist_new_node(sl, NULL, SKIPLIST_MAX_HEIGHT);
+    if (!sl->head) {
+        return APR_ENOMEM;
+    }
+    for (level = 0; level < SKIPLIST_MAX_HEIGHT; level++) {
+        sl->head->next[level] = NULL;
+    }
+    sl->height = 0;
+    return APR_SUCCESS;
 }
 
 static apr_status_t skiplisti_init(apr_skiplist **s, apr_pool_t *p)
@@ -204,10 +340,10 @@ static apr_status_t skiplisti_init(apr_skiplist **s, apr_pool_t *p)
     sl->height = 0;
     sl->preheight = 0;
     sl->size = 0;
-    sl->top = NULL;
-    sl->bottom = NULL;
+    sl->head = NULL;
     sl->index = NULL;
 #endif
+    sl->rand_state = SKIPLIST_RAND_SEED;
     sl->pool = p;
     *s = sl;
     return APR_SUCCESS;
@@ -226,16 +362,46 @@ static int indexing_compk(void *ac, void *b)
     return ((ac < bc) ? -1 : ((ac > bc) ? 1 : 0));
 }
 
-APR_DECLARE(apr_status_t) apr_skiplist_init(apr_skiplist **s, apr_pool_t *p)
+APR_DECLARE(apr_status_t) apr_skiplist_init_ex(apr_skiplist **s,
+                                               apr_pool_t *p,
+                                               unsigned int flags)
 {
     apr_skiplist *sl;
-    skiplisti_init(s, p);
+    apr_status_t rv;
+
+    /* The nodes of a concurrent skip list must never go back to the heap */
+    if ((flags & APR_SKIPLIST_CONCURRENT) && !p) {
+        return APR_EINVAL;
+    }
+    rv = skiplisti_init(s, p);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
     sl = *s;
     skiplisti_init(&(sl->index), p);
     apr_skiplist_set_compare(sl->index, indexing_comp, indexing_compk);
+
+    if (flags & APR_SKIPLIST_CONCURRENT) {
+        skiplist_sync_t *sync = apr_pcalloc(p, sizeof(*sync));
+#if APR_HAS_THREADS
+        rv = apr_thread_mutex_create(&sync->lock, APR_THREAD_MUTEX_DEFAULT, p);
+        if (rv != APR_SUCCESS) {
+            return rv;
+        }
+#endif
+        sync->retired = apr_array_make(p, 16, sizeof(apr_skiplistnode *));
+        sl->sync = sync;
+        /* The readers can't wait for the head to be created */
+        return skiplist_make_head(sl);
+    }
     return APR_SUCCESS;
 }
 
+APR_DECLARE(apr_status_t) apr_skiplist_init(apr_skiplist **s, apr_pool_t *p)
+{
+    return apr_skiplist_init_ex(s, p, 0);
+}
+
 APR_DECLARE(void) apr_skiplist_set_compare(apr_skiplist *sl,
                           apr_skiplist_compare comp,
                           apr_skiplist_compare compk)
@@ -262,6 +428,12 @@ APR_DECLARE(void) apr_skiplist_add_index(apr_skiplist *sl,
     }
     skiplisti_init(&ni, sl->pool);
     apr_skiplist_set_compare(ni, comp, compk);
+    if (sl->sync) {
+        ni->sync = sl->sync;
+        if (skiplist_make_head(ni) != APR_SUCCESS) {
+            return;
+        }
+    }
     /* Build the new index... This can be expensive! */
     m = apr_skiplist_insert(sl->index, ni);
     while (m->prev) {
@@ -269,30 +441,30 @@ APR_DECLARE(void) apr_skiplist_add_index(apr_skiplist *sl,
         icount++;
     }
     for (m = apr_skiplist_getlist(sl); m; apr_skiplist_next(sl, &m)) {
-        int j = icount - 1;
-        apr_skiplistnode *nsln;
+        int j = icount;
+        apr_skiplistnode *nsln, *li = m;
         nsln = apr_skiplist_insert(ni, m->data);
         /* skip from main index down list */
         while (j > 0) {
-            m = m->nextindex;
+            li = li->nextindex;
             j--;
         }
-        /* insert this node in the indexlist after m */
-        nsln->nextindex = m->nextindex;
-        if (m->nextindex) {
-            m->nextindex->previndex = nsln;
+        /* insert this node in the indexlist after li */
+        nsln->nextindex = li->nextindex;
+        if (li->nextindex) {
+            li->nextindex->previndex = nsln;
         }
-        nsln->previndex = m;
-        m->nextindex = nsln;
+        nsln->previndex = li;
+        li->nextindex = nsln;
     }
 }
 
 APR_DECLARE(apr_skiplistnode *) apr_skiplist_getlist(apr_skiplist *sl)
 {
-    if (!sl->bottom) {
+    if (!sl->head) {
         return NULL;
     }
-    return sl->bottom->next;
+    return sl->head->next[0];
 }
 
 APR_DECLARE(void *) apr_skiplist_find(apr_skiplist *sl, void *data, apr_skiplistnode **iter)
@@ -303,35 +475,30 @@ APR_DECLARE(void *) apr_skiplist_find(apr_skiplist *sl, void *data, apr_skiplist
     return apr_skiplist_find_compare(sl, data, iter, sl->compare);
 }
 
-static int skiplisti_find_compare(apr_skiplist *sl, void *data,
-                           apr_skiplistnode **ret,
-                           apr_skiplist_compare comp)
+static apr_skiplistnode *skiplisti_find_compare(apr_skiplist *sl, void *data,
+                                                apr_skiplist_compare comp)
 {
-    int count = 0;
-    apr_skiplistnode *m;
-    m = sl->top;
-    while (m) {
-        int compared;
-        compared = (m->next) ? comp(data, m->next->data) : -1;
-        if (compared == 0) {
-            m = m->next;
-            while (m->down) {
-                m = m->down;
+    apr_skiplistnode *m, *n, *last = NULL;
+    int level;
+
+    m = sl->head;
+    for (level = sl->height - 1; level >= 0; level--) {
+        /* The node which stopped the walk at the level above need not
+         * be compared again
+         */
+        while ((n = m->next[level]) && n != last) {
+            int compared = comp(data, n->data);
+            if (compared == 0) {
+                return n;
             }
-            *ret = m;
-            return count;
-        }
-        if (compared < 0) {
-            m = m->down;
-            count++;
-        }
-        else {
-            m = m->next;
-            count++;
+            if (compared < 0) {
+                break;
+            }
+            m = n;
         }
+        last = n;
     }
-    *ret = NULL;
-    return count;
+    return NULL;
 }
 
 APR_DECLARE(void *) apr_skiplist_find_compare(apr_skiplist *sli, void *data,
@@ -340,6 +507,7 @@ APR_DECLARE(void *) apr_skiplist_find_compare(apr_skiplist *sli, void *data,
 {
     apr_skiplistnode *m;
     apr_skiplist *sl;
+    void *found;
     if (comp == sli->compare || !sli->index) {
         sl = sli;
     }
@@ -353,157 +521,229 @@ APR_DECLARE(void *) apr_skiplist_find_compare(apr_skiplist *sli, void *data,
         }
         sl = (apr_skiplist *) m->data;
     }
-    skiplisti_find_compare(sl, data, &m, sl->comparek);
+    SKIPLIST_READ_BEGIN(sl);
+    m = skiplisti_find_compare(sl, data, sl->comparek);
+    found = (m) ? m->data : NULL;
+    SKIPLIST_READ_END(sl);
     if (iter) {
         *iter = m;
     }
-    return (m) ? m->data : NULL;
+    return found;
 }
 
 
 APR_DECLARE(void *) apr_skiplist_next(apr_skiplist *sl, apr_skiplistnode **iter)
 {
+    void *data = NULL;
     if (!*iter) {
         return NULL;
     }
-    *iter = (*iter)->next;
-    return (*iter) ? ((*iter)->data) : NULL;
+    SKIPLIST_READ_BEGIN(sl);
+    *iter = (*iter)->next[0];
+    if (*iter) {
+        data = (*iter)->data;
+    }
+    SKIPLIST_READ_END(sl);
+    return data;
 }
 
 APR_DECLARE(void *) apr_skiplist_previous(apr_skiplist *sl, apr_skiplistnode **iter)
 {
+    void *data = NULL;
     if (!*iter) {
         return NULL;
     }
+    SKIPLIST_READ_BEGIN(sl);
     *iter = (*iter)->prev;
-    return (*iter) ? ((*iter)->data) : NULL;
+    if (*iter) {
+        data = (*iter)->data;
+    }
+    SKIPLIST_READ_END(sl);
+    return data;
 }
 
-static apr_skiplistnode *insert_compare(apr_skiplist *sl, void *data,
-                                        apr_skiplist_compare comp, int add)
+/* The first node of sl whose element is not less than data (or NULL) */
+static apr_skiplistnode *skiplisti_lower_bound(apr_skiplist *sl, void *data,
+                                               apr_skiplist_compare comp)
 {
-    apr_skiplistnode *m, *p, *tmp, *ret = NULL;
-    int nh = 1, ch;
-    if (!sl->top) {
-        sl->height = 1;
-        sl->topend = sl->bottomend = sl->top = sl->bottom =
-            (apr_skiplistnode *)apr_skiplist_alloc(sl, sizeof(apr_skiplistnode));
-        sl->top->next = NULL;
-        sl->top->data = NULL;
-        sl->top->prev = NULL;
-        sl->top->up = NULL;
-        sl->top->down = NULL;
-        sl->top->nextindex = NULL;
-        sl->top->previndex = NULL;
-        sl->top->sl = sl;
+    apr_skiplistnode *m, *n, *last = NULL;
+    int level;
+
+    if (!sl->head) {
+        return NULL;
     }
-    if (sl->preheight) {
-        while (nh < sl->preheight && get_b_rand()) {
-            nh++;
+    m = sl->head;
+    for (level = sl->height - 1; level >= 0; level--) {
+        while ((n = m->next[level]) && n != last && comp(data, n->data) > 0) {
+            m = n;
         }
+        last = n;
     }
-    else {
-        while (nh <= sl->height && get_b_rand()) {
-            nh++;
+    return m->next[0];
+}
+
+APR_DECLARE(void *) apr_skiplist_lower_bound(apr_skiplist *sl, void *data,
+                                             apr_skiplistnode **iter)
+{
+    apr_skiplistnode *m;
+    void *found;
+
+    if (!sl->comparek) {
+        if (iter) {
+            *iter = NULL;
         }
+        return NULL;
+    }
+    SKIPLIST_READ_BEGIN(sl);
+    m = skiplisti_lower_bound(sl, data, sl->comparek);
+    found = (m) ? m->data : NULL;
+    SKIPLIST_READ_END(sl);
+    if (iter) {
+        *iter = m;
     }
-    ch = sl->height;
+    return found;
+}
 
-    /* Now we have in nh the height at which we wish to insert our new node,
-     * and in ch the current height: don't create skip paths to the inserted
-     * element until the walk down through the tree (which decrements ch)
-     * reaches nh. From there, any walk down pushes the current node on a
-     * stack (the node(s) after which we would insert) to pop back through
-     * for insertion later.
-     */
-    m = sl->top;
-    while (m) {
-        int compared = -1;
-        if (m->next) {
-            compared = comp(data, m->next->data);
-        }
-        if (compared == 0 && !add) {
-            /* Keep the existing element(s) */
-            skiplist_stack_clear(sl);
-            return NULL;
-        }
-        if (compared < 0) {
-            if (ch <= nh) {
-                /* push on stack */
-                skiplist_stack_push(sl, m);
-            }
-            m = m->down;
-            ch--;
-        }
-        else {
-            m = m->next;
-        }
+APR_DECLARE(void *) apr_skiplist_range(apr_skiplist *sl, void *lo, void *hi,
+                                       apr_skiplistnode **iter,
+                                       apr_skiplistnode **end)
+{
+    apr_skiplistnode *first, *last = NULL;
+    void *found = NULL;
+
+    if (!sl->comparek) {
+        *iter = *end = NULL;
+        return NULL;
     }
-    /* Pop the stack and insert nodes */
-    p = NULL;
-    while ((m = skiplist_stack_pop(sl))) {
-        tmp = (apr_skiplistnode *)apr_skiplist_alloc(sl, sizeof(apr_skiplistnode));
-        tmp->next = m->next;
-        if (m->next) {
-            m->next->prev = tmp;
-        }
-        tmp->prev = m;
-        tmp->up = NULL;
-        tmp->nextindex = tmp->previndex = NULL;
-        tmp->down = p;
-        if (p) {
-            p->up = tmp;
-        }
-        else {
-            /* This sets ret to the bottom-most node we are inserting */
-            ret = tmp;
-        }
-        tmp->data = data;
-        tmp->sl = sl;
-        m->next = tmp;
-        p = tmp;
-    }
-
-    /* Now we are sure the node is inserted, grow our tree to 'nh' tall */
-    for (; sl->height < nh; sl->height++) {
-        m = (apr_skiplistnode *)apr_skiplist_alloc(sl, sizeof(apr_skiplistnode));
-        tmp = (apr_skiplistnode *)apr_skiplist_alloc(sl, sizeof(apr_skiplistnode));
-        m->up = m->prev = m->nextindex = m->previndex = NULL;
-        m->next = tmp;
-        m->down = sl->top;
-        m->data = NULL;
-        m->sl = sl;
-        if (sl->top) {
-            sl->top->up = m;
-        }
-        else {
-            sl->bottom = sl->bottomend = m;
-        }
-        sl->top = sl->topend = tmp->prev = m;
-        tmp->up = tmp->next = tmp->nextindex = tmp->previndex = NULL;
-        tmp->down = p;
-        tmp->data = data;
-        tmp->sl = sl;
-        p = p->up = tmp;
+    SKIPLIST_READ_BEGIN(sl);
+    if (lo) {
+        first = skiplisti_lower_bound(sl, lo, sl->comparek);
+    }
+    else {
+        first = apr_skiplist_getlist(sl);
     }
+    if (hi) {
+        last = skiplisti_lower_bound(sl, hi, sl->comparek);
+    }
+    if (!first || (last && sl->comparek(hi, first->data) <= 0)) {
+        /* Empty (or reversed) range */
+        first = last;
+    }
+    else {
+        found = first->data;
+    }
+    SKIPLIST_READ_END(sl);
+    *iter = first;
+    *end = last;
+    return found;
+}
+
+static apr_skiplistnode *skiplisti_insert(apr_skiplist *sl, void *data,
+                                          apr_skiplist_compare comp, int add);
+
+/* Insert the element of the new node m of sl into each index of sl */
+static void skiplist_insert_index(apr_skiplist *sl, apr_skiplistnode *m)
+{
     if (sl->index != NULL) {
         /*
          * this is a external insertion, we must insert into each index as
          * well
          */
-        apr_skiplistnode *ni, *li;
-        li = ret;
+        apr_skiplistnode *p, *ni, *li;
+        li = m;
         for (p = apr_skiplist_getlist(sl->index); p; apr_skiplist_next(sl->index, &p)) {
-            ni = apr_skiplist_insert((apr_skiplist *) p->data, ret->data);
+            apr_skiplist *isl = (apr_skiplist *) p->data;
+            ni = skiplisti_insert(isl, m->data, isl->compare, 0);
             li->nextindex = ni;
             ni->previndex = li;
             li = ni;
         }
     }
+}
+
+static apr_skiplistnode *skiplisti_insert(apr_skiplist *sl, void *data,
+                                          apr_skiplist_compare comp, int add)
+{
+    apr_skiplistnode *update[SKIPLIST_MAX_HEIGHT];
+    apr_skiplistnode *m, *n, *last = NULL, *ret;
+    int nh, level;
+
+    if (!sl->head && skiplist_make_head(sl) != APR_SUCCESS) {
+        return NULL;
+    }
+    if (sl->preheight) {
+        nh = skiplist_rand_height(sl, sl->preheight);
+    }
+    else {
+        nh = skiplist_rand_height(sl, sl->height + 1);
+    }
+    if (nh > SKIPLIST_MAX_HEIGHT) {
+        nh = SKIPLIST_MAX_HEIGHT;
+    }
+
+    /* Walk down the levels, remembering at each one the node after which
+     * the new one goes (after the equal ones, if adding)
+     */
+    m = sl->head;
+    for (level = sl->height - 1; level >= 0; level--) {
+        while ((n = m->next[level]) && n != last) {
+            int compared = comp(data, n->data);
+            if (compared == 0 && !add) {
+                /* Keep the existing element(s) */
+                return NULL;
+            }
+            if (compared < 0) {
+                break;
+            }
+            m = n;
+        }
+        last = n;
+        update[level] = m;
+    }
+    for (level = sl->height; level < nh; level++) {
+        update[level] = sl->head;
+    }
+
+    ret = skiplist_new_node(sl, data, nh);
+    if (!ret) {
+        return NULL;
+    }
+    /* The node is complete before being linked, and linked bottom level
+     * first, so that a concurrent reader finding it at some level can
+     * always walk down from there
+     */
+    for (level = 0; level < nh; level++) {
+        ret->next[level] = update[level]->next[level];
+    }
+    for (level = 0; level < nh; level++) {
+        skiplist_link(sl, update[level], level, ret);
+    }
+    if (update[0] != sl->head) {
+        ret->prev = update[0];
+    }
+    if (ret->next[0]) {
+        ret->next[0]->prev = ret;
+    }
+    if (sl->height < nh) {
+        sl->height = nh;
+    }
+    skiplist_insert_index(sl, ret);
     sl->size++;
     return ret;
 }
 
+static apr_skiplistnode *insert_compare(apr_skiplist *sl, void *data,
+                                        apr_skiplist_compare comp, int add)
+{
+    apr_skiplistnode *m;
+    if (SKIPLIST_LOCK(sl) != APR_SUCCESS) {
+        return NULL;
+    }
+    m = skiplisti_insert(sl, data, comp, add);
+    SKIPLIST_UNLOCK(sl);
+    return m;
+}
+
 APR_DECLARE(apr_skiplistnode *) apr_skiplist_insert_compare(apr_skiplist *sl, void *data,
                                       apr_skiplist_compare comp)
 {
@@ -532,6 +772,72 @@ APR_DECLARE(apr_skiplistnode *) apr_skiplist_add(apr_skiplist *sl, void *data)
     return insert_compare(sl, data, sl->compare, 1);
 }
 
+APR_DECLARE(apr_status_t) apr_skiplist_bulk_load(apr_skiplist *sl,
+                                                 void **data, size_t n)
+{
+    apr_skiplistnode *update[SKIPLIST_MAX_HEIGHT];
+    apr_skiplistnode *m, *prev = NULL;
+    apr_status_t rv = APR_SUCCESS;
+    size_t i;
+    int level, nh, max;
+
+    if (!sl->compare) {
+        return APR_EINVAL;
+    }
+    for (i = 1; i < n; i++) {
+        if (sl->compare(data[i - 1], data[i]) > 0) {
+            return APR_EINVAL;
+        }
+    }
+    if (SKIPLIST_LOCK(sl) != APR_SUCCESS) {
+        return APR_EGENERAL;
+    }
+    if (sl->size) {
+        SKIPLIST_UNLOCK(sl);
+        return APR_EINVAL;
+    }
+    if (!sl->head && skiplist_make_head(sl) != APR_SUCCESS) {
+        SKIPLIST_UNLOCK(sl);
+        return APR_ENOMEM;
+    }
+
+    /* Append each element at the end of the levels it goes in, which
+     * are the last nodes seen at those levels so far
+     */
+    for (level = 0; level < SKIPLIST_MAX_HEIGHT; level++) {
+        update[level] = sl->head;
+    }
+    max = sl->preheight ? sl->preheight : SKIPLIST_MAX_HEIGHT;
+    if (max > SKIPLIST_MAX_HEIGHT) {
+        max = SKIPLIST_MAX_HEIGHT;
+    }
+    for (i = 0; i < n; i++) {
+        nh = skiplist_rand_height(sl, max);
+        m = skiplist_new_node(sl, data[i], nh);
+        if (!m) {
+            rv = APR_ENOMEM;
+            break;
+        }
+        for (level = 0; level < nh; level++) {
+            m->next[level] = NULL;
+        }
+        m->prev = prev;
+        for (level = 0; level < nh; level++) {
+            skiplist_link(sl, update[level], level, m);
+            update[level] = m;
+        }
+        if (sl->height < nh) {
+            sl->height = nh;
+        }
+        skiplist_insert_index(sl, m);
+        sl->size++;
+        prev = m;
+    }
+
+    SKIPLIST_UNLOCK(sl);
+    return rv;
+}
+
 APR_DECLARE(int) apr_skiplist_remove(apr_skiplist *sl, void *data, apr_skiplist_freefunc myfree)
 {
     if (!sl->compare) {
@@ -543,61 +849,56 @@ APR_DECLARE(int) apr_skiplist_remove(apr_skiplist *sl, void *data, apr_skiplist_
 #if 0
 void skiplist_print_struct(apr_skiplist * sl, char *prefix)
 {
-    apr_skiplistnode *p, *q;
+    apr_skiplistnode *p;
     fprintf(stderr, "Skiplist Structure (height: %d)\n", sl->height);
-    p = sl->bottom;
-    while (p) {
-        q = p;
-        fprintf(stderr, prefix);
-        while (q) {
-            fprintf(stderr, "%p ", q->data);
-            q = q->up;
-        }
-        fprintf(stderr, "\n");
-        p = p->next;
+    for (p = apr_skiplist_getlist(sl); p; p = p->next[0]) {
+        fprintf(stderr, "%s%p (%d)\n", prefix, p->data, p->height);
     }
 }
 #endif
 
-static int skiplisti_remove(apr_skiplist *sl, apr_skiplistnode *m, apr_skiplist_freefunc myfree)
+/* Remove m from sl, the caller being responsible for freeing its data
+ * (once unlocked, since the free function may use the skip list)
+ */
+static int skiplisti_remove(apr_skiplist *sl, apr_skiplistnode *m)
 {
-    apr_skiplistnode *p;
+    apr_skiplistnode *p, *n;
+    int level;
     if (!m) {
         return 0;
     }
     if (m->nextindex) {
-        skiplisti_remove(m->nextindex->sl, m->nextindex, NULL);
-    }
-    while (m->up) {
-        m = m->up;
+        skiplisti_remove(m->nextindex->sl, m->nextindex);
     }
-    while (m) {
-        p = m;
-        p->prev->next = p->next;/* take me out of the list */
-        if (p->next) {
-            p->next->prev = p->prev;    /* take me out of the list */
+    /* Unlink the node from each of its levels, walking down from the top
+     * to find its predecessors: first by comparison (when possible) up to
+     * the elements equal to it, then by identity among those.
+     */
+    p = sl->head;
+    for (level = sl->height - 1; level >= 0; level--) {
+        while ((n = p->next[level]) && n != m && sl->compare
+               && sl->compare(m->data, n->data) > 0) {
+            p = n;
         }
-        m = m->down;
-        /* This only frees the actual data in the bottom one */
-        if (!m && myfree && p->data) {
-            myfree(p->data);
+        if (level < m->height) {
+            while ((n = p->next[level]) && n != m) {
+                p = n;
+            }
+            if (n) {
+                /* m keeps its links for the concurrent readers on it */
+                skiplist_link(sl, p, level, m->next[level]);
+            }
         }
-        apr_skiplist_free(sl, p);
     }
+    if (m->next[0]) {
+        m->next[0]->prev = m->prev;
+    }
+    skiplist_retire(sl, m);
     sl->size--;
-    while (sl->top && sl->top->next == NULL) {
-        /* While the row is empty and we are not on the bottom row */
-        p = sl->top;
-        sl->top = sl->top->down;/* Move top down one */
-        if (sl->top) {
-            sl->top->up = NULL; /* Make it think its the top */
-        }
-        apr_skiplist_free(sl, p);
+    while (sl->height > 0 && sl->head->next[sl->height - 1] == NULL) {
+        /* While the top level is empty */
         sl->height--;
     }
-    if (!sl->top) {
-        sl->bottom = NULL;
-    }
     return sl->height;  /* return 1; ?? */
 }
 
@@ -607,6 +908,8 @@ APR_DECLARE(int) apr_skiplist_remove_compare(apr_skiplist *sli,
 {
     apr_skiplistnode *m;
     apr_skiplist *sl;
+    void *removed;
+    int rv;
     if (comp == sli->comparek || !sli->index) {
         sl = sli;
     }
@@ -617,38 +920,56 @@ APR_DECLARE(int) apr_skiplist_remove_compare(apr_skiplist *sli,
         }
         sl = (apr_skiplist *) m->data;
     }
-    skiplisti_find_compare(sl, data, &m, comp);
+    if (SKIPLIST_LOCK(sli) != APR_SUCCESS) {
+        return 0;
+    }
+    m = skiplisti_find_compare(sl, data, comp);
     if (!m) {
+        SKIPLIST_UNLOCK(sli);
         return 0;
     }
     while (m->previndex) {
         m = m->previndex;
     }
-    return skiplisti_remove(sl, m, myfree);
+    removed = m->data;
+    rv = skiplisti_remove(sli, m);
+    SKIPLIST_UNLOCK(sli);
+    /* This only frees the actual data in the bottom one */
+    if (myfree && removed) {
+        myfree(removed);
+    }
+    return rv;
 }
 
 APR_DECLARE(void) apr_skiplist_remove_all(apr_skiplist *sl, apr_skiplist_freefunc myfree)
 {
     /*
-     * This must remove even the place holder nodes (bottom though top)
-     * because we specify in the API that one can free the Skiplist after
-     * making this call without memory leaks
+     * This must remove even the head node because we specify in the API
+     * that one can free the Skiplist after making this call without memory
+     * leaks
      */
-    apr_skiplistnode *m, *p, *u;
-    m = sl->bottom;
+    apr_skiplistnode *m, *p;
+    m = apr_skiplist_getlist(sl);
     while (m) {
-        p = m->next;
-        if (p && myfree && p->data)
-            myfree(p->data);
-        while (m) {
-            u = m->up;
-            apr_skiplist_free(sl, m);
-            m = u;
-        }
+        p = m->next[0];
+        if (myfree && m->data)
+            myfree(m->data);
+        skiplist_free(sl, m);
         m = p;
     }
-    sl->top = sl->bottom = NULL;
-    sl->topend = sl->bottomend = NULL;
+    if (sl->sync) {
+        /* Keep the head, but empty */
+        int level;
+        for (level = 0; level < SKIPLIST_MAX_HEIGHT; level++) {
+            sl->head->next[level] = NULL;
+        }
+    }
+    else {
+        if (sl->head) {
+            skiplist_free(sl, sl->head);
+        }
+        sl->head = NULL;
+    }
     sl->height = 0;
     sl->size = 0;
 }
@@ -657,10 +978,17 @@ APR_DECLARE(void *) apr_skiplist_pop(apr_skiplist *a, apr_skiplist_freefunc myfr
 {
     apr_skiplistnode *sln;
     void *data = NULL;
+    if (SKIPLIST_LOCK(a) != APR_SUCCESS) {
+        return NULL;
+    }
     sln = apr_skiplist_getlist(a);
     if (sln) {
         data = sln->data;
-        skiplisti_remove(a, sln, myfree);
+        skiplisti_remove(a, sln);
+    }
+    SKIPLIST_UNLOCK(a);
+    if (myfree && data) {
+        myfree(data);
     }
     return data;
 }
@@ -668,11 +996,14 @@ APR_DECLARE(void *) apr_skiplist_pop(apr_skiplist *a, apr_skiplist_freefunc myfr
 APR_DECLARE(void *) apr_skiplist_peek(apr_skiplist *a)
 {
     apr_skiplistnode *sln;
+    void *data = NULL;
+    SKIPLIST_READ_BEGIN(a);
     sln = apr_skiplist_getlist(a);
     if (sln) {
-        return sln->data;
+        data = sln->data;
     }
-    return NULL;
+    SKIPLIST_READ_END(a);
+    return data;
 }
 
 APR_DECLARE(size_t) apr_skiplist_size(const apr_skiplist *sl)
@@ -698,15 +1029,20 @@ APR_DECLARE(void) apr_skiplist_set_preheight(apr_skiplist *sl, int to)
 static void skiplisti_destroy(void *vsl)
 {
     apr_skiplist_destroy((apr_skiplist *) vsl, NULL);
-    apr_skiplist_free((apr_skiplist *) vsl, vsl);
 }
 
 APR_DECLARE(void) apr_skiplist_destroy(apr_skiplist *sl, apr_skiplist_freefunc myfree)
 {
-    while (apr_skiplist_pop(sl->index, skiplisti_destroy) != NULL)
-        ;
+    /* The skip lists of the indexes have no index themselves */
+    if (sl->index) {
+        while (apr_skiplist_pop(sl->index, skiplisti_destroy) != NULL)
+            ;
+    }
     apr_skiplist_remove_all(sl, myfree);
     if (!sl->pool) {
+        if (sl->index) {
+            apr_skiplist_destroy(sl->index, NULL);
+        }
         free(sl);
     }
 }
@@ -716,7 +1052,7 @@ APR_DECLARE(apr_skiplist *) apr_skiplist_merge(apr_skiplist *sl1, apr_skiplist *
     /* Check integrity! */
     apr_skiplist temp;
     struct apr_skiplistnode *b2;
-    if (sl1->bottomend == NULL || sl1->bottomend->prev == NULL) {
+    if (sl1->size == 0) {
         apr_skiplist_remove_all(sl1, NULL);
         temp = *sl1;
         *sl1 = *sl2;
@@ -724,7 +1060,7 @@ APR_DECLARE(apr_skiplist *) apr_skiplist_merge(apr_skiplist *sl1, apr_skiplist *
         /* swap them so that sl2 can be freed normally upon return. */
         return sl1;
     }
-    if(sl2->bottom == NULL || sl2->bottom->next == NULL) {
+    if (sl2->size == 0) {
         apr_skiplist_remove_all(sl2, NULL);
         return sl1;
     }
@@ -0,0 +1,387 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "apr_private.h"
+
+#include "apr_general.h"
+#include "apr_pools.h"
+#include "apr_tables.h"
+#if APR_HAS_THREADS
+#include "apr_thread_pool.h"
+#endif
+
+#if APR_HAVE_STRING_H
+#include <string.h>
+#endif
+
+/*****************************************************************
+ * Sorting and searching the elements of an array.
+ */
+
+/* Partitions smaller than this are insertion sorted */
+#define SORT_INSERTION_MAX 16
+
+/* The elements are moved by swapping them in place, the common sizes of
+ * scalars and pointers with a single load and store of each (elements
+ * being aligned on their size in an array, when it is a power of 2)
+ */
+static APR_INLINE void sort_swap(char *a, char *b, apr_size_t size)
+{
+    /* memcpy() of a constant size compiles to plain loads and stores,
+     * without assuming the elements to be aligned
+     */
+    switch (size) {
+    case 4: {
+        apr_uint32_t t;
+        memcpy(&t, a, 4);
+        memcpy(a, b, 4);
+        memcpy(b, &t, 4);
+        break;
+    }
+    case 8: {
+        apr_uint64_t t;
+        memcpy(&t, a, 8);
+        memcpy(a, b, 8);
+        memcpy(b, &t, 8);
+        break;
+    }
+    default: {
+        char t[64];
+        while (size > sizeof(t)) {
+            memcpy(t, a, sizeof(t));
+            memcpy(a, b, sizeof(t));
+            memcpy(b, t, sizeof(t));
+            a += sizeof(t);
+            b += sizeof(t);
+            size -= sizeof(t);
+        }
+        memcpy(t, a, size);
+        memcpy(a, b, size);
+        memcpy(b, t, size);
+        break;
+    }
+    }
+}
+
+static void sort_insertion(char *base, apr_size_t n, apr_size_t size,
+                           apr_array_compare_fn_t *cmp)
+{
+    char *end = base + n * size, *i, *j;
+
+    for (i = base + size; i < end; i += size) {
+        for (j = i; j > base && cmp(j - size, j) > 0; j -= size) {
+            sort_swap(j - size, j, size);
+        }
+    }
+}
+
+static void sort_sift_down(char *base, apr_size_t root, apr_size_t n,
+                           apr_size_t size, apr_array_compare_fn_t *cmp)
+{
+    apr_size_t child;
+
+    while ((child = 2 * root + 1) < n) {
+        if (child + 1 < n
+            && cmp(base + child * size, base + (child + 1) * size) < 0) {
+            child++;
+        }
+        if (cmp(base + root * size, base + child * size) >= 0) {
+            return;
+        }
+        sort_swap(base + root * size, base + child * size, size);
+        root = child;
+    }
+}
+
+static void sort_heap(char *base, apr_size_t n, apr_size_t size,
+                      apr_array_compare_fn_t *cmp)
+{
+    apr_size_t i;
+
+    for (i = n / 2; i-- > 0;) {
+        sort_sift_down(base, i, n, size, cmp);
+    }
+    for (i = n; i-- > 1;) {
+        sort_swap(base, base + i * size, size);
+        sort_sift_down(base, 0, i, size, cmp);
+    }
+}
+
+/* Introsort: quicksort (median of three pivot), falling back to heapsort
+ * when the recursion gets too deep for the partitions to be balanced, and
+ * leaving the small partitions to a final insertion sort
+ */
+static void sort_intro(char *base, apr_size_t n, apr_size_t size,
+                       apr_array_compare_fn_t *cmp, int depth)
+{
+    while (n > SORT_INSERTION_MAX) {
+        char *lo, *hi, *mid;
+
+        if (depth-- == 0) {
+            sort_heap(base, n, size, cmp);
+            return;
+        }
+
+        /* Median of first, middle and last in base[0], the pivot, and
+         * sentinels for the partitioning at base[1] and base[n - 1]
+         */
+        mid = base + (n / 2) * size;
+        hi = base + (n - 1) * size;
+        sort_swap(base + size, mid, size);
+        if (cmp(base + size, hi) > 0) {
+            sort_swap(base + size, hi, size);
+        }
+        if (cmp(base, hi) > 0) {
+            sort_swap(base, hi, size);
+        }
+        if (cmp(base + size, base) > 0) {
+            sort_swap(base + size, base, size);
+        }
+
+        lo = base + size;
+        for (;;) {
+            do {
+                lo += size;
+            } while (cmp(lo, base) < 0);
+            do {
+                hi -= size;
+            } while (cmp(hi, base) > 0);
+            if (lo >= hi) {
+                break;
+            }
+            sort_swap(lo, hi, size);
+        }
+        sort_swap(base, hi, size);
+
+        /* Recurse on the smaller side, loop on the larger one */
+        {
+            apr_size_t left = (hi - base) / size;
+            apr_size_t right = n - left - 1;
+
+            if (left < right) {
+                sort_intro(base, left, size, cmp, depth);
+                base = hi + size;
+                n = right;
+            }
+            else {
+                sort_intro(hi + size, right, size, cmp, depth);
+                n = left;
+            }
+        }
+    }
+}
+
+static void sort_elts(char *base, apr_size_t n, apr_size_t size,
+                      apr_array_compare_fn_t *cmp)
+{
+    int depth = 0;
+    apr_size_t m;
+
+    for (m = n; m > 1; m >>= 1) {
+        depth += 2;
+    }
+    sort_intro(base, n, size, cmp, depth);
+    sort_insertion(base, n, size, cmp);
+}
+
+APR_DECLARE(void) apr_array_sort(apr_array_header_t *arr,
+                                 apr_array_compare_fn_t *cmp)
+{
+    if (arr->nelts > 1) {
+        sort_elts(arr->elts, arr->nelts, arr->elt_size, cmp);
+    }
+}
+
+APR_DECLARE(int) apr_array_lower_bound(const apr_array_header_t *arr,
+                                       const void *key,
+                                       apr_array_compare_fn_t *cmp)
+{
+    int lo = 0, n = arr->nelts;
+
+    while (n > 0) {
+        int half = n / 2;
+
+        if (cmp(key, arr->elts + (lo + half) * arr->elt_size) > 0) {
+            lo += half + 1;
+            n -= half + 1;
+        }
+        else {
+            n = half;
+        }
+    }
+    return lo;
+}
+
+APR_DECLARE(void *) apr_array_bsearch(const apr_array_header_t *arr,
+                                      const void *key,
+                                      apr_array_compare_fn_t *cmp)
+{
+    int i = apr_array_lower_bound(arr, key, cmp);
+    char *elt;
+
+    if (i == arr->nelts) {
+        return NULL;
+    }
+    elt = arr->elts + i * arr->elt_size;
+    return cmp(key, elt) == 0 ? elt : NULL;
+}
+
+#if APR_HAS_THREADS
+
+/* Below this number of elements per thread, sorting in parallel does not
+ * pay for the tasks and the merges
+ */
+#define SORT_PARALLEL_MIN 4096
+
+typedef struct sort_task_t {
+    apr_array_compare_fn_t *cmp;
+    apr_size_t size;
+    /* Sort [src, src + n), or merge [src, src + n) and [src2, src2 + n2)
+     * into dst
+     */
+    char *src, *src2, *dst;
+    apr_size_t n, n2;
+} sort_task_t;
+
+static void * APR_THREAD_FUNC sort_task(apr_thread_t *thd, void *data)
+{
+    sort_task_t *task = data;
+
+    sort_elts(task->src, task->n, task->size, task->cmp);
+    return NULL;
+}
+
+static void * APR_THREAD_FUNC merge_task(apr_thread_t *thd, void *data)
+{
+    sort_task_t *task = data;
+    apr_size_t size = task->size;
+    char *a = task->src, *a_end = a + task->n * size;
+    char *b = task->src2, *b_end = b + task->n2 * size;
+    char *dst = task->dst;
+
+    while (a < a_end && b < b_end) {
+        /* The first run wins the ties */
+        if (task->cmp(b, a) < 0) {
+            memcpy(dst, b, size);
+            b += size;
+        }
+        else {
+            memcpy(dst, a, size);
+            a += size;
+        }
+        dst += size;
+    }
+    memcpy(dst, a, a_end - a);
+    memcpy(dst + (a_end - a), b, b_end - b);
+    return NULL;
+}
+
+APR_DECLARE(apr_status_t) apr_array_sort_parallel(apr_array_header_t *arr,
+                                                 apr_array_compare_fn_t *cmp,
+                                                 apr_thread_pool_t *tp)
+{
+    apr_pool_t *pool;
+    apr_thread_pool_group_t *group;
+    sort_task_t *tasks;
+    void **params;
+    apr_size_t n = arr->nelts, size = arr->elt_size, runs, run, i;
+    char *src, *dst, *tmp;
+    apr_status_t rv;
+
+    runs = apr_thread_pool_thread_max_get(tp);
+    if (runs > n / SORT_PARALLEL_MIN) {
+        runs = n / SORT_PARALLEL_MIN;
+    }
+    if (runs < 2) {
+        apr_array_sort(arr, cmp);
+        return APR_SUCCESS;
+    }
+
+    rv = apr_pool_create(&pool, arr->pool);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+    rv = apr_thread_pool_group_create(&group, pool);
+    if (rv != APR_SUCCESS) {
+        apr_pool_destroy(pool);
+        return rv;
+    }
+    tasks = apr_palloc(pool, runs * sizeof(*tasks));
+    params = apr_palloc(pool, runs * sizeof(*params));
+    tmp = apr_palloc(pool, n * size);
+
+    /* Sort runs of n / runs elements, one per thread */
+    run = (n + runs - 1) / runs;
+    for (i = 0; i < runs; i++) {
+        apr_size_t first = i * run;
+
+        tasks[i].cmp = cmp;
+        tasks[i].size = size;
+        tasks[i].src = arr->elts + first * size;
+        tasks[i].n = (first + run < n) ? run : n - first;
+        params[i] = &tasks[i];
+    }
+    rv = apr_thread_pool_push_batch(tp, sort_task, params, runs,
+                                    APR_THREAD_TASK_PRIORITY_NORMAL, arr,
+                                    group);
+    apr_thread_pool_group_wait(group);
+
+    /* Then merge them two by two, from one buffer to the other */
+    src = arr->elts;
+    dst = tmp;
+    while (rv == APR_SUCCESS && run < n) {
+        apr_size_t merges = 0, first;
+
+        for (first = 0; first < n; first += 2 * run) {
+            sort_task_t *task = &tasks[merges];
+
+            task->src = src + first * size;
+            task->dst = dst + first * size;
+            if (first + run >= n) {
+                /* Odd run out, merged with nothing */
+                task->n = n - first;
+                task->n2 = 0;
+            }
+            else {
+                task->n = run;
+                task->n2 = (first + 2 * run < n) ? run : n - first - run;
+            }
+            task->src2 = task->src + task->n * size;
+            params[merges++] = task;
+        }
+        rv = apr_thread_pool_push_batch(tp, merge_task, params, merges,
+                                        APR_THREAD_TASK_PRIORITY_NORMAL, arr,
+                                        group);
+        apr_thread_pool_group_wait(group);
+        if (rv != APR_SUCCESS) {
+            /* dst may be incomplete, src still has all the elements */
+            break;
+        }
+
+        run *= 2;
+        tmp = src;
+        src = dst;
+        dst = tmp;
+    }
+    if (src != arr->elts) {
+        memcpy(arr->elts, src, n * size);
+    }
+
+    apr_pool_destroy(pool);
+    return rv;
+}
+
+#endif /* APR_HAS_THREADS */
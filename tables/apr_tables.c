@@ -26,6 +26,7 @@
 #include "apr_general.h"
 #include "apr_pools.h"
 #include "apr_tables.h"
+#include "apr_hash.h"
 #include "apr_strings.h"
 #include "apr_lib.h"
 #if APR_HAVE_STDLIB_H
@@ -51,6 +52,131 @@
  * The 'array' functions...
  */
 
+/* The arrays made by apr_array_make_ex() are registered in the user data
+ * of their pool, by the address of their header: nothing in the header
+ * itself tells them apart, since the headers made by hand or copied are
+ * pool arrays whatever they contain.
+ */
+#define ARRAY_EX_KEY "apr_array_make_ex"
+
+typedef struct {
+    const apr_array_header_t *arr;  /* the key */
+    apr_allocator_t *allocator;
+} array_ex_t;
+
+static apr_hash_t *array_ex_registry(apr_pool_t *p)
+{
+    void *registry = NULL;
+
+    if (p) {
+        apr_pool_userdata_get(&registry, ARRAY_EX_KEY, p);
+    }
+    return registry;
+}
+
+/* The allocator of an array made by apr_array_make_ex(), if it is one */
+static apr_allocator_t *array_allocator(const apr_array_header_t *arr)
+{
+    apr_hash_t *registry = array_ex_registry(arr->pool);
+    array_ex_t *ex;
+
+    if (registry == NULL) {
+        return NULL;
+    }
+    ex = apr_hash_get(registry, &arr, sizeof(arr));
+    return ex ? ex->allocator : NULL;
+}
+
+/* Allocate the elements of an array, at least *nelts of them (the
+ * allocator's regions being rounded up, the array takes all the room)
+ */
+static char *array_alloc(apr_array_header_t *arr, apr_allocator_t *allocator,
+                         int *nelts, int clear)
+{
+    char *elts;
+
+    if (allocator) {
+        apr_memnode_t *node;
+
+        node = apr_allocator_alloc(allocator,
+                                   (apr_size_t)*nelts * arr->elt_size);
+        if (node == NULL) {
+            apr_abortfunc_t abort_fn = apr_pool_abort_get(arr->pool);
+            if (abort_fn) {
+                abort_fn(APR_ENOMEM);
+            }
+            return NULL;
+        }
+        *nelts = (int)((node->endp - node->first_avail) / arr->elt_size);
+        elts = node->first_avail;
+        if (clear) {
+            memset(elts, 0, (apr_size_t)*nelts * arr->elt_size);
+        }
+    }
+    else if (clear) {
+        elts = apr_pcalloc(arr->pool, *nelts * arr->elt_size);
+    }
+    else {
+        elts = apr_palloc(arr->pool, *nelts * arr->elt_size);
+    }
+    return elts;
+}
+
+static void array_free(apr_array_header_t *arr, apr_allocator_t *allocator)
+{
+    if (allocator && arr->elts) {
+        apr_allocator_free(allocator, (apr_memnode_t *)
+                           (arr->elts - APR_MEMNODE_T_SIZE));
+        arr->elts = NULL;
+    }
+}
+
+static apr_status_t array_cleanup(void *data)
+{
+    apr_array_header_t *arr = data;
+
+    array_free(arr, array_allocator(arr));
+    arr->nelts = arr->nalloc = 0;
+    /* The memory of the header may be reused by anything now */
+    apr_hash_set(array_ex_registry(arr->pool), &arr, sizeof(arr), NULL);
+    return APR_SUCCESS;
+}
+
+/* Make room for at least nelts elements, the new ones being zeroed if
+ * clear is set.  The size doubles unless exact is set.  Returns zero,
+ * leaving the array untouched, if the memory can't be allocated.
+ */
+static int array_grow(apr_array_header_t *arr, int nelts, int clear,
+                      int exact)
+{
+    apr_allocator_t *allocator = array_allocator(arr);
+    int new_size = nelts;
+    char *new_data;
+
+    if (!exact) {
+        new_size = (arr->nalloc <= 0) ? 1 : arr->nalloc * 2;
+        while (new_size < nelts) {
+            new_size *= 2;
+        }
+    }
+
+    new_data = array_alloc(arr, allocator, &new_size, 0);
+    if (new_data == NULL) {
+        return 0;
+    }
+    if (arr->nalloc > 0) {
+        memcpy(new_data, arr->elts, arr->nalloc * arr->elt_size);
+    }
+    if (clear) {
+        memset(new_data + arr->nalloc * arr->elt_size, 0,
+               arr->elt_size * (new_size - arr->nalloc));
+    }
+    array_free(arr, allocator);
+    arr->elts = new_data;
+    arr->nalloc = new_size;
+    return 1;
+}
+
 static void make_array_core(apr_array_header_t *res, apr_pool_t *p,
 			    int nelts, int elt_size, int clear)
 {
@@ -90,6 +216,43 @@ APR_DECLARE(apr_array_header_t *) apr_array_make(apr_pool_t *p,
     return res;
 }
 
+APR_DECLARE(apr_array_header_t *) apr_array_make_ex(apr_pool_t *p,
+                                                    int nelts, int elt_size,
+                                                    apr_allocator_t *allocator)
+{
+    apr_array_header_t *res;
+    apr_hash_t *registry;
+    array_ex_t *ex;
+
+    if (allocator == NULL) {
+        allocator = apr_pool_allocator_get(p);
+        if (allocator == NULL) {
+            /* Pool debugging */
+            return apr_array_make(p, nelts, elt_size);
+        }
+    }
+    if (nelts < 1) {
+        nelts = 1;
+    }
+
+    if ((registry = array_ex_registry(p)) == NULL) {
+        registry = apr_hash_make(p);
+        apr_pool_userdata_setn(registry, ARRAY_EX_KEY, NULL, p);
+    }
+    res = (apr_array_header_t *) apr_palloc(p, sizeof(apr_array_header_t));
+    res->pool = p;
+    res->elt_size = elt_size;
+    res->nelts = 0;
+    ex = apr_palloc(p, sizeof(*ex));
+    ex->arr = res;
+    ex->allocator = allocator;
+    apr_hash_set(registry, &ex->arr, sizeof(ex->arr), ex);
+    res->elts = array_alloc(res, allocator, &nelts, 1);
+    res->nalloc = res->elts ? nelts : 0;
+    apr_pool_cleanup_register(p, res, array_cleanup, apr_pool_cleanup_null);
+    return res;
+}
+
 APR_DECLARE(void) apr_array_clear(apr_array_header_t *arr)
 {
     arr->nelts = 0;
@@ -106,17 +269,8 @@ APR_DECLARE(void *) apr_array_pop(apr_array_header_t *arr)
 
 APR_DECLARE(void *) apr_array_push(apr_array_header_t *arr)
 {
-    if (arr->nelts == arr->nalloc) {
-        int new_size = (arr->nalloc <= 0) ? 1 : arr->nalloc * 2;
-        char *new_data;
-
-        new_data = apr_palloc(arr->pool, arr->elt_size * new_size);
-
-        memcpy(new_data, arr->elts, arr->nalloc * arr->elt_size);
-        memset(new_data + arr->nalloc * arr->elt_size, 0,
-               arr->elt_size * (new_size - arr->nalloc));
-        arr->elts = new_data;
-        arr->nalloc = new_size;
+    if (arr->nelts == arr->nalloc && !array_grow(arr, arr->nelts + 1, 1, 0)) {
+        return NULL;
     }
 
     ++arr->nelts;
@@ -125,39 +279,43 @@ APR_DECLARE(void *) apr_array_push(apr_array_header_t *arr)
 
 static void *apr_array_push_noclear(apr_array_header_t *arr)
 {
-    if (arr->nelts == arr->nalloc) {
-        int new_size = (arr->nalloc <= 0) ? 1 : arr->nalloc * 2;
-        char *new_data;
-
-        new_data = apr_palloc(arr->pool, arr->elt_size * new_size);
-
-        memcpy(new_data, arr->elts, arr->nalloc * arr->elt_size);
-        arr->elts = new_data;
-        arr->nalloc = new_size;
+    if (arr->nelts == arr->nalloc && !array_grow(arr, arr->nelts + 1, 0, 0)) {
+        return NULL;
     }
 
     ++arr->nelts;
     return arr->elts + (arr->elt_size * (arr->nelts - 1));
 }
 
-APR_DECLARE(void) apr_array_cat(apr_array_header_t *dst,
-			       const apr_array_header_t *src)
+APR_DECLARE(void *) apr_array_push_n(apr_array_header_t *arr, int nelts)
 {
-    int elt_size = dst->elt_size;
+    char *first;
 
-    if (dst->nelts + src->nelts > dst->nalloc) {
-	int new_size = (dst->nalloc <= 0) ? 1 : dst->nalloc * 2;
-	char *new_data;
+    if (arr->nelts + nelts > arr->nalloc
+        && !array_grow(arr, arr->nelts + nelts, 0, 0)) {
+        return NULL;
+    }
 
-	while (dst->nelts + src->nelts > new_size) {
-	    new_size *= 2;
-	}
+    first = arr->elts + arr->elt_size * arr->nelts;
+    arr->nelts += nelts;
+    return first;
+}
 
-	new_data = apr_pcalloc(dst->pool, elt_size * new_size);
-	memcpy(new_data, dst->elts, dst->nalloc * elt_size);
+APR_DECLARE(void) apr_array_reserve(apr_array_header_t *arr, int nelts)
+{
+    if (nelts > arr->nalloc) {
+        array_grow(arr, nelts, 1, 1);
+    }
+}
 
-	dst->elts = new_data;
-	dst->nalloc = new_size;
+APR_DECLARE(void) apr_array_cat(apr_array_header_t *dst,
+			       const apr_array_header_t *src)
+{
+    int elt_size = dst->elt_size;
+
+    if (dst->nelts + src->nelts > dst->nalloc
+        && !array_grow(dst, dst->nelts + src->nelts, 1, 0)) {
+        return;
     }
 
     memcpy(dst->elts + dst->nelts * elt_size, src->elts,
@@ -328,6 +486,36 @@ APR_DECLARE(char *) apr_array_pstrcat(apr_pool_t *p,
     checksum &= CASE_MASK;                     \
 }
 
+/* Tables with more entries than this get a full-key index, see
+ * table_index_build()
+ */
+#ifndef TABLE_FULL_INDEX_MIN
+#define TABLE_FULL_INDEX_MIN 16
+#endif
+
+/* Whether an entry has the given key, knowing its checksum and
+ * full-key hash
+ */
+#define TABLE_KEY_MATCHES(elt, k, checksum, fhash)     \
+    ((fhash) == (elt)->key_hash &&                     \
+     (checksum) == (elt)->key_checksum &&              \
+     !strcasecmp((elt)->key, (k)))
+
+/* The full-key index of a table:
+ *   - buckets[key_hash & mask] is the offset of the last entry in
+ *     the bucket (or -1)
+ *   - next[i] is the offset of the previous entry in the bucket of
+ *     the i'th entry (or -1)
+ * so that walking a bucket visits its entries in reverse order of the
+ * table.  The hashes themselves are the key_hash of the entries.
+ */
+typedef struct {
+    int *buckets;
+    int *next;
+    int mask;
+    int nalloc;
+} table_index_t;
+
 /** The opaque string-content table type */
 struct apr_table_t {
     /* This has to be first to promote backwards compatibility with
@@ -355,16 +543,16 @@ struct apr_table_t {
     apr_uint32_t index_initialized;
     int index_first[TABLE_HASH_SIZE];
     int index_last[TABLE_HASH_SIZE];
+    /* The index above only looks at the first character of the keys,
+     * so once the table has more than TABLE_FULL_INDEX_MIN entries it
+     * also gets a hash index of the whole (case-folded) keys, which is
+     * NULL until then.  It's maintained by the functions adding entries
+     * and rebuilt by table_reindex(), but never built by the lookups
+     * so that read only tables can still be shared by threads.
+     */
+    table_index_t *findex;
 };
 
-/* keep state for apr_table_getm() */
-typedef struct
-{
-    apr_pool_t *p;
-    const char *first;
-    apr_array_header_t *merged;
-} table_getm_t;
-
 /*
  * NOTICE: if you tweak this you should look at is_empty_table() 
  * and table_elts() in alloc.h
@@ -387,6 +575,134 @@ static apr_table_entry_t *do_table_push(const char *func, apr_table_t *t)
 #define table_push(t)	((apr_table_entry_t *) apr_array_push_noclear(&(t)->a))
 #endif /* MAKE_TABLE_PROFILE */
 
+static APR_INLINE apr_uint32_t table_hash_finish(apr_uint32_t hash)
+{
+    /* Mix the high bits in, only the low ones select the bucket */
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6b;
+    hash ^= hash >> 13;
+
+    return hash;
+}
+
+/* The full-key hash of a key, with the same case folding as
+ * COMPUTE_KEY_CHECKSUM(), computed along with its length
+ */
+static APR_INLINE apr_uint32_t table_key_hash(const char *key,
+                                              apr_size_t *klen)
+{
+    const unsigned char *k = (const unsigned char *)key;
+    apr_uint32_t hash = 0;
+
+    for (; *k; k++) {
+        hash = hash * 33 + (*k & (unsigned char)CASE_MASK);
+    }
+    *klen = k - (const unsigned char *)key;
+
+    return table_hash_finish(hash);
+}
+
+static APR_INLINE apr_uint32_t table_key_hash_len(const char *key,
+                                                  apr_size_t klen)
+{
+    const unsigned char *k = (const unsigned char *)key;
+    apr_uint32_t hash = 0;
+    apr_size_t i;
+
+    for (i = 0; i < klen; i++) {
+        hash = hash * 33 + (k[i] & (unsigned char)CASE_MASK);
+    }
+
+    return table_hash_finish(hash);
+}
+
+static APR_INLINE void table_index_link(apr_table_t *t, int i)
+{
+    const apr_table_entry_t *elts = (const apr_table_entry_t *)t->a.elts;
+    table_index_t *ix = t->findex;
+    int *bucket = &ix->buckets[elts[i].key_hash & ix->mask];
+
+    ix->next[i] = *bucket;
+    *bucket = i;
+}
+
+/* (Re)build the full-key index of a table from the key_hash of its
+ * entries.  The index is only reallocated when the table outgrows it.
+ */
+static void table_index_build(apr_table_t *t)
+{
+    table_index_t *ix = t->findex;
+    int i;
+
+    if (!ix || ix->nalloc < t->a.nelts) {
+        int size = TABLE_FULL_INDEX_MIN * 2;
+
+        while (size < t->a.nalloc) {
+            size <<= 1;
+        }
+        ix = apr_palloc(t->a.pool, sizeof(*ix));
+        ix->buckets = apr_palloc(t->a.pool, size * sizeof(int));
+        ix->next = apr_palloc(t->a.pool, size * sizeof(int));
+        ix->mask = size - 1;
+        ix->nalloc = size;
+        t->findex = ix;
+    }
+
+    for (i = 0; i <= ix->mask; i++) {
+        ix->buckets[i] = -1;
+    }
+    for (i = 0; i < t->a.nelts; i++) {
+        table_index_link(t, i);
+    }
+}
+
+/* Index the entry just pushed to the table */
+static APR_INLINE void table_index_add(apr_table_t *t)
+{
+    table_index_t *ix = t->findex;
+    int i = t->a.nelts - 1;
+
+    if (ix && i < ix->nalloc) {
+        table_index_link(t, i);
+    }
+    else if (ix || t->a.nelts > TABLE_FULL_INDEX_MIN) {
+        table_index_build(t);
+    }
+}
+
+/* Find the range of entries which may have the given key, in
+ * [*first, *last].  Without a full-key index that's the range of the
+ * first character index (which must be initialized), otherwise it's
+ * exactly the first and last matches.  Returns zero if nothing matches.
+ */
+static APR_INLINE int table_find(const apr_table_t *t, const char *key,
+                                 int hash, apr_uint32_t checksum,
+                                 apr_uint32_t fhash, int *first, int *last)
+{
+    const table_index_t *ix = t->findex;
+    const apr_table_entry_t *elts;
+    int i;
+
+    if (!ix) {
+        *first = t->index_first[hash];
+        *last = t->index_last[hash];
+        return 1;
+    }
+
+    elts = (const apr_table_entry_t *)t->a.elts;
+    *first = *last = -1;
+    for (i = ix->buckets[fhash & ix->mask]; i >= 0; i = ix->next[i]) {
+        if (TABLE_KEY_MATCHES(&elts[i], key, checksum, fhash)) {
+            if (*first < 0) {
+                *last = i;
+            }
+            *first = i;
+        }
+    }
+
+    return *first >= 0;
+}
+
 APR_DECLARE(const apr_array_header_t *) apr_table_elts(const apr_table_t *t)
 {
     return (const apr_array_header_t *)t;
@@ -406,6 +722,7 @@ APR_DECLARE(apr_table_t *) apr_table_make(apr_pool_t *p, int nelts)
     t->creator = __builtin_return_address(0);
 #endif
     t->index_initialized = 0;
+    t->findex = NULL;
     return t;
 }
 
@@ -428,20 +745,10 @@ APR_DECLARE(apr_table_t *) apr_table_copy(apr_pool_t *p, const apr_table_t *t)
     memcpy(new->index_first, t->index_first, sizeof(int) * TABLE_HASH_SIZE);
     memcpy(new->index_last, t->index_last, sizeof(int) * TABLE_HASH_SIZE);
     new->index_initialized = t->index_initialized;
-    return new;
-}
-
-APR_DECLARE(apr_table_t *) apr_table_clone(apr_pool_t *p, const apr_table_t *t)
-{
-    const apr_array_header_t *array = apr_table_elts(t);
-    apr_table_entry_t *elts = (apr_table_entry_t *) array->elts;
-    apr_table_t *new = apr_table_make(p, array->nelts);
-    int i;
-
-    for (i = 0; i < array->nelts; i++) {
-        apr_table_add(new, elts[i].key, elts[i].val);
+    new->findex = NULL;
+    if (t->findex) {
+        table_index_build(new);
     }
-
     return new;
 }
 
@@ -460,12 +767,39 @@ static void table_reindex(apr_table_t *t)
             TABLE_SET_INDEX_INITIALIZED(t, hash);
         }
     }
+
+    if (t->findex || t->a.nelts > TABLE_FULL_INDEX_MIN) {
+        table_index_build(t);
+    }
+}
+
+APR_DECLARE(apr_table_t *) apr_table_clone(apr_pool_t *p, const apr_table_t *t)
+{
+    const apr_array_header_t *array = apr_table_elts(t);
+    apr_table_entry_t *elts = (apr_table_entry_t *) array->elts;
+    apr_table_t *new = apr_table_make(p, array->nelts);
+    int i;
+
+    /* Like apr_table_add() for each entry, reusing their hashes */
+    for (i = 0; i < array->nelts; i++) {
+        apr_table_entry_t *elt = table_push(new);
+
+        *elt = elts[i];
+        elt->key = apr_pstrdup(p, elts[i].key);
+        elt->val = apr_pstrdup(p, elts[i].val);
+    }
+    table_reindex(new);
+
+    return new;
 }
 
 APR_DECLARE(void) apr_table_clear(apr_table_t *t)
 {
     t->a.nelts = 0;
     t->index_initialized = 0;
+    if (t->findex) {
+        table_index_build(t);
+    }
 }
 
 APR_DECLARE(const char *) apr_table_get(const apr_table_t *t, const char *key)
@@ -473,7 +807,7 @@ APR_DECLARE(const char *) apr_table_get(const apr_table_t *t, const char *key)
     apr_table_entry_t *next_elt;
     apr_table_entry_t *end_elt;
     apr_uint32_t checksum;
-    int hash;
+    int hash, first, last;
 
     if (key == NULL) {
 	return NULL;
@@ -484,6 +818,16 @@ APR_DECLARE(const char *) apr_table_get(const apr_table_t *t, const char *key)
         return NULL;
     }
     COMPUTE_KEY_CHECKSUM(key, checksum);
+    if (t->findex) {
+        apr_size_t klen;
+
+        /* table_find() compared the keys already */
+        if (!table_find(t, key, hash, checksum, table_key_hash(key, &klen),
+                        &first, &last)) {
+            return NULL;
+        }
+        return ((apr_table_entry_t *) t->a.elts)[first].val;
+    }
     next_elt = ((apr_table_entry_t *) t->a.elts) + t->index_first[hash];;
     end_elt = ((apr_table_entry_t *) t->a.elts) + t->index_last[hash];
 
@@ -497,14 +841,18 @@ APR_DECLARE(const char *) apr_table_get(const apr_table_t *t, const char *key)
     return NULL;
 }
 
-APR_DECLARE(void) apr_table_set(apr_table_t *t, const char *key,
-                                const char *val)
+/* apr_table_set[n][_len](), copying the key and value to the pool of
+ * the table if copy is set (vlen is only used then)
+ */
+static void table_set(apr_table_t *t, const char *key, apr_size_t klen,
+                      apr_uint32_t fhash, const char *val, apr_size_t vlen,
+                      int copy)
 {
     apr_table_entry_t *next_elt;
     apr_table_entry_t *end_elt;
     apr_table_entry_t *table_end;
     apr_uint32_t checksum;
-    int hash;
+    int hash, first, last;
 
     COMPUTE_KEY_CHECKSUM(key, checksum);
     hash = TABLE_HASH(key);
@@ -513,25 +861,27 @@ APR_DECLARE(void) apr_table_set(apr_table_t *t, const char *key,
         TABLE_SET_INDEX_INITIALIZED(t, hash);
         goto add_new_elt;
     }
-    next_elt = ((apr_table_entry_t *) t->a.elts) + t->index_first[hash];;
-    end_elt = ((apr_table_entry_t *) t->a.elts) + t->index_last[hash];
+    if (!table_find(t, key, hash, checksum, fhash, &first, &last)) {
+        goto add_new_elt;
+    }
+    next_elt = ((apr_table_entry_t *) t->a.elts) + first;
+    end_elt = ((apr_table_entry_t *) t->a.elts) + last;
     table_end =((apr_table_entry_t *) t->a.elts) + t->a.nelts;
 
     for (; next_elt <= end_elt; next_elt++) {
-	if ((checksum == next_elt->key_checksum) &&
-            !strcasecmp(next_elt->key, key)) {
+	if (TABLE_KEY_MATCHES(next_elt, key, checksum, fhash)) {
 
             /* Found an existing entry with the same key, so overwrite it */
 
             int must_reindex = 0;
             apr_table_entry_t *dst_elt = NULL;
 
-            next_elt->val = apr_pstrdup(t->a.pool, val);
+            next_elt->val = copy ? apr_pstrmemdup(t->a.pool, val, vlen)
+                                 : (char *)val;
 
             /* Remove any other instances of this key */
             for (next_elt++; next_elt <= end_elt; next_elt++) {
-                if ((checksum == next_elt->key_checksum) &&
-                    !strcasecmp(next_elt->key, key)) {
+                if (TABLE_KEY_MATCHES(next_elt, key, checksum, fhash)) {
                     t->a.nelts--;
                     if (!dst_elt) {
                         dst_elt = next_elt;
@@ -564,81 +914,42 @@ APR_DECLARE(void) apr_table_set(apr_table_t *t, const char *key,
 add_new_elt:
     t->index_last[hash] = t->a.nelts;
     next_elt = (apr_table_entry_t *) table_push(t);
-    next_elt->key = apr_pstrdup(t->a.pool, key);
-    next_elt->val = apr_pstrdup(t->a.pool, val);
+    if (copy) {
+        next_elt->key = apr_pstrmemdup(t->a.pool, key, klen);
+        next_elt->val = apr_pstrmemdup(t->a.pool, val, vlen);
+    }
+    else {
+        next_elt->key = (char *)key;
+        next_elt->val = (char *)val;
+    }
     next_elt->key_checksum = checksum;
+    next_elt->key_hash = fhash;
+    table_index_add(t);
 }
 
-APR_DECLARE(void) apr_table_setn(apr_table_t *t, const char *key,
-                                 const char *val)
+APR_DECLARE(void) apr_table_set(apr_table_t *t, const char *key,
+                                const char *val)
 {
-    apr_table_entry_t *next_elt;
-    apr_table_entry_t *end_elt;
-    apr_table_entry_t *table_end;
-    apr_uint32_t checksum;
-    int hash;
-
-    COMPUTE_KEY_CHECKSUM(key, checksum);
-    hash = TABLE_HASH(key);
-    if (!TABLE_INDEX_IS_INITIALIZED(t, hash)) {
-        t->index_first[hash] = t->a.nelts;
-        TABLE_SET_INDEX_INITIALIZED(t, hash);
-        goto add_new_elt;
-    }
-    next_elt = ((apr_table_entry_t *) t->a.elts) + t->index_first[hash];;
-    end_elt = ((apr_table_entry_t *) t->a.elts) + t->index_last[hash];
-    table_end =((apr_table_entry_t *) t->a.elts) + t->a.nelts;
-
-    for (; next_elt <= end_elt; next_elt++) {
-	if ((checksum == next_elt->key_checksum) &&
-            !strcasecmp(next_elt->key, key)) {
-
-            /* Found an existing entry with the same key, so overwrite it */
+    apr_size_t klen;
+    apr_uint32_t fhash = table_key_hash(key, &klen);
 
-            int must_reindex = 0;
-            apr_table_entry_t *dst_elt = NULL;
-
-            next_elt->val = (char *)val;
+    table_set(t, key, klen, fhash, val, strlen(val), 1);
+}
 
-            /* Remove any other instances of this key */
-            for (next_elt++; next_elt <= end_elt; next_elt++) {
-                if ((checksum == next_elt->key_checksum) &&
-                    !strcasecmp(next_elt->key, key)) {
-                    t->a.nelts--;
-                    if (!dst_elt) {
-                        dst_elt = next_elt;
-                    }
-                }
-                else if (dst_elt) {
-                    *dst_elt++ = *next_elt;
-                    must_reindex = 1;
-                }
-            }
+APR_DECLARE(void) apr_table_setn(apr_table_t *t, const char *key,
+                                 const char *val)
+{
+    apr_size_t klen;
+    apr_uint32_t fhash = table_key_hash(key, &klen);
 
-            /* If we've removed anything, shift over the remainder
-             * of the table (note that the previous loop didn't
-             * run to the end of the table, just to the last match
-             * for the index)
-             */
-            if (dst_elt) {
-                for (; next_elt < table_end; next_elt++) {
-                    *dst_elt++ = *next_elt;
-                }
-                must_reindex = 1;
-            }
-            if (must_reindex) {
-                table_reindex(t);
-            }
-            return;
-        }
-    }
+    table_set(t, key, klen, fhash, val, 0, 0);
+}
 
-add_new_elt:
-    t->index_last[hash] = t->a.nelts;
-    next_elt = (apr_table_entry_t *) table_push(t);
-    next_elt->key = (char *)key;
-    next_elt->val = (char *)val;
-    next_elt->key_checksum = checksum;
+APR_DECLARE(void) apr_table_setn_len(apr_table_t *t,
+                                     const char *key, apr_size_t klen,
+                                     const char *val, apr_size_t vlen)
+{
+    table_set(t, key, klen, table_key_hash_len(key, klen), val, vlen, 0);
 }
 
 APR_DECLARE(void) apr_table_unset(apr_table_t *t, const char *key)
@@ -646,8 +957,9 @@ APR_DECLARE(void) apr_table_unset(apr_table_t *t, const char *key)
     apr_table_entry_t *next_elt;
     apr_table_entry_t *end_elt;
     apr_table_entry_t *dst_elt;
-    apr_uint32_t checksum;
-    int hash;
+    apr_uint32_t checksum, fhash;
+    apr_size_t klen;
+    int hash, first, last;
     int must_reindex;
 
     hash = TABLE_HASH(key);
@@ -655,12 +967,15 @@ APR_DECLARE(void) apr_table_unset(apr_table_t *t, const char *key)
         return;
     }
     COMPUTE_KEY_CHECKSUM(key, checksum);
-    next_elt = ((apr_table_entry_t *) t->a.elts) + t->index_first[hash];
-    end_elt = ((apr_table_entry_t *) t->a.elts) + t->index_last[hash];
+    fhash = table_key_hash(key, &klen);
+    if (!table_find(t, key, hash, checksum, fhash, &first, &last)) {
+        return;
+    }
+    next_elt = ((apr_table_entry_t *) t->a.elts) + first;
+    end_elt = ((apr_table_entry_t *) t->a.elts) + last;
     must_reindex = 0;
     for (; next_elt <= end_elt; next_elt++) {
-	if ((checksum == next_elt->key_checksum) &&
-            !strcasecmp(next_elt->key, key)) {
+	if (TABLE_KEY_MATCHES(next_elt, key, checksum, fhash)) {
 
             /* Found a match: remove this entry, plus any additional
              * matches for the same key that might follow
@@ -670,8 +985,7 @@ APR_DECLARE(void) apr_table_unset(apr_table_t *t, const char *key)
             t->a.nelts--;
             dst_elt = next_elt;
             for (next_elt++; next_elt <= end_elt; next_elt++) {
-                if ((checksum == next_elt->key_checksum) &&
-                    !strcasecmp(next_elt->key, key)) {
+                if (TABLE_KEY_MATCHES(next_elt, key, checksum, fhash)) {
                     t->a.nelts--;
                 }
                 else {
@@ -695,31 +1009,47 @@ APR_DECLARE(void) apr_table_unset(apr_table_t *t, const char *key)
     }
 }
 
-APR_DECLARE(void) apr_table_merge(apr_table_t *t, const char *key,
-				 const char *val)
+/* apr_table_merge[n](), copying the key and value to the pool of the
+ * table if copy is set
+ */
+static void table_merge(apr_table_t *t, const char *key, const char *val,
+                        int copy)
 {
     apr_table_entry_t *next_elt;
     apr_table_entry_t *end_elt;
-    apr_uint32_t checksum;
-    int hash;
+    apr_uint32_t checksum, fhash;
+    apr_size_t klen, vlen = strlen(val);
+    int hash, first, last;
 
     COMPUTE_KEY_CHECKSUM(key, checksum);
     hash = TABLE_HASH(key);
+    fhash = table_key_hash(key, &klen);
     if (!TABLE_INDEX_IS_INITIALIZED(t, hash)) {
         t->index_first[hash] = t->a.nelts;
         TABLE_SET_INDEX_INITIALIZED(t, hash);
         goto add_new_elt;
     }
-    next_elt = ((apr_table_entry_t *) t->a.elts) + t->index_first[hash];
-    end_elt = ((apr_table_entry_t *) t->a.elts) + t->index_last[hash];
+    if (!table_find(t, key, hash, checksum, fhash, &first, &last)) {
+        goto add_new_elt;
+    }
+    next_elt = ((apr_table_entry_t *) t->a.elts) + first;
+    end_elt = ((apr_table_entry_t *) t->a.elts) + last;
 
     for (; next_elt <= end_elt; next_elt++) {
-	if ((checksum == next_elt->key_checksum) &&
-            !strcasecmp(next_elt->key, key)) {
+	if (TABLE_KEY_MATCHES(next_elt, key, checksum, fhash)) {
 
-            /* Found an existing entry with the same key, so merge with it */
-	    next_elt->val = apr_pstrcat(t->a.pool, next_elt->val, ", ",
-                                        val, NULL);
+            /* Found an existing entry with the same key, so merge with it
+             * (its value may have been changed outside of the table
+             * functions, so it's measured here)
+             */
+            apr_size_t len = strlen(next_elt->val);
+            char *new_val = apr_palloc(t->a.pool, len + 2 + vlen + 1);
+
+            memcpy(new_val, next_elt->val, len);
+            new_val[len++] = ',';
+            new_val[len++] = ' ';
+            memcpy(new_val + len, val, vlen + 1);
+            next_elt->val = new_val;
             return;
         }
     }
@@ -727,19 +1057,28 @@ APR_DECLARE(void) apr_table_merge(apr_table_t *t, const char *key,
 add_new_elt:
     t->index_last[hash] = t->a.nelts;
     next_elt = (apr_table_entry_t *) table_push(t);
-    next_elt->key = apr_pstrdup(t->a.pool, key);
-    next_elt->val = apr_pstrdup(t->a.pool, val);
+    if (copy) {
+        next_elt->key = apr_pstrmemdup(t->a.pool, key, klen);
+        next_elt->val = apr_pstrmemdup(t->a.pool, val, vlen);
+    }
+    else {
+        next_elt->key = (char *)key;
+        next_elt->val = (char *)val;
+    }
     next_elt->key_checksum = checksum;
+    next_elt->key_hash = fhash;
+    table_index_add(t);
+}
+
+APR_DECLARE(void) apr_table_merge(apr_table_t *t, const char *key,
+				 const char *val)
+{
+    table_merge(t, key, val, 1);
 }
 
 APR_DECLARE(void) apr_table_mergen(apr_table_t *t, const char *key,
 				  const char *val)
 {
-    apr_table_entry_t *next_elt;
-    apr_table_entry_t *end_elt;
-    apr_uint32_t checksum;
-    int hash;
-
 #if APR_POOL_DEBUG
     {
 	apr_pool_t *pool;
@@ -758,37 +1097,15 @@ APR_DECLARE(void) apr_table_mergen(apr_table_t *t, const char *key,
     }
 #endif
 
-    COMPUTE_KEY_CHECKSUM(key, checksum);
-    hash = TABLE_HASH(key);
-    if (!TABLE_INDEX_IS_INITIALIZED(t, hash)) {
-        t->index_first[hash] = t->a.nelts;
-        TABLE_SET_INDEX_INITIALIZED(t, hash);
-        goto add_new_elt;
-    }
-    next_elt = ((apr_table_entry_t *) t->a.elts) + t->index_first[hash];;
-    end_elt = ((apr_table_entry_t *) t->a.elts) + t->index_last[hash];
-
-    for (; next_elt <= end_elt; next_elt++) {
-	if ((checksum == next_elt->key_checksum) &&
-            !strcasecmp(next_elt->key, key)) {
-
-            /* Found an existing entry with the same key, so merge with it */
-	    next_elt->val = apr_pstrcat(t->a.pool, next_elt->val, ", ",
-                                        val, NULL);
-            return;
-        }
-    }
-
-add_new_elt:
-    t->index_last[hash] = t->a.nelts;
-    next_elt = (apr_table_entry_t *) table_push(t);
-    next_elt->key = (char *)key;
-    next_elt->val = (char *)val;
-    next_elt->key_checksum = checksum;
+    table_merge(t, key, val, 0);
 }
 
-APR_DECLARE(void) apr_table_add(apr_table_t *t, const char *key,
-			       const char *val)
+/* apr_table_add[n][_len](), copying the key and value to the pool of
+ * the table if copy is set (vlen is only used then)
+ */
+static APR_INLINE void table_add(apr_table_t *t, const char *key,
+                                 apr_size_t klen, apr_uint32_t fhash,
+                                 const char *val, apr_size_t vlen, int copy)
 {
     apr_table_entry_t *elts;
     apr_uint32_t checksum;
@@ -802,17 +1119,33 @@ APR_DECLARE(void) apr_table_add(apr_table_t *t, const char *key,
     }
     COMPUTE_KEY_CHECKSUM(key, checksum);
     elts = (apr_table_entry_t *) table_push(t);
-    elts->key = apr_pstrdup(t->a.pool, key);
-    elts->val = apr_pstrdup(t->a.pool, val);
+    if (copy) {
+        elts->key = apr_pstrmemdup(t->a.pool, key, klen);
+        elts->val = apr_pstrmemdup(t->a.pool, val, vlen);
+    }
+    else {
+        elts->key = (char *)key;
+        elts->val = (char *)val;
+    }
     elts->key_checksum = checksum;
+    elts->key_hash = fhash;
+    table_index_add(t);
+}
+
+APR_DECLARE(void) apr_table_add(apr_table_t *t, const char *key,
+			       const char *val)
+{
+    apr_size_t klen;
+    apr_uint32_t fhash = table_key_hash(key, &klen);
+
+    table_add(t, key, klen, fhash, val, strlen(val), 1);
 }
 
 APR_DECLARE(void) apr_table_addn(apr_table_t *t, const char *key,
 				const char *val)
 {
-    apr_table_entry_t *elts;
-    apr_uint32_t checksum;
-    int hash;
+    apr_size_t klen;
+    apr_uint32_t fhash;
 
 #if APR_POOL_DEBUG
     {
@@ -827,17 +1160,28 @@ APR_DECLARE(void) apr_table_addn(apr_table_t *t, const char *key,
     }
 #endif
 
-    hash = TABLE_HASH(key);
-    t->index_last[hash] = t->a.nelts;
-    if (!TABLE_INDEX_IS_INITIALIZED(t, hash)) {
-        t->index_first[hash] = t->a.nelts;
-        TABLE_SET_INDEX_INITIALIZED(t, hash);
+    fhash = table_key_hash(key, &klen);
+    table_add(t, key, klen, fhash, val, 0, 0);
+}
+
+APR_DECLARE(void) apr_table_addn_len(apr_table_t *t,
+                                     const char *key, apr_size_t klen,
+                                     const char *val, apr_size_t vlen)
+{
+#if APR_POOL_DEBUG
+    {
+	if (!apr_pool_is_ancestor(apr_pool_find(key), t->a.pool)) {
+	    fprintf(stderr, "apr_table_addn_len: key not in ancestor pool of t\n");
+	    abort();
+	}
+	if (!apr_pool_is_ancestor(apr_pool_find(val), t->a.pool)) {
+	    fprintf(stderr, "apr_table_addn_len: val not in ancestor pool of t\n");
+	    abort();
+	}
     }
-    COMPUTE_KEY_CHECKSUM(key, checksum);
-    elts = (apr_table_entry_t *) table_push(t);
-    elts->key = (char *)key;
-    elts->val = (char *)val;
-    elts->key_checksum = checksum;
+#endif
+
+    table_add(t, key, klen, table_key_hash_len(key, klen), val, vlen, 0);
 }
 
 APR_DECLARE(apr_table_t *) apr_table_overlay(apr_pool_t *p,
@@ -868,6 +1212,7 @@ APR_DECLARE(apr_table_t *) apr_table_overlay(apr_pool_t *p,
     res->a.pool = p;
     copy_array_hdr_core(&res->a, &overlay->a);
     apr_array_cat(&res->a, &base->a);
+    res->findex = NULL;
     table_reindex(res);
     return res;
 }
@@ -971,13 +1316,16 @@ APR_DECLARE(int) apr_table_vdo(apr_table_do_callback_fn_t *comp,
         if (argp) {
             /* Scan for entries that match the next key */
             int hash = TABLE_HASH(argp);
-            if (TABLE_INDEX_IS_INITIALIZED(t, hash)) {
-                apr_uint32_t checksum;
-                COMPUTE_KEY_CHECKSUM(argp, checksum);
-                for (i = t->index_first[hash];
-                     rv && (i <= t->index_last[hash]); ++i) {
-                    if (elts[i].key && (checksum == elts[i].key_checksum) &&
-                                        !strcasecmp(elts[i].key, argp)) {
+            int first, last;
+            apr_uint32_t checksum, fhash;
+            apr_size_t klen;
+            COMPUTE_KEY_CHECKSUM(argp, checksum);
+            fhash = table_key_hash(argp, &klen);
+            if (TABLE_INDEX_IS_INITIALIZED(t, hash) &&
+                table_find(t, argp, hash, checksum, fhash, &first, &last)) {
+                for (i = first; rv && (i <= last); ++i) {
+                    if (elts[i].key &&
+                        TABLE_KEY_MATCHES(&elts[i], argp, checksum, fhash)) {
                         rv = (*comp) (rec, elts[i].key, elts[i].val);
                     }
                 }
@@ -999,6 +1347,19 @@ APR_DECLARE(int) apr_table_vdo(apr_table_do_callback_fn_t *comp,
     return vdorv;
 }
 
+/* The order of the entries for apr_table_compress(), which only needs
+ * the ones with the same key to be next to each other: sorting by hash
+ * first spares most of the strcasecmp()s
+ */
+static APR_INLINE int table_entry_cmp(const apr_table_entry_t *a,
+                                      const apr_table_entry_t *b)
+{
+    if (a->key_hash != b->key_hash) {
+        return (a->key_hash < b->key_hash) ? -1 : 1;
+    }
+    return strcasecmp(a->key, b->key);
+}
+
 static apr_table_entry_t **table_mergesort(apr_pool_t *pool,
                                            apr_table_entry_t **values, 
                                            apr_size_t n)
@@ -1013,7 +1374,7 @@ static apr_table_entry_t **table_mergesort(apr_pool_t *pool,
 
     /* First pass: sort pairs of elements (blocksize=1) */
     for (i = 0; i + 1 < n; i += 2) {
-        if (strcasecmp(values[i]->key, values[i + 1]->key) > 0) {
+        if (table_entry_cmp(values[i], values[i + 1]) > 0) {
             apr_table_entry_t *swap = values[i];
             values[i] = values[i + 1];
             values[i + 1] = swap;
@@ -1063,8 +1424,8 @@ static apr_table_entry_t **table_mergesort(apr_pool_t *pool,
                     }
                     break;
                 }
-                if (strcasecmp(values[block1_start]->key,
-                               values[block2_start]->key) > 0) {
+                if (table_entry_cmp(values[block1_start],
+                                    values[block2_start]) > 0) {
                     *dst++ = values[block2_start++];
                 }
                 else {
@@ -1117,6 +1478,12 @@ APR_DECLARE(void) apr_table_compress(apr_table_t *t, unsigned flags)
     table_next = (apr_table_entry_t *)t->a.elts;
     i = t->a.nelts;
     do {
+        apr_size_t klen;
+
+        /* The sort relies on the hashes, so refresh them in case keys
+         * were changed outside of the table functions
+         */
+        table_next->key_hash = table_key_hash(table_next->key, &klen);
         *sort_next++ = table_next++;
     } while (--i);
 
@@ -1133,13 +1500,14 @@ APR_DECLARE(void) apr_table_compress(apr_table_t *t, unsigned flags)
     sort_end = sort_array + t->a.nelts;
     last = sort_next++;
     while (sort_next < sort_end) {
-        if (((*sort_next)->key_checksum == (*last)->key_checksum) &&
-            !strcasecmp((*sort_next)->key, (*last)->key)) {
+        if (TABLE_KEY_MATCHES(*sort_next, (*last)->key,
+                              (*last)->key_checksum, (*last)->key_hash)) {
             apr_table_entry_t **dup_last = sort_next + 1;
             dups_found = 1;
             while ((dup_last < sort_end) &&
-                   ((*dup_last)->key_checksum == (*last)->key_checksum) &&
-                   !strcasecmp((*dup_last)->key, (*last)->key)) {
+                   TABLE_KEY_MATCHES(*dup_last, (*last)->key,
+                                     (*last)->key_checksum,
+                                     (*last)->key_hash)) {
                 dup_last++;
             }
             dup_last--; /* Elements from last through dup_last, inclusive,
@@ -1207,6 +1575,10 @@ static void apr_table_cat(apr_table_t *t, const apr_table_t *s)
 
     apr_array_cat(&t->a,&s->a);
 
+    if (t->findex || t->a.nelts > TABLE_FULL_INDEX_MIN) {
+        table_index_build(t);
+    }
+
     if (n == 0) {
         memcpy(t->index_first,s->index_first,sizeof(int) * TABLE_HASH_SIZE);
         memcpy(t->index_last, s->index_last, sizeof(int) * TABLE_HASH_SIZE);
@@ -1247,50 +1619,73 @@ APR_DECLARE(void) apr_table_overlap(apr_table_t *a, const apr_table_t *b,
     apr_table_compress(a, flags);
 }
 
-static int table_getm_do(void *v, const char *key, const char *val)
-{
-    table_getm_t *state = (table_getm_t *) v;
-
-    if (!state->first) {
-        /**
-         * The most common case is a single header, and this is covered by
-         * a fast path that doesn't allocate any memory. On the second and
-         * subsequent header, an array is created and the array concatenated
-         * together to form the final value.
-         */
-        state->first = val;
-    }
-    else {
-        const char **elt;
-        if (!state->merged) {
-            state->merged = apr_array_make(state->p, 10, sizeof(const char *));
-            elt = apr_array_push(state->merged);
-            *elt = state->first;
-        }
-        elt = apr_array_push(state->merged);
-        *elt = val;
-    }
-    return 1;
-}
-
 APR_DECLARE(const char *) apr_table_getm(apr_pool_t *p, const apr_table_t *t,
         const char *key)
 {
-    table_getm_t state;
+    const apr_table_entry_t *elts = (const apr_table_entry_t *) t->a.elts;
+    const char *first_val = NULL;
+    char *merged, *dst;
+    apr_uint32_t checksum, fhash;
+    apr_size_t klen, len = 0;
+    int hash, first, last, i, n = 0;
 
-    state.p = p;
-    state.first = NULL;
-    state.merged = NULL;
-
-    apr_table_do(table_getm_do, &state, t, key, NULL);
+    if (key == NULL) {
+        return NULL;
+    }
 
-    if (!state.first) {
+    hash = TABLE_HASH(key);
+    if (!TABLE_INDEX_IS_INITIALIZED(t, hash)) {
         return NULL;
     }
-    else if (!state.merged) {
-        return state.first;
+    COMPUTE_KEY_CHECKSUM(key, checksum);
+    fhash = table_key_hash(key, &klen);
+    if (!table_find(t, key, hash, checksum, fhash, &first, &last)) {
+        return NULL;
     }
-    else {
-        return apr_array_pstrcat(p, state.merged, ',');
+
+    /* As apr_table_do() did, the NULL values are skipped until the first
+     * value, and are empty afterwards.
+     */
+    for (i = first; i <= last; i++) {
+        if (elts[i].key && TABLE_KEY_MATCHES(&elts[i], key, checksum, fhash)) {
+            if (!n) {
+                if (!elts[i].val) {
+                    continue;
+                }
+                first = i;
+                first_val = elts[i].val;
+            }
+            n++;
+            len += 1; /* for ',' or trailing null */
+            if (elts[i].val) {
+                len += strlen(elts[i].val);
+            }
+        }
+    }
+
+    /**
+     * The most common case is a single header, and this is covered by
+     * a fast path that doesn't allocate any memory. Otherwise the values
+     * are concatenated, separated by commas, to form the final value.
+     */
+    if (n <= 1) {
+        return first_val;
     }
+
+    merged = dst = apr_palloc(p, len);
+    for (n = 0, i = first; i <= last; i++) {
+        if (elts[i].key && TABLE_KEY_MATCHES(&elts[i], key, checksum, fhash)) {
+            if (n++) {
+                *dst++ = ',';
+            }
+            if (elts[i].val) {
+                len = strlen(elts[i].val);
+                memcpy(dst, elts[i].val, len);
+                dst += len;
+            }
+        }
+    }
+    *dst = '\0';
+
+    return merged;
 }
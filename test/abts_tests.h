@@ -88,7 +88,10 @@ const struct testlist {
     {testqueue},
     {testreslist},
     {testlfsabi},
-    {testskiplist}
+    {testskiplist},
+    {testthreadpool},
+    {testflathash},
+    {testradix}
 };
 
 #endif /* APR_TEST_INCLUDES */
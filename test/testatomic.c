@@ -230,6 +230,99 @@ static void test_inc_neg1(abts_case *tc, void *data)
     ABTS_ASSERT(tc, str, y32 == 0);
 }
 
+static void test_set_read64(abts_case *tc, void *data)
+{
+    apr_uint64_t y64;
+    apr_atomic_set64(&y64, APR_UINT64_C(0x100000002));
+    ABTS_ASSERT(tc, "atomic_set64 failed", y64 == APR_UINT64_C(0x100000002));
+    ABTS_ASSERT(tc, "atomic_read64 failed",
+                apr_atomic_read64(&y64) == APR_UINT64_C(0x100000002));
+}
+
+static void test_dec64(abts_case *tc, void *data)
+{
+    apr_uint64_t y64;
+    int rv;
+
+    apr_atomic_set64(&y64, APR_UINT64_C(0x100000000));
+
+    rv = apr_atomic_dec64(&y64);
+    ABTS_ASSERT(tc, "atomic_dec64 failed", y64 == APR_UINT64_C(0xffffffff));
+    ABTS_ASSERT(tc, "atomic_dec64 returned zero when it shouldn't", rv != 0);
+
+    apr_atomic_set64(&y64, 1);
+    rv = apr_atomic_dec64(&y64);
+    ABTS_ASSERT(tc, "atomic_dec64 failed", y64 == 0);
+    ABTS_ASSERT(tc, "atomic_dec64 didn't returned zero when it should", rv == 0);
+}
+
+static void test_xchg64(abts_case *tc, void *data)
+{
+    apr_uint64_t oldval;
+    apr_uint64_t y64;
+
+    apr_atomic_set64(&y64, 100);
+    oldval = apr_atomic_xchg64(&y64, APR_UINT64_C(0x5000000000));
+
+    ABTS_ASSERT(tc, "xchg64 didn't return the old value", oldval == 100);
+    ABTS_ASSERT(tc, "xchg64 failed", y64 == APR_UINT64_C(0x5000000000));
+}
+
+static void test_cas64(abts_case *tc, void *data)
+{
+    apr_uint64_t casval = APR_UINT64_C(0x1200000000);
+    apr_uint64_t oldval;
+
+    oldval = apr_atomic_cas64(&casval, 23, 12);
+    ABTS_ASSERT(tc, "cas64 swapped a different value",
+                oldval == APR_UINT64_C(0x1200000000)
+                && casval == APR_UINT64_C(0x1200000000));
+
+    oldval = apr_atomic_cas64(&casval, 23, APR_UINT64_C(0x1200000000));
+    ABTS_ASSERT(tc, "cas64 didn't swap the same value",
+                oldval == APR_UINT64_C(0x1200000000) && casval == 23);
+}
+
+static void test_add_inc_sub64(abts_case *tc, void *data)
+{
+    apr_uint64_t y64;
+    apr_uint64_t oldval;
+
+    /* carry into the upper half */
+    apr_atomic_set64(&y64, APR_UINT64_C(0xfffffffe));
+    oldval = apr_atomic_add64(&y64, 1);
+    ABTS_ASSERT(tc, "add64 didn't return the old value",
+                oldval == APR_UINT64_C(0xfffffffe));
+    oldval = apr_atomic_inc64(&y64);
+    ABTS_ASSERT(tc, "inc64 didn't return the old value",
+                oldval == APR_UINT64_C(0xffffffff));
+    ABTS_ASSERT(tc, "inc64 didn't carry", y64 == APR_UINT64_C(0x100000000));
+
+    apr_atomic_sub64(&y64, 2);
+    ABTS_ASSERT(tc, "sub64 didn't borrow", y64 == APR_UINT64_C(0xfffffffe));
+
+    apr_atomic_add64(&y64, (apr_uint64_t)-1);
+    ABTS_ASSERT(tc, "add64 of -1 failed", y64 == APR_UINT64_C(0xfffffffd));
+}
+
+static void test_ordered(abts_case *tc, void *data)
+{
+    apr_uint32_t y32;
+    apr_uint64_t y64;
+
+    apr_atomic_set32_release(&y32, 2);
+    ABTS_INT_EQUAL(tc, 2, apr_atomic_read32_acquire(&y32));
+    ABTS_INT_EQUAL(tc, 2, apr_atomic_add32_relaxed(&y32, 3));
+    ABTS_INT_EQUAL(tc, 5, apr_atomic_read32_acquire(&y32));
+
+    apr_atomic_set64_release(&y64, APR_UINT64_C(0x200000000));
+    ABTS_ASSERT(tc, "read64_acquire failed",
+                apr_atomic_read64_acquire(&y64) == APR_UINT64_C(0x200000000));
+    ABTS_ASSERT(tc, "add64_relaxed didn't return the old value",
+                apr_atomic_add64_relaxed(&y64, 3) == APR_UINT64_C(0x200000000));
+    ABTS_ASSERT(tc, "add64_relaxed failed",
+                apr_atomic_read64_acquire(&y64) == APR_UINT64_C(0x200000003));
+}
 
 #if APR_HAS_THREADS
 
@@ -309,6 +402,103 @@ static void test_atomics_threaded(abts_case *tc, void *data)
     ABTS_ASSERT(tc, "Failed creating threads", rv == APR_SUCCESS);
 }
 
+/* start close to 2^32 for the carry to happen concurrently */
+#define ATOMIC64_BASE APR_UINT64_C(0xfffff000)
+
+static volatile apr_uint64_t atomic64_ops;
+
+static void *APR_THREAD_FUNC thread_func_atomic64(apr_thread_t *thd,
+                                                  void *data)
+{
+    int i;
+
+    for (i = 0; i < NUM_ITERATIONS ; i++) {
+        apr_atomic_inc64(&atomic64_ops);
+        apr_atomic_add64(&atomic64_ops, 2);
+        apr_atomic_dec64(&atomic64_ops);
+        apr_atomic_dec64(&atomic64_ops);
+        apr_atomic_add64_relaxed(&atomic64_ops, 1);
+        apr_atomic_sub64(&atomic64_ops, 1);
+    }
+    apr_thread_exit(thd, exit_ret_val);
+    return NULL;
+}
+
+static void test_atomics64_threaded(abts_case *tc, void *data)
+{
+    apr_thread_t *t[NUM_THREADS];
+    apr_status_t rv;
+    int i;
+
+    apr_atomic_set64(&atomic64_ops, ATOMIC64_BASE);
+
+    for (i = 0; i < NUM_THREADS; i++) {
+        rv = apr_thread_create(&t[i], NULL, thread_func_atomic64, NULL, p);
+        ABTS_ASSERT(tc, "Failed creating threads", rv == APR_SUCCESS);
+    }
+
+    for (i = 0; i < NUM_THREADS; i++) {
+        apr_status_t s;
+        apr_thread_join(&s, t[i]);
+
+        ABTS_ASSERT(tc, "Invalid return value from thread_join",
+                    s == exit_ret_val);
+    }
+
+    ABTS_ASSERT(tc, "Concurrent 64-bit operations lost updates",
+                apr_atomic_read64(&atomic64_ops)
+                == ATOMIC64_BASE + NUM_THREADS * NUM_ITERATIONS);
+}
+
+#define NUM_MESSAGES 10000
+
+static volatile apr_uint32_t message_seq;
+static volatile apr_uint64_t message_payload;
+
+static void *APR_THREAD_FUNC thread_func_release(apr_thread_t *thd,
+                                                 void *data)
+{
+    apr_uint32_t i;
+
+    for (i = 1; i <= NUM_MESSAGES; i++) {
+        /* wait for the reader to consume the previous message */
+        while (apr_atomic_read32_acquire(&message_seq) != 2 * i - 2) {
+            apr_thread_yield();
+        }
+        message_payload = (apr_uint64_t)i << 32 | i;
+        apr_atomic_set32_release(&message_seq, 2 * i - 1);
+    }
+    apr_thread_exit(thd, exit_ret_val);
+    return NULL;
+}
+
+static void test_acquire_release(abts_case *tc, void *data)
+{
+    apr_thread_t *t;
+    apr_status_t rv, s;
+    apr_uint32_t i;
+    int torn = 0;
+
+    apr_atomic_set32(&message_seq, 0);
+    rv = apr_thread_create(&t, NULL, thread_func_release, NULL, p);
+    ABTS_ASSERT(tc, "Failed creating thread", rv == APR_SUCCESS);
+
+    for (i = 1; i <= NUM_MESSAGES; i++) {
+        while (apr_atomic_read32_acquire(&message_seq) != 2 * i - 1) {
+            apr_thread_yield();
+        }
+        if (message_payload != ((apr_uint64_t)i << 32 | i)) {
+            torn++;
+        }
+        apr_atomic_set32_release(&message_seq, 2 * i);
+    }
+
+    apr_thread_join(&s, t);
+    ABTS_ASSERT(tc, "Invalid return value from thread_join",
+                s == exit_ret_val);
+    ABTS_INT_EQUAL(tc, 0, torn);
+}
+
 #undef NUM_THREADS
 #define NUM_THREADS 7
 
@@ -525,9 +715,17 @@ abts_suite *testatomic(abts_suite *suite)
     abts_run_test(suite, test_set_add_inc_sub, NULL);
     abts_run_test(suite, test_wrap_zero, NULL);
     abts_run_test(suite, test_inc_neg1, NULL);
+    abts_run_test(suite, test_set_read64, NULL);
+    abts_run_test(suite, test_dec64, NULL);
+    abts_run_test(suite, test_xchg64, NULL);
+    abts_run_test(suite, test_cas64, NULL);
+    abts_run_test(suite, test_add_inc_sub64, NULL);
+    abts_run_test(suite, test_ordered, NULL);
 
 #if APR_HAS_THREADS
     abts_run_test(suite, test_atomics_threaded, NULL);
+    abts_run_test(suite, test_atomics64_threaded, NULL);
+    abts_run_test(suite, test_acquire_release, NULL);
     abts_run_test(suite, test_atomics_busyloop_threaded, NULL);
 #endif
 
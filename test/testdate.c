@@ -191,12 +191,53 @@ static void test_date_rfc(abts_case *tc, void *data)
     }
 }
 
+static void test_date_parse_http_cache(abts_case *tc, void *data)
+{
+    static const char *const dates[] = {
+        "Sun, 06 Nov 1994 08:49:37 GMT",
+        "Sunday, 06-Nov-94 08:49:37 GMT",
+        "Wednesday, 09-Nov-94 08:49:37 GMT",
+        "Sun Nov  6 08:49:37 1994",
+        "Sun, 6 Nov 1994 08:49:37 GMT",
+        "Sun, 06 Nov 1994 08:49:38 GMT",
+        "Sun, 06 Nov 1994 08:49:37",
+        "Sun, 31 Nov 1994 08:49:37 GMT",
+        "06 Nov 1994 08:49:37 GMT",
+        "",
+        "Sat, 08 Jan 2000 18:31:41 GMT and a long trailer"
+    };
+    const int n = sizeof(dates) / sizeof(dates[0]);
+    apr_time_t first[sizeof(dates) / sizeof(dates[0])];
+    int i, j;
+
+    for (i = 0; i < n; i++) {
+        first[i] = apr_date_parse_http(dates[i]);
+    }
+    ABTS_TRUE(tc, first[0] == APR_INT64_C(784111777) * APR_USEC_PER_SEC);
+    ABTS_TRUE(tc, first[1] == first[0]);
+    ABTS_TRUE(tc, first[3] == first[0]);
+    ABTS_TRUE(tc, first[4] == first[0]);
+    ABTS_TRUE(tc, first[5] == first[0] + APR_USEC_PER_SEC);
+    ABTS_TRUE(tc, first[7] == APR_DATE_BAD);
+    ABTS_TRUE(tc, first[8] == APR_DATE_BAD);
+    ABTS_TRUE(tc, first[9] == APR_DATE_BAD);
+
+    /* Again, from the cache or not, in another order */
+    for (j = 0; j < 10; j++) {
+        for (i = n; i-- > 0;) {
+            ABTS_TRUE(tc, apr_date_parse_http(dates[i]) == first[i]);
+        }
+    }
+    ABTS_TRUE(tc, apr_date_parse_http(NULL) == APR_DATE_BAD);
+}
+
 abts_suite *testdate(abts_suite *suite)
 {
     suite = ADD_SUITE(suite);
 
     abts_run_test(suite, test_date_parse_http, NULL);
     abts_run_test(suite, test_date_rfc, NULL);
+    abts_run_test(suite, test_date_parse_http_cache, NULL);
 
     return suite;
 }
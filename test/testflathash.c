@@ -0,0 +1,210 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "testutil.h"
+#include "apr.h"
+#include "apr_strings.h"
+#include "apr_general.h"
+#include "apr_pools.h"
+#include "apr_hash.h"
+#include "apr_flathash.h"
+
+#define NUM_KEYS 100000
+
+static void set_get(abts_case *tc, void *data)
+{
+    apr_flathash_t *h;
+
+    h = apr_flathash_make(p);
+    ABTS_PTR_NOTNULL(tc, h);
+    ABTS_PTR_EQUAL(tc, p, apr_flathash_pool_get(h));
+
+    apr_flathash_set(h, "key", APR_HASH_KEY_STRING, "value");
+    ABTS_STR_EQUAL(tc, "value",
+                   apr_flathash_get(h, "key", APR_HASH_KEY_STRING));
+    ABTS_PTR_EQUAL(tc, NULL, apr_flathash_get(h, "ke", 2));
+
+    /* overwrite, then delete */
+    apr_flathash_set(h, "key", 3, "other");
+    ABTS_STR_EQUAL(tc, "other", apr_flathash_get(h, "key", 3));
+    ABTS_INT_EQUAL(tc, 1, apr_flathash_count(h));
+    apr_flathash_set(h, "key", APR_HASH_KEY_STRING, NULL);
+    ABTS_PTR_EQUAL(tc, NULL, apr_flathash_get(h, "key", APR_HASH_KEY_STRING));
+    ABTS_INT_EQUAL(tc, 0, apr_flathash_count(h));
+
+    /* deleting a missing key is a noop */
+    apr_flathash_set(h, "key", APR_HASH_KEY_STRING, NULL);
+    ABTS_INT_EQUAL(tc, 0, apr_flathash_count(h));
+}
+
+static void grow_and_delete(abts_case *tc, void *data)
+{
+    apr_flathash_t *h;
+    char **keys;
+    int i, found;
+
+    h = apr_flathash_make(p);
+    keys = apr_palloc(p, NUM_KEYS * sizeof(char *));
+    for (i = 0; i < NUM_KEYS; i++) {
+        keys[i] = apr_psprintf(p, "key%d", i);
+        apr_flathash_set(h, keys[i], APR_HASH_KEY_STRING, keys[i]);
+    }
+    ABTS_INT_EQUAL(tc, NUM_KEYS, apr_flathash_count(h));
+
+    for (found = 0, i = 0; i < NUM_KEYS; i++) {
+        found += apr_flathash_get(h, keys[i], APR_HASH_KEY_STRING) == keys[i];
+    }
+    ABTS_INT_EQUAL(tc, NUM_KEYS, found);
+
+    /* delete the odd keys */
+    for (i = 1; i < NUM_KEYS; i += 2) {
+        apr_flathash_set(h, keys[i], APR_HASH_KEY_STRING, NULL);
+    }
+    ABTS_INT_EQUAL(tc, NUM_KEYS / 2, apr_flathash_count(h));
+    for (found = 0, i = 0; i < NUM_KEYS; i++) {
+        void *val = apr_flathash_get(h, keys[i], APR_HASH_KEY_STRING);
+        found += (i % 2) ? val == NULL : val == keys[i];
+    }
+    ABTS_INT_EQUAL(tc, NUM_KEYS, found);
+}
+
+static void churn(abts_case *tc, void *data)
+{
+    apr_flathash_t *h;
+    int i, round;
+
+    /* the deleted slots must not fill the table */
+    h = apr_flathash_make_ex(p, NULL, sizeof(int), 0);
+    for (round = 0; round < 100; round++) {
+        for (i = 0; i < 100; i++) {
+            int key = round * 100 + i;
+            apr_flathash_set(h, &key, 0, "x");
+        }
+        for (i = 0; i < 100; i++) {
+            int key = round * 100 + i;
+            apr_flathash_set(h, &key, 0, NULL);
+        }
+    }
+    ABTS_INT_EQUAL(tc, 0, apr_flathash_count(h));
+    ABTS_PTR_EQUAL(tc, NULL, apr_flathash_first(NULL, h));
+}
+
+static void inline_keys(abts_case *tc, void *data)
+{
+    apr_flathash_t *h, *h2;
+    apr_flathash_index_t *hi;
+    int i, key, sum;
+
+    h = apr_flathash_make_ex(p, NULL, sizeof(int), 10);
+    for (i = 0; i < 1000; i++) {
+        /* the key is copied, the local variable can change */
+        key = i;
+        apr_flathash_set(h, &key, 0, (void *)(apr_uintptr_t)(i + 1));
+    }
+    key = 500;
+    ABTS_INT_EQUAL(tc, 501,
+                   (int)(apr_uintptr_t)apr_flathash_get(h, &key, 0));
+
+    h2 = apr_flathash_copy(p, h);
+    for (sum = 0, hi = apr_flathash_first(p, h2); hi;
+         hi = apr_flathash_next(hi)) {
+        const int *k = apr_flathash_this_key(hi);
+
+        ABTS_INT_EQUAL(tc, sizeof(int), apr_flathash_this_key_len(hi));
+        ABTS_INT_EQUAL(tc, *k + 1,
+                       (int)(apr_uintptr_t)apr_flathash_this_val(hi));
+        sum += *k;
+    }
+    ABTS_INT_EQUAL(tc, 999 * 1000 / 2, sum);
+
+    apr_flathash_clear(h);
+    ABTS_INT_EQUAL(tc, 0, apr_flathash_count(h));
+    ABTS_PTR_EQUAL(tc, NULL, apr_flathash_get(h, &key, 0));
+    ABTS_INT_EQUAL(tc, 1000, apr_flathash_count(h2));
+}
+
+static unsigned int bad_hash(const char *key, apr_ssize_t *klen)
+{
+    if (*klen == APR_HASH_KEY_STRING)
+        *klen = strlen(key);
+    return 42;
+}
+
+static int count_cb(void *rec, const void *key, apr_ssize_t klen,
+                    const void *val)
+{
+    (*(int *)rec)++;
+    return 1;
+}
+
+static void collisions(abts_case *tc, void *data)
+{
+    apr_flathash_t *h;
+    const char *keys[200];
+    int i, found, count = 0;
+
+    h = apr_flathash_make_custom(p, bad_hash);
+    for (i = 0; i < 200; i++) {
+        keys[i] = apr_itoa(p, i);
+        apr_flathash_set(h, keys[i], APR_HASH_KEY_STRING, keys[i]);
+    }
+    for (i = 0; i < 200; i += 3) {
+        apr_flathash_set(h, keys[i], APR_HASH_KEY_STRING, NULL);
+    }
+    for (found = 0, i = 0; i < 200; i++) {
+        void *val = apr_flathash_get(h, keys[i], APR_HASH_KEY_STRING);
+        found += (i % 3) ? val == keys[i] : val == NULL;
+    }
+    ABTS_INT_EQUAL(tc, 200, found);
+
+    ABTS_TRUE(tc, apr_flathash_do(count_cb, &count, h));
+    ABTS_INT_EQUAL(tc, apr_flathash_count(h), count);
+}
+
+static void delete_iterating(abts_case *tc, void *data)
+{
+    apr_flathash_t *h;
+    apr_flathash_index_t *hi;
+    int i, seen = 0;
+
+    h = apr_flathash_make(p);
+    apr_flathash_reserve(h, 500);
+    for (i = 0; i < 500; i++) {
+        const char *key = apr_itoa(p, i);
+        apr_flathash_set(h, key, APR_HASH_KEY_STRING, key);
+    }
+    for (hi = apr_flathash_first(NULL, h); hi; hi = apr_flathash_next(hi)) {
+        apr_flathash_set(h, apr_flathash_this_key(hi),
+                         apr_flathash_this_key_len(hi), NULL);
+        seen++;
+    }
+    ABTS_INT_EQUAL(tc, 500, seen);
+    ABTS_INT_EQUAL(tc, 0, apr_flathash_count(h));
+}
+
+abts_suite *testflathash(abts_suite *suite)
+{
+    suite = ADD_SUITE(suite)
+
+    abts_run_test(suite, set_get, NULL);
+    abts_run_test(suite, grow_and_delete, NULL);
+    abts_run_test(suite, churn, NULL);
+    abts_run_test(suite, inline_keys, NULL);
+    abts_run_test(suite, collisions, NULL);
+    abts_run_test(suite, delete_iterating, NULL);
+
+    return suite;
+}
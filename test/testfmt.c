@@ -18,6 +18,13 @@
 #include "apr.h"
 #include "apr_portable.h"
 #include "apr_strings.h"
+#include "apr_lib.h"
+#if APR_HAVE_STDIO_H
+#include <stdio.h>
+#endif
+#if APR_HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
 
 static void ssize_t_fmt(abts_case *tc, void *data)
 {
@@ -146,6 +153,147 @@ static void error_fmt(abts_case *tc, void *data)
     ABTS_STR_EQUAL(tc, sbuf, s);
 }
 
+static void int_conversions(abts_case *tc, void *data)
+{
+    char buf[200], expected[200];
+    int i;
+
+    /* All the lengths of digits, around the pairs */
+    srand(42);
+    for (i = 0; i < 10000; i++) {
+        int shift = i % 64;
+        apr_uint64_t u = (((apr_uint64_t)rand() << 32) ^ rand()) >> shift;
+        apr_int64_t d = (i & 1) ? -(apr_int64_t)(u >> 1) : (apr_int64_t)u;
+        int n = (int)(unsigned int)u;
+
+        apr_snprintf(buf, sizeof buf, "%d %u %x %X %o|%" APR_INT64_T_FMT
+                     " %" APR_UINT64_T_FMT " %" APR_UINT64_T_HEX_FMT,
+                     n, (unsigned int)n, (unsigned int)n, (unsigned int)n,
+                     (unsigned int)n, d, u, u);
+        sprintf(expected, "%d %u %x %X %o|%" APR_INT64_T_FMT
+                " %" APR_UINT64_T_FMT " %" APR_UINT64_T_HEX_FMT,
+                n, (unsigned int)n, (unsigned int)n, (unsigned int)n,
+                (unsigned int)n, d, u, u);
+        ABTS_STR_EQUAL(tc, expected, buf);
+    }
+
+    apr_snprintf(buf, sizeof buf, "%d %d %" APR_INT64_T_FMT " %"
+                 APR_UINT64_T_FMT, APR_INT32_MIN, APR_INT32_MAX,
+                 APR_INT64_MIN, APR_UINT64_MAX);
+    ABTS_STR_EQUAL(tc, "-2147483648 2147483647 -9223372036854775808 "
+                   "18446744073709551615", buf);
+}
+
+static void compiled_fmt(abts_case *tc, void *data)
+{
+    const apr_format_t *format;
+    char buf[200], expected[200];
+    apr_status_t rv = APR_ENOTIMPL;
+    int n = 0;
+
+    format = apr_format_compile(p, "%s - %-5s [%05d|%+d|% d] \"%.3s\" "
+                                "%#x %#o %c %% %*d|%-*d|%.*s %pm%n end");
+    apr_snprintf(expected, sizeof expected, "%s - %-5s [%05d|%+d|% d] "
+                 "\"%.3s\" %#x %#o %c %% %*d|%-*d|%.*s %pm end",
+                 "host", "ab", -42, 7, 7, "abcdef", 255, 8, 'z', 4, 1, -4,
+                 2, 2, "xyz", &rv);
+    apr_format_snprintf(buf, sizeof buf, format,
+                        "host", "ab", -42, 7, 7, "abcdef", 255, 8, 'z',
+                        4, 1, -4, 2, 2, "xyz", &rv, &n);
+    ABTS_STR_EQUAL(tc, expected, buf);
+    ABTS_INT_EQUAL(tc, (int)strlen(buf) - 4, n);
+
+    format = apr_format_compile(p, "%" APR_OFF_T_FMT ":%" APR_SIZE_T_FMT
+                                ":%" APR_INT64_T_FMT ":%hd:%5.1f:%g");
+    apr_format_snprintf(buf, sizeof buf, format, (apr_off_t)-1234567,
+                        (apr_size_t)89, APR_INT64_C(-9876543210),
+                        (short)-3, 2.5, 1.5);
+    ABTS_STR_EQUAL(tc, "-1234567:89:-9876543210:-3:  2.5:1.5", buf);
+
+    /* No conversion, unknown ones, and a trailing % */
+    format = apr_format_compile(p, "just text");
+    apr_format_snprintf(buf, sizeof buf, format);
+    ABTS_STR_EQUAL(tc, "just text", buf);
+    format = apr_format_compile(p, "%w %pz%");
+    apr_format_snprintf(buf, sizeof buf, format, NULL);
+    ABTS_STR_EQUAL(tc, "%w bogus %p", buf);
+    format = apr_format_compile(p, "");
+    ABTS_INT_EQUAL(tc, 0, apr_format_snprintf(buf, sizeof buf, format));
+    ABTS_STR_EQUAL(tc, "", buf);
+
+    /* Truncated, and counted only */
+    format = apr_format_compile(p, "0123456789 %d");
+    ABTS_INT_EQUAL(tc, 5, apr_format_snprintf(buf, 6, format, 42));
+    ABTS_STR_EQUAL(tc, "01234", buf);
+    ABTS_INT_EQUAL(tc, 13, apr_format_snprintf(NULL, 0, format, 42));
+}
+
+typedef struct small_buff_t {
+    apr_vformatter_buff_t vbuff;
+    char chunk[3];
+    char out[200];
+    apr_size_t len;
+} small_buff_t;
+
+static int small_flush(apr_vformatter_buff_t *vbuff)
+{
+    small_buff_t *b = (small_buff_t *)vbuff;
+    apr_size_t n = vbuff->curpos - b->chunk;
+
+    memcpy(b->out + b->len, b->chunk, n);
+    b->len += n;
+    vbuff->curpos = b->chunk;
+    return 0;
+}
+
+static int small_apply(small_buff_t *b, const apr_format_t *format, ...)
+{
+    va_list ap;
+    int cc;
+
+    b->len = 0;
+    b->vbuff.curpos = b->chunk;
+    b->vbuff.endpos = b->chunk + sizeof(b->chunk);
+    va_start(ap, format);
+    cc = apr_format_apply(small_flush, &b->vbuff, format, ap);
+    va_end(ap);
+    small_flush(&b->vbuff);
+    b->out[b->len] = '\0';
+    return cc;
+}
+
+static void compiled_fmt_flush(abts_case *tc, void *data)
+{
+    const apr_format_t *format;
+    small_buff_t b;
+
+    /* Literal runs and conversions longer than the buffer */
+    format = apr_format_compile(p, "a long literal run %s, %10d.");
+    ABTS_INT_EQUAL(tc, 44, small_apply(&b, format, "and a string", 12345));
+    ABTS_STR_EQUAL(tc, "a long literal run and a string,      12345.", b.out);
+}
+
+/* A compiled log format gives the same lines as apr_snprintf() */
+static void compiled_fmt_log(abts_case *tc, void *data)
+{
+    const char *fmt = "%s - %s [%s] \"%s %s %s\" %d %" APR_OFF_T_FMT
+                      " %" APR_TIME_T_FMT "\n";
+    const apr_format_t *format = apr_format_compile(p, fmt);
+    char buf[256], buf2[256];
+    int i;
+
+    for (i = 0; i < 1000; i += 7) {
+        apr_snprintf(buf, sizeof buf, fmt, "192.168.0.1", "-",
+                     "10/Oct/2000:13:55:36 -0700", "GET", "/index.html",
+                     "HTTP/1.1", 200, (apr_off_t)2326 + i, (apr_time_t)i);
+        apr_format_snprintf(buf2, sizeof buf2, format, "192.168.0.1", "-",
+                            "10/Oct/2000:13:55:36 -0700", "GET", "/index.html",
+                            "HTTP/1.1", 200, (apr_off_t)2326 + i,
+                            (apr_time_t)i);
+        ABTS_STR_EQUAL(tc, buf, buf2);
+    }
+}
+
 abts_suite *testfmt(abts_suite *suite)
 {
     suite = ADD_SUITE(suite)
@@ -160,6 +308,10 @@ abts_suite *testfmt(abts_suite *suite)
     abts_run_test(suite, uint64_t_hex_fmt, NULL);
     abts_run_test(suite, more_int64_fmts, NULL);
     abts_run_test(suite, error_fmt, NULL);
+    abts_run_test(suite, int_conversions, NULL);
+    abts_run_test(suite, compiled_fmt, NULL);
+    abts_run_test(suite, compiled_fmt_flush, NULL);
+    abts_run_test(suite, compiled_fmt_log, NULL);
 
     return suite;
 }
@@ -20,6 +20,7 @@
 #include "apr_general.h"
 #include "apr_pools.h"
 #include "apr_hash.h"
+#include "apr_time.h"
 
 #define MAX_LTH 256
 #define MAX_DEPTH 11
@@ -511,6 +512,178 @@ static void overlay_fetch(abts_case *tc, void *data)
                        apr_hash_get(overlay, "overlay5", APR_HASH_KEY_STRING));
 }
 
+static const struct {
+    const char *name;
+    apr_hashfunc_t func;
+} hashfuncs[] = {
+    { "default", apr_hashfunc_default },
+    { "siphash", apr_hashfunc_siphash },
+    { "crc32c",  apr_hashfunc_crc32c }
+};
+#define NUM_HASHFUNCS (sizeof(hashfuncs) / sizeof(hashfuncs[0]))
+
+static void hashfunc_keys(abts_case *tc, void *data)
+{
+    char buf[80], *key;
+    apr_size_t f, len, off;
+
+    for (f = 0; f < NUM_HASHFUNCS; f++) {
+        apr_hashfunc_t func = hashfuncs[f].func;
+
+        for (len = 0; len < 64; len++) {
+            apr_ssize_t klen = APR_HASH_KEY_STRING, klen2 = len;
+            unsigned int hash;
+
+            memset(buf, 'x', sizeof(buf));
+            buf[len] = '\0';
+            hash = func(buf, &klen);
+            ABTS_INT_EQUAL(tc, len, klen);
+
+            /* the alignment of the key doesn't matter */
+            for (off = 1; off < 8; off++) {
+                key = memmove(buf + off, buf + off - 1, len);
+                ABTS_INT_EQUAL(tc, hash, func(key, &klen2));
+            }
+
+            /* all of the bytes do */
+            if (len) {
+                key[len - 1] = 'y';
+                ABTS_TRUE(tc, hash != func(key, &klen2));
+            }
+        }
+    }
+}
+
+static void hashfunc_vectors(abts_case *tc, void *data)
+{
+    static const struct {
+        const char *key;
+        unsigned int hash;
+    } vectors[] = {
+        { "", 0 },
+        { "a", 97 },
+        { "abc", 108966 },
+        { "\xff\x80", 8543 },
+        { "/a/fairly/long/url/500", 3249892715U }
+    };
+    apr_size_t i;
+
+    /* The keyed functions have a random secret, only the default one can
+     * be checked against known values.
+     */
+    for (i = 0; i < sizeof(vectors) / sizeof(vectors[0]); i++) {
+        apr_ssize_t klen = APR_HASH_KEY_STRING;
+
+        ABTS_INT_EQUAL(tc, vectors[i].hash,
+                       apr_hashfunc_default(vectors[i].key, &klen));
+        ABTS_INT_EQUAL(tc, strlen(vectors[i].key), klen);
+    }
+}
+
+static void hashfunc_custom(abts_case *tc, void *data)
+{
+    apr_hash_t *h;
+    apr_size_t f;
+    int i;
+
+    for (f = 1; f < NUM_HASHFUNCS; f++) {
+        h = apr_hash_make_custom(p, hashfuncs[f].func);
+        for (i = 0; i < 1000; i++) {
+            const char *key = apr_psprintf(p, "/a/fairly/long/url/%d", i);
+            apr_hash_set(h, key, APR_HASH_KEY_STRING, key);
+        }
+        ABTS_INT_EQUAL(tc, 1000, apr_hash_count(h));
+        ABTS_STR_EQUAL(tc, "/a/fairly/long/url/500",
+                       apr_hash_get(h, "/a/fairly/long/url/500",
+                                    APR_HASH_KEY_STRING));
+        ABTS_PTR_EQUAL(tc, NULL, apr_hash_get(h, "/a/fairly/long/url/",
+                                              APR_HASH_KEY_STRING));
+    }
+}
+
+#define BENCH_BYTES   (1024 * 1024)
+#define BENCH_KEYS    65536
+#define BENCH_BUCKETS 65536
+
+static volatile unsigned int bench_sink;
+
+static void hashfunc_bench(abts_case *tc, void *data)
+{
+    static const apr_size_t lens[] = { 8, 32, 128, 512 };
+    static unsigned int chains[BENCH_BUCKETS];
+    char *keys[BENCH_KEYS], buf[600];
+    apr_size_t f, l, i;
+    apr_pool_t *pool;
+
+    apr_pool_create(&pool, p);
+    memset(buf, '/', sizeof(buf));
+
+    /* Only a glimpse of the throughput, to keep the suite quick */
+    for (f = 0; f < NUM_HASHFUNCS; f++) {
+        apr_hashfunc_t func = hashfuncs[f].func;
+
+        for (l = 0; l < sizeof(lens) / sizeof(lens[0]); l++) {
+            apr_time_t start = apr_time_now(), elapsed;
+            apr_size_t bytes = 0;
+
+            for (i = 0; bytes < BENCH_BYTES; i++) {
+                apr_ssize_t klen = lens[l];
+                buf[i % lens[l]] = (char)i;
+                bench_sink += func(buf, &klen);
+                bytes += lens[l];
+            }
+            elapsed = apr_time_now() - start;
+            abts_log_message("%-8s %3" APR_SIZE_T_FMT "B keys: %4" APR_TIME_T_FMT
+                             " MB/s", hashfuncs[f].name, lens[l],
+                             elapsed ? (apr_time_t)bytes / elapsed : 0);
+        }
+    }
+
+    /* Chain lengths with URL-like and sequential binary keys */
+    for (i = 0; i < BENCH_KEYS; i++) {
+        keys[i] = apr_psprintf(pool, "/route/%" APR_SIZE_T_FMT "/index.html", i);
+    }
+    for (f = 0; f < NUM_HASHFUNCS; f++) {
+        int round;
+
+        for (round = 0; round < 2; round++) {
+            unsigned int hist[5] = { 0 }, max = 0;
+
+            memset(chains, 0, sizeof(chains));
+            for (i = 0; i < BENCH_KEYS; i++) {
+                apr_ssize_t klen = round ? (apr_ssize_t)sizeof(i)
+                                         : APR_HASH_KEY_STRING;
+                const char *key = round ? (const char *)&i : keys[i];
+
+                chains[hashfuncs[f].func(key, &klen) % BENCH_BUCKETS]++;
+            }
+            for (i = 0; i < BENCH_BUCKETS; i++) {
+                hist[chains[i] < 4 ? chains[i] : 4]++;
+                if (chains[i] > max)
+                    max = chains[i];
+            }
+            /* ideally (Poisson) 36.8%, 36.8%, 18.4%, 6.1%, 1.9% */
+            abts_log_message("%-8s %s keys, chains of 0/1/2/3/4+: "
+                             "%.1f%% %.1f%% %.1f%% %.1f%% %.1f%%, max %u",
+                             hashfuncs[f].name, round ? "binary" : "URL",
+                             hist[0] * 100.0 / BENCH_BUCKETS,
+                             hist[1] * 100.0 / BENCH_BUCKETS,
+                             hist[2] * 100.0 / BENCH_BUCKETS,
+                             hist[3] * 100.0 / BENCH_BUCKETS,
+                             hist[4] * 100.0 / BENCH_BUCKETS, max);
+            ABTS_TRUE(tc, max < 32);
+            if (hashfuncs[f].func != apr_hashfunc_default) {
+                /* the keyed ones are as good as random, whatever the keys */
+                ABTS_TRUE(tc, max < 16);
+                ABTS_TRUE(tc, hist[0] > BENCH_BUCKETS * 33 / 100
+                              && hist[0] < BENCH_BUCKETS * 41 / 100);
+            }
+        }
+    }
+
+    apr_pool_destroy(pool);
+}
+
 abts_suite *testhash(abts_suite *suite)
 {
     suite = ADD_SUITE(suite)
@@ -536,6 +709,11 @@ abts_suite *testhash(abts_suite *suite)
     abts_run_test(suite, overlay_same, NULL);
     abts_run_test(suite, overlay_fetch, NULL);
 
+    abts_run_test(suite, hashfunc_keys, NULL);
+    abts_run_test(suite, hashfunc_vectors, NULL);
+    abts_run_test(suite, hashfunc_custom, NULL);
+    abts_run_test(suite, hashfunc_bench, NULL);
+
     return suite;
 }
 
@@ -17,8 +17,12 @@
 
 #include "apr_general.h"
 #include "apr_pools.h"
+#include "apr_allocator.h"
 #include "apr_errno.h"
 #include "apr_file_io.h"
+#include "apr_strings.h"
+#include "apr_thread_mutex.h"
+#include "apr_thread_proc.h"
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -139,6 +143,301 @@ static void test_cleanups(abts_case *tc, void *data)
     }
 }
 
+static void test_stats(abts_case *tc, void *data)
+{
+    apr_allocator_t *allocator;
+    apr_allocator_stats_t astats;
+    apr_pool_stats_t pstats;
+    apr_pool_t *owner, *sub;
+    apr_size_t free_total;
+    apr_status_t rv;
+    int i;
+
+    rv = apr_allocator_create(&allocator);
+    APR_ASSERT_SUCCESS(tc, "create allocator", rv);
+    rv = apr_pool_create_ex(&owner, NULL, NULL, allocator);
+    APR_ASSERT_SUCCESS(tc, "create owner pool", rv);
+    apr_allocator_owner_set(allocator, owner);
+
+    apr_allocator_stats_get(&astats, allocator);
+    ABTS_TRUE(tc, astats.boundary > 0);
+    ABTS_INT_EQUAL(tc, 1, astats.node_mallocs);
+    ABTS_INT_EQUAL(tc, 0, astats.free);
+    ABTS_TRUE(tc, astats.allocated > 0);
+
+    rv = apr_pool_create(&sub, owner);
+    APR_ASSERT_SUCCESS(tc, "create subpool", rv);
+    for (i = 0; i < 64; i++) {
+        apr_palloc(sub, ALLOC_BYTES);
+    }
+
+    apr_pool_stats_get(&pstats, sub, 0);
+    ABTS_INT_EQUAL(tc, 1, pstats.pools);
+    ABTS_TRUE(tc, pstats.nodes > 1);
+    ABTS_TRUE(tc, pstats.slow_allocs > 0);
+    ABTS_TRUE(tc, pstats.used > 64 * ALLOC_BYTES);
+    ABTS_TRUE(tc, pstats.size >= pstats.used);
+
+    apr_pool_stats_get(&pstats, owner, 1);
+    ABTS_INT_EQUAL(tc, 2, pstats.pools);
+
+    apr_pool_destroy(sub);
+
+    apr_allocator_stats_get(&astats, allocator);
+    ABTS_TRUE(tc, astats.free > 0);
+    ABTS_INT_EQUAL(tc, astats.node_allocs - 1, astats.node_frees);
+    for (free_total = 0, i = 0; i < APR_ALLOCATOR_SIZE_CLASSES; i++) {
+        free_total += astats.free_sizes[i];
+    }
+    ABTS_INT_EQUAL(tc, astats.free, free_total);
+
+    /* everything beyond the threshold goes back to the system */
+    apr_allocator_max_free_set(allocator, 1);
+    rv = apr_pool_create(&sub, owner);
+    APR_ASSERT_SUCCESS(tc, "create subpool", rv);
+    for (i = 0; i < 64; i++) {
+        apr_palloc(sub, ALLOC_BYTES);
+    }
+    apr_pool_destroy(sub);
+
+    apr_allocator_stats_get(&astats, allocator);
+    ABTS_TRUE(tc, astats.max_free_hits > 0);
+    ABTS_TRUE(tc, astats.max_free > 0);
+
+    apr_pool_destroy(owner);
+}
+
+static void test_regions(abts_case *tc, void *data)
+{
+    static const apr_uint32_t flags[] = {
+        APR_ALLOCATOR_REGIONS,
+        APR_ALLOCATOR_HUGEPAGES,
+        APR_ALLOCATOR_NUMA_LOCAL | APR_ALLOCATOR_HUGEPAGES
+    };
+    apr_allocator_t *allocator;
+    apr_allocator_stats_t stats;
+    apr_pool_t *owner, *sub;
+    apr_status_t rv;
+    char *mem;
+    int i, j;
+
+    for (i = 0; i < sizeof(flags) / sizeof(flags[0]); i++) {
+        rv = apr_allocator_create_ex(&allocator, flags[i], 64 * 1024);
+        if (rv == APR_ENOTIMPL) {
+            ABTS_NOT_IMPL(tc, "Allocator regions");
+            return;
+        }
+        APR_ASSERT_SUCCESS(tc, "create allocator", rv);
+        rv = apr_pool_create_ex(&owner, NULL, NULL, allocator);
+        APR_ASSERT_SUCCESS(tc, "create owner pool", rv);
+        apr_allocator_owner_set(allocator, owner);
+        apr_allocator_max_free_set(allocator, 1);
+
+        for (j = 0; j < 16; j++) {
+            rv = apr_pool_create(&sub, owner);
+            APR_ASSERT_SUCCESS(tc, "create subpool", rv);
+
+            /* larger than the region */
+            mem = apr_palloc(sub, 256 * 1024);
+            ABTS_PTR_NOTNULL(tc, mem);
+            memset(mem, j, 256 * 1024);
+
+            mem = apr_palloc(sub, j * ALLOC_BYTES);
+            ABTS_PTR_NOTNULL(tc, mem);
+            memset(mem, j, j * ALLOC_BYTES);
+
+            apr_pool_destroy(sub);
+        }
+
+        /* memnodes are never given back to the system */
+        apr_allocator_stats_get(&stats, allocator);
+        ABTS_INT_EQUAL(tc, 0, stats.max_free_hits);
+        ABTS_TRUE(tc, stats.free > 256 * 1024);
+
+        apr_pool_destroy(owner);
+    }
+}
+
+#if APR_HAS_THREADS
+#define CACHE_THREADS 4
+#define CACHE_LOOPS   1000
+
+static void churn_pools(apr_pool_t *parent)
+{
+    apr_pool_t *sub;
+    int i;
+
+    for (i = 0; i < CACHE_LOOPS; i++) {
+        apr_pool_create(&sub, parent);
+        apr_palloc(sub, ALLOC_BYTES);
+        apr_palloc(sub, 3 * ALLOC_BYTES);
+        apr_pool_destroy(sub);
+    }
+}
+
+static void * APR_THREAD_FUNC cache_thread(apr_thread_t *thd, void *data)
+{
+    apr_pool_t *parent;
+
+    /* an unmanaged pool per thread, sharing the allocator */
+    apr_pool_create_unmanaged_ex(&parent, NULL, data);
+    churn_pools(parent);
+    apr_pool_destroy(parent);
+
+    return NULL;
+}
+
+static void test_thread_cache(abts_case *tc, void *data)
+{
+    apr_allocator_t *allocator;
+    apr_allocator_thread_cache_stats_t stats;
+    apr_thread_mutex_t *mutex;
+    apr_thread_t *threads[CACHE_THREADS];
+    apr_pool_t *owner, *sub;
+    apr_status_t rv;
+    int i;
+
+    rv = apr_allocator_create(&allocator);
+    APR_ASSERT_SUCCESS(tc, "create allocator", rv);
+    rv = apr_pool_create_ex(&owner, NULL, NULL, allocator);
+    APR_ASSERT_SUCCESS(tc, "create owner pool", rv);
+    apr_allocator_owner_set(allocator, owner);
+    rv = apr_thread_mutex_create(&mutex, APR_THREAD_MUTEX_DEFAULT, owner);
+    APR_ASSERT_SUCCESS(tc, "create mutex", rv);
+    apr_allocator_mutex_set(allocator, mutex);
+
+    rv = apr_allocator_thread_cache_stats_get(&stats, allocator);
+    ABTS_INT_EQUAL(tc, APR_EINVAL, rv);
+
+    rv = apr_allocator_thread_cache_set(allocator, 4, owner);
+    APR_ASSERT_SUCCESS(tc, "enable thread cache", rv);
+
+    churn_pools(owner);
+
+    rv = apr_allocator_thread_cache_stats_get(&stats, allocator);
+    APR_ASSERT_SUCCESS(tc, "get thread cache stats", rv);
+    ABTS_TRUE(tc, stats.misses > 0);
+    ABTS_TRUE(tc, stats.hits > stats.misses);
+
+    for (i = 0; i < CACHE_THREADS; i++) {
+        rv = apr_thread_create(&threads[i], NULL, cache_thread, allocator, p);
+        APR_ASSERT_SUCCESS(tc, "create thread", rv);
+    }
+    for (i = 0; i < CACHE_THREADS; i++) {
+        apr_status_t retval;
+        apr_thread_join(&retval, threads[i]);
+    }
+
+    rv = apr_allocator_thread_cache_set(allocator, 0, owner);
+    APR_ASSERT_SUCCESS(tc, "disable thread cache", rv);
+    rv = apr_allocator_thread_cache_stats_get(&stats, allocator);
+    ABTS_INT_EQUAL(tc, APR_EINVAL, rv);
+
+    /* the caches go away along with the pool they are bound to */
+    apr_pool_create(&sub, owner);
+    rv = apr_allocator_thread_cache_set(allocator, 8, sub);
+    APR_ASSERT_SUCCESS(tc, "enable thread cache", rv);
+    churn_pools(owner);
+    apr_pool_destroy(sub);
+    rv = apr_allocator_thread_cache_stats_get(&stats, allocator);
+    ABTS_INT_EQUAL(tc, APR_EINVAL, rv);
+
+    apr_pool_destroy(owner);
+}
+#endif /* APR_HAS_THREADS */
+
+static void test_palloc_aligned(abts_case *tc, void *data)
+{
+    apr_pool_t *pool;
+    apr_size_t align;
+    char *prev = NULL;
+
+    APR_ASSERT_SUCCESS(tc, "create pool", apr_pool_create(&pool, p));
+
+    for (align = 1; align <= 4096; align <<= 1) {
+        char *mem = apr_palloc_aligned(pool, 100, align);
+
+        ABTS_PTR_NOTNULL(tc, mem);
+        ABTS_TRUE(tc, ((apr_uintptr_t)mem & (align - 1)) == 0);
+        ABTS_TRUE(tc, mem != prev);
+        memset(mem, 0xa5, 100);
+        prev = mem;
+
+        /* interleave with unaligned allocations */
+        mem = apr_palloc(pool, 3);
+        ABTS_PTR_NOTNULL(tc, mem);
+        memset(mem, 0x5a, 3);
+    }
+
+    /* larger than a memnode */
+    prev = apr_palloc_aligned(pool, 64 * 1024, 256);
+    ABTS_PTR_NOTNULL(tc, prev);
+    ABTS_TRUE(tc, ((apr_uintptr_t)prev & 255) == 0);
+    memset(prev, 0, 64 * 1024);
+
+    ABTS_PTR_EQUAL(tc, NULL, apr_palloc_aligned(pool, 16, 0));
+    ABTS_PTR_EQUAL(tc, NULL, apr_palloc_aligned(pool, 16, 24));
+
+    apr_pool_destroy(pool);
+}
+
+static void test_mark_rollback(abts_case *tc, void *data)
+{
+    apr_allocator_t *allocator;
+    apr_allocator_stats_t astats;
+    apr_pool_stats_t before, after;
+    apr_pool_mark_t outer, inner;
+    apr_pool_t *pool;
+    apr_size_t node_allocs;
+    char *keep, *mem;
+    int i, round;
+
+    APR_ASSERT_SUCCESS(tc, "create allocator", apr_allocator_create(&allocator));
+    APR_ASSERT_SUCCESS(tc, "create pool",
+                       apr_pool_create_ex(&pool, NULL, NULL, allocator));
+    apr_allocator_owner_set(allocator, pool);
+
+    keep = apr_pstrdup(pool, "kept across rollbacks");
+    apr_pool_stats_get(&before, pool, 0);
+
+    for (round = 0; round < 3; round++) {
+        apr_allocator_stats_get(&astats, allocator);
+        node_allocs = astats.node_allocs;
+
+        apr_pool_mark(pool, &outer);
+        for (i = 0; i < 64; i++) {
+            mem = apr_palloc(pool, ALLOC_BYTES);
+            memset(mem, i, ALLOC_BYTES);
+        }
+
+        apr_pool_mark(pool, &inner);
+        mem = apr_palloc(pool, 64 * 1024);
+        memset(mem, 0, 64 * 1024);
+        apr_pool_rollback(pool, &inner);
+
+        for (i = 0; i < 16; i++) {
+            mem = apr_palloc(pool, ALLOC_BYTES);
+            memset(mem, i, ALLOC_BYTES);
+        }
+        apr_pool_rollback(pool, &outer);
+
+        ABTS_STR_EQUAL(tc, "kept across rollbacks", keep);
+        apr_pool_stats_get(&after, pool, 0);
+        /* only the headers of the blocks kept by the pool remain used */
+        ABTS_INT_EQUAL(tc, before.used + (after.nodes - before.nodes)
+                                         * APR_MEMNODE_T_SIZE,
+                       after.used);
+
+        /* the blocks obtained in the first round are reused afterwards */
+        if (round > 0) {
+            apr_allocator_stats_get(&astats, allocator);
+            ABTS_INT_EQUAL(tc, node_allocs, astats.node_allocs);
+        }
+    }
+
+    apr_pool_destroy(pool);
+}
+
 abts_suite *testpool(abts_suite *suite)
 {
     suite = ADD_SUITE(suite)
@@ -150,6 +449,13 @@ abts_suite *testpool(abts_suite *suite)
     abts_run_test(suite, alloc_bytes, NULL);
     abts_run_test(suite, calloc_bytes, NULL);
     abts_run_test(suite, test_cleanups, NULL);
+    abts_run_test(suite, test_palloc_aligned, NULL);
+    abts_run_test(suite, test_mark_rollback, NULL);
+    abts_run_test(suite, test_stats, NULL);
+    abts_run_test(suite, test_regions, NULL);
+#if APR_HAS_THREADS
+    abts_run_test(suite, test_thread_cache, NULL);
+#endif
 
     return suite;
 }
@@ -17,6 +17,7 @@
 #include "apu.h"
 #include "apr_queue.h"
 #include "apr_thread_pool.h"
+#include "apr_thread_proc.h"
 #include "apr_time.h"
 #include "abts.h"
 #include "testutil.h"
@@ -121,6 +122,149 @@ static void test_queue_producer_consumer(abts_case *tc, void *data)
     ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
 }
 
+static void test_queue_lockfree(abts_case *tc, void *data)
+{
+    apr_queue_t *q;
+    apr_status_t rv;
+    apr_uintptr_t i;
+    void *v;
+
+    rv = apr_queue_create_ex(&q, 0, APR_QUEUE_LOCKFREE, p);
+    ABTS_INT_EQUAL(tc, APR_EINVAL, rv);
+
+    /* the capacity is rounded up to 8 */
+    rv = apr_queue_create_ex(&q, 5, APR_QUEUE_LOCKFREE, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    rv = apr_queue_trypop(q, &v);
+    ABTS_INT_EQUAL(tc, APR_EAGAIN, rv);
+
+    /* go around the ring a few times */
+    for (i = 0; i < 8 * 3; i++) {
+        rv = apr_queue_trypush(q, (void *)(i + 1));
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+        if (i % 8 == 7) {
+            apr_uintptr_t j;
+
+            ABTS_INT_EQUAL(tc, 8, apr_queue_size(q));
+            rv = apr_queue_trypush(q, NULL);
+            ABTS_INT_EQUAL(tc, APR_EAGAIN, rv);
+
+            for (j = i - 7; j <= i; j++) {
+                rv = apr_queue_pop(q, &v);
+                ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+                ABTS_TRUE(tc, v == (void *)(j + 1));
+            }
+            ABTS_INT_EQUAL(tc, 0, apr_queue_size(q));
+        }
+    }
+
+    rv = apr_queue_term(q);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_queue_push(q, NULL);
+    ABTS_INT_EQUAL(tc, APR_EOF, rv);
+}
+
+#define BENCH_ITEMS 20000
+
+typedef struct bench_t {
+    apr_queue_t *queue;
+    apr_uint64_t sum;
+    apr_status_t rv;
+} bench_t;
+
+static void * APR_THREAD_FUNC bench_producer(apr_thread_t *thd, void *data)
+{
+    bench_t *b = data;
+    apr_uintptr_t i;
+
+    for (i = 1; i <= BENCH_ITEMS; i++) {
+        do {
+            b->rv = apr_queue_push(b->queue, (void *)i);
+        } while (b->rv == APR_EINTR);
+        if (b->rv != APR_SUCCESS) {
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+static void * APR_THREAD_FUNC bench_consumer(apr_thread_t *thd, void *data)
+{
+    bench_t *b = data;
+    void *v;
+    int i;
+
+    for (i = 0; i < BENCH_ITEMS; i++) {
+        do {
+            b->rv = apr_queue_pop(b->queue, &v);
+        } while (b->rv == APR_EINTR);
+        if (b->rv != APR_SUCCESS) {
+            break;
+        }
+        b->sum += (apr_uintptr_t)v;
+    }
+
+    return NULL;
+}
+
+/* Moves BENCH_ITEMS per producer through a small queue, with as many
+ * consumers as producers, and logs the throughput (testall -v).
+ */
+static void test_queue_throughput(abts_case *tc, void *data)
+{
+    static const int nthreads[] = { 1, 2, 4, 8 };
+    bench_t producers[8], consumers[8];
+    apr_thread_t *threads[16];
+    apr_uint64_t sum;
+    apr_time_t start, elapsed;
+    apr_status_t rv, retval;
+    apr_uint32_t flags;
+    int n, i, j;
+
+    for (flags = 0; flags <= APR_QUEUE_LOCKFREE; flags += APR_QUEUE_LOCKFREE) {
+        for (n = 0; n < sizeof(nthreads) / sizeof(nthreads[0]); n++) {
+            apr_queue_t *q;
+
+            rv = apr_queue_create_ex(&q, 64, flags, p);
+            ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+            start = apr_time_now();
+            for (i = 0, j = 0; i < nthreads[n]; i++) {
+                producers[i].queue = consumers[i].queue = q;
+                producers[i].sum = consumers[i].sum = 0;
+                producers[i].rv = consumers[i].rv = APR_SUCCESS;
+                rv = apr_thread_create(&threads[j++], NULL, bench_consumer,
+                                       &consumers[i], p);
+                ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+                rv = apr_thread_create(&threads[j++], NULL, bench_producer,
+                                       &producers[i], p);
+                ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+            }
+            for (i = 0; i < j; i++) {
+                apr_thread_join(&retval, threads[i]);
+            }
+            elapsed = apr_time_now() - start;
+
+            for (sum = 0, i = 0; i < nthreads[n]; i++) {
+                ABTS_INT_EQUAL(tc, APR_SUCCESS, producers[i].rv);
+                ABTS_INT_EQUAL(tc, APR_SUCCESS, consumers[i].rv);
+                sum += consumers[i].sum;
+            }
+            ABTS_TRUE(tc, sum == (apr_uint64_t)nthreads[n]
+                                 * BENCH_ITEMS * (BENCH_ITEMS + 1) / 2);
+            ABTS_INT_EQUAL(tc, 0, apr_queue_size(q));
+
+            abts_log_message("%s queue, %d producers/consumers: "
+                             "%" APR_TIME_T_FMT " items/s",
+                             flags ? "lock-free" : "mutex", nthreads[n],
+                             (apr_time_t)nthreads[n] * BENCH_ITEMS
+                             * APR_USEC_PER_SEC / (elapsed ? elapsed : 1));
+        }
+    }
+}
+
 #endif /* APR_HAS_THREADS */
 
 abts_suite *testqueue(abts_suite *suite)
@@ -129,6 +273,8 @@ abts_suite *testqueue(abts_suite *suite)
 
 #if APR_HAS_THREADS
     abts_run_test(suite, test_queue_producer_consumer, NULL);
+    abts_run_test(suite, test_queue_lockfree, NULL);
+    abts_run_test(suite, test_queue_throughput, NULL);
 #endif /* APR_HAS_THREADS */
 
     return suite;
@@ -0,0 +1,286 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "testutil.h"
+#include "apr.h"
+#include "apr_strings.h"
+#include "apr_general.h"
+#include "apr_pools.h"
+#include "apr_network_io.h"
+#include "apr_radix.h"
+
+static void string_keys(abts_case *tc, void *data)
+{
+    apr_radix_t *t;
+    apr_size_t len;
+
+    t = apr_radix_make(p);
+    ABTS_PTR_NOTNULL(tc, t);
+    ABTS_PTR_EQUAL(tc, p, apr_radix_pool_get(t));
+
+    apr_radix_set(t, "/", APR_RADIX_KEY_STRING, "root");
+    apr_radix_set(t, "/docs/", APR_RADIX_KEY_STRING, "docs");
+    apr_radix_set(t, "/docs/api/", APR_RADIX_KEY_STRING, "api");
+    apr_radix_set(t, "/download", APR_RADIX_KEY_STRING, "download");
+    ABTS_INT_EQUAL(tc, 4, apr_radix_count(t));
+
+    ABTS_STR_EQUAL(tc, "docs", apr_radix_get(t, "/docs/",
+                                             APR_RADIX_KEY_STRING));
+    ABTS_PTR_EQUAL(tc, NULL, apr_radix_get(t, "/docs", APR_RADIX_KEY_STRING));
+    ABTS_PTR_EQUAL(tc, NULL, apr_radix_get(t, "/do", APR_RADIX_KEY_STRING));
+
+    ABTS_STR_EQUAL(tc, "api",
+                   apr_radix_longest_prefix(t, "/docs/api/index.html",
+                                            APR_RADIX_KEY_STRING, &len));
+    ABTS_INT_EQUAL(tc, 10, len);
+    ABTS_STR_EQUAL(tc, "docs",
+                   apr_radix_longest_prefix(t, "/docs/apx",
+                                            APR_RADIX_KEY_STRING, &len));
+    ABTS_INT_EQUAL(tc, 6, len);
+    ABTS_STR_EQUAL(tc, "download",
+                   apr_radix_longest_prefix(t, "/downloads",
+                                            APR_RADIX_KEY_STRING, NULL));
+    ABTS_STR_EQUAL(tc, "root",
+                   apr_radix_longest_prefix(t, "/doc", 4, &len));
+    ABTS_INT_EQUAL(tc, 1, len);
+    ABTS_PTR_EQUAL(tc, NULL, apr_radix_longest_prefix(t, "docs", 4, NULL));
+
+    /* Deleting an inner key keeps the ones below */
+    apr_radix_set(t, "/docs/", APR_RADIX_KEY_STRING, NULL);
+    ABTS_INT_EQUAL(tc, 3, apr_radix_count(t));
+    ABTS_STR_EQUAL(tc, "root",
+                   apr_radix_longest_prefix(t, "/docs/apx",
+                                            APR_RADIX_KEY_STRING, NULL));
+    ABTS_STR_EQUAL(tc, "api",
+                   apr_radix_longest_prefix(t, "/docs/api/x",
+                                            APR_RADIX_KEY_STRING, NULL));
+    apr_radix_set(t, "/docs/api/", APR_RADIX_KEY_STRING, NULL);
+    apr_radix_set(t, "/nothere", APR_RADIX_KEY_STRING, NULL);
+    ABTS_INT_EQUAL(tc, 2, apr_radix_count(t));
+    ABTS_STR_EQUAL(tc, "download", apr_radix_get(t, "/download",
+                                                 APR_RADIX_KEY_STRING));
+
+    /* The empty key is a prefix of everything */
+    apr_radix_set(t, "", 0, "empty");
+    ABTS_STR_EQUAL(tc, "empty",
+                   apr_radix_longest_prefix(t, "x", 1, &len));
+    ABTS_INT_EQUAL(tc, 0, len);
+
+    apr_radix_clear(t);
+    ABTS_INT_EQUAL(tc, 0, apr_radix_count(t));
+    ABTS_PTR_EQUAL(tc, NULL, apr_radix_longest_prefix(t, "/docs/", 6, NULL));
+}
+
+static void bit_keys(abts_case *tc, void *data)
+{
+    apr_radix_t *t;
+    unsigned char k1 = 0xa0, k2 = 0xb0, k = 0xaf;
+    apr_size_t bits;
+
+    t = apr_radix_make(p);
+    apr_radix_set_bits(t, &k1, 3, "101");    /* 101 */
+    apr_radix_set_bits(t, &k2, 4, "1011");   /* 1011 */
+    ABTS_STR_EQUAL(tc, "101", apr_radix_get_bits(t, &k, 3));
+    ABTS_PTR_EQUAL(tc, NULL, apr_radix_get_bits(t, &k, 4));
+    ABTS_STR_EQUAL(tc, "101",
+                   apr_radix_longest_prefix_bits(t, &k, 8, &bits));
+    ABTS_INT_EQUAL(tc, 3, bits);
+    ABTS_STR_EQUAL(tc, "1011",
+                   apr_radix_longest_prefix_bits(t, &k2, 8, &bits));
+    ABTS_INT_EQUAL(tc, 4, bits);
+
+    /* The partial bytes keys don't count for whole bytes lookups */
+    ABTS_PTR_EQUAL(tc, NULL, apr_radix_longest_prefix(t, &k, 1, NULL));
+}
+
+static void ip_subnets(abts_case *tc, void *data)
+{
+    apr_radix_t *t;
+    apr_sockaddr_t *sa;
+    int prefix;
+
+    t = apr_radix_make(p);
+
+    apr_sockaddr_info_get(&sa, "10.0.0.0", APR_INET, 0, 0, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, apr_radix_set_addr(t, sa, 8, "ten"));
+    ABTS_INT_EQUAL(tc, APR_EINVAL, apr_radix_set_addr(t, sa, 33, "bad"));
+    apr_sockaddr_info_get(&sa, "10.1.2.0", APR_INET, 0, 0, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, apr_radix_set_addr(t, sa, 24, "ten-1-2"));
+    apr_sockaddr_info_get(&sa, "10.1.2.3", APR_INET, 0, 0, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, apr_radix_set_addr(t, sa, -1, "host"));
+
+    apr_sockaddr_info_get(&sa, "10.1.2.3", APR_INET, 0, 0, p);
+    ABTS_STR_EQUAL(tc, "host", apr_radix_longest_prefix_addr(t, sa, &prefix));
+    ABTS_INT_EQUAL(tc, 32, prefix);
+    apr_sockaddr_info_get(&sa, "10.1.2.4", APR_INET, 0, 0, p);
+    ABTS_STR_EQUAL(tc, "ten-1-2",
+                   apr_radix_longest_prefix_addr(t, sa, &prefix));
+    ABTS_INT_EQUAL(tc, 24, prefix);
+    apr_sockaddr_info_get(&sa, "10.200.0.1", APR_INET, 0, 0, p);
+    ABTS_STR_EQUAL(tc, "ten", apr_radix_longest_prefix_addr(t, sa, &prefix));
+    ABTS_INT_EQUAL(tc, 8, prefix);
+    apr_sockaddr_info_get(&sa, "192.168.0.1", APR_INET, 0, 0, p);
+    ABTS_PTR_EQUAL(tc, NULL, apr_radix_longest_prefix_addr(t, sa, NULL));
+
+    /* The default route */
+    apr_sockaddr_info_get(&sa, "0.0.0.0", APR_INET, 0, 0, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, apr_radix_set_addr(t, sa, 0, "any"));
+    apr_sockaddr_info_get(&sa, "192.168.0.1", APR_INET, 0, 0, p);
+    ABTS_STR_EQUAL(tc, "any", apr_radix_longest_prefix_addr(t, sa, &prefix));
+    ABTS_INT_EQUAL(tc, 0, prefix);
+
+#if APR_HAVE_IPV6
+    {
+        apr_sockaddr_t *sa6;
+
+        /* IPv4 subnets match IPv4-mapped addresses */
+        if (apr_sockaddr_info_get(&sa6, "::ffff:10.1.2.9", APR_INET6, 0, 0,
+                                  p) == APR_SUCCESS) {
+            ABTS_STR_EQUAL(tc, "ten-1-2",
+                           apr_radix_longest_prefix_addr(t, sa6, &prefix));
+            ABTS_INT_EQUAL(tc, 24, prefix);
+        }
+        /* but not the other IPv6 addresses */
+        if (apr_sockaddr_info_get(&sa6, "fe80::1", APR_INET6, 0, 0,
+                                  p) == APR_SUCCESS) {
+            ABTS_PTR_EQUAL(tc, NULL,
+                           apr_radix_longest_prefix_addr(t, sa6, NULL));
+            ABTS_INT_EQUAL(tc, APR_SUCCESS,
+                           apr_radix_set_addr(t, sa6, 10, "link-local"));
+            ABTS_STR_EQUAL(tc, "link-local",
+                           apr_radix_longest_prefix_addr(t, sa6, &prefix));
+            ABTS_INT_EQUAL(tc, 10, prefix);
+        }
+    }
+#endif
+}
+
+static int count_cb(void *rec, const void *key, apr_size_t bits,
+                    const void *val)
+{
+    const char **prev = rec;
+
+    /* in order */
+    if (*prev && strcmp(*prev, val) >= 0) {
+        return 0;
+    }
+    *prev = val;
+    return 1;
+}
+
+#define NUM_KEYS 2000
+
+static void random_keys(abts_case *tc, void *data)
+{
+    apr_radix_t *t;
+    char **keys;
+    const char *prev = NULL;
+    apr_uint32_t x = 42;
+    int i, j, ok;
+
+    /* Compared with a brute force search */
+    t = apr_radix_make(p);
+    keys = apr_palloc(p, NUM_KEYS * sizeof(char *));
+    for (i = 0; i < NUM_KEYS; i++) {
+        char buf[8];
+        int len;
+
+        x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+        len = 1 + x % 6;
+        for (j = 0; j < len; j++) {
+            buf[j] = "ab/"[(x >> (3 + 2 * j)) % 3];
+        }
+        buf[len] = '\0';
+        keys[i] = apr_pstrdup(p, buf);
+        apr_radix_set(t, keys[i], APR_RADIX_KEY_STRING, keys[i]);
+        apr_radix_set(t, keys[i], APR_RADIX_KEY_STRING, keys[i]);
+    }
+    /* Delete a third of them */
+    for (i = 0; i < NUM_KEYS; i += 3) {
+        apr_radix_set(t, keys[i], APR_RADIX_KEY_STRING, NULL);
+    }
+
+    for (ok = 0, i = 0; i < NUM_KEYS; i++) {
+        const char *best = NULL, *found;
+        int k;
+
+        for (k = 0; k < NUM_KEYS; k++) {
+            const char *cand = apr_radix_get(t, keys[k],
+                                             APR_RADIX_KEY_STRING);
+            if (cand && !strncmp(keys[i], cand, strlen(cand))
+                && (!best || strlen(cand) > strlen(best))) {
+                best = cand;
+            }
+        }
+        found = apr_radix_longest_prefix(t, keys[i], APR_RADIX_KEY_STRING,
+                                         NULL);
+        ok += (best == NULL) ? found == NULL
+                             : (found && !strcmp(best, found));
+    }
+    ABTS_INT_EQUAL(tc, NUM_KEYS, ok);
+
+    ABTS_TRUE(tc, apr_radix_do(count_cb, &prev, t));
+}
+
+/* The longest prefix lookups agree with apr_ipsubnet_test() */
+static void subnet_lookups(abts_case *tc, void *data)
+{
+    apr_pool_t *pool;
+    apr_radix_t *t;
+    apr_ipsubnet_t **subnets;
+    apr_sockaddr_t *sa;
+    int i, j, agreed = 0;
+
+    apr_pool_create(&pool, p);
+    t = apr_radix_make(pool);
+    subnets = apr_palloc(pool, 1000 * sizeof(*subnets));
+    for (i = 0; i < 1000; i++) {
+        const char *net = apr_psprintf(pool, "10.%d.%d.0", i / 250, i % 250);
+
+        apr_ipsubnet_create(&subnets[i], net, "24", pool);
+        apr_sockaddr_info_get(&sa, net, APR_INET, 0, 0, pool);
+        apr_radix_set_addr(t, sa, 24, subnets[i]);
+    }
+    for (i = 0; i < 100; i++) {
+        apr_ipsubnet_t *subnet = NULL;
+
+        apr_sockaddr_info_get(&sa, apr_psprintf(pool, "10.%d.%d.1", i % 5, i),
+                              APR_INET, 0, 0, pool);
+        for (j = 0; j < 1000; j++) {
+            if (apr_ipsubnet_test(subnets[j], sa)) {
+                subnet = subnets[j];
+                break;
+            }
+        }
+        agreed += apr_radix_longest_prefix_addr(t, sa, NULL) == subnet;
+    }
+    ABTS_INT_EQUAL(tc, 100, agreed);
+
+    apr_pool_destroy(pool);
+}
+
+abts_suite *testradix(abts_suite *suite)
+{
+    suite = ADD_SUITE(suite)
+
+    abts_run_test(suite, string_keys, NULL);
+    abts_run_test(suite, bit_keys, NULL);
+    abts_run_test(suite, ip_subnets, NULL);
+    abts_run_test(suite, random_keys, NULL);
+    abts_run_test(suite, subnet_lookups, NULL);
+
+    return suite;
+}
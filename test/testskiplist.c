@@ -20,6 +20,8 @@
 #include "apr_general.h"
 #include "apr_pools.h"
 #include "apr_skiplist.h"
+#include "apr_atomic.h"
+#include "apr_thread_proc.h"
 #if APR_HAVE_STDIO_H
 #include <stdio.h>
 #endif
@@ -299,6 +301,436 @@ static void skiplist_test(abts_case *tc, void *data) {
     apr_pool_clear(ptmp);
 }
 
+typedef struct {
+    int key;
+    int seq;
+} elem_t;
+
+static int elem_comp(void *a, void *b)
+{
+    return ((elem_t *)a)->key - ((elem_t *)b)->key;
+}
+
+static int elem_seq_comp(void *a, void *b)
+{
+    return ((elem_t *)a)->seq - ((elem_t *)b)->seq;
+}
+
+#define NUM_ELEMS 10000
+
+static void skiplist_order(abts_case *tc, void *data)
+{
+    apr_skiplist *sl;
+    apr_skiplistnode *iter;
+    elem_t *elems, *e, *prev;
+    int i, n, ordered;
+
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, apr_skiplist_init(&sl, ptmp));
+    apr_skiplist_set_compare(sl, elem_comp, elem_comp);
+
+    /* Many duplicates, which must stay in their order of addition */
+    elems = apr_palloc(ptmp, NUM_ELEMS * sizeof(elem_t));
+    for (i = 0; i < NUM_ELEMS; i++) {
+        elems[i].key = (i * 7919) % (NUM_ELEMS / 10);
+        elems[i].seq = i;
+        ABTS_PTR_NOTNULL(tc, apr_skiplist_add(sl, &elems[i]));
+    }
+    ABTS_INT_EQUAL(tc, NUM_ELEMS, apr_skiplist_size(sl));
+
+    n = ordered = 0;
+    prev = NULL;
+    iter = apr_skiplist_getlist(sl);
+    e = apr_skiplist_peek(sl);
+    while (iter) {
+        apr_skiplistnode *back = iter;
+
+        ordered += !prev || prev->key < e->key
+                   || (prev->key == e->key && prev->seq < e->seq);
+        ABTS_PTR_EQUAL(tc, prev, apr_skiplist_previous(sl, &back));
+        prev = e;
+        n++;
+        e = apr_skiplist_next(sl, &iter);
+    }
+    ABTS_INT_EQUAL(tc, NUM_ELEMS, n);
+    ABTS_INT_EQUAL(tc, NUM_ELEMS, ordered);
+
+    /* Remove every other element, and pop the rest in order */
+    for (i = 0; i < NUM_ELEMS; i += 2) {
+        ABTS_TRUE(tc, apr_skiplist_remove_compare(sl, &elems[i], NULL,
+                                                  elem_comp) >= 0);
+    }
+    ABTS_INT_EQUAL(tc, NUM_ELEMS / 2, apr_skiplist_size(sl));
+    for (n = 0, prev = NULL; (e = apr_skiplist_pop(sl, NULL)); n++) {
+        ABTS_TRUE(tc, !prev || prev->key <= e->key);
+        prev = e;
+    }
+    ABTS_INT_EQUAL(tc, NUM_ELEMS / 2, n);
+    ABTS_INT_EQUAL(tc, 0, apr_skiplist_height(sl));
+    ABTS_PTR_EQUAL(tc, NULL, apr_skiplist_peek(sl));
+
+    apr_pool_clear(ptmp);
+}
+
+static void skiplist_index(abts_case *tc, void *data)
+{
+    apr_skiplist *sl;
+    elem_t elems[100], key, *e;
+    int i;
+
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, apr_skiplist_init(&sl, NULL));
+    apr_skiplist_set_compare(sl, elem_comp, elem_comp);
+    for (i = 0; i < 50; i++) {
+        elems[i].key = 100 - i;
+        elems[i].seq = i;
+        apr_skiplist_insert(sl, &elems[i]);
+    }
+
+    /* A second order, on the existing elements then the new ones */
+    apr_skiplist_add_index(sl, elem_seq_comp, elem_seq_comp);
+    for (; i < 100; i++) {
+        elems[i].key = 100 - i;
+        elems[i].seq = i;
+        apr_skiplist_insert(sl, &elems[i]);
+    }
+    ABTS_INT_EQUAL(tc, 100, apr_skiplist_size(sl));
+
+    key.seq = 75;
+    e = apr_skiplist_find_compare(sl, &key, NULL, elem_seq_comp);
+    ABTS_PTR_EQUAL(tc, &elems[75], e);
+    key.key = 25;
+    e = apr_skiplist_find(sl, &key, NULL);
+    ABTS_PTR_EQUAL(tc, &elems[75], e);
+
+    /* Removing through the index removes from the main list too */
+    ABTS_TRUE(tc, apr_skiplist_remove_compare(sl, &key, NULL,
+                                              elem_seq_comp) >= 0);
+    ABTS_INT_EQUAL(tc, 99, apr_skiplist_size(sl));
+    ABTS_PTR_EQUAL(tc, NULL, apr_skiplist_find(sl, &key, NULL));
+    ABTS_PTR_EQUAL(tc, NULL, apr_skiplist_find_compare(sl, &key, NULL,
+                                                       elem_seq_comp));
+
+    ABTS_PTR_EQUAL(tc, &elems[99], apr_skiplist_pop(sl, NULL));
+    key.seq = 99;
+    ABTS_PTR_EQUAL(tc, NULL, apr_skiplist_find_compare(sl, &key, NULL,
+                                                       elem_seq_comp));
+    key.seq = 98;
+    ABTS_PTR_EQUAL(tc, &elems[98], apr_skiplist_find_compare(sl, &key, NULL,
+                                                             elem_seq_comp));
+
+    apr_skiplist_destroy(sl, NULL);
+}
+
+static void skiplist_bulk_load(abts_case *tc, void *data)
+{
+    apr_skiplist *sl;
+    apr_skiplistnode *iter;
+    elem_t *elems, *e, *prev;
+    void **sorted;
+    int i, n, ordered;
+
+    elems = apr_palloc(ptmp, 10 * NUM_ELEMS * sizeof(elem_t));
+    sorted = apr_palloc(ptmp, 10 * NUM_ELEMS * sizeof(void *));
+    for (i = 0; i < 10 * NUM_ELEMS; i++) {
+        /* with duplicates */
+        elems[i].key = i / 2;
+        elems[i].seq = i;
+        sorted[i] = &elems[i];
+    }
+
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, apr_skiplist_init(&sl, ptmp));
+    apr_skiplist_set_compare(sl, elem_comp, elem_comp);
+    /* not sorted */
+    sorted[0] = &elems[2];
+    ABTS_INT_EQUAL(tc, APR_EINVAL, apr_skiplist_bulk_load(sl, sorted, 2));
+    ABTS_INT_EQUAL(tc, 0, apr_skiplist_size(sl));
+    sorted[0] = &elems[0];
+
+    ABTS_INT_EQUAL(tc, APR_SUCCESS,
+                   apr_skiplist_bulk_load(sl, sorted, 10 * NUM_ELEMS));
+    ABTS_INT_EQUAL(tc, 10 * NUM_ELEMS, apr_skiplist_size(sl));
+    /* not empty anymore */
+    ABTS_INT_EQUAL(tc, APR_EINVAL, apr_skiplist_bulk_load(sl, sorted, 1));
+
+    n = ordered = 0;
+    prev = NULL;
+    iter = apr_skiplist_getlist(sl);
+    e = apr_skiplist_peek(sl);
+    while (iter) {
+        apr_skiplistnode *back = iter;
+
+        ordered += !prev || prev->seq + 1 == e->seq;
+        ABTS_PTR_EQUAL(tc, prev, apr_skiplist_previous(sl, &back));
+        prev = e;
+        n++;
+        e = apr_skiplist_next(sl, &iter);
+    }
+    ABTS_INT_EQUAL(tc, 10 * NUM_ELEMS, n);
+    ABTS_INT_EQUAL(tc, 10 * NUM_ELEMS, ordered);
+    for (n = 0, i = 0; i < 10 * NUM_ELEMS; i++) {
+        e = apr_skiplist_find(sl, &elems[i], NULL);
+        n += e && e->key == elems[i].key;
+    }
+    ABTS_INT_EQUAL(tc, 10 * NUM_ELEMS, n);
+
+    apr_pool_clear(ptmp);
+}
+
+static void skiplist_range(abts_case *tc, void *data)
+{
+    apr_skiplist *sl;
+    apr_skiplistnode *iter, *end;
+    elem_t elems[100], lo, hi, *e;
+    void *sorted[100];
+    int i, n;
+
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, apr_skiplist_init(&sl, ptmp));
+    apr_skiplist_set_compare(sl, elem_comp, elem_comp);
+    /* 0, 0, 2, 2, 4, 4, ... */
+    for (i = 0; i < 100; i++) {
+        elems[i].key = (i / 2) * 2;
+        elems[i].seq = i;
+        sorted[i] = &elems[i];
+    }
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, apr_skiplist_bulk_load(sl, sorted, 100));
+
+    /* The first of the equal elements, or the following one */
+    lo.key = 10;
+    ABTS_PTR_EQUAL(tc, &elems[10], apr_skiplist_lower_bound(sl, &lo, &iter));
+    ABTS_PTR_EQUAL(tc, &elems[11], apr_skiplist_next(sl, &iter));
+    lo.key = 11;
+    ABTS_PTR_EQUAL(tc, &elems[12], apr_skiplist_lower_bound(sl, &lo, &iter));
+    lo.key = -5;
+    ABTS_PTR_EQUAL(tc, &elems[0], apr_skiplist_lower_bound(sl, &lo, NULL));
+    lo.key = 99;
+    ABTS_PTR_EQUAL(tc, NULL, apr_skiplist_lower_bound(sl, &lo, &iter));
+    ABTS_PTR_EQUAL(tc, NULL, iter);
+
+    /* [10, 20) */
+    lo.key = 10;
+    hi.key = 20;
+    n = 0;
+    for (e = apr_skiplist_range(sl, &lo, &hi, &iter, &end); iter != end;
+         e = apr_skiplist_next(sl, &iter)) {
+        ABTS_TRUE(tc, e->key >= 10 && e->key < 20);
+        n++;
+    }
+    ABTS_INT_EQUAL(tc, 10, n);
+
+    /* Unbounded ranges */
+    n = 0;
+    for (e = apr_skiplist_range(sl, NULL, &hi, &iter, &end); iter != end;
+         e = apr_skiplist_next(sl, &iter)) {
+        n++;
+    }
+    ABTS_INT_EQUAL(tc, 20, n);
+    n = 0;
+    for (e = apr_skiplist_range(sl, &lo, NULL, &iter, &end); iter != end;
+         e = apr_skiplist_next(sl, &iter)) {
+        n++;
+    }
+    ABTS_INT_EQUAL(tc, 90, n);
+    ABTS_PTR_EQUAL(tc, NULL, end);
+
+    /* Empty ranges */
+    hi.key = 10;
+    ABTS_PTR_EQUAL(tc, NULL, apr_skiplist_range(sl, &lo, &hi, &iter, &end));
+    ABTS_PTR_EQUAL(tc, end, iter);
+    lo.key = 31;
+    hi.key = 32;
+    ABTS_PTR_EQUAL(tc, NULL, apr_skiplist_range(sl, &lo, &hi, &iter, &end));
+    ABTS_PTR_EQUAL(tc, end, iter);
+    lo.key = 40;
+    hi.key = 20;
+    ABTS_PTR_EQUAL(tc, NULL, apr_skiplist_range(sl, &lo, &hi, &iter, &end));
+    ABTS_PTR_EQUAL(tc, end, iter);
+
+    apr_pool_clear(ptmp);
+}
+
+#if APR_HAS_THREADS
+
+#define NUM_CONC_ELEMS 1000
+#define NUM_CONC_ROUNDS 50
+#define NUM_CONC_READERS 3
+
+static apr_skiplist *conc_sl;
+static elem_t conc_elems[2 * NUM_CONC_ELEMS];
+static volatile apr_uint32_t conc_done;
+static volatile apr_uint32_t conc_errors;
+
+/* The even keys are always in the list, the odd ones come and go */
+static void * APR_THREAD_FUNC conc_writer(apr_thread_t *thd, void *data)
+{
+    int round, i;
+
+    for (round = 0; round < NUM_CONC_ROUNDS; round++) {
+        for (i = 1; i < 2 * NUM_CONC_ELEMS; i += 2) {
+            if (!apr_skiplist_insert(conc_sl, &conc_elems[i])) {
+                apr_atomic_inc32(&conc_errors);
+            }
+        }
+        for (i = 1; i < 2 * NUM_CONC_ELEMS; i += 2) {
+            if (apr_skiplist_remove(conc_sl, &conc_elems[i], NULL) < 0) {
+                apr_atomic_inc32(&conc_errors);
+            }
+        }
+    }
+    apr_atomic_set32(&conc_done, 1);
+    apr_thread_exit(thd, APR_SUCCESS);
+    return NULL;
+}
+
+static void * APR_THREAD_FUNC conc_reader(apr_thread_t *thd, void *data)
+{
+    apr_skiplistnode *iter;
+    elem_t *e;
+    int i, n;
+
+    while (!apr_atomic_read32(&conc_done)) {
+        for (i = 0; i < 2 * NUM_CONC_ELEMS; i += 2) {
+            if (apr_skiplist_find(conc_sl, &conc_elems[i], NULL)
+                    != &conc_elems[i]) {
+                apr_atomic_inc32(&conc_errors);
+            }
+        }
+        /* A walk only meets valid elements, though it can be moved
+         * elsewhere in the list if its node is recycled between two steps
+         */
+        n = 0;
+        iter = apr_skiplist_getlist(conc_sl);
+        e = apr_skiplist_peek(conc_sl);
+        while (e && n++ < 4 * NUM_CONC_ELEMS) {
+            if (e < conc_elems || e >= conc_elems + 2 * NUM_CONC_ELEMS) {
+                apr_atomic_inc32(&conc_errors);
+            }
+            e = apr_skiplist_next(conc_sl, &iter);
+        }
+        apr_thread_yield();
+    }
+    apr_thread_exit(thd, APR_SUCCESS);
+    return NULL;
+}
+
+static void skiplist_concurrent(abts_case *tc, void *data)
+{
+    apr_thread_t *writer, *readers[NUM_CONC_READERS];
+    apr_status_t rv, s;
+    int i;
+
+    ABTS_INT_EQUAL(tc, APR_EINVAL,
+                   apr_skiplist_init_ex(&conc_sl, NULL,
+                                        APR_SKIPLIST_CONCURRENT));
+    rv = apr_skiplist_init_ex(&conc_sl, ptmp, APR_SKIPLIST_CONCURRENT);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    apr_skiplist_set_compare(conc_sl, elem_comp, elem_comp);
+    ABTS_PTR_EQUAL(tc, NULL, apr_skiplist_peek(conc_sl));
+    for (i = 0; i < 2 * NUM_CONC_ELEMS; i++) {
+        conc_elems[i].key = i;
+        conc_elems[i].seq = i;
+    }
+    for (i = 0; i < 2 * NUM_CONC_ELEMS; i += 2) {
+        apr_skiplist_insert(conc_sl, &conc_elems[i]);
+    }
+
+    apr_atomic_set32(&conc_done, 0);
+    apr_atomic_set32(&conc_errors, 0);
+    for (i = 0; i < NUM_CONC_READERS; i++) {
+        rv = apr_thread_create(&readers[i], NULL, conc_reader, NULL, p);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+    rv = apr_thread_create(&writer, NULL, conc_writer, NULL, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    apr_thread_join(&s, writer);
+    for (i = 0; i < NUM_CONC_READERS; i++) {
+        apr_thread_join(&s, readers[i]);
+    }
+    ABTS_INT_EQUAL(tc, 0, apr_atomic_read32(&conc_errors));
+    ABTS_INT_EQUAL(tc, NUM_CONC_ELEMS, apr_skiplist_size(conc_sl));
+
+    apr_skiplist_destroy(conc_sl, NULL);
+    apr_pool_clear(ptmp);
+}
+
+static void conc_free(void *mem)
+{
+    apr_skiplist_free(conc_sl, mem);
+}
+
+/* The elements are freed outside of the lock, with the skip list usable */
+static void skiplist_concurrent_free(abts_case *tc, void *data)
+{
+    elem_t *e;
+    int i;
+
+    ABTS_INT_EQUAL(tc, APR_SUCCESS,
+                   apr_skiplist_init_ex(&conc_sl, ptmp,
+                                        APR_SKIPLIST_CONCURRENT));
+    apr_skiplist_set_compare(conc_sl, elem_comp, elem_comp);
+    for (i = 0; i < 10; i++) {
+        e = apr_skiplist_alloc(conc_sl, sizeof(*e));
+        e->key = e->seq = i;
+        apr_skiplist_insert(conc_sl, e);
+    }
+    e = apr_skiplist_peek(conc_sl);
+    ABTS_INT_EQUAL(tc, 1, apr_skiplist_remove(conc_sl, e, conc_free) >= 0);
+    e = apr_skiplist_pop(conc_sl, conc_free);
+    ABTS_PTR_NOTNULL(tc, e);
+    ABTS_INT_EQUAL(tc, 8, apr_skiplist_size(conc_sl));
+
+    /* The chunks freed are reused */
+    ABTS_PTR_EQUAL(tc, e, apr_skiplist_alloc(conc_sl, sizeof(*e)));
+
+    apr_skiplist_destroy(conc_sl, NULL);
+    apr_pool_clear(ptmp);
+}
+
+/* The memory of a removed node is never handed to apr_skiplist_alloc(),
+ * an iterator held on it can still walk on
+ */
+static void skiplist_concurrent_iter(abts_case *tc, void *data)
+{
+    apr_skiplistnode *iter;
+    elem_t *e;
+    void *mem;
+    size_t size;
+    int n;
+
+    ABTS_INT_EQUAL(tc, APR_SUCCESS,
+                   apr_skiplist_init_ex(&conc_sl, ptmp,
+                                        APR_SKIPLIST_CONCURRENT));
+    apr_skiplist_set_compare(conc_sl, elem_comp, elem_comp);
+    for (n = 0; n < 100; n++) {
+        conc_elems[n].key = conc_elems[n].seq = n;
+        apr_skiplist_insert(conc_sl, &conc_elems[n]);
+    }
+
+    iter = apr_skiplist_getlist(conc_sl);
+    ABTS_PTR_EQUAL(tc, &conc_elems[0], apr_skiplist_find(conc_sl,
+                                                         &conc_elems[0],
+                                                         &iter));
+    ABTS_INT_EQUAL(tc, 1, apr_skiplist_remove(conc_sl, &conc_elems[0],
+                                              NULL) >= 0);
+
+    /* whatever the size of the node is */
+    for (size = sizeof(void *); size <= 1024; size += sizeof(void *)) {
+        mem = apr_skiplist_alloc(conc_sl, size);
+        ABTS_PTR_NOTNULL(tc, mem);
+        memset(mem, 0x5a, size);
+    }
+
+    for (n = 0; (e = apr_skiplist_next(conc_sl, &iter)) != NULL; n++) {
+        if (n >= 100 || e < conc_elems || e >= conc_elems + 100) {
+            ABTS_FAIL(tc, "walked out of the skip list");
+            break;
+        }
+    }
+
+    apr_skiplist_destroy(conc_sl, NULL);
+    apr_pool_clear(ptmp);
+}
+
+#endif /* APR_HAS_THREADS */
 
 abts_suite *testskiplist(abts_suite *suite)
 {
@@ -317,6 +749,15 @@ abts_suite *testskiplist(abts_suite *suite)
     abts_run_test(suite, skiplist_random_loop, NULL);
 
     abts_run_test(suite, skiplist_test, NULL);
+    abts_run_test(suite, skiplist_order, NULL);
+    abts_run_test(suite, skiplist_index, NULL);
+    abts_run_test(suite, skiplist_bulk_load, NULL);
+    abts_run_test(suite, skiplist_range, NULL);
+#if APR_HAS_THREADS
+    abts_run_test(suite, skiplist_concurrent, NULL);
+    abts_run_test(suite, skiplist_concurrent_free, NULL);
+    abts_run_test(suite, skiplist_concurrent_iter, NULL);
+#endif
 
     apr_pool_destroy(ptmp);
 
@@ -19,6 +19,9 @@
 #include "apr.h"
 #include "apr_general.h"
 #include "apr_strmatch.h"
+#include "apr_lib.h"
+#include "apr_time.h"
+#include "apr_strings.h"
 #if APR_HAVE_STDLIB_H
 #include <stdlib.h>
 #endif
@@ -81,11 +84,308 @@ static void test_str(abts_case *tc, void *data)
     ABTS_PTR_EQUAL(tc, input6 + 35, match);
 }
 
+static const char *naive_match(const char *pat, const char *s,
+                               apr_size_t slen, int case_sensitive)
+{
+    apr_size_t len = strlen(pat), i, j;
+
+    for (i = 0; i + len <= slen; i++) {
+        for (j = 0; j < len; j++) {
+            if (case_sensitive ? s[i + j] != pat[j]
+                : apr_tolower(s[i + j]) != apr_tolower(pat[j])) {
+                break;
+            }
+        }
+        if (j == len) {
+            return s + i;
+        }
+    }
+    return NULL;
+}
+
+/* Random patterns and strings on a small alphabet, so that there are many
+ * partial matches, of all the lengths around the SIMD blocks' ones.
+ */
+static void test_random(abts_case *tc, void *data)
+{
+    static const char alphabet[] = "abAB\200";
+    char buf[256], pat[48];
+    int i;
+
+    srand(42);
+    for (i = 0; i < 20000; i++) {
+        const apr_strmatch_pattern *pattern;
+        apr_size_t plen = 1 + rand() % 40, slen = rand() % sizeof(buf), j;
+        int case_sensitive = rand() % 2;
+
+        for (j = 0; j < plen; j++) {
+            pat[j] = alphabet[rand() % (sizeof(alphabet) - 1)];
+        }
+        pat[plen] = '\0';
+        for (j = 0; j < slen; j++) {
+            buf[j] = alphabet[rand() % (sizeof(alphabet) - 1)];
+        }
+        /* Plant the pattern somewhere half of the time */
+        if (rand() % 2 && plen <= slen) {
+            memcpy(buf + rand() % (slen - plen + 1), pat, plen);
+        }
+
+        pattern = apr_strmatch_precompile(p, pat, case_sensitive);
+        ABTS_PTR_NOTNULL(tc, pattern);
+        ABTS_PTR_EQUAL(tc, naive_match(pat, buf, slen, case_sensitive),
+                       apr_strmatch(pattern, buf, slen));
+    }
+}
+
+static void test_perf(abts_case *tc, void *data)
+{
+    const apr_size_t len = 1024 * 1024;
+    const char *needle = "Content-Disposition: attachment";
+    const apr_strmatch_pattern *pattern, *pattern_nocase;
+    const char *match;
+    apr_time_t start, case_time, nocase_time, strstr_time;
+    char *buf;
+    apr_size_t i;
+    int n;
+
+    /* Some text looking like HTTP headers, without the needle */
+    buf = apr_palloc(p, len + 1);
+    for (i = 0; i < len; i++) {
+        buf[i] = "Content-Type: text/html; charset=utf-8\r\n"[i % 40];
+    }
+    buf[len] = '\0';
+
+    pattern = apr_strmatch_precompile(p, needle, 1);
+    pattern_nocase = apr_strmatch_precompile(p, needle, 0);
+
+    start = apr_time_now();
+    for (n = 0; n < 20; n++) {
+        match = apr_strmatch(pattern, buf, len);
+        ABTS_PTR_EQUAL(tc, NULL, match);
+    }
+    case_time = apr_time_now() - start;
+
+    start = apr_time_now();
+    for (n = 0; n < 20; n++) {
+        match = apr_strmatch(pattern_nocase, buf, len);
+        ABTS_PTR_EQUAL(tc, NULL, match);
+    }
+    nocase_time = apr_time_now() - start;
+
+    start = apr_time_now();
+    for (n = 0; n < 20; n++) {
+        match = strstr(buf, needle);
+        ABTS_PTR_EQUAL(tc, NULL, match);
+    }
+    strstr_time = apr_time_now() - start;
+
+    abts_log_message("20 searches in 1MB: apr_strmatch %" APR_TIME_T_FMT "us, "
+                     "nocase %" APR_TIME_T_FMT "us, strstr %"
+                     APR_TIME_T_FMT "us",
+                     case_time, nocase_time, strstr_time);
+}
+
+typedef struct multi_match_t {
+    int id;
+    apr_off_t offset;
+} multi_match_t;
+
+typedef struct multi_matches_t {
+    multi_match_t m[64];
+    int n;
+    /* Stop after this number of matches */
+    int stop;
+} multi_matches_t;
+
+static int multi_collect(void *rec, int id, apr_off_t offset)
+{
+    multi_matches_t *matches = rec;
+
+    if (matches->n < 64) {
+        matches->m[matches->n].id = id;
+        matches->m[matches->n].offset = offset;
+    }
+    matches->n++;
+    return matches->n != matches->stop;
+}
+
+static void test_multi(abts_case *tc, void *data)
+{
+    static const char * const patterns[] = {
+        "he", "she", "his", "hers", "she"
+    };
+    const apr_strmatch_multi_t *multi;
+    apr_strmatch_multi_state_t state;
+    multi_matches_t matches;
+    const char *match;
+    int id;
+
+    multi = apr_strmatch_multi_precompile(p, patterns, 5, 1);
+    ABTS_PTR_NOTNULL(tc, multi);
+
+    match = apr_strmatch_multi_first(multi, "ushers", 6, &id);
+    ABTS_STR_EQUAL(tc, "shers", match);
+    ABTS_INT_EQUAL(tc, 1, id);
+    match = apr_strmatch_multi_first(multi, "ushe", 3, &id);
+    ABTS_PTR_EQUAL(tc, NULL, match);
+    match = apr_strmatch_multi_first(multi, "this", 4, &id);
+    ABTS_STR_EQUAL(tc, "his", match);
+    ABTS_INT_EQUAL(tc, 2, id);
+    match = apr_strmatch_multi_first(multi, "USHERS", 6, &id);
+    ABTS_PTR_EQUAL(tc, NULL, match);
+
+    /* All the matches, by end then longest first, over two buffers */
+    memset(&matches, 0, sizeof(matches));
+    apr_strmatch_multi_state_init(&state);
+    ABTS_INT_EQUAL(tc, 1, apr_strmatch_multi_exec(multi, &state, "ush", 3,
+                                                  multi_collect, &matches));
+    ABTS_INT_EQUAL(tc, 0, matches.n);
+    ABTS_INT_EQUAL(tc, 1, apr_strmatch_multi_exec(multi, &state, "ers", 3,
+                                                  multi_collect, &matches));
+    ABTS_INT_EQUAL(tc, 4, matches.n);
+    ABTS_INT_EQUAL(tc, 1, matches.m[0].id);
+    ABTS_INT_EQUAL(tc, 1, (int)matches.m[0].offset);
+    ABTS_INT_EQUAL(tc, 4, matches.m[1].id);
+    ABTS_INT_EQUAL(tc, 1, (int)matches.m[1].offset);
+    ABTS_INT_EQUAL(tc, 0, matches.m[2].id);
+    ABTS_INT_EQUAL(tc, 2, (int)matches.m[2].offset);
+    ABTS_INT_EQUAL(tc, 3, matches.m[3].id);
+    ABTS_INT_EQUAL(tc, 2, (int)matches.m[3].offset);
+    ABTS_INT_EQUAL(tc, 6, (int)state.offset);
+
+    /* Stopped at the first match, resumed after it */
+    memset(&matches, 0, sizeof(matches));
+    matches.stop = 1;
+    apr_strmatch_multi_state_init(&state);
+    ABTS_INT_EQUAL(tc, 0, apr_strmatch_multi_exec(multi, &state, "ushers", 6,
+                                                  multi_collect, &matches));
+    ABTS_INT_EQUAL(tc, 4, (int)state.offset);
+    matches.stop = 0;
+    ABTS_INT_EQUAL(tc, 1, apr_strmatch_multi_exec(multi, &state, "rs", 2,
+                                                  multi_collect, &matches));
+    ABTS_INT_EQUAL(tc, 2, matches.n);
+    ABTS_INT_EQUAL(tc, 3, matches.m[1].id);
+    ABTS_INT_EQUAL(tc, 2, (int)matches.m[1].offset);
+
+    multi = apr_strmatch_multi_precompile(p, patterns, 5, 0);
+    ABTS_PTR_NOTNULL(tc, multi);
+    match = apr_strmatch_multi_first(multi, "USHERS", 6, &id);
+    ABTS_STR_EQUAL(tc, "SHERS", match);
+    ABTS_INT_EQUAL(tc, 1, id);
+
+    ABTS_PTR_EQUAL(tc, NULL, apr_strmatch_multi_precompile(p, patterns, 0, 1));
+    {
+        static const char * const empty[] = { "a", "" };
+        ABTS_PTR_EQUAL(tc, NULL, apr_strmatch_multi_precompile(p, empty, 2,
+                                                               1));
+    }
+}
+
+typedef struct multi_count_t {
+    const char * const *patterns;
+    const char *buf;
+    int case_sensitive;
+    int n;
+    int bad;
+} multi_count_t;
+
+static int multi_check(void *rec, int id, apr_off_t offset)
+{
+    multi_count_t *count = rec;
+    const char *pat = count->patterns[id];
+    apr_size_t len = strlen(pat);
+
+    if (naive_match(pat, count->buf + offset, len,
+                    count->case_sensitive) == NULL) {
+        count->bad++;
+    }
+    count->n++;
+    return 1;
+}
+
+/* Random patterns, enough of them for 32-bit states, searched in random
+ * chunks of a random string: each match reported is one, and they are
+ * all reported.
+ */
+static void test_multi_random(abts_case *tc, void *data)
+{
+    static const char alphabet[] = "abcD";
+    const int npatterns = 3000;
+    const apr_size_t len = 20000;
+    char **patterns, *buf;
+    int i, round;
+
+    srand(4242);
+    patterns = apr_palloc(p, npatterns * sizeof(*patterns));
+    buf = apr_palloc(p, len + 1);
+    for (round = 0; round < 4; round++) {
+        int npat = round < 2 ? 50 : npatterns;
+        int case_sensitive = round % 2;
+        const apr_strmatch_multi_t *multi;
+        apr_strmatch_multi_state_t state;
+        multi_count_t count;
+        apr_size_t j, k;
+        int expected = 0;
+
+        for (i = 0; i < npat; i++) {
+            /* Short ones (which match) and long ones (which make states) */
+            apr_size_t plen = (i % 2) ? 1 + rand() % 6 : 60 + rand() % 30;
+
+            patterns[i] = apr_palloc(p, plen + 1);
+            for (j = 0; j < plen; j++) {
+                patterns[i][j] = alphabet[rand() % 4];
+                if (!case_sensitive && rand() % 2) {
+                    patterns[i][j] = apr_toupper(patterns[i][j]);
+                }
+            }
+            patterns[i][plen] = '\0';
+        }
+        for (j = 0; j < len; j++) {
+            buf[j] = alphabet[rand() % 4];
+        }
+        buf[len] = '\0';
+
+        for (i = 0; i < npat; i++) {
+            const char *s = buf, *end = buf + len;
+
+            while ((s = naive_match(patterns[i], s, end - s,
+                                    case_sensitive)) != NULL) {
+                expected++;
+                s++;
+            }
+        }
+
+        multi = apr_strmatch_multi_precompile(p, (const char * const *)patterns,
+                                              npat, case_sensitive);
+        ABTS_PTR_NOTNULL(tc, multi);
+
+        count.patterns = (const char * const *)patterns;
+        count.buf = buf;
+        count.case_sensitive = case_sensitive;
+        count.n = count.bad = 0;
+        apr_strmatch_multi_state_init(&state);
+        for (j = 0; j < len; j += k) {
+            k = 1 + rand() % 100;
+            if (k > len - j) {
+                k = len - j;
+            }
+            apr_strmatch_multi_exec(multi, &state, buf + j, k,
+                                    multi_check, &count);
+        }
+        ABTS_INT_EQUAL(tc, 0, count.bad);
+        ABTS_INT_EQUAL(tc, expected, count.n);
+    }
+}
+
 abts_suite *teststrmatch(abts_suite *suite)
 {
     suite = ADD_SUITE(suite);
 
     abts_run_test(suite, test_str, NULL);
+    abts_run_test(suite, test_random, NULL);
+    abts_run_test(suite, test_perf, NULL);
+    abts_run_test(suite, test_multi, NULL);
+    abts_run_test(suite, test_multi_random, NULL);
 
     return suite;
 }
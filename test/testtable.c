@@ -20,6 +20,9 @@
 #include "apr_general.h"
 #include "apr_pools.h"
 #include "apr_tables.h"
+#if APR_HAS_THREADS
+#include "apr_thread_pool.h"
+#endif
 #if APR_HAVE_STDIO_H
 #include <stdio.h>
 #endif
@@ -42,6 +45,255 @@ static void array_clear(abts_case *tc, void *data)
     ABTS_INT_EQUAL(tc, 0, a1->nelts);
 }
 
+static void array_push_n(abts_case *tc, void *data)
+{
+    apr_array_header_t *a;
+    int *elts, i;
+
+    a = apr_array_make(p, 1, sizeof(int));
+    APR_ARRAY_PUSH(a, int) = 42;
+    elts = apr_array_push_n(a, 100);
+    for (i = 0; i < 100; i++) {
+        elts[i] = i;
+    }
+    ABTS_INT_EQUAL(tc, 101, a->nelts);
+    ABTS_TRUE(tc, a->nalloc >= 101);
+    ABTS_INT_EQUAL(tc, 42, APR_ARRAY_IDX(a, 0, int));
+    ABTS_INT_EQUAL(tc, 99, APR_ARRAY_IDX(a, 100, int));
+
+    apr_array_reserve(a, 1000);
+    ABTS_INT_EQUAL(tc, 1000, a->nalloc);
+    ABTS_INT_EQUAL(tc, 101, a->nelts);
+    ABTS_INT_EQUAL(tc, 99, APR_ARRAY_IDX(a, 100, int));
+    /* never shrinks */
+    apr_array_reserve(a, 10);
+    ABTS_INT_EQUAL(tc, 1000, a->nalloc);
+}
+
+#define ARRAY_BIG_NELTS 200000
+
+static apr_size_t array_in_use(apr_pool_t *pool)
+{
+    apr_allocator_stats_t stats;
+
+    apr_allocator_stats_get(&stats, apr_pool_allocator_get(pool));
+    return stats.allocated - stats.free;
+}
+
+static void array_allocator(abts_case *tc, void *data)
+{
+    apr_pool_t *pool1, *pool2;
+    apr_allocator_t *allocator1, *allocator2;
+    apr_array_header_t *a1, *a2, *a3;
+    apr_size_t used1, used2;
+    int i, ok;
+
+    /* Apart, to compare the memory used */
+    apr_allocator_create(&allocator1);
+    apr_allocator_create(&allocator2);
+    apr_pool_create_ex(&pool1, NULL, NULL, allocator1);
+    apr_pool_create_ex(&pool2, NULL, NULL, allocator2);
+    apr_allocator_owner_set(allocator1, pool1);
+    apr_allocator_owner_set(allocator2, pool2);
+
+    a1 = apr_array_make(pool1, 1, sizeof(int));
+    a2 = apr_array_make_ex(pool2, 1, sizeof(int), NULL);
+    for (i = 0; i < ARRAY_BIG_NELTS; i++) {
+        APR_ARRAY_PUSH(a1, int) = i;
+        APR_ARRAY_PUSH(a2, int) = i;
+    }
+    for (ok = 0, i = 0; i < ARRAY_BIG_NELTS; i++) {
+        ok += APR_ARRAY_IDX(a2, i, int) == i;
+    }
+    ABTS_INT_EQUAL(tc, ARRAY_BIG_NELTS, ok);
+
+    /* The previous elements went back to the allocator */
+    used1 = array_in_use(pool1);
+    used2 = array_in_use(pool2);
+    ABTS_TRUE(tc, used2 < used1);
+
+    /* The other operations work the same */
+    a3 = apr_array_copy(p, a2);
+    apr_array_cat(a2, a3);
+    ABTS_INT_EQUAL(tc, 2 * ARRAY_BIG_NELTS, a2->nelts);
+    ABTS_INT_EQUAL(tc, ARRAY_BIG_NELTS - 1,
+                   APR_ARRAY_IDX(a2, 2 * ARRAY_BIG_NELTS - 1, int));
+    ABTS_INT_EQUAL(tc, ARRAY_BIG_NELTS - 1, *(int *)apr_array_pop(a2));
+    apr_array_clear(a2);
+    ABTS_INT_EQUAL(tc, 0, a2->nelts);
+
+    apr_pool_destroy(pool1);
+    apr_pool_destroy(pool2);
+}
+
+/* Headers made by hand (or copied) grow out of their pool, whatever is in
+ * their allocator fields
+ */
+static void array_hand_built(abts_case *tc, void *data)
+{
+    apr_array_header_t *a, copy, hand;
+    int elts[2] = { 1, 2 };
+    int i;
+
+    a = apr_array_make_ex(p, 2, sizeof(int), NULL);
+    APR_ARRAY_PUSH(a, int) = 1;
+    copy = *a;
+    for (i = 0; i < 100; i++) {
+        APR_ARRAY_PUSH(&copy, int) = i;
+    }
+    ABTS_INT_EQUAL(tc, 101, copy.nelts);
+    ABTS_INT_EQUAL(tc, 1, a->nelts);
+    ABTS_INT_EQUAL(tc, 1, APR_ARRAY_IDX(a, 0, int));
+
+    memset(&hand, 0x5a, sizeof(hand));
+    hand.pool = p;
+    hand.elt_size = sizeof(int);
+    hand.nelts = hand.nalloc = 2;
+    hand.elts = (char *)elts;
+    APR_ARRAY_PUSH(&hand, int) = 3;
+    ABTS_INT_EQUAL(tc, 3, hand.nelts);
+    ABTS_INT_EQUAL(tc, 2, APR_ARRAY_IDX(&hand, 1, int));
+    ABTS_INT_EQUAL(tc, 3, APR_ARRAY_IDX(&hand, 2, int));
+}
+
+static int int_cmp(const void *a, const void *b)
+{
+    int x = *(const int *)a, y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+typedef struct {
+    char name[20];
+    int seq;
+} record_t;
+
+static int record_cmp(const void *a, const void *b)
+{
+    return strcmp(((const record_t *)a)->name, ((const record_t *)b)->name);
+}
+
+#define SORT_NELTS 100000
+
+static int sorted_ints(const apr_array_header_t *a)
+{
+    int i;
+
+    for (i = 1; i < a->nelts; i++) {
+        if (APR_ARRAY_IDX(a, i - 1, int) > APR_ARRAY_IDX(a, i, int)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void array_sort(abts_case *tc, void *data)
+{
+    apr_array_header_t *a, *r;
+    apr_uint32_t x = 2463534242u;
+    int i, key, *found;
+    record_t *rec;
+
+    /* Random, sorted, reversed and all equal */
+    a = apr_array_make(p, SORT_NELTS, sizeof(int));
+    for (i = 0; i < SORT_NELTS; i++) {
+        x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+        APR_ARRAY_PUSH(a, int) = (int)(x % 50000);
+    }
+    apr_array_sort(a, int_cmp);
+    ABTS_TRUE(tc, sorted_ints(a));
+    apr_array_sort(a, int_cmp);
+    ABTS_TRUE(tc, sorted_ints(a));
+    for (i = 0; i < SORT_NELTS; i++) {
+        APR_ARRAY_IDX(a, i, int) = SORT_NELTS - i;
+    }
+    apr_array_sort(a, int_cmp);
+    ABTS_TRUE(tc, sorted_ints(a));
+    ABTS_INT_EQUAL(tc, 1, APR_ARRAY_IDX(a, 0, int));
+    for (i = 0; i < SORT_NELTS; i++) {
+        APR_ARRAY_IDX(a, i, int) = 7;
+    }
+    apr_array_sort(a, int_cmp);
+    ABTS_TRUE(tc, sorted_ints(a));
+
+    /* Searches */
+    for (i = 0; i < SORT_NELTS; i++) {
+        APR_ARRAY_IDX(a, i, int) = 2 * (i / 2);
+    }
+    key = 10;
+    ABTS_INT_EQUAL(tc, 10, apr_array_lower_bound(a, &key, int_cmp));
+    found = apr_array_bsearch(a, &key, int_cmp);
+    ABTS_PTR_EQUAL(tc, &APR_ARRAY_IDX(a, 10, int), found);
+    key = 11;
+    ABTS_INT_EQUAL(tc, 12, apr_array_lower_bound(a, &key, int_cmp));
+    ABTS_PTR_EQUAL(tc, NULL, apr_array_bsearch(a, &key, int_cmp));
+    key = SORT_NELTS;
+    ABTS_INT_EQUAL(tc, SORT_NELTS, apr_array_lower_bound(a, &key, int_cmp));
+    ABTS_PTR_EQUAL(tc, NULL, apr_array_bsearch(a, &key, int_cmp));
+    key = -1;
+    ABTS_INT_EQUAL(tc, 0, apr_array_lower_bound(a, &key, int_cmp));
+
+    /* Bigger elements */
+    r = apr_array_make(p, 1000, sizeof(record_t));
+    for (i = 0; i < 1000; i++) {
+        rec = apr_array_push(r);
+        apr_snprintf(rec->name, sizeof(rec->name), "record-%d",
+                     (i * 7919) % 1000);
+        rec->seq = i;
+    }
+    apr_array_sort(r, record_cmp);
+    for (key = 0, i = 1; i < r->nelts; i++) {
+        key += record_cmp(&APR_ARRAY_IDX(r, i - 1, record_t),
+                          &APR_ARRAY_IDX(r, i, record_t)) < 0;
+    }
+    ABTS_INT_EQUAL(tc, 999, key);
+    rec = apr_array_bsearch(r, "record-500", record_cmp);
+    ABTS_PTR_NOTNULL(tc, rec);
+    if (rec) {
+        ABTS_STR_EQUAL(tc, "record-500", rec->name);
+        ABTS_INT_EQUAL(tc, 500, (rec->seq * 7919) % 1000);
+    }
+}
+
+#if APR_HAS_THREADS
+static void array_sort_parallel(abts_case *tc, void *data)
+{
+    apr_thread_pool_t *tp;
+    apr_array_header_t *a, *b, *c;
+    apr_uint32_t x = 88172645u;
+    int i, same;
+
+    a = apr_array_make(p, 10 * SORT_NELTS, sizeof(int));
+    for (i = 0; i < 10 * SORT_NELTS; i++) {
+        x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+        APR_ARRAY_PUSH(a, int) = (int)x;
+    }
+    b = apr_array_copy(p, a);
+    c = apr_array_copy(p, a);
+
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, apr_thread_pool_create(&tp, 0, 4, p));
+
+    qsort(a->elts, a->nelts, a->elt_size, int_cmp);
+    apr_array_sort(b, int_cmp);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, apr_array_sort_parallel(c, int_cmp, tp));
+
+    for (same = 0, i = 0; i < a->nelts; i++) {
+        same += APR_ARRAY_IDX(a, i, int) == APR_ARRAY_IDX(b, i, int)
+                && APR_ARRAY_IDX(a, i, int) == APR_ARRAY_IDX(c, i, int);
+    }
+    ABTS_INT_EQUAL(tc, a->nelts, same);
+
+    /* Odd sizes, and too small to be parallel */
+    for (i = 3; i < 10 * SORT_NELTS; i = i * 3 + 1) {
+        a->nelts = i;
+        ABTS_INT_EQUAL(tc, APR_SUCCESS,
+                       apr_array_sort_parallel(a, int_cmp, tp));
+        ABTS_TRUE(tc, sorted_ints(a));
+    }
+
+    apr_thread_pool_destroy(tp);
+}
+#endif
+
 static void table_make(abts_case *tc, void *data)
 {
     t1 = apr_table_make(p, 5);
@@ -73,6 +325,15 @@ static void table_getm(abts_case *tc, void *data)
     val = apr_table_getm(subp, t1, "foo");
     ABTS_STR_EQUAL(tc, "bar,baz", val);
 
+    /* NULL values are skipped until the first value, empty afterwards */
+    apr_table_addn(t1, "nul", NULL);
+    ABTS_PTR_EQUAL(tc, NULL, apr_table_getm(subp, t1, "nul"));
+    apr_table_addn(t1, "nul", "x");
+    apr_table_addn(t1, "nul", NULL);
+    apr_table_addn(t1, "nul", "y");
+    ABTS_STR_EQUAL(tc, "x,,y", apr_table_getm(subp, t1, "nul"));
+    apr_table_unset(t1, "nul");
+
     apr_pool_destroy(subp);
 }
 
@@ -199,11 +460,144 @@ static void table_overlap2(abts_case *tc, void *data)
 
 }
 
+static void table_len(abts_case *tc, void *data)
+{
+    apr_table_t *t, *t2;
+    const apr_array_header_t *arr;
+    apr_table_entry_t *elts;
+
+    t = apr_table_make(p, 4);
+    apr_table_setn_len(t, "Content-Type", 12, "text/html", 9);
+    apr_table_addn_len(t, "Vary", 4, "Accept", 6);
+    apr_table_addn_len(t, "vary", 4, "", 0);
+    apr_table_addn_len(t, "VARY", 4, "Cookie", 6);
+    ABTS_STR_EQUAL(tc, "text/html", apr_table_get(t, "content-type"));
+    ABTS_STR_EQUAL(tc, "Accept,,Cookie", apr_table_getm(p, t, "Vary"));
+
+    apr_table_setn_len(t, "content-type", 12, "text/plain", 10);
+    ABTS_INT_EQUAL(tc, 4, apr_table_elts(t)->nelts);
+    apr_table_merge(t, "Content-Type", "charset=utf-8");
+    ABTS_STR_EQUAL(tc, "text/plain, charset=utf-8",
+                   apr_table_get(t, "Content-Type"));
+
+    /* Clones and compression keep the values right */
+    t2 = apr_table_clone(p, t);
+    apr_table_compress(t2, APR_OVERLAP_TABLES_MERGE);
+    arr = apr_table_elts(t2);
+    elts = (apr_table_entry_t *)arr->elts;
+    ABTS_INT_EQUAL(tc, 2, arr->nelts);
+    ABTS_STR_EQUAL(tc, "Content-Type", elts[0].key);
+    ABTS_STR_EQUAL(tc, "Vary", elts[1].key);
+    ABTS_STR_EQUAL(tc, "Accept, , Cookie", elts[1].val);
+    apr_table_merge(t2, "Vary", "Origin");
+    ABTS_STR_EQUAL(tc, "Accept, , Cookie, Origin",
+                   apr_table_get(t2, "vary"));
+
+    /* Values changed in place are measured again */
+    elts[1].val = "Host";
+    apr_table_merge(t2, "Vary", "Origin");
+    ABTS_STR_EQUAL(tc, "Host, Origin", apr_table_get(t2, "vary"));
+
+    apr_table_compress(t, APR_OVERLAP_TABLES_SET);
+    ABTS_STR_EQUAL(tc, "Cookie", apr_table_get(t, "Vary"));
+    apr_table_mergen(t, "Vary", "Origin");
+    ABTS_STR_EQUAL(tc, "Cookie, Origin", apr_table_get(t, "Vary"));
+}
+
+#define BIG_NELTS 200
+
+static int count_do(void *rec, const char *key, const char *val)
+{
+    (*(int *)rec)++;
+    return 1;
+}
+
+static void table_big(abts_case *tc, void *data)
+{
+    const apr_array_header_t *arr;
+    apr_table_t *t, *t2;
+    char **keys;
+    int i, found, count;
+
+    /* Same first characters, to defeat the first character index */
+    t = apr_table_make(p, 1);
+    keys = apr_palloc(p, BIG_NELTS * sizeof(char *));
+    for (i = 0; i < BIG_NELTS; i++) {
+        keys[i] = apr_psprintf(p, "X-Forwarded-%d", i);
+        apr_table_setn(t, keys[i], keys[i]);
+    }
+    ABTS_INT_EQUAL(tc, BIG_NELTS, apr_table_elts(t)->nelts);
+
+    for (found = 0, i = 0; i < BIG_NELTS; i++) {
+        const char *key = apr_psprintf(p, "x-FORWARDED-%d", i);
+        found += apr_table_get(t, key) == keys[i];
+    }
+    ABTS_INT_EQUAL(tc, BIG_NELTS, found);
+    ABTS_PTR_EQUAL(tc, NULL, apr_table_get(t, "X-Forwarded-"));
+    ABTS_PTR_EQUAL(tc, NULL, apr_table_get(t, "X-Forwarded-2000"));
+
+    /* Duplicates: get returns the first, set and unset handle all */
+    apr_table_addn(t, "x-forwarded-10", "dup1");
+    apr_table_addn(t, "X-Forwarded-10", "dup2");
+    ABTS_STR_EQUAL(tc, keys[10], apr_table_get(t, "X-FORWARDED-10"));
+    count = 0;
+    apr_table_do(count_do, &count, t, "X-Forwarded-10", NULL);
+    ABTS_INT_EQUAL(tc, 3, count);
+    apr_table_set(t, "X-Forwarded-10", "one");
+    ABTS_INT_EQUAL(tc, BIG_NELTS, apr_table_elts(t)->nelts);
+    ABTS_STR_EQUAL(tc, "one", apr_table_get(t, "X-Forwarded-10"));
+
+    apr_table_unset(t, "X-Forwarded-0");
+    apr_table_unset(t, "x-forwarded-199");
+    ABTS_INT_EQUAL(tc, BIG_NELTS - 2, apr_table_elts(t)->nelts);
+    ABTS_PTR_EQUAL(tc, NULL, apr_table_get(t, "X-Forwarded-0"));
+    ABTS_PTR_EQUAL(tc, NULL, apr_table_get(t, "X-Forwarded-199"));
+    ABTS_STR_EQUAL(tc, keys[100], apr_table_get(t, "X-Forwarded-100"));
+
+    /* The order of the entries is kept */
+    arr = apr_table_elts(t);
+    ABTS_STR_EQUAL(tc, "X-Forwarded-1",
+                   ((apr_table_entry_t *)arr->elts)[0].key);
+    ABTS_STR_EQUAL(tc, "X-Forwarded-198",
+                   ((apr_table_entry_t *)arr->elts)[arr->nelts - 1].key);
+
+    apr_table_mergen(t, "X-Forwarded-5", "more");
+    ABTS_STR_EQUAL(tc, "X-Forwarded-5, more",
+                   apr_table_get(t, "X-Forwarded-5"));
+
+    /* Copies and overlays get their own index */
+    t2 = apr_table_copy(p, t);
+    apr_table_setn(t2, "X-Forwarded-6", "six");
+    ABTS_STR_EQUAL(tc, "six", apr_table_get(t2, "X-Forwarded-6"));
+    ABTS_STR_EQUAL(tc, keys[6], apr_table_get(t, "X-Forwarded-6"));
+
+    t2 = apr_table_overlay(p, t2, t);
+    ABTS_STR_EQUAL(tc, "six", apr_table_get(t2, "X-Forwarded-6"));
+    apr_table_compress(t2, APR_OVERLAP_TABLES_MERGE);
+    ABTS_INT_EQUAL(tc, BIG_NELTS - 2, apr_table_elts(t2)->nelts);
+    ABTS_STR_EQUAL(tc, "six, X-Forwarded-6",
+                   apr_table_get(t2, "X-Forwarded-6"));
+    ABTS_STR_EQUAL(tc, "X-Forwarded-7, X-Forwarded-7",
+                   apr_table_get(t2, "X-Forwarded-7"));
+
+    apr_table_clear(t);
+    ABTS_PTR_EQUAL(tc, NULL, apr_table_get(t, "X-Forwarded-1"));
+    apr_table_setn(t, "X-Forwarded-1", "back");
+    ABTS_STR_EQUAL(tc, "back", apr_table_get(t, "X-Forwarded-1"));
+}
+
 abts_suite *testtable(abts_suite *suite)
 {
     suite = ADD_SUITE(suite)
 
     abts_run_test(suite, array_clear, NULL);
+    abts_run_test(suite, array_push_n, NULL);
+    abts_run_test(suite, array_allocator, NULL);
+    abts_run_test(suite, array_hand_built, NULL);
+    abts_run_test(suite, array_sort, NULL);
+#if APR_HAS_THREADS
+    abts_run_test(suite, array_sort_parallel, NULL);
+#endif
     abts_run_test(suite, table_make, NULL);
     abts_run_test(suite, table_get, NULL);
     abts_run_test(suite, table_getm, NULL);
@@ -215,6 +609,8 @@ abts_suite *testtable(abts_suite *suite)
     abts_run_test(suite, table_unset, NULL);
     abts_run_test(suite, table_overlap, NULL);
     abts_run_test(suite, table_overlap2, NULL);
+    abts_run_test(suite, table_len, NULL);
+    abts_run_test(suite, table_big, NULL);
 
     return suite;
 }
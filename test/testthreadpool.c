@@ -0,0 +1,256 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "apr_thread_pool.h"
+#include "apr_atomic.h"
+#include "apr_time.h"
+#include "abts.h"
+#include "testutil.h"
+
+#if APR_HAS_THREADS
+
+#define FANOUT 4
+#define DEPTH  5
+/* 1 + 4 + 16 + 64 + 256 + 1024 */
+#define FANOUT_TASKS 1365
+
+static apr_thread_pool_t *thrp;
+static volatile apr_uint32_t tasks_done;
+static volatile apr_uint32_t pushes_done;
+
+static void * APR_THREAD_FUNC fanout_task(apr_thread_t *thd, void *data)
+{
+    apr_uintptr_t depth = (apr_uintptr_t)data;
+    int i;
+
+    if (depth < DEPTH) {
+        for (i = 0; i < FANOUT; i++) {
+            apr_thread_pool_push(thrp, fanout_task, (void *)(depth + 1),
+                                 (apr_byte_t)(depth * 50), NULL);
+        }
+    }
+    apr_atomic_inc32(&tasks_done);
+
+    return NULL;
+}
+
+static int wait_for(volatile apr_uint32_t *counter, apr_uint32_t value)
+{
+    int i;
+
+    for (i = 0; i < 1000 && apr_atomic_read32(counter) < value; i++) {
+        apr_sleep(10000);
+    }
+    return apr_atomic_read32(counter) == value;
+}
+
+static void test_work_stealing(abts_case *tc, void *data)
+{
+    apr_status_t rv;
+    int i;
+
+    rv = apr_thread_pool_create_ex(&thrp, 2, 4, APR_THREAD_POOL_WORK_STEALING,
+                                   p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    /* a few times, to go through idle workers stealing */
+    for (i = 0; i < 3; i++) {
+        apr_atomic_set32(&tasks_done, 0);
+        rv = apr_thread_pool_push(thrp, fanout_task, (void *)0,
+                                  APR_THREAD_TASK_PRIORITY_NORMAL, NULL);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+        ABTS_TRUE(tc, wait_for(&tasks_done, FANOUT_TASKS));
+    }
+
+    ABTS_INT_EQUAL(tc, 0, apr_thread_pool_tasks_count(thrp));
+    ABTS_TRUE(tc, apr_thread_pool_threads_count(thrp) <= 4);
+
+    rv = apr_thread_pool_destroy(thrp);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+}
+
+static char cancelled_owner;
+
+static void * APR_THREAD_FUNC cancelled_task(apr_thread_t *thd, void *data)
+{
+    apr_sleep(1000);
+    apr_atomic_inc32(&tasks_done);
+    return NULL;
+}
+
+static void * APR_THREAD_FUNC pushing_task(apr_thread_t *thd, void *data)
+{
+    int i;
+
+    for (i = 0; i < 200; i++) {
+        apr_thread_pool_push(thrp, cancelled_task, NULL,
+                             APR_THREAD_TASK_PRIORITY_NORMAL,
+                             &cancelled_owner);
+    }
+    apr_atomic_set32(&pushes_done, 1);
+
+    return NULL;
+}
+
+static void test_work_stealing_cancel(abts_case *tc, void *data)
+{
+    apr_uint32_t done;
+    apr_status_t rv;
+
+    rv = apr_thread_pool_create_ex(&thrp, 2, 2, APR_THREAD_POOL_WORK_STEALING,
+                                   p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    apr_atomic_set32(&tasks_done, 0);
+    apr_atomic_set32(&pushes_done, 0);
+    rv = apr_thread_pool_push(thrp, pushing_task, NULL,
+                              APR_THREAD_TASK_PRIORITY_NORMAL, NULL);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_TRUE(tc, wait_for(&pushes_done, 1));
+
+    rv = apr_thread_pool_tasks_cancel(thrp, &cancelled_owner);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    /* nothing of the owner runs after the cancel */
+    done = apr_atomic_read32(&tasks_done);
+    ABTS_TRUE(tc, done < 200);
+    apr_sleep(50000);
+    ABTS_INT_EQUAL(tc, done, apr_atomic_read32(&tasks_done));
+    ABTS_INT_EQUAL(tc, 0, apr_thread_pool_tasks_count(thrp));
+
+    rv = apr_thread_pool_destroy(thrp);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+}
+
+#define BATCH_TASKS 1000
+
+static apr_thread_pool_group_t *group;
+
+static void * APR_THREAD_FUNC counting_task(apr_thread_t *thd, void *data)
+{
+    apr_atomic_inc32(data);
+    apr_atomic_inc32(&tasks_done);
+    return NULL;
+}
+
+static void * APR_THREAD_FUNC batching_task(apr_thread_t *thd, void *data)
+{
+    apr_thread_pool_push_batch(thrp, counting_task, data, BATCH_TASKS,
+                               APR_THREAD_TASK_PRIORITY_NORMAL, NULL, group);
+    return NULL;
+}
+
+static void test_batch(abts_case *tc, void *data)
+{
+    static volatile apr_uint32_t counters[BATCH_TASKS];
+    void *params[BATCH_TASKS];
+    apr_uint32_t flags = (apr_uint32_t)(apr_uintptr_t)data;
+    apr_status_t rv;
+    int i, round;
+
+    rv = apr_thread_pool_create_ex(&thrp, 0, 4, flags, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_thread_pool_group_create(&group, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, apr_thread_pool_group_poll(group));
+
+    for (i = 0; i < BATCH_TASKS; i++) {
+        counters[i] = 0;
+        params[i] = (void *)&counters[i];
+    }
+
+    /* pushed by this thread, then by a task (to its queue if stealing) */
+    for (round = 0; round < 2; round++) {
+        apr_atomic_set32(&tasks_done, 0);
+        if (round == 0) {
+            rv = apr_thread_pool_push_batch(thrp, counting_task, params,
+                                            BATCH_TASKS,
+                                            APR_THREAD_TASK_PRIORITY_NORMAL,
+                                            NULL, group);
+        }
+        else {
+            rv = apr_thread_pool_push_group(thrp, batching_task, params,
+                                            APR_THREAD_TASK_PRIORITY_NORMAL,
+                                            NULL, group);
+        }
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+        rv = apr_thread_pool_group_wait(group);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, apr_thread_pool_group_poll(group));
+        ABTS_INT_EQUAL(tc, 0, apr_thread_pool_group_pending(group));
+        ABTS_INT_EQUAL(tc, BATCH_TASKS, apr_atomic_read32(&tasks_done));
+    }
+    for (i = 0; i < BATCH_TASKS; i++) {
+        ABTS_INT_EQUAL(tc, 2, counters[i]);
+    }
+
+    rv = apr_thread_pool_destroy(thrp);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+}
+
+static void * APR_THREAD_FUNC sleeping_task(apr_thread_t *thd, void *data)
+{
+    apr_sleep(100000);
+    return NULL;
+}
+
+static void test_group_cancel(abts_case *tc, void *data)
+{
+    apr_status_t rv;
+    int i;
+
+    rv = apr_thread_pool_create(&thrp, 1, 1, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_thread_pool_group_create(&group, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    for (i = 0; i < 10; i++) {
+        rv = apr_thread_pool_push_group(thrp, sleeping_task, NULL,
+                                        APR_THREAD_TASK_PRIORITY_NORMAL,
+                                        &cancelled_owner, group);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+    ABTS_INT_EQUAL(tc, APR_INCOMPLETE, apr_thread_pool_group_poll(group));
+
+    /* the cancelled tasks are done too */
+    rv = apr_thread_pool_tasks_cancel(thrp, &cancelled_owner);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_thread_pool_group_wait(group);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 0, apr_thread_pool_group_pending(group));
+
+    rv = apr_thread_pool_destroy(thrp);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+}
+
+#endif /* APR_HAS_THREADS */
+
+abts_suite *testthreadpool(abts_suite *suite)
+{
+    suite = ADD_SUITE(suite);
+
+#if APR_HAS_THREADS
+    abts_run_test(suite, test_work_stealing, NULL);
+    abts_run_test(suite, test_work_stealing_cancel, NULL);
+    abts_run_test(suite, test_batch, (void *)0);
+    abts_run_test(suite, test_batch,
+                  (void *)(apr_uintptr_t)APR_THREAD_POOL_WORK_STEALING);
+    abts_run_test(suite, test_group_cancel, NULL);
+#endif /* APR_HAS_THREADS */
+
+    return suite;
+}
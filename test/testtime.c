@@ -20,6 +20,7 @@
 #include "apr_lib.h"
 #include "testutil.h"
 #include "apr_strings.h"
+#include "apr_thread_proc.h"
 #include <time.h>
 
 #define STR_SIZE 45
@@ -293,6 +294,170 @@ static void test_2038(abts_case *tc, void *data)
                        apr_time_exp_get(&t, &xt));
 }
 
+static void test_now_monotonic(abts_case *tc, void *data)
+{
+    apr_time_t start, last, t;
+    int i;
+
+    start = last = apr_time_now_monotonic();
+    for (i = 0; i < 100000; i++) {
+        t = apr_time_now_monotonic();
+        ABTS_ASSERT(tc, "monotonic clock went back", t >= last);
+        last = t;
+    }
+    apr_sleep(apr_time_from_msec(10));
+    ABTS_ASSERT(tc, "monotonic clock didn't advance",
+                apr_time_now_monotonic() - start >= apr_time_from_msec(10));
+}
+
+static void test_now_coarse(abts_case *tc, void *data)
+{
+    apr_time_t t, last;
+    int i;
+
+    /* Within the tick (and some scheduling) of the precise clocks */
+    t = apr_time_now_coarse() - apr_time_now();
+    ABTS_ASSERT(tc, "coarse clock too far from apr_time_now()",
+                t < apr_time_from_msec(100) && t > -apr_time_from_msec(100));
+    t = apr_time_now_monotonic_coarse() - apr_time_now_monotonic();
+    ABTS_ASSERT(tc, "coarse clock too far from apr_time_now_monotonic()",
+                t < apr_time_from_msec(100) && t > -apr_time_from_msec(100));
+
+    last = apr_time_now_monotonic_coarse();
+    for (i = 0; i < 100000; i++) {
+        t = apr_time_now_monotonic_coarse();
+        ABTS_ASSERT(tc, "monotonic coarse clock went back", t >= last);
+        last = t;
+    }
+}
+
+static void test_tick(abts_case *tc, void *data)
+{
+    apr_time_t tick, t;
+
+    tick = apr_time_tick();
+    ABTS_TRUE(tc, tick != 0);
+    ABTS_TRUE(tc, apr_time_tick() >= tick);
+
+    apr_sleep(apr_time_from_msec(50));
+    ABTS_TRUE(tc, apr_time_tick() == tick);
+    t = apr_time_tick_update();
+    ABTS_ASSERT(tc, "tick didn't advance",
+                t - tick >= apr_time_from_msec(40));
+    ABTS_TRUE(tc, apr_time_tick() == t);
+}
+
+static void test_common_log_date(abts_case *tc, void *data)
+{
+    apr_status_t rv;
+    apr_time_exp_t xt;
+    char str[STR_SIZE], expected[STR_SIZE];
+    apr_int32_t off;
+
+    rv = apr_common_log_date(str, now);
+    if (rv == APR_ENOTIMPL) {
+        ABTS_NOT_IMPL(tc, "apr_common_log_date");
+    }
+    ABTS_TRUE(tc, rv == APR_SUCCESS);
+
+    apr_time_exp_lt(&xt, now);
+    off = xt.tm_gmtoff < 0 ? -xt.tm_gmtoff : xt.tm_gmtoff;
+    apr_snprintf(expected, sizeof(expected),
+                 "%02d/%s/%d:%02d:%02d:%02d %c%02d%02d", xt.tm_mday, apr_month_snames[xt.tm_mon], xt.tm_year + 1900,
+                 xt.tm_hour, xt.tm_min, xt.tm_sec,
+                 xt.tm_gmtoff < 0 ? '-' : '+', off / 3600, off % 3600 / 60);
+    ABTS_STR_EQUAL(tc, expected, str);
+    ABTS_SIZE_EQUAL(tc, APR_COMMON_LOG_DATE_LEN, strlen(str) + 1);
+}
+
+/* The RFC 822 date of t, without apr_rfc822_date() and its cache */
+static void rfc822_expected(char *str, apr_time_t t)
+{
+    apr_time_exp_t xt;
+    apr_size_t sz;
+
+    apr_time_exp_gmt(&xt, t);
+    apr_strftime(str, &sz, STR_SIZE, "%a, %d %b %Y %H:%M:%S GMT", &xt);
+}
+
+static void test_date_cache(abts_case *tc, void *data)
+{
+    char str[STR_SIZE], expected[STR_SIZE];
+    int i;
+
+    /* Seconds landing in the same cache slots, asked more than once */
+    for (i = 0; i < 400; i++) {
+        apr_time_t t = now + apr_time_from_sec((i % 100) * 16) + i;
+
+        apr_rfc822_date(str, t);
+        rfc822_expected(expected, t);
+        ABTS_STR_EQUAL(tc, expected, str);
+    }
+
+    /* Times before the epoch */
+    for (i = -3; i <= 3; i++) {
+        apr_time_t t = i * (APR_USEC_PER_SEC / 2);
+
+        apr_rfc822_date(str, t);
+        rfc822_expected(expected, t);
+        ABTS_STR_EQUAL(tc, expected, str);
+    }
+    apr_rfc822_date(str, -APR_USEC_PER_SEC);
+    ABTS_STR_EQUAL(tc, "Wed, 31 Dec 1969 23:59:59 GMT", str);
+}
+
+#if APR_HAS_THREADS
+
+#define DATE_THREADS 4
+#define DATE_SECONDS 40
+
+static char date_expected[DATE_SECONDS][STR_SIZE];
+
+static void * APR_THREAD_FUNC date_thread(apr_thread_t *thd, void *data)
+{
+    apr_uint32_t seed = (apr_uint32_t)(apr_uintptr_t)data;
+    apr_size_t errors = 0;
+    char str[STR_SIZE];
+    int i;
+
+    for (i = 0; i < 100000; i++) {
+        int sec;
+
+        seed = seed * 1103515245 + 12345;
+        sec = (seed >> 16) % DATE_SECONDS;
+        apr_rfc822_date(str, now + apr_time_from_sec(sec));
+        if (strcmp(str, date_expected[sec]) != 0) {
+            errors++;
+        }
+    }
+    apr_thread_exit(thd, errors ? APR_EGENERAL : APR_SUCCESS);
+    return NULL;
+}
+
+static void test_date_cache_threads(abts_case *tc, void *data)
+{
+    apr_thread_t *threads[DATE_THREADS];
+    apr_status_t rv, retval;
+    int i;
+
+    for (i = 0; i < DATE_SECONDS; i++) {
+        rfc822_expected(date_expected[i], now + apr_time_from_sec(i));
+    }
+    for (i = 0; i < DATE_THREADS; i++) {
+        rv = apr_thread_create(&threads[i], NULL, date_thread,
+                               (void *)(apr_uintptr_t)(i + 1), p);
+        ABTS_ASSERT(tc, "Failed creating thread", rv == APR_SUCCESS);
+    }
+    for (i = 0; i < DATE_THREADS; i++) {
+        rv = apr_thread_join(&retval, threads[i]);
+        ABTS_ASSERT(tc, "Thread join failed", rv == APR_SUCCESS);
+        ABTS_ASSERT(tc, "Bad date formatted in thread",
+                    retval == APR_SUCCESS);
+    }
+}
+
+#endif /* APR_HAS_THREADS */
+
 abts_suite *testtime(abts_suite *suite)
 {
     suite = ADD_SUITE(suite)
@@ -310,6 +475,14 @@ abts_suite *testtime(abts_suite *suite)
     abts_run_test(suite, test_exp_tz, NULL);
     abts_run_test(suite, test_strftimeoffset, NULL);
     abts_run_test(suite, test_2038, NULL);
+    abts_run_test(suite, test_now_monotonic, NULL);
+    abts_run_test(suite, test_now_coarse, NULL);
+    abts_run_test(suite, test_tick, NULL);
+    abts_run_test(suite, test_common_log_date, NULL);
+    abts_run_test(suite, test_date_cache, NULL);
+#if APR_HAS_THREADS
+    abts_run_test(suite, test_date_cache_threads, NULL);
+#endif
 
     return suite;
 }
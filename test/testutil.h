@@ -131,5 +131,8 @@ abts_suite *testrmm(abts_suite *suite);
 abts_suite *testdbm(abts_suite *suite);
 abts_suite *testlfsabi(abts_suite *suite);
 abts_suite *testskiplist(abts_suite *suite);
+abts_suite *testthreadpool(abts_suite *suite);
+abts_suite *testflathash(abts_suite *suite);
+abts_suite *testradix(abts_suite *suite);
 
 #endif /* APR_TEST_INCLUDES */
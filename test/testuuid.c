@@ -17,6 +17,9 @@
 #include "testutil.h"
 #include "apr_general.h"
 #include "apr_uuid.h"
+#include "apr_tables.h"
+#include "apr_thread_proc.h"
+#include "apr_time.h"
 
 static void test_uuid_parse(abts_case *tc, void *data)
 {
@@ -45,12 +48,192 @@ static void test_gen2(abts_case *tc, void *data)
              memcmp(&uuid, &uuid2, sizeof(uuid)) != 0);
 }
 
+static int uuid_version(const apr_uuid_t *uuid)
+{
+    return uuid->data[6] >> 4;
+}
+
+static int uuid_variant_ok(const apr_uuid_t *uuid)
+{
+    return (uuid->data[8] & 0xC0) == 0x80;
+}
+
+static void test_versions(abts_case *tc, void *data)
+{
+    static const int versions[] = { 1, 4, 7 };
+    apr_uuid_t uuid, uuids[10];
+    int i, j;
+
+    apr_uuid_get_v4(&uuid);
+    ABTS_INT_EQUAL(tc, 4, uuid_version(&uuid));
+    ABTS_TRUE(tc, uuid_variant_ok(&uuid));
+
+    apr_uuid_get_v7(&uuid);
+    ABTS_INT_EQUAL(tc, 7, uuid_version(&uuid));
+    ABTS_TRUE(tc, uuid_variant_ok(&uuid));
+
+    for (i = 0; i < sizeof(versions) / sizeof(versions[0]); i++) {
+        APR_ASSERT_SUCCESS(tc, "apr_uuid_get_n",
+                           apr_uuid_get_n(uuids, 10, versions[i]));
+        for (j = 0; j < 10; j++) {
+            ABTS_INT_EQUAL(tc, versions[i], uuid_version(&uuids[j]));
+            ABTS_TRUE(tc, uuid_variant_ok(&uuids[j]));
+        }
+    }
+    APR_ASSERT_SUCCESS(tc, "apr_uuid_get_n", apr_uuid_get_n(uuids, 10, 0));
+    ABTS_INT_EQUAL(tc, APR_EINVAL, apr_uuid_get_n(uuids, 10, 5));
+}
+
+static void test_v7_order(abts_case *tc, void *data)
+{
+    apr_uuid_t uuids[1000];
+    apr_uint64_t ms;
+    apr_time_t before, after;
+    int i;
+
+    before = apr_time_now();
+    for (i = 0; i < 500; i++) {
+        apr_uuid_get_v7(&uuids[i]);
+    }
+    apr_uuid_get_n(&uuids[500], 500, 7);
+    after = apr_time_now();
+
+    for (i = 1; i < 1000; i++) {
+        ABTS_ASSERT(tc, "V7 UUIDs out of order",
+                    memcmp(&uuids[i - 1], &uuids[i], sizeof(uuids[i])) < 0);
+    }
+
+    /* unix_ts_ms, within the time of the generation (allowing for the
+     * fractions incremented ahead of the clock)
+     */
+    for (ms = 0, i = 0; i < 6; i++) {
+        ms = (ms << 8) | uuids[0].data[i];
+    }
+    ABTS_TRUE(tc, ms >= (apr_uint64_t)apr_time_as_msec(before));
+    ABTS_TRUE(tc, ms <= (apr_uint64_t)apr_time_as_msec(after) + 1);
+}
+
+static int uuid_compare(const void *a, const void *b)
+{
+    return memcmp(a, b, sizeof(apr_uuid_t));
+}
+
+#if APR_HAS_THREADS
+
+#define UUID_THREADS 8
+#define UUID_PER_THREAD 20000
+
+typedef struct uuid_thread_t {
+    apr_uuid_t *uuids;
+    int version;
+    int ordered;
+} uuid_thread_t;
+
+/* Alternate single and bulk generation, checking the ordering of V7 */
+static void * APR_THREAD_FUNC uuid_thread(apr_thread_t *thd, void *data)
+{
+    uuid_thread_t *ut = data;
+    int i;
+
+    ut->ordered = 1;
+    for (i = 0; i < UUID_PER_THREAD; i += 100) {
+        if (i % 200) {
+            apr_uuid_get_n(&ut->uuids[i], 100, ut->version);
+        }
+        else {
+            int j;
+
+            for (j = i; j < i + 100; j++) {
+                switch (ut->version) {
+                case 4:
+                    apr_uuid_get_v4(&ut->uuids[j]);
+                    break;
+                case 7:
+                    apr_uuid_get_v7(&ut->uuids[j]);
+                    break;
+                case 1:
+                    apr_uuid_get_n(&ut->uuids[j], 1, 1);
+                    break;
+                default:
+                    apr_uuid_get(&ut->uuids[j]);
+                    break;
+                }
+            }
+        }
+    }
+    if (ut->version == 7) {
+        for (i = 1; i < UUID_PER_THREAD; i++) {
+            if (uuid_compare(&ut->uuids[i - 1], &ut->uuids[i]) >= 0) {
+                ut->ordered = 0;
+            }
+        }
+    }
+    apr_thread_exit(thd, APR_SUCCESS);
+    return NULL;
+}
+
+static void test_threads(abts_case *tc, void *data)
+{
+    static const int versions[] = { 0, 1, 4, 7 };
+    apr_thread_t *threads[UUID_THREADS];
+    uuid_thread_t uts[UUID_THREADS];
+    apr_array_header_t *arr;
+    apr_status_t rv, retval;
+    apr_time_t start, elapsed[4];
+    int v, i;
+
+    arr = apr_array_make(p, UUID_THREADS * UUID_PER_THREAD,
+                         sizeof(apr_uuid_t));
+    for (v = 0; v < 4; v++) {
+        arr->nelts = UUID_THREADS * UUID_PER_THREAD;
+        memset(arr->elts, 0, arr->nelts * arr->elt_size);
+
+        start = apr_time_now();
+        for (i = 0; i < UUID_THREADS; i++) {
+            uts[i].uuids = (apr_uuid_t *)arr->elts + i * UUID_PER_THREAD;
+            uts[i].version = versions[v];
+            rv = apr_thread_create(&threads[i], NULL, uuid_thread, &uts[i],
+                                   p);
+            ABTS_ASSERT(tc, "Failed creating thread", rv == APR_SUCCESS);
+        }
+        for (i = 0; i < UUID_THREADS; i++) {
+            rv = apr_thread_join(&retval, threads[i]);
+            ABTS_ASSERT(tc, "Thread join failed", rv == APR_SUCCESS);
+            ABTS_ASSERT(tc, "V7 UUIDs of a thread out of order",
+                        uts[i].ordered);
+        }
+        elapsed[v] = apr_time_now() - start;
+
+        apr_array_sort(arr, uuid_compare);
+        for (i = 1; i < arr->nelts; i++) {
+            if (uuid_compare(&APR_ARRAY_IDX(arr, i - 1, apr_uuid_t),
+                             &APR_ARRAY_IDX(arr, i, apr_uuid_t)) == 0) {
+                break;
+            }
+        }
+        ABTS_ASSERT(tc, "generated the same UUID twice", i == arr->nelts);
+    }
+
+    abts_log_message("%d UUIDs on %d threads: apr_uuid_get %" APR_TIME_T_FMT
+                     "us, V1 %" APR_TIME_T_FMT "us, V4 %" APR_TIME_T_FMT
+                     "us, V7 %" APR_TIME_T_FMT "us",
+                     UUID_THREADS * UUID_PER_THREAD, UUID_THREADS,
+                     elapsed[0], elapsed[1], elapsed[2], elapsed[3]);
+}
+
+#endif /* APR_HAS_THREADS */
+
 abts_suite *testuuid(abts_suite *suite)
 {
     suite = ADD_SUITE(suite);
 
     abts_run_test(suite, test_uuid_parse, NULL);
     abts_run_test(suite, test_gen2, NULL);
+    abts_run_test(suite, test_versions, NULL);
+    abts_run_test(suite, test_v7_order, NULL);
+#if APR_HAS_THREADS
+    abts_run_test(suite, test_threads, NULL);
+#endif
 
     return suite;
 }
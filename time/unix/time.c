@@ -19,6 +19,7 @@
 #include "apr_lib.h"
 #include "apr_private.h"
 #include "apr_strings.h"
+#include "apr_atomic.h"
 
 /* private APR headers */
 #include "apr_arch_internal_time.h"
@@ -78,6 +79,73 @@ APR_DECLARE(apr_time_t) apr_time_now(void)
     return tv.tv_sec * APR_USEC_PER_SEC + tv.tv_usec;
 }
 
+#ifdef HAVE_CLOCK_GETTIME
+static APR_INLINE apr_time_t clock_now(clockid_t clock)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec * APR_USEC_PER_SEC + ts.tv_nsec / 1000;
+}
+#endif
+
+APR_DECLARE(apr_time_t) apr_time_now_monotonic(void)
+{
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+    return clock_now(CLOCK_MONOTONIC);
+#else
+    return apr_time_now();
+#endif
+}
+
+APR_DECLARE(apr_time_t) apr_time_now_coarse(void)
+{
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_REALTIME_COARSE)
+    return clock_now(CLOCK_REALTIME_COARSE);
+#elif defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_REALTIME_FAST)
+    return clock_now(CLOCK_REALTIME_FAST);
+#else
+    return apr_time_now();
+#endif
+}
+
+APR_DECLARE(apr_time_t) apr_time_now_monotonic_coarse(void)
+{
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC_COARSE)
+    return clock_now(CLOCK_MONOTONIC_COARSE);
+#elif defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC_FAST)
+    return clock_now(CLOCK_MONOTONIC_FAST);
+#else
+    return apr_time_now_monotonic();
+#endif
+}
+
+/* The last tick, from apr_time_now_monotonic_coarse() */
+static volatile apr_uint64_t time_tick;
+
+APR_DECLARE(apr_time_t) apr_time_tick(void)
+{
+    apr_uint64_t tick = apr_atomic_read64(&time_tick);
+
+    if (!tick) {
+        return apr_time_tick_update();
+    }
+    return (apr_time_t)tick;
+}
+
+APR_DECLARE(apr_time_t) apr_time_tick_update(void)
+{
+    apr_uint64_t tick = apr_time_now_monotonic_coarse(), last;
+
+    /* Never go back, when updated concurrently */
+    do {
+        last = apr_atomic_read64(&time_tick);
+        if (last >= tick) {
+            return (apr_time_t)last;
+        }
+    } while (apr_atomic_cas64(&time_tick, tick, last) != last);
+    return (apr_time_t)tick;
+}
+
 static void explode_time(apr_time_exp_t *xt, apr_time_t t,
                          apr_int32_t offset, int use_localtime)
 {
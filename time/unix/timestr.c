@@ -18,6 +18,7 @@
 #include "apr_time.h"
 #include "apr_lib.h"
 #include "apr_private.h"
+#include "apr_slot_cache.h"
 /* System Headers required for time library */
 #if APR_HAVE_SYS_TIME_H
 #include <sys/time.h>
@@ -39,7 +40,59 @@ APR_DECLARE_DATA const char apr_day_snames[7][4] =
     "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"
 };
 
-apr_status_t apr_rfc822_date(char *date_str, apr_time_t t)
+/*
+ * The formatted dates are cached for the last seconds asked, in rings of
+ * lock-free slots indexed by the second: servers format the current time
+ * over and over, and all the threads can share the same few strings.
+ */
+#define DATE_CACHE_SIZE 16 /* power of 2 */
+
+typedef union date_cache_entry_t {
+    apr_uint32_t w[APR_SLOT_WORDS];
+    struct {
+        apr_int64_t sec;
+        char str[APR_SLOT_WORDS * 4 - sizeof(apr_int64_t)];
+    } d;
+} date_cache_entry_t;
+
+#define DATE_CACHE_WORDS(len) (2 + ((len) + 3) / 4)
+
+static apr_slot_t rfc822_cache[DATE_CACHE_SIZE];
+static apr_slot_t ctime_cache[DATE_CACHE_SIZE];
+static apr_slot_t common_log_cache[DATE_CACHE_SIZE];
+
+static int date_cache_get(apr_slot_t *cache, apr_time_t t, char *date_str,
+                          apr_size_t len)
+{
+    date_cache_entry_t e;
+    apr_int64_t sec = apr_time_sec(t);
+
+    /* Negative times aren't rounded down by apr_time_sec() */
+    if (t < 0
+        || !apr__slot_read(&cache[sec & (DATE_CACHE_SIZE - 1)], e.w,
+                           DATE_CACHE_WORDS(len))
+        || e.d.sec != sec) {
+        return 0;
+    }
+    memcpy(date_str, e.d.str, len);
+    return 1;
+}
+
+static void date_cache_put(apr_slot_t *cache, apr_time_t t,
+                           const char *date_str, apr_size_t len)
+{
+    date_cache_entry_t e;
+    apr_int64_t sec = apr_time_sec(t);
+
+    if (t >= 0) {
+        e.d.sec = sec;
+        memcpy(e.d.str, date_str, len);
+        apr__slot_write(&cache[sec & (DATE_CACHE_SIZE - 1)], e.w,
+                        DATE_CACHE_WORDS(len));
+    }
+}
+
+static void rfc822_date(char *date_str, apr_time_t t)
 {
     apr_time_exp_t xt;
     const char *s;
@@ -84,10 +137,18 @@ apr_status_t apr_rfc822_date(char *date_str, apr_time_t t)
     *date_str++ = 'M';
     *date_str++ = 'T';
     *date_str++ = 0;
+}
+
+apr_status_t apr_rfc822_date(char *date_str, apr_time_t t)
+{
+    if (!date_cache_get(rfc822_cache, t, date_str, APR_RFC822_DATE_LEN)) {
+        rfc822_date(date_str, t);
+        date_cache_put(rfc822_cache, t, date_str, APR_RFC822_DATE_LEN);
+    }
     return APR_SUCCESS;
 }
 
-apr_status_t apr_ctime(char *date_str, apr_time_t t)
+static void ctime_date(char *date_str, apr_time_t t)
 {
     apr_time_exp_t xt;
     const char *s;
@@ -125,7 +186,73 @@ apr_status_t apr_ctime(char *date_str, apr_time_t t)
     *date_str++ = real_year % 100 / 10 + '0';
     *date_str++ = real_year % 10 + '0';
     *date_str++ = 0;
+}
+
+apr_status_t apr_ctime(char *date_str, apr_time_t t)
+{
+    if (!date_cache_get(ctime_cache, t, date_str, APR_CTIME_LEN)) {
+        ctime_date(date_str, t);
+        date_cache_put(ctime_cache, t, date_str, APR_CTIME_LEN);
+    }
+    return APR_SUCCESS;
+}
+
+static void common_log_date(char *date_str, apr_time_t t)
+{
+    apr_time_exp_t xt;
+    const char *s;
+    int real_year, off;
+
+    /* example: "10/Oct/2000:13:55:36 -0700" */
+    /*           12345678901234567890123456  */
+
+    apr_time_exp_lt(&xt, t);
+    *date_str++ = xt.tm_mday / 10 + '0';
+    *date_str++ = xt.tm_mday % 10 + '0';
+    *date_str++ = '/';
+    s = &apr_month_snames[xt.tm_mon][0];
+    *date_str++ = *s++;
+    *date_str++ = *s++;
+    *date_str++ = *s++;
+    *date_str++ = '/';
+    real_year = 1900 + xt.tm_year;
+    *date_str++ = real_year / 1000 + '0';
+    *date_str++ = real_year % 1000 / 100 + '0';
+    *date_str++ = real_year % 100 / 10 + '0';
+    *date_str++ = real_year % 10 + '0';
+    *date_str++ = ':';
+    *date_str++ = xt.tm_hour / 10 + '0';
+    *date_str++ = xt.tm_hour % 10 + '0';
+    *date_str++ = ':';
+    *date_str++ = xt.tm_min / 10 + '0';
+    *date_str++ = xt.tm_min % 10 + '0';
+    *date_str++ = ':';
+    *date_str++ = xt.tm_sec / 10 + '0';
+    *date_str++ = xt.tm_sec % 10 + '0';
+    *date_str++ = ' ';
+    if (xt.tm_gmtoff < 0) {
+        *date_str++ = '-';
+        off = -xt.tm_gmtoff / 60;
+    }
+    else {
+        *date_str++ = '+';
+        off = xt.tm_gmtoff / 60;
+    }
+    *date_str++ = off / 600 % 10 + '0';
+    *date_str++ = off / 60 % 10 + '0';
+    *date_str++ = off % 60 / 10 + '0';
+    *date_str++ = off % 10 + '0';
+    *date_str++ = 0;
+}
 
+apr_status_t apr_common_log_date(char *date_str, apr_time_t t)
+{
+    if (!date_cache_get(common_log_cache, t, date_str,
+                        APR_COMMON_LOG_DATE_LEN)) {
+        common_log_date(date_str, t);
+        date_cache_put(common_log_cache, t, date_str,
+                       APR_COMMON_LOG_DATE_LEN);
+    }
     return APR_SUCCESS;
 }
 
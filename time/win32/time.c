@@ -19,6 +19,7 @@
 #include "apr_general.h"
 #include "apr_lib.h"
 #include "apr_portable.h"
+#include "apr_atomic.h"
 #if APR_HAVE_TIME_H
 #include <time.h>
 #endif
@@ -99,6 +100,64 @@ APR_DECLARE(apr_time_t) apr_time_now(void)
     return aprtime; 
 }
 
+APR_DECLARE(apr_time_t) apr_time_now_monotonic(void)
+{
+    static LONGLONG freq;
+    LARGE_INTEGER count;
+
+    if (!freq) {
+        LARGE_INTEGER f;
+        QueryPerformanceFrequency(&f);
+        freq = f.QuadPart;
+    }
+    QueryPerformanceCounter(&count);
+    /* Seconds and remainder apart, not to overflow */
+    return (count.QuadPart / freq) * APR_USEC_PER_SEC
+           + (count.QuadPart % freq) * APR_USEC_PER_SEC / freq;
+}
+
+/* GetSystemTimeAsFileTime() already has the resolution of the tick */
+APR_DECLARE(apr_time_t) apr_time_now_coarse(void)
+{
+    return apr_time_now();
+}
+
+APR_DECLARE(apr_time_t) apr_time_now_monotonic_coarse(void)
+{
+#if !defined(_WIN32_WCE) && _WIN32_WINNT >= 0x0600
+    return (apr_time_t)GetTickCount64() * 1000;
+#else
+    return apr_time_now_monotonic();
+#endif
+}
+
+/* The last tick, from apr_time_now_monotonic_coarse() */
+static volatile apr_uint64_t time_tick;
+
+APR_DECLARE(apr_time_t) apr_time_tick(void)
+{
+    apr_uint64_t tick = apr_atomic_read64(&time_tick);
+
+    if (!tick) {
+        return apr_time_tick_update();
+    }
+    return (apr_time_t)tick;
+}
+
+APR_DECLARE(apr_time_t) apr_time_tick_update(void)
+{
+    apr_uint64_t tick = apr_time_now_monotonic_coarse(), last;
+
+    /* Never go back, when updated concurrently */
+    do {
+        last = apr_atomic_read64(&time_tick);
+        if (last >= tick) {
+            return (apr_time_t)last;
+        }
+    } while (apr_atomic_cas64(&time_tick, tick, last) != last);
+    return (apr_time_t)tick;
+}
+
 APR_DECLARE(apr_status_t) apr_time_exp_gmt(apr_time_exp_t *result,
                                            apr_time_t input)
 {
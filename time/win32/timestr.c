@@ -121,6 +121,56 @@ APR_DECLARE(apr_status_t) apr_ctime(char *date_str, apr_time_t t)
     return APR_SUCCESS;
 }
 
+APR_DECLARE(apr_status_t) apr_common_log_date(char *date_str, apr_time_t t)
+{
+    apr_time_exp_t xt;
+    const char *s;
+    int real_year, off;
+
+    /* example: "10/Oct/2000:13:55:36 -0700" */
+    /*           12345678901234567890123456  */
+
+    apr_time_exp_lt(&xt, t);
+    *date_str++ = xt.tm_mday / 10 + '0';
+    *date_str++ = xt.tm_mday % 10 + '0';
+    *date_str++ = '/';
+    s = &apr_month_snames[xt.tm_mon][0];
+    *date_str++ = *s++;
+    *date_str++ = *s++;
+    *date_str++ = *s++;
+    *date_str++ = '/';
+    real_year = 1900 + xt.tm_year;
+    *date_str++ = real_year / 1000 + '0';
+    *date_str++ = real_year % 1000 / 100 + '0';
+    *date_str++ = real_year % 100 / 10 + '0';
+    *date_str++ = real_year % 10 + '0';
+    *date_str++ = ':';
+    *date_str++ = xt.tm_hour / 10 + '0';
+    *date_str++ = xt.tm_hour % 10 + '0';
+    *date_str++ = ':';
+    *date_str++ = xt.tm_min / 10 + '0';
+    *date_str++ = xt.tm_min % 10 + '0';
+    *date_str++ = ':';
+    *date_str++ = xt.tm_sec / 10 + '0';
+    *date_str++ = xt.tm_sec % 10 + '0';
+    *date_str++ = ' ';
+    if (xt.tm_gmtoff < 0) {
+        *date_str++ = '-';
+        off = -xt.tm_gmtoff / 60;
+    }
+    else {
+        *date_str++ = '+';
+        off = xt.tm_gmtoff / 60;
+    }
+    *date_str++ = off / 600 % 10 + '0';
+    *date_str++ = off / 60 % 10 + '0';
+    *date_str++ = off % 60 / 10 + '0';
+    *date_str++ = off % 10 + '0';
+    *date_str++ = 0;
+
+    return APR_SUCCESS;
+}
+
 
 #ifndef _WIN32_WCE
 
@@ -40,6 +40,7 @@
 #endif
 
 #include "apr_date.h"
+#include "apr_slot_cache.h"
 
 /*
  * Compare a string to a mask
@@ -142,7 +143,7 @@ APR_DECLARE(int) apr_date_checkmask(const char *data, const char *mask)
  * but many changes since then.
  *
  */
-APR_DECLARE(apr_time_t) apr_date_parse_http(const char *date)
+static apr_time_t date_parse_http(const char *date)
 {
     apr_time_exp_t ds;
     apr_time_t result;
@@ -280,6 +281,54 @@ APR_DECLARE(apr_time_t) apr_date_parse_http(const char *date)
     return result;
 }
 
+/*
+ * The last dates parsed by apr_date_parse_http() are cached, in a ring of
+ * lock-free slots indexed by a hash of the string: the same few dates come
+ * again and again in the If-Modified-Since headers of the requests for the
+ * same resources.  Only the strings short enough to fit a slot with their
+ * result are cached, which includes the RFC 1123 and asctime() formats.
+ */
+#define DATE_CACHE_SIZE 16 /* power of 2 */
+
+typedef union date_cache_entry_t {
+    apr_uint32_t w[APR_SLOT_WORDS];
+    struct {
+        apr_time_t result;
+        char str[APR_SLOT_WORDS * 4 - sizeof(apr_time_t)];
+    } d;
+} date_cache_entry_t;
+
+static apr_slot_t date_http_cache[DATE_CACHE_SIZE];
+
+APR_DECLARE(apr_time_t) apr_date_parse_http(const char *date)
+{
+    date_cache_entry_t e, key;
+    apr_uint32_t hash = 0;
+    apr_slot_t *slot;
+    apr_size_t len;
+    int i;
+
+    if (!date || (len = strlen(date)) >= sizeof(key.d.str)) {
+        return date_parse_http(date);
+    }
+
+    memset(key.d.str, 0, sizeof(key.d.str));
+    memcpy(key.d.str, date, len);
+    for (i = 2; i < APR_SLOT_WORDS; i++) {
+        hash = (hash ^ key.w[i]) * 0x9E3779B1;
+    }
+    slot = &date_http_cache[hash >> 28 & (DATE_CACHE_SIZE - 1)];
+
+    if (apr__slot_read(slot, e.w, APR_SLOT_WORDS)
+        && memcmp(e.d.str, key.d.str, sizeof(key.d.str)) == 0) {
+        return e.d.result;
+    }
+
+    key.d.result = date_parse_http(date);
+    apr__slot_write(slot, key.w, APR_SLOT_WORDS);
+    return key.d.result;
+}
+
 /*
  * Parses a string resembling an RFC 822 date.  This is meant to be
  * leinent in its parsing of dates.  Hence, this will parse a wider 
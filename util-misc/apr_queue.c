@@ -28,6 +28,7 @@
 
 #include "apu.h"
 #include "apr_portable.h"
+#include "apr_atomic.h"
 #include "apr_thread_mutex.h"
 #include "apr_thread_cond.h"
 #include "apr_errno.h"
@@ -40,7 +41,36 @@
 #define QUEUE_DEBUG
  */
 
+/* The cache line size assumed to keep the hot fields of the lock-free
+ * ring apart.
+ */
+#define QUEUE_CACHE_LINE 64
+
+/**
+ * A slot of the lock-free ring: its sequence number tells whether it can
+ * be pushed to (seq == position) or popped from (seq == position + 1).
+ */
+typedef struct queue_cell_t {
+    volatile apr_uint32_t seq;
+    void                 *data;
+} queue_cell_t;
+
+/**
+ * The lock-free ring, allocated aligned on a cache line.
+ */
+typedef struct queue_ring_t {
+    volatile apr_uint32_t in;   /**< next position to push to */
+    char pad1[QUEUE_CACHE_LINE - sizeof(apr_uint32_t)];
+    volatile apr_uint32_t out;  /**< next position to pop from */
+    char pad2[QUEUE_CACHE_LINE - sizeof(apr_uint32_t)];
+    volatile apr_uint32_t full_waiters;
+    volatile apr_uint32_t empty_waiters;
+    apr_uint32_t          mask; /**< # cells - 1 */
+    queue_cell_t         *cells;
+} queue_ring_t;
+
 struct apr_queue_t {
+    queue_ring_t       *ring;  /**< the lock-free ring, if any */
     void              **data;
     unsigned int        nelts; /**< # elements */
     unsigned int        in;    /**< next empty location */
@@ -52,6 +82,7 @@ struct apr_queue_t {
     apr_thread_cond_t  *not_empty;
     apr_thread_cond_t  *not_full;
     int                 terminated;
+    unsigned int        interrupts; /**< # of apr_queue_interrupt_all() */
 };
 
 #ifdef QUEUE_DEBUG
@@ -101,11 +132,45 @@ static apr_status_t queue_destroy(void *data)
 APR_DECLARE(apr_status_t) apr_queue_create(apr_queue_t **q, 
                                            unsigned int queue_capacity, 
                                            apr_pool_t *a)
+{
+    return apr_queue_create_ex(q, queue_capacity, 0, a);
+}
+
+APR_DECLARE(apr_status_t) apr_queue_create_ex(apr_queue_t **q,
+                                              unsigned int queue_capacity,
+                                              apr_uint32_t flags,
+                                              apr_pool_t *a)
 {
     apr_status_t rv;
     apr_queue_t *queue;
+    queue_ring_t *ring = NULL;
+    apr_uint32_t i, ncells;
+
+    if (flags & APR_QUEUE_LOCKFREE) {
+        if (queue_capacity == 0 || queue_capacity > 0x80000000U) {
+            return APR_EINVAL;
+        }
+        for (ncells = 1; ncells < queue_capacity; ncells <<= 1)
+            ;
+
+        ring = apr_palloc_aligned(a, sizeof(queue_ring_t), QUEUE_CACHE_LINE);
+        ring->cells = apr_palloc_aligned(a, ncells * sizeof(queue_cell_t),
+                                         QUEUE_CACHE_LINE);
+        for (i = 0; i < ncells; i++) {
+            ring->cells[i].seq = i;
+            ring->cells[i].data = NULL;
+        }
+        ring->mask = ncells - 1;
+        ring->in = 0;
+        ring->out = 0;
+        ring->full_waiters = 0;
+        ring->empty_waiters = 0;
+        queue_capacity = ncells;
+    }
+
     queue = apr_palloc(a, sizeof(apr_queue_t));
     *q = queue;
+    queue->ring = ring;
 
     /* nested doesn't work ;( */
     rv = apr_thread_mutex_create(&queue->one_big_mutex,
@@ -126,7 +191,7 @@ APR_DECLARE(apr_status_t) apr_queue_create(apr_queue_t **q,
     }
 
     /* Set all the data in the queue to NULL */
-    queue->data = apr_pcalloc(a, queue_capacity * sizeof(void*));
+    queue->data = ring ? NULL : apr_pcalloc(a, queue_capacity * sizeof(void*));
     queue->bounds = queue_capacity;
     queue->nelts = 0;
     queue->in = 0;
@@ -134,12 +199,169 @@ APR_DECLARE(apr_status_t) apr_queue_create(apr_queue_t **q,
     queue->terminated = 0;
     queue->full_waiters = 0;
     queue->empty_waiters = 0;
+    queue->interrupts = 0;
 
     apr_pool_cleanup_register(a, queue, queue_destroy, apr_pool_cleanup_null);
 
     return APR_SUCCESS;
 }
 
+/**
+ * Push new data onto the lock-free ring, or return APR_EAGAIN if it is
+ * full.  The CAS on the position orders the read of the cell's sequence
+ * before the write of its data, the exchange of the sequence publishes
+ * the data.
+ */
+static apr_status_t ring_push(queue_ring_t *ring, void *data)
+{
+    queue_cell_t *cell;
+    apr_uint32_t pos, seq, cur;
+
+    pos = apr_atomic_read32(&ring->in);
+    for (;;) {
+        cell = &ring->cells[pos & ring->mask];
+        seq = apr_atomic_read32(&cell->seq);
+        if (seq == pos) {
+            cur = apr_atomic_cas32(&ring->in, pos + 1, pos);
+            if (cur == pos) {
+                break;
+            }
+            pos = cur;
+        }
+        else if ((apr_int32_t)(seq - pos) < 0) {
+            return APR_EAGAIN;
+        }
+        else {
+            pos = apr_atomic_read32(&ring->in);
+        }
+    }
+
+    cell->data = data;
+    apr_atomic_xchg32(&cell->seq, pos + 1);
+
+    return APR_SUCCESS;
+}
+
+/**
+ * Pop data from the lock-free ring, or return APR_EAGAIN if it is empty.
+ */
+static apr_status_t ring_pop(queue_ring_t *ring, void **data)
+{
+    queue_cell_t *cell;
+    apr_uint32_t pos, seq, cur;
+
+    pos = apr_atomic_read32(&ring->out);
+    for (;;) {
+        cell = &ring->cells[pos & ring->mask];
+        seq = apr_atomic_read32(&cell->seq);
+        if (seq == pos + 1) {
+            cur = apr_atomic_cas32(&ring->out, pos + 1, pos);
+            if (cur == pos) {
+                break;
+            }
+            pos = cur;
+        }
+        else if ((apr_int32_t)(seq - (pos + 1)) < 0) {
+            return APR_EAGAIN;
+        }
+        else {
+            pos = apr_atomic_read32(&ring->out);
+        }
+    }
+
+    *data = cell->data;
+    apr_atomic_xchg32(&cell->seq, pos + ring->mask + 1);
+
+    return APR_SUCCESS;
+}
+
+/**
+ * Wake up a thread waiting for the lock-free ring to become non full
+ * (or non empty), if any.  The waiter registers itself before checking
+ * the ring again, so either it sees our update or we see it waiting.
+ */
+static apr_status_t ring_signal(apr_queue_t *queue,
+                                volatile apr_uint32_t *waiters,
+                                apr_thread_cond_t *cond)
+{
+    apr_status_t rv;
+
+    if (!apr_atomic_read32(waiters)) {
+        return APR_SUCCESS;
+    }
+
+    rv = apr_thread_mutex_lock(queue->one_big_mutex);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+    rv = apr_thread_cond_signal(cond);
+    if (rv != APR_SUCCESS) {
+        apr_thread_mutex_unlock(queue->one_big_mutex);
+        return rv;
+    }
+    return apr_thread_mutex_unlock(queue->one_big_mutex);
+}
+
+/**
+ * Push to (or pop from) the lock-free ring, blocking while it is full
+ * (or empty) if asked to.  The mutex and condition variables are only
+ * used to wait, until the operation succeeds or the queue is interrupted.
+ */
+static apr_status_t ring_push_or_pop(apr_queue_t *queue, void **data,
+                                     int pop, int block)
+{
+    queue_ring_t *ring = queue->ring;
+    volatile apr_uint32_t *waiters;
+    apr_thread_cond_t *cond;
+    unsigned int interrupts;
+    apr_status_t rv;
+
+#define RING_OP() (pop ? ring_pop(ring, data) : ring_push(ring, *data))
+
+    rv = RING_OP();
+    if (rv == APR_EAGAIN && block) {
+        if (pop) {
+            waiters = &ring->empty_waiters;
+            cond = queue->not_empty;
+        }
+        else {
+            waiters = &ring->full_waiters;
+            cond = queue->not_full;
+        }
+
+        rv = apr_thread_mutex_lock(queue->one_big_mutex);
+        if (rv != APR_SUCCESS) {
+            return rv;
+        }
+        interrupts = queue->interrupts;
+        apr_atomic_inc32(waiters);
+        while ((rv = RING_OP()) == APR_EAGAIN && !queue->terminated
+               && interrupts == queue->interrupts) {
+            rv = apr_thread_cond_wait(cond, queue->one_big_mutex);
+            if (rv != APR_SUCCESS) {
+                break;
+            }
+        }
+        apr_atomic_dec32(waiters);
+        apr_thread_mutex_unlock(queue->one_big_mutex);
+
+        if (rv == APR_EAGAIN) {
+            Q_DBG("queue full/empty (intr)", queue);
+            return queue->terminated ? APR_EOF : APR_EINTR;
+        }
+    }
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+
+#undef RING_OP
+
+    if (pop) {
+        return ring_signal(queue, &ring->full_waiters, queue->not_full);
+    }
+    return ring_signal(queue, &ring->empty_waiters, queue->not_empty);
+}
+
 /**
  * Push new data onto the queue. Blocks if the queue is full. Once
  * the push operation has completed, it signals other threads waiting
@@ -153,6 +375,10 @@ APR_DECLARE(apr_status_t) apr_queue_push(apr_queue_t *queue, void *data)
         return APR_EOF; /* no more elements ever again */
     }
 
+    if (queue->ring) {
+        return ring_push_or_pop(queue, &data, 0, 1);
+    }
+
     rv = apr_thread_mutex_lock(queue->one_big_mutex);
     if (rv != APR_SUCCESS) {
         return rv;
@@ -216,6 +442,10 @@ APR_DECLARE(apr_status_t) apr_queue_trypush(apr_queue_t *queue, void *data)
         return APR_EOF; /* no more elements ever again */
     }
 
+    if (queue->ring) {
+        return ring_push_or_pop(queue, &data, 0, 0);
+    }
+
     rv = apr_thread_mutex_lock(queue->one_big_mutex);
     if (rv != APR_SUCCESS) {
         return rv;
@@ -252,6 +482,11 @@ APR_DECLARE(apr_status_t) apr_queue_trypush(apr_queue_t *queue, void *data)
  * not thread safe
  */
 APR_DECLARE(unsigned int) apr_queue_size(apr_queue_t *queue) {
+    if (queue->ring) {
+        /* read out first, so that it is never past in */
+        apr_uint32_t out = apr_atomic_read32(&queue->ring->out);
+        return apr_atomic_read32(&queue->ring->in) - out;
+    }
     return queue->nelts;
 }
 
@@ -269,6 +504,10 @@ APR_DECLARE(apr_status_t) apr_queue_pop(apr_queue_t *queue, void **data)
         return APR_EOF; /* no more elements ever again */
     }
 
+    if (queue->ring) {
+        return ring_push_or_pop(queue, data, 1, 1);
+    }
+
     rv = apr_thread_mutex_lock(queue->one_big_mutex);
     if (rv != APR_SUCCESS) {
         return rv;
@@ -333,6 +572,10 @@ APR_DECLARE(apr_status_t) apr_queue_trypop(apr_queue_t *queue, void **data)
         return APR_EOF; /* no more elements ever again */
     }
 
+    if (queue->ring) {
+        return ring_push_or_pop(queue, data, 1, 0);
+    }
+
     rv = apr_thread_mutex_lock(queue->one_big_mutex);
     if (rv != APR_SUCCESS) {
         return rv;
@@ -369,6 +612,7 @@ APR_DECLARE(apr_status_t) apr_queue_interrupt_all(apr_queue_t *queue)
     if ((rv = apr_thread_mutex_lock(queue->one_big_mutex)) != APR_SUCCESS) {
         return rv;
     }
+    queue->interrupts++;
     apr_thread_cond_broadcast(queue->not_empty);
     apr_thread_cond_broadcast(queue->not_full);
 
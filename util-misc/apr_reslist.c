@@ -81,7 +81,7 @@ static apr_res_t *pop_resource(apr_reslist_t *reslist)
 static void push_resource(apr_reslist_t *reslist, apr_res_t *resource)
 {
     APR_RING_INSERT_HEAD(&reslist->avail_list, resource, apr_res_t, link);
-    resource->freed = apr_time_now();
+    resource->freed = apr_time_now_monotonic();
     reslist->nidle++;
 }
 
@@ -221,7 +221,7 @@ APR_DECLARE(apr_status_t) apr_reslist_maintain(apr_reslist_t *reslist)
     }
 
     /* Check if we need to expire old resources */
-    now = apr_time_now();
+    now = apr_time_now_monotonic();
     while (reslist->nidle > reslist->smax && reslist->nidle > 0) {
         /* Peak at the last resource in the list */
         res = APR_RING_LAST(&reslist->avail_list);
@@ -338,7 +338,7 @@ APR_DECLARE(apr_status_t) apr_reslist_acquire(apr_reslist_t *reslist,
 #endif
     /* If there are idle resources on the available list, use
      * them right away. */
-    now = apr_time_now();
+    now = apr_time_now_monotonic();
     while (reslist->nidle > 0) {
         /* Pop off the first resource */
         res = pop_resource(reslist);
@@ -18,6 +18,7 @@
 
 #include <assert.h>
 #include "apr_thread_pool.h"
+#include "apr_atomic.h"
 #include "apr_ring.h"
 #include "apr_thread_cond.h"
 #include "apr_portable.h"
@@ -27,12 +28,18 @@
 #define TASK_PRIORITY_SEGS 4
 #define TASK_PRIORITY_SEG(x) (((x)->dispatch.priority & 0xFF) / 64)
 
+/* Max tasks recycled by a worker before they go back to the pool's list */
+#define TASK_RECYCLED_MAX 64
+
+#define WORK_STEALING(me) ((me)->flags & APR_THREAD_POOL_WORK_STEALING)
+
 typedef struct apr_thread_pool_task
 {
     APR_RING_ENTRY(apr_thread_pool_task) link;
     apr_thread_start_t func;
     void *param;
     void *owner;
+    apr_thread_pool_group_t *group;
     union
     {
         apr_byte_t priority;
@@ -42,12 +49,26 @@ typedef struct apr_thread_pool_task
 
 APR_RING_HEAD(apr_thread_pool_tasks, apr_thread_pool_task);
 
+struct apr_thread_pool_group
+{
+    volatile apr_uint32_t pending;
+    apr_thread_mutex_t *lock;
+    apr_thread_cond_t *cond;
+};
+
 struct apr_thread_list_elt
 {
     APR_RING_ENTRY(apr_thread_list_elt) link;
     apr_thread_t *thd;
     volatile void *current_owner;
     volatile enum { TH_RUN, TH_STOP, TH_PROBATION } state;
+    /* work-stealing mode only */
+    apr_thread_mutex_t *deque_lock;
+    struct apr_thread_pool_tasks deque[TASK_PRIORITY_SEGS];
+    volatile apr_size_t deque_cnt;
+    struct apr_thread_pool_tasks recycled_tasks;
+    apr_size_t recycled_cnt;
+    apr_size_t tasks_run;
 };
 
 APR_RING_HEAD(apr_thread_list, apr_thread_list_elt);
@@ -77,6 +98,8 @@ struct apr_thread_pool
     struct apr_thread_pool_tasks *recycled_tasks;
     struct apr_thread_list *recycled_thds;
     apr_thread_pool_task_t *task_idx[TASK_PRIORITY_SEGS];
+    apr_uint32_t flags;
+    apr_threadkey_t *worker_key;
 };
 
 static apr_status_t thread_pool_construct(apr_thread_pool_t * me,
@@ -136,6 +159,14 @@ static apr_status_t thread_pool_construct(apr_thread_pool_t * me,
     for (i = 0; i < TASK_PRIORITY_SEGS; i++) {
         me->task_idx[i] = NULL;
     }
+    if (WORK_STEALING(me)) {
+        rv = apr_threadkey_private_create(&me->worker_key, NULL, me->pool);
+        if (APR_SUCCESS != rv) {
+            apr_thread_mutex_destroy(me->lock);
+            apr_thread_cond_destroy(me->cond);
+            return rv;
+        }
+    }
     goto FINAL_EXIT;
   CATCH_ENOMEM:
     rv = APR_ENOMEM;
@@ -161,7 +192,7 @@ static apr_thread_pool_task_t *pop_task(apr_thread_pool_t * me)
                APR_RING_SENTINEL(me->scheduled_tasks, apr_thread_pool_task,
                                  link));
         /* if it's time */
-        if (task->dispatch.time <= apr_time_now()) {
+        if (task->dispatch.time <= apr_time_now_monotonic()) {
             --me->scheduled_task_cnt;
             APR_RING_REMOVE(task, link);
             return task;
@@ -198,9 +229,44 @@ static apr_interval_time_t waiting_time(apr_thread_pool_t * me)
     assert(task !=
            APR_RING_SENTINEL(me->scheduled_tasks, apr_thread_pool_task,
                              link));
-    return task->dispatch.time - apr_time_now();
+    return task->dispatch.time - apr_time_now_monotonic();
+}
+
+/*
+ * Account for cnt tasks of the group being done (run or cancelled), waking
+ * up its waiters when none is left.  The last tasks are accounted for under
+ * the group's lock, where the waiters check for them too, so that nothing
+ * touches the group anymore once a waiter may see it done (and destroy it).
+ */
+static void group_done(apr_thread_pool_group_t *group, apr_uint32_t cnt)
+{
+    apr_uint32_t pending;
+
+    for (;;) {
+        pending = apr_atomic_read32(&group->pending);
+        if (pending <= cnt) {
+            break;
+        }
+        if (apr_atomic_cas32(&group->pending, pending - cnt,
+                             pending) == pending) {
+            return;
+        }
+    }
+
+    apr_thread_mutex_lock(group->lock);
+    apr_atomic_sub32(&group->pending, cnt);
+    if (!apr_atomic_read32(&group->pending)) {
+        apr_thread_cond_broadcast(group->cond);
+    }
+    apr_thread_mutex_unlock(group->lock);
 }
 
+#define task_done(task) do {                    \
+    if ((task)->group) {                        \
+        group_done((task)->group, 1);           \
+    }                                           \
+} while (0)
+
 /*
  * NOTE: This function is not thread safe by itself. Caller should hold the lock
  */
@@ -214,6 +280,19 @@ static struct apr_thread_list_elt *elt_new(apr_thread_pool_t * me,
         if (NULL == elt) {
             return NULL;
         }
+        if (WORK_STEALING(me)) {
+            int seg;
+
+            if (APR_SUCCESS != apr_thread_mutex_create(&elt->deque_lock,
+                                                       APR_THREAD_MUTEX_DEFAULT,
+                                                       me->pool)) {
+                return NULL;
+            }
+            for (seg = 0; seg < TASK_PRIORITY_SEGS; seg++) {
+                APR_RING_INIT(&elt->deque[seg], apr_thread_pool_task, link);
+            }
+            APR_RING_INIT(&elt->recycled_tasks, apr_thread_pool_task, link);
+        }
     }
     else {
         elt = APR_RING_FIRST(me->recycled_thds);
@@ -227,6 +306,183 @@ static struct apr_thread_list_elt *elt_new(apr_thread_pool_t * me,
     return elt;
 }
 
+/*
+ * Work-stealing mode: each worker has a deque of tasks per priority segment
+ * for the tasks pushed by the tasks it runs.  The worker pushes and pops at
+ * the tail of its deque (LIFO) without the pool's lock, while the other
+ * workers steal from the head (FIFO) when they have nothing else to do.
+ * The tasks pushed by other threads go to the pool's queue as usual.
+ */
+
+static void task_insert(apr_thread_pool_t *me, apr_thread_pool_task_t *t,
+                        int push);
+
+/*
+ * Take a task from the deque of the victim, for the taker which may be the
+ * owner of the deque (from the tail) or a thief (from the head). The taker's
+ * current_owner is set with the deque locked, so that tasks_cancel() either
+ * finds the task in the deque or the taker running it.
+ */
+static apr_thread_pool_task_t *deque_take(struct apr_thread_list_elt *victim,
+                                          struct apr_thread_list_elt *taker)
+{
+    apr_thread_pool_task_t *task = NULL;
+    int seg;
+
+    apr_thread_mutex_lock(victim->deque_lock);
+    for (seg = TASK_PRIORITY_SEGS - 1; seg >= 0; seg--) {
+        if (!APR_RING_EMPTY(&victim->deque[seg], apr_thread_pool_task, link)) {
+            if (victim == taker) {
+                task = APR_RING_LAST(&victim->deque[seg]);
+            }
+            else {
+                task = APR_RING_FIRST(&victim->deque[seg]);
+            }
+            APR_RING_REMOVE(task, link);
+            --victim->deque_cnt;
+            taker->current_owner = task->owner;
+            break;
+        }
+    }
+    apr_thread_mutex_unlock(victim->deque_lock);
+
+    return task;
+}
+
+/*
+ * Keep the task for the next ones pushed by the worker, the pool's list
+ * gets them back by batches.
+ */
+static void ws_task_recycle(apr_thread_pool_t *me,
+                            struct apr_thread_list_elt *elt,
+                            apr_thread_pool_task_t *task)
+{
+    APR_RING_INSERT_TAIL(&elt->recycled_tasks, task, apr_thread_pool_task,
+                         link);
+    if (++elt->recycled_cnt > TASK_RECYCLED_MAX) {
+        apr_thread_mutex_lock(me->lock);
+        APR_RING_CONCAT(me->recycled_tasks, &elt->recycled_tasks,
+                        apr_thread_pool_task, link);
+        apr_thread_mutex_unlock(me->lock);
+        elt->recycled_cnt = 0;
+    }
+}
+
+/*
+ * Run the tasks of the worker's deque after the given one, without the
+ * pool's lock.
+ */
+static void ws_run_deque(apr_thread_pool_t *me,
+                         struct apr_thread_list_elt *elt, apr_thread_t *t,
+                         apr_thread_pool_task_t *task)
+{
+    for (;;) {
+        ws_task_recycle(me, elt, task);
+        elt->current_owner = NULL;
+        if (TH_STOP == elt->state || me->terminated) {
+            break;
+        }
+        task = deque_take(elt, elt);
+        if (NULL == task) {
+            break;
+        }
+        ++elt->tasks_run;
+        apr_thread_data_set(task, "apr_thread_pool_task", NULL, t);
+        task->func(t, task->param);
+        task_done(task);
+    }
+}
+
+/*
+ * NOTE: This function is not thread safe by itself. Caller should hold the lock
+ */
+static apr_thread_pool_task_t *ws_steal(apr_thread_pool_t *me,
+                                        struct apr_thread_list_elt *elt)
+{
+    struct apr_thread_list_elt *victim;
+    apr_thread_pool_task_t *task;
+
+    for (victim = APR_RING_FIRST(me->busy_thds);
+         victim != APR_RING_SENTINEL(me->busy_thds, apr_thread_list_elt, link);
+         victim = APR_RING_NEXT(victim, link)) {
+        if (victim != elt && victim->deque_cnt) {
+            task = deque_take(victim, elt);
+            if (task) {
+                return task;
+            }
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Whether a task could be stolen, checked by a worker going idle after
+ * it registered as such: a worker pushing to its deque then either sees
+ * it idle and signals it, or this sees the task (both use the deque lock).
+ *
+ * NOTE: This function is not thread safe by itself. Caller should hold the lock
+ */
+static int ws_stealable(apr_thread_pool_t *me)
+{
+    struct apr_thread_list_elt *victim;
+    apr_size_t cnt;
+
+    for (victim = APR_RING_FIRST(me->busy_thds);
+         victim != APR_RING_SENTINEL(me->busy_thds, apr_thread_list_elt, link);
+         victim = APR_RING_NEXT(victim, link)) {
+        apr_thread_mutex_lock(victim->deque_lock);
+        cnt = victim->deque_cnt;
+        apr_thread_mutex_unlock(victim->deque_lock);
+        if (cnt) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Own deque first, then the pool's queue, then the other workers' deques.
+ *
+ * NOTE: This function is not thread safe by itself. Caller should hold the lock
+ */
+static apr_thread_pool_task_t *ws_next_task(apr_thread_pool_t *me,
+                                            struct apr_thread_list_elt *elt)
+{
+    apr_thread_pool_task_t *task;
+
+    task = deque_take(elt, elt);
+    if (NULL == task) {
+        task = pop_task(me);
+    }
+    if (NULL == task) {
+        task = ws_steal(me, elt);
+    }
+    return task;
+}
+
+/*
+ * Move the tasks left in the deque of a stopping worker to the pool's queue.
+ *
+ * NOTE: This function is not thread safe by itself. Caller should hold the lock
+ */
+static void ws_deque_flush(apr_thread_pool_t *me,
+                           struct apr_thread_list_elt *elt)
+{
+    apr_thread_pool_task_t *task;
+    int seg;
+
+    apr_thread_mutex_lock(elt->deque_lock);
+    for (seg = TASK_PRIORITY_SEGS - 1; seg >= 0; seg--) {
+        while (!APR_RING_EMPTY(&elt->deque[seg], apr_thread_pool_task, link)) {
+            task = APR_RING_FIRST(&elt->deque[seg]);
+            APR_RING_REMOVE(task, link);
+            task_insert(me, task, 1);
+        }
+    }
+    elt->deque_cnt = 0;
+    apr_thread_mutex_unlock(elt->deque_lock);
+}
+
 /*
  * The worker thread function. Take a task from the queue and perform it if
  * there is any. Otherwise, put itself into the idle thread list and waiting
@@ -249,6 +505,9 @@ static void *APR_THREAD_FUNC thread_pool_func(apr_thread_t * t, void *param)
         apr_thread_mutex_unlock(me->lock);
         apr_thread_exit(t, APR_ENOMEM);
     }
+    if (WORK_STEALING(me)) {
+        apr_threadkey_private_set(elt, me->worker_key);
+    }
 
     while (!me->terminated && elt->state != TH_STOP) {
         /* Test if not new element, it is awakened from idle */
@@ -258,24 +517,37 @@ static void *APR_THREAD_FUNC thread_pool_func(apr_thread_t * t, void *param)
         }
 
         APR_RING_INSERT_TAIL(me->busy_thds, elt, apr_thread_list_elt, link);
-        task = pop_task(me);
+        task = WORK_STEALING(me) ? ws_next_task(me, elt) : pop_task(me);
         while (NULL != task && !me->terminated) {
             ++me->tasks_run;
             elt->current_owner = task->owner;
             apr_thread_mutex_unlock(me->lock);
             apr_thread_data_set(task, "apr_thread_pool_task", NULL, t);
             task->func(t, task->param);
-            apr_thread_mutex_lock(me->lock);
-            apr_pool_owner_set(me->pool, 0);
-            APR_RING_INSERT_TAIL(me->recycled_tasks, task,
-                                 apr_thread_pool_task, link);
+            task_done(task);
+            if (WORK_STEALING(me)) {
+                ws_run_deque(me, elt, t, task);
+                apr_thread_mutex_lock(me->lock);
+                apr_pool_owner_set(me->pool, 0);
+                me->tasks_run += elt->tasks_run;
+                elt->tasks_run = 0;
+            }
+            else {
+                apr_thread_mutex_lock(me->lock);
+                apr_pool_owner_set(me->pool, 0);
+                APR_RING_INSERT_TAIL(me->recycled_tasks, task,
+                                     apr_thread_pool_task, link);
+            }
             elt->current_owner = NULL;
             if (TH_STOP == elt->state) {
                 break;
             }
-            task = pop_task(me);
+            task = WORK_STEALING(me) ? ws_next_task(me, elt) : pop_task(me);
         }
         assert(NULL == elt->current_owner);
+        if (WORK_STEALING(me) && elt->deque_cnt) {
+            ws_deque_flush(me, elt);
+        }
         if (TH_STOP != elt->state)
             APR_RING_REMOVE(elt, link);
 
@@ -299,6 +571,11 @@ static void *APR_THREAD_FUNC thread_pool_func(apr_thread_t * t, void *param)
         ++me->idle_cnt;
         APR_RING_INSERT_TAIL(me->idle_thds, elt, apr_thread_list_elt, link);
 
+        /* unless some work can be stolen */
+        if (WORK_STEALING(me) && ws_stealable(me)) {
+            continue;
+        }
+
         /* 
          * If there is a scheduled task, always scheduled to perform that task.
          * Since there is no guarantee that current idle threads are scheduled
@@ -340,6 +617,9 @@ static apr_status_t thread_pool_cleanup(void *me)
     apr_pool_owner_set(_myself->pool, 0);
     apr_thread_mutex_destroy(_myself->lock);
     apr_thread_cond_destroy(_myself->cond);
+    if (_myself->worker_key) {
+        apr_threadkey_private_delete(_myself->worker_key);
+    }
     return APR_SUCCESS;
 }
 
@@ -347,6 +627,15 @@ APR_DECLARE(apr_status_t) apr_thread_pool_create(apr_thread_pool_t ** me,
                                                  apr_size_t init_threads,
                                                  apr_size_t max_threads,
                                                  apr_pool_t * pool)
+{
+    return apr_thread_pool_create_ex(me, init_threads, max_threads, 0, pool);
+}
+
+APR_DECLARE(apr_status_t) apr_thread_pool_create_ex(apr_thread_pool_t ** me,
+                                                    apr_size_t init_threads,
+                                                    apr_size_t max_threads,
+                                                    apr_uint32_t flags,
+                                                    apr_pool_t * pool)
 {
     apr_thread_t *t;
     apr_status_t rv = APR_SUCCESS;
@@ -363,6 +652,7 @@ APR_DECLARE(apr_status_t) apr_thread_pool_create(apr_thread_pool_t ** me,
     rv = apr_pool_create(&tp->pool, pool);
     if (APR_SUCCESS != rv)
         return rv;
+    tp->flags = flags;
     rv = thread_pool_construct(tp, init_threads, max_threads);
     if (APR_SUCCESS != rv)
         return rv;
@@ -400,6 +690,23 @@ APR_DECLARE(apr_status_t) apr_thread_pool_destroy(apr_thread_pool_t * me)
     return APR_SUCCESS;
 }
 
+static void task_init(apr_thread_pool_task_t *t, apr_thread_start_t func,
+                      void *param, apr_byte_t priority, void *owner,
+                      apr_time_t time)
+{
+    APR_RING_ELEM_INIT(t, link);
+    t->func = func;
+    t->param = param;
+    t->owner = owner;
+    t->group = NULL;
+    if (time > 0) {
+        t->dispatch.time = apr_time_now_monotonic() + time;
+    }
+    else {
+        t->dispatch.priority = priority;
+    }
+}
+
 /*
  * NOTE: This function is not thread safe by itself. Caller should hold the lock
  */
@@ -421,16 +728,7 @@ static apr_thread_pool_task_t *task_new(apr_thread_pool_t * me,
         APR_RING_REMOVE(t, link);
     }
 
-    APR_RING_ELEM_INIT(t, link);
-    t->func = func;
-    t->param = param;
-    t->owner = owner;
-    if (time > 0) {
-        t->dispatch.time = apr_time_now() + time;
-    }
-    else {
-        t->dispatch.priority = priority;
-    }
+    task_init(t, func, param, priority, owner, time);
     return t;
 }
 
@@ -530,23 +828,16 @@ static apr_status_t schedule_task(apr_thread_pool_t *me,
     return rv;
 }
 
-static apr_status_t add_task(apr_thread_pool_t *me, apr_thread_start_t func,
-                             void *param, apr_byte_t priority, int push,
-                             void *owner)
+/*
+ * Queue the task at the bottom (push) or the top of the tasks of same
+ * priority.
+ *
+ * NOTE: This function is not thread safe by itself. Caller should hold the lock
+ */
+static void task_insert(apr_thread_pool_t *me, apr_thread_pool_task_t *t,
+                        int push)
 {
-    apr_thread_pool_task_t *t;
     apr_thread_pool_task_t *t_loc;
-    apr_thread_t *thd;
-    apr_status_t rv = APR_SUCCESS;
-
-    apr_thread_mutex_lock(me->lock);
-    apr_pool_owner_set(me->pool, 0);
-
-    t = task_new(me, func, param, priority, owner, 0);
-    if (NULL == t) {
-        apr_thread_mutex_unlock(me->lock);
-        return APR_ENOMEM;
-    }
 
     t_loc = add_if_empty(me, t);
     if (NULL == t_loc) {
@@ -570,17 +861,190 @@ static apr_status_t add_task(apr_thread_pool_t *me, apr_thread_start_t func,
     me->task_cnt++;
     if (me->task_cnt > me->tasks_high)
         me->tasks_high = me->task_cnt;
-    if (0 == me->thd_cnt || (0 == me->idle_cnt && me->thd_cnt < me->thd_max &&
-                             me->task_cnt > me->threshold)) {
-        rv = apr_thread_create(&thd, NULL, thread_pool_func, me, me->pool);
-        if (APR_SUCCESS == rv) {
-            ++me->thd_cnt;
-            if (me->thd_cnt > me->thd_high)
-                me->thd_high = me->thd_cnt;
+}
+
+/*
+ * Append a task to the chain of tasks of ws_add_tasks(), which is not a
+ * ring (no sentinel) until it is spliced into the deque.
+ */
+static void ws_chain_task(apr_thread_pool_task_t **first,
+                          apr_thread_pool_task_t **last,
+                          apr_thread_pool_task_t *t)
+{
+    if (*last) {
+        APR_RING_NEXT(*last, link) = t;
+        APR_RING_PREV(t, link) = *last;
+    }
+    else {
+        *first = t;
+    }
+    *last = t;
+}
+
+/*
+ * Push tasks to the deque of the calling worker, waking up an idle worker
+ * to steal them if any, or creating one like add_tasks() would.
+ */
+static apr_status_t ws_add_tasks(apr_thread_pool_t *me,
+                                 struct apr_thread_list_elt *elt,
+                                 apr_thread_start_t func, void **params,
+                                 apr_size_t n, apr_byte_t priority,
+                                 void *owner, apr_thread_pool_group_t *group)
+{
+    apr_thread_pool_task_t *t, *first = NULL, *last = NULL;
+    apr_thread_t *thd;
+    apr_status_t rv = APR_SUCCESS;
+    apr_size_t i, cnt;
+
+    /* Get the tasks from the ones recycled by the worker first, and only
+     * lock the thread pool for the remaining ones.  They are chained from
+     * first to last, and spliced at once into the deque (they all have the
+     * same priority, hence go to the same segment).
+     */
+    for (i = 0; i < n; i++) {
+        if (APR_RING_EMPTY(&elt->recycled_tasks, apr_thread_pool_task, link)) {
+            break;
+        }
+        t = APR_RING_FIRST(&elt->recycled_tasks);
+        APR_RING_REMOVE(t, link);
+        --elt->recycled_cnt;
+        task_init(t, func, params[i], priority, owner, 0);
+        t->group = group;
+        ws_chain_task(&first, &last, t);
+    }
+    if (i < n) {
+        apr_thread_mutex_lock(me->lock);
+        apr_pool_owner_set(me->pool, 0);
+        for (; i < n; i++) {
+            t = task_new(me, func, params[i], priority, owner, 0);
+            if (NULL == t) {
+                rv = APR_ENOMEM;
+                break;
+            }
+            t->group = group;
+            ws_chain_task(&first, &last, t);
+        }
+        apr_thread_mutex_unlock(me->lock);
+        if (group && i < n) {
+            group_done(group, (apr_uint32_t)(n - i));
+        }
+        if (0 == i) {
+            return rv;
         }
     }
 
-    apr_thread_cond_signal(me->cond);
+    apr_thread_mutex_lock(elt->deque_lock);
+    APR_RING_SPLICE_TAIL(&elt->deque[TASK_PRIORITY_SEG(first)], first, last,
+                         apr_thread_pool_task, link);
+    cnt = elt->deque_cnt += i;
+    apr_thread_mutex_unlock(elt->deque_lock);
+
+    if (me->idle_cnt || (me->thd_cnt < me->thd_max && cnt > me->threshold)) {
+        apr_thread_mutex_lock(me->lock);
+        apr_pool_owner_set(me->pool, 0);
+        if (0 == me->idle_cnt && me->thd_cnt < me->thd_max) {
+            if (APR_SUCCESS == apr_thread_create(&thd, NULL, thread_pool_func,
+                                                 me, me->pool)) {
+                ++me->thd_cnt;
+                if (me->thd_cnt > me->thd_high)
+                    me->thd_high = me->thd_cnt;
+            }
+        }
+        if (i > 1) {
+            apr_thread_cond_broadcast(me->cond);
+        }
+        else {
+            apr_thread_cond_signal(me->cond);
+        }
+        apr_thread_mutex_unlock(me->lock);
+    }
+
+    return rv;
+}
+
+static apr_status_t add_tasks(apr_thread_pool_t *me, apr_thread_start_t func,
+                              void **params, apr_size_t n,
+                              apr_byte_t priority, int push, void *owner,
+                              apr_thread_pool_group_t *group)
+{
+    apr_thread_pool_task_t *t;
+    apr_thread_t *thd;
+    apr_status_t rv = APR_SUCCESS;
+    apr_size_t i;
+
+    if (0 == n) {
+        return APR_SUCCESS;
+    }
+    if (group) {
+        apr_uint32_t pending;
+
+        /* The group can't account for more than APR_UINT32_MAX tasks */
+        do {
+            pending = apr_atomic_read32(&group->pending);
+            if (n > APR_UINT32_MAX - pending) {
+                return APR_EINVAL;
+            }
+        } while (apr_atomic_cas32(&group->pending,
+                                  pending + (apr_uint32_t)n,
+                                  pending) != pending);
+    }
+
+    if (push && WORK_STEALING(me)) {
+        struct apr_thread_list_elt *elt;
+
+        apr_threadkey_private_get((void **)&elt, me->worker_key);
+        if (elt) {
+            return ws_add_tasks(me, elt, func, params, n, priority, owner,
+                                group);
+        }
+    }
+
+    apr_thread_mutex_lock(me->lock);
+    apr_pool_owner_set(me->pool, 0);
+
+    for (i = 0; i < n; i++) {
+        t = task_new(me, func, params[i], priority, owner, 0);
+        if (NULL == t) {
+            rv = APR_ENOMEM;
+            break;
+        }
+        t->group = group;
+        task_insert(me, t, push);
+    }
+    if (group && i < n) {
+        group_done(group, (apr_uint32_t)(n - i));
+    }
+    if (0 == i) {
+        apr_thread_mutex_unlock(me->lock);
+        return rv;
+    }
+
+    /* Create up to as many threads as there are tasks, if none is idle */
+    while (0 == me->thd_cnt || (0 == me->idle_cnt && me->thd_cnt < me->thd_max &&
+                                me->task_cnt > me->threshold)) {
+        apr_status_t trv;
+
+        trv = apr_thread_create(&thd, NULL, thread_pool_func, me, me->pool);
+        if (APR_SUCCESS != trv) {
+            if (APR_SUCCESS == rv) {
+                rv = trv;
+            }
+            break;
+        }
+        ++me->thd_cnt;
+        if (me->thd_cnt > me->thd_high)
+            me->thd_high = me->thd_cnt;
+        if (0 == --i) {
+            break;
+        }
+    }
+
+    if (n > 1) {
+        apr_thread_cond_broadcast(me->cond);
+    }
+    else {
+        apr_thread_cond_signal(me->cond);
+    }
     apr_thread_mutex_unlock(me->lock);
 
     return rv;
@@ -592,7 +1056,28 @@ APR_DECLARE(apr_status_t) apr_thread_pool_push(apr_thread_pool_t *me,
                                                apr_byte_t priority,
                                                void *owner)
 {
-    return add_task(me, func, param, priority, 1, owner);
+    return add_tasks(me, func, &param, 1, priority, 1, owner, NULL);
+}
+
+APR_DECLARE(apr_status_t) apr_thread_pool_push_group(apr_thread_pool_t *me,
+                                                apr_thread_start_t func,
+                                                void *param,
+                                                apr_byte_t priority,
+                                                void *owner,
+                                                apr_thread_pool_group_t *group)
+{
+    return add_tasks(me, func, &param, 1, priority, 1, owner, group);
+}
+
+APR_DECLARE(apr_status_t) apr_thread_pool_push_batch(apr_thread_pool_t *me,
+                                                apr_thread_start_t func,
+                                                void **params,
+                                                apr_size_t n,
+                                                apr_byte_t priority,
+                                                void *owner,
+                                                apr_thread_pool_group_t *group)
+{
+    return add_tasks(me, func, params, n, priority, 1, owner, group);
 }
 
 APR_DECLARE(apr_status_t) apr_thread_pool_schedule(apr_thread_pool_t *me,
@@ -610,7 +1095,66 @@ APR_DECLARE(apr_status_t) apr_thread_pool_top(apr_thread_pool_t *me,
                                               apr_byte_t priority,
                                               void *owner)
 {
-    return add_task(me, func, param, priority, 0, owner);
+    return add_tasks(me, func, &param, 1, priority, 0, owner, NULL);
+}
+
+APR_DECLARE(apr_status_t) apr_thread_pool_group_create(
+                                                apr_thread_pool_group_t **group,
+                                                apr_pool_t *pool)
+{
+    apr_thread_pool_group_t *g;
+    apr_status_t rv;
+
+    g = apr_palloc(pool, sizeof(*g));
+    g->pending = 0;
+    rv = apr_thread_mutex_create(&g->lock, APR_THREAD_MUTEX_DEFAULT, pool);
+    if (APR_SUCCESS != rv) {
+        return rv;
+    }
+    rv = apr_thread_cond_create(&g->cond, pool);
+    if (APR_SUCCESS != rv) {
+        return rv;
+    }
+
+    *group = g;
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(apr_status_t) apr_thread_pool_group_wait(
+                                                apr_thread_pool_group_t *group)
+{
+    apr_status_t rv = APR_SUCCESS;
+
+    apr_thread_mutex_lock(group->lock);
+    while (apr_atomic_read32(&group->pending) && APR_SUCCESS == rv) {
+        rv = apr_thread_cond_wait(group->cond, group->lock);
+    }
+    apr_thread_mutex_unlock(group->lock);
+
+    return rv;
+}
+
+APR_DECLARE(apr_status_t) apr_thread_pool_group_poll(
+                                                apr_thread_pool_group_t *group)
+{
+    apr_uint32_t pending;
+
+    if (apr_atomic_read32(&group->pending)) {
+        return APR_INCOMPLETE;
+    }
+
+    /* Synchronize with the last group_done() before reporting it done */
+    apr_thread_mutex_lock(group->lock);
+    pending = apr_atomic_read32(&group->pending);
+    apr_thread_mutex_unlock(group->lock);
+
+    return pending ? APR_INCOMPLETE : APR_SUCCESS;
+}
+
+APR_DECLARE(apr_size_t) apr_thread_pool_group_pending(
+                                                apr_thread_pool_group_t *group)
+{
+    return apr_atomic_read32(&group->pending);
 }
 
 static apr_status_t remove_scheduled_tasks(apr_thread_pool_t *me,
@@ -628,6 +1172,7 @@ static apr_status_t remove_scheduled_tasks(apr_thread_pool_t *me,
         if (t_loc->owner == owner) {
             --me->scheduled_task_cnt;
             APR_RING_REMOVE(t_loc, link);
+            task_done(t_loc);
         }
         t_loc = next;
     }
@@ -656,12 +1201,44 @@ static apr_status_t remove_tasks(apr_thread_pool_t *me, void *owner)
                 }
             }
             APR_RING_REMOVE(t_loc, link);
+            task_done(t_loc);
         }
         t_loc = next;
     }
     return APR_SUCCESS;
 }
 
+static void remove_deque_tasks(apr_thread_pool_t *me,
+                               struct apr_thread_list *thds, void *owner)
+{
+    struct apr_thread_list_elt *elt;
+    apr_thread_pool_task_t *t_loc;
+    apr_thread_pool_task_t *next;
+    int seg;
+
+    for (elt = APR_RING_FIRST(thds);
+         elt != APR_RING_SENTINEL(thds, apr_thread_list_elt, link);
+         elt = APR_RING_NEXT(elt, link)) {
+        apr_thread_mutex_lock(elt->deque_lock);
+        for (seg = 0; seg < TASK_PRIORITY_SEGS; seg++) {
+            t_loc = APR_RING_FIRST(&elt->deque[seg]);
+            while (t_loc != APR_RING_SENTINEL(&elt->deque[seg],
+                                              apr_thread_pool_task, link)) {
+                next = APR_RING_NEXT(t_loc, link);
+                if (t_loc->owner == owner) {
+                    --elt->deque_cnt;
+                    APR_RING_REMOVE(t_loc, link);
+                    task_done(t_loc);
+                    APR_RING_INSERT_TAIL(me->recycled_tasks, t_loc,
+                                         apr_thread_pool_task, link);
+                }
+                t_loc = next;
+            }
+        }
+        apr_thread_mutex_unlock(elt->deque_lock);
+    }
+}
+
 static void wait_on_busy_threads(apr_thread_pool_t *me, void *owner)
 {
 #ifndef NDEBUG
@@ -709,6 +1286,10 @@ APR_DECLARE(apr_status_t) apr_thread_pool_tasks_cancel(apr_thread_pool_t *me,
     if (me->scheduled_task_cnt > 0) {
         rv = remove_scheduled_tasks(me, owner);
     }
+    if (WORK_STEALING(me)) {
+        remove_deque_tasks(me, me->busy_thds, owner);
+        remove_deque_tasks(me, me->idle_thds, owner);
+    }
     apr_thread_mutex_unlock(me->lock);
     wait_on_busy_threads(me, owner);
 
@@ -717,7 +1298,23 @@ APR_DECLARE(apr_status_t) apr_thread_pool_tasks_cancel(apr_thread_pool_t *me,
 
 APR_DECLARE(apr_size_t) apr_thread_pool_tasks_count(apr_thread_pool_t *me)
 {
-    return me->task_cnt;
+    struct apr_thread_list_elt *elt;
+    apr_size_t cnt;
+
+    if (!WORK_STEALING(me)) {
+        return me->task_cnt;
+    }
+
+    apr_thread_mutex_lock(me->lock);
+    cnt = me->task_cnt;
+    for (elt = APR_RING_FIRST(me->busy_thds);
+         elt != APR_RING_SENTINEL(me->busy_thds, apr_thread_list_elt, link);
+         elt = APR_RING_NEXT(elt, link)) {
+        cnt += elt->deque_cnt;
+    }
+    apr_thread_mutex_unlock(me->lock);
+
+    return cnt;
 }
 
 APR_DECLARE(apr_size_t)